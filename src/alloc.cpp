@@ -53,6 +53,7 @@ struct header {
 
 
 static allocinfo mstat;		/* memory statistics */
+static slabinfo *slabs[SLAB_TYPES];	/* typed slab statistics */
 
 /*
  * NAME:	newmem()
@@ -962,12 +963,28 @@ void m_purge()
     }
 }
 
+/*
+ * NAME:	mem->slab()
+ * DESCRIPTION:	register the statistics of a typed slab allocator
+ */
+void m_slab(int type, slabinfo *info)
+{
+    slabs[type] = info;
+}
+
 /*
  * NAME:	mem->info()
  * DESCRIPTION:	return information about memory usage
  */
 allocinfo *m_info()
 {
+    int i;
+
+    for (i = 0; i < SLAB_TYPES; i++) {
+	if (slabs[i] != (slabinfo *) NULL) {
+	    mstat.slab[i] = *slabs[i];
+	}
+    }
     return &mstat;
 }
 
@@ -116,6 +116,132 @@ public:
     }
 };
 
+struct slabinfo {
+    size_t memsize;	/* memory in slabs */
+    size_t memused;	/* memory in use by items */
+};
+
+# define SLAB_STRING	0	/* String slabs */
+# define SLAB_ARRAY	1	/* Array slabs */
+# define SLAB_MAPELT	2	/* mapping element slabs */
+# define SLAB_TYPES	3
+
+extern void  m_slab	(int, slabinfo*);
+
+/*
+ * Typed allocator for small items of which there are very many.  Items
+ * have no header: a free item holds the free list link, and an allocated
+ * item is given back to the slab of its type.
+ */
+template <class T, int SLAB> class Slab {
+public:
+    Slab(int type) {
+	slab = (Tslab *) NULL;
+	flist = (Titem *) NULL;
+	slabsize = 0;
+	stats.memsize = stats.memused = 0;
+	m_slab(type, &stats);
+    }
+
+    /*
+     * allocate an item
+     */
+    T *alloc() {
+	Titem *item;
+
+	stats.memused += sizeof(T);
+	if (flist != (Titem *) NULL) {
+	    item = flist;
+	    flist = item->list;
+	} else {
+	    if (slabsize == 0) {
+		Tslab *s;
+
+		s = ALLOC(Tslab, 1);
+		s->prev = slab;
+		slab = s;
+		slabsize = SLAB;
+		stats.memsize += sizeof(Tslab);
+	    }
+	    item = &slab->items[--slabsize];
+	}
+	return (T *) item;
+    }
+
+    /*
+     * free an item
+     */
+    void del(T *ptr) {
+	Titem *item;
+
+	stats.memused -= sizeof(T);
+	item = (Titem *) ptr;
+	item->list = flist;
+	flist = item;
+    }
+
+    /*
+     * clean up slabs
+     */
+    void clean() {
+	while (slab != (Tslab *) NULL) {
+	    Tslab *prev;
+
+	    prev = slab->prev;
+	    FREE(slab);
+	    slab = prev;
+	}
+	flist = (Titem *) NULL;
+	slabsize = 0;
+	stats.memsize = stats.memused = 0;
+    }
+
+private:
+    union Titem {
+	Titem *list;		/* next in free list */
+	double align;		/* alignment */
+	char item[sizeof(T)];	/* item */
+    };
+    struct Tslab {
+	Tslab *prev;		/* previous slab */
+	Titem items[SLAB];	/* items */
+    };
+
+    Tslab *slab;		/* current slab */
+    Titem *flist;		/* list of free items */
+    int slabsize;		/* # unused items in current slab */
+    slabinfo stats;		/* memory statistics */
+};
+
+/*
+ * Inherited by classes that are allocated from the slab for their type.
+ */
+template <class T, int SLAB, int TYPE> class SlabAllocated {
+public:
+# ifdef MEMDEBUG
+    static void *operator new(size_t size, const char *file, int line) {
+	UNREFERENCED_PARAMETER(size);
+	UNREFERENCED_PARAMETER(file);
+	UNREFERENCED_PARAMETER(line);
+	return slab.alloc();
+    }
+# else
+    static void *operator new(size_t size) {
+	UNREFERENCED_PARAMETER(size);
+	return slab.alloc();
+    }
+# endif
+
+    static void operator delete(void *ptr) {
+	slab.del((T *) ptr);
+    }
+
+    static Slab<T, SLAB> slab;	/* slab for this type */
+};
+
+template <class T, int SLAB, int TYPE>
+Slab<T, SLAB> SlabAllocated<T, SLAB, TYPE>::slab(TYPE);
+
 # ifdef MEMDEBUG
 # define _N_		new
 # define new_F_		new
@@ -234,6 +360,7 @@ struct allocinfo {
     size_t smemused;	/* static memory used */
     size_t dmemsize;	/* dynamic memory used */
     size_t dmemused;	/* dynamic memory used */
+    slabinfo slab[SLAB_TYPES];	/* memory in typed slabs */
 };
 
 extern allocinfo *m_info ();
@@ -27,8 +27,6 @@
 
 static int cmp (cvoid*, cvoid*);
 
-# define ARR_CHUNK	128
-
 class ArrHash : public ChunkAllocated {
 public:
     ArrHash(Array *a, Uint idx) {
@@ -59,14 +57,13 @@ public:
 
 # define MELT_CHUNK	128
 
-class MapElt : public ChunkAllocated {
+class MapElt : public SlabAllocated<MapElt, MELT_CHUNK, SLAB_MAPELT> {
 public:
-    MapElt(Uint hashval, MapElt *next) {
+    MapElt(Uint hashval) {
 	this->hashval = hashval;
 	add = FALSE;
 	idx = nil_value;
 	val = nil_value;
-	this->next = next;
     }
     ~MapElt() {
 	if (add) {
@@ -154,13 +151,15 @@ public:
     bool add;			/* new element? */
     Value idx;			/* index */
     Value val;			/* value */
-    MapElt *next;		/* next in hash table */
 };
 
-static Chunk<MapElt, MELT_CHUNK> echunk;
-
-# define MTABLE_SIZE	16	/* most mappings are quite small */
+# define MTABLE_SIZE	16	/* most mappings are quite small (power of 2) */
 
+/*
+ * The hash table is open-addressed with linear probing, and kept at most
+ * half full, so that mappings which grow by many elements between two
+ * merges with the sorted array part do not degrade into long chains.
+ */
 class MapHash : public ChunkAllocated {
 public:
     MapHash() {
@@ -172,12 +171,11 @@ public:
     }
     ~MapHash() {
 	unsigned short i;
-	MapElt *e, *n, **t;
+	MapElt **t;
 
 	for (i = size, t = table; i > 0; t++) {
-	    for (e = *t; e != (MapElt *) NULL; e = n) {
-		n = e->next;
-		delete e;
+	    if (*t != (MapElt *) NULL) {
+		delete *t;
 		--i;
 	    }
 	}
@@ -190,10 +188,10 @@ public:
     void shallowDelete()
     {
 	unsigned short i;
-	MapElt *e, *n, **t;
+	MapElt *e, **t;
 
 	for (i = size, t = table; i > 0; t++) {
-	    for (e = *t; e != (MapElt *) NULL; e = n) {
+	    if ((e=*t) != (MapElt *) NULL) {
 		if (e->add) {
 		    if (e->idx.type == T_STRING) {
 			e->idx.u.string->del();
@@ -203,7 +201,6 @@ public:
 		    }
 		    e->add = FALSE;
 		}
-		n = e->next;
 		delete e;
 		--i;
 	    }
@@ -212,43 +209,18 @@ public:
 	delete this;
     }
 
-    /*
-     * extend hashtable
-     */
-    void grow() {
-	unsigned short i;
-	Uint j;
-	MapElt *e, *n, **t, **newTable;
-
-	tablesize <<= 1;
-	newTable = ALLOC(MapElt*, tablesize);
-	memset(newTable, '\0', tablesize * sizeof(MapElt*));
-
-	/*
-	 * copy entries from old hashtable to new hashtable
-	 */
-	for (i = size, t = table; i > 0; t++) {
-	    for (e = *t; e != (MapElt *) NULL; e = n) {
-		n = e->next;
-		j = e->hashval % tablesize;
-		e->next = newTable[j];
-		newTable[j] = e;
-		--i;
-	    }
-	}
-	FREE(table);
-	table = newTable;
-    }
-
     /*
      * add MapElt
      */
     MapElt *add(Uint hashval) {
-	Uint i;
+	MapElt **t;
 
+	if ((Uint) (size + 1) << 1 > tablesize) {
+	    rehash(tablesize << 1);
+	}
 	size++;
-	i = hashval % tablesize;
-	return table[i] = chunknew (echunk) MapElt(hashval, table[i]);
+	t = slot(hashval);
+	return *t = new MapElt(hashval);
     }
 
     /*
@@ -261,7 +233,7 @@ public:
 	if (e->add && --sizemod == 0) {
 	    m->hashmod = FALSE;
 	}
-	*p = e->next;
+	unlink(p);
 	e->remove(data, m);
 	--size;
     }
@@ -270,13 +242,15 @@ public:
      * find MapElt in hashtable
      */
     MapElt **search(Value *val, Uint i) {
-	MapElt **p, *e;
+	Uint mask, j;
+	MapElt *e;
 
-	for (p = &table[i % tablesize];
-	     (e=*p) != (MapElt *) NULL; p = &e->next) {
-	    if (cmp(val, &e->idx) == 0 &&
+	mask = tablesize - 1;
+	for (j = i & mask; (e=table[j]) != (MapElt *) NULL; j = (j + 1) & mask)
+	{
+	    if (e->hashval == i && cmp(val, &e->idx) == 0 &&
 		(!T_INDEXED(val->type) || val->u.array == e->idx.u.array)) {
-		return p;
+		return &table[j];
 	    }
 	}
 
@@ -287,28 +261,33 @@ public:
      * collect MapElts from hash table
      */
     unsigned short collect(Value *v, Array *m, Dataspace *data) {
-	unsigned short i, j;
-	MapElt *e, **p, **t;
+	unsigned short i, j, n;
+	MapElt *e, **t;
 
 	t = table;
-	for (i = size, size = sizemod = j = 0; i > 0; ) {
-	    for (p = t++; (e=*p) != (MapElt *) NULL; --i) {
-		if (m != (Array *) NULL && e->clean(data, m)) {
-		    *p = e->next;
-		    delete e;
-		    continue;
-		}
-
-		if (e->add) {
-		    e->add = FALSE;
-		    *v++ = e->idx;
-		    *v++ = e->val;
-		    j++;
-		}
-		size++;
+	n = size;
+	for (i = size, size = sizemod = j = 0; i > 0; t++) {
+	    if ((e=*t) == (MapElt *) NULL) {
+		continue;
+	    }
+	    --i;
+	    if (m != (Array *) NULL && e->clean(data, m)) {
+		*t = (MapElt *) NULL;
+		delete e;
+		continue;
+	    }
 
-		p = &e->next;
+	    if (e->add) {
+		e->add = FALSE;
+		*v++ = e->idx;
+		*v++ = e->val;
+		j++;
 	    }
+	    size++;
+	}
+	if (size != n) {
+	    /* restore the probe sequences broken by removed elements */
+	    rehash(tablesize);
 	}
 	return j;
     }
@@ -317,49 +296,246 @@ public:
     unsigned short sizemod;	/* mapping size modification */
     Uint tablesize;		/* actual hash table size */
     MapElt **table;		/* hash table */
+
+private:
+    /*
+     * find a free slot for a hash value
+     */
+    MapElt **slot(Uint hashval) {
+	Uint mask, j;
+
+	mask = tablesize - 1;
+	for (j = hashval & mask; table[j] != (MapElt *) NULL; j = (j + 1) & mask)
+	    ;
+	return &table[j];
+    }
+
+    /*
+     * empty a slot, moving back elements further along the probe sequence
+     */
+    void unlink(MapElt **p) {
+	Uint mask, i, j, k;
+	MapElt *e;
+
+	mask = tablesize - 1;
+	i = p - table;
+	for (j = (i + 1) & mask; (e=table[j]) != (MapElt *) NULL;
+	     j = (j + 1) & mask) {
+	    k = e->hashval & mask;
+	    if ((i <= j) ? (i < k && k <= j) : (i < k || k <= j)) {
+		continue;	/* already between its own slot and j */
+	    }
+	    table[i] = e;
+	    i = j;
+	}
+	table[i] = (MapElt *) NULL;
+    }
+
+    /*
+     * move all entries to a new hash table
+     */
+    void rehash(Uint newsize) {
+	unsigned short i;
+	MapElt **t, **old;
+
+	old = table;
+	tablesize = newsize;
+	table = ALLOC(MapElt*, tablesize);
+	memset(table, '\0', tablesize * sizeof(MapElt*));
+	for (i = size, t = old; i > 0; t++) {
+	    if (*t != (MapElt *) NULL) {
+		*slot((*t)->hashval) = *t;
+		--i;
+	    }
+	}
+	FREE(old);
+    }
 };
 
 static Chunk<MapHash, ARR_CHUNK> mchunk;
 
 # define ABCHUNKSZ	32
+# define ABSAVESZ	64	/* # elements saved at a time (even) */
 
 class ArrBak : public ChunkAllocated {
 public:
-    ArrBak(Array *a, Value *elts, unsigned short size, Dataplane *plane) {
+    ArrBak(Array *a, Value *elts, Value **saved, unsigned short size,
+	   Dataplane *plane) {
 	arr = a;
 	original = elts;
+	this->saved = saved;
 	this->size = size;
 	this->plane = plane;
+	prev = a->bak;
+	a->bak = this;
+    }
+
+    /*
+     * reference copied values
+     */
+    static void ref(Value *v, unsigned int n) {
+	while (n != 0) {
+	    switch (v->type) {
+	    case T_STRING:
+		v->u.string->ref();
+		break;
+
+	    case T_ARRAY:
+	    case T_MAPPING:
+	    case T_LWOBJECT:
+		v->u.array->ref();
+		break;
+	    }
+	    v++;
+	    --n;
+	}
+    }
+
+    /*
+     * remove references from copied values
+     */
+    static void del(Value *v, unsigned int n) {
+	while (n != 0) {
+	    i_del_value(v++);
+	    --n;
+	}
+    }
+
+    /*
+     * number of elements in a saved chunk
+     */
+    unsigned short chunkSize(unsigned short i) {
+	i *= ABSAVESZ;
+	return (size - i > ABSAVESZ) ? ABSAVESZ : size - i;
+    }
+
+    /*
+     * save the chunk of elements that includes the given one
+     */
+    void save(Value *elt) {
+	unsigned short i, n;
+	Value *v;
+
+	if (saved != (Value **) NULL && elt >= arr->elts &&
+	    elt < arr->elts + size) {
+	    i = (elt - arr->elts) / ABSAVESZ;
+	    if (saved[i] == (Value *) NULL) {
+		n = chunkSize(i);
+		memcpy(v = ALLOC(Value, n), arr->elts + i * ABSAVESZ,
+		       n * sizeof(Value));
+		ref(v, n);
+		saved[i] = v;
+	    }
+	}
+    }
+
+    /*
+     * save all elements not saved yet, before they are moved around
+     */
+    void saveAll() {
+	unsigned short i, n;
+	Value *v;
+
+	if (saved != (Value **) NULL) {
+	    v = original = ALLOC(Value, size);
+	    for (i = 0; i * ABSAVESZ < size; i++, v += n) {
+		n = chunkSize(i);
+		if (saved[i] != (Value *) NULL) {
+		    memcpy(v, saved[i], n * sizeof(Value));
+		    FREE(saved[i]);
+		} else {
+		    memcpy(v, arr->elts + i * ABSAVESZ, n * sizeof(Value));
+		    ref(v, n);
+		}
+	    }
+	    FREE(saved);
+	    saved = (Value **) NULL;
+	}
     }
 
     /*
      * discard backup and make modifications permanent
      */
     void commit() {
-	if (original != (Value *) NULL) {
-	    Value *v;
+	if (saved != (Value **) NULL) {
 	    unsigned short i;
 
-	    for (v = original, i = size; i != 0; v++, --i) {
-		i_del_value(v);
+	    for (i = 0; i * ABSAVESZ < size; i++) {
+		if (saved[i] != (Value *) NULL) {
+		    del(saved[i], chunkSize(i));
+		    FREE(saved[i]);
+		}
 	    }
+	    FREE(saved);
+	} else if (original != (Value *) NULL) {
+	    del(original, size);
 	    FREE(original);
 	}
+	arr->bak = prev;
 	arr->del();
     }
 
+    /*
+     * pass on what the backup on the previous plane lacks, and commit
+     */
+    void merge() {
+	unsigned short i, n;
+
+	if (prev != (ArrBak *) NULL && prev->saved != (Value **) NULL) {
+	    if (saved != (Value **) NULL) {
+		/* chunks not modified on the previous plane */
+		for (i = 0; i * ABSAVESZ < size; i++) {
+		    if (prev->saved[i] == (Value *) NULL) {
+			prev->saved[i] = saved[i];
+			saved[i] = (Value *) NULL;
+		    }
+		}
+	    } else {
+		/* complete the previous backup with this one */
+		for (i = 0; i * ABSAVESZ < size; i++) {
+		    if (prev->saved[i] != (Value *) NULL) {
+			n = chunkSize(i);
+			del(original + i * ABSAVESZ, n);
+			memcpy(original + i * ABSAVESZ, prev->saved[i],
+			       n * sizeof(Value));
+			FREE(prev->saved[i]);
+		    }
+		}
+		FREE(prev->saved);
+		prev->saved = (Value **) NULL;
+		prev->original = original;
+		original = (Value *) NULL;
+	    }
+	}
+	commit();
+    }
+
     /*
      * discard changes and restore backup
      */
     void discard() {
-	unsigned short i;
-	Value *v;
+	if (saved != (Value **) NULL) {
+	    unsigned short i, n;
+	    Value *v;
 
-	if (arr->elts != (Value *) NULL) {
-	    for (v = arr->elts, i = arr->size; i != 0; v++, --i) {
-		i_del_value(v);
+	    /* restore saved chunks in place */
+	    for (i = 0; i * ABSAVESZ < size; i++) {
+		if (saved[i] != (Value *) NULL) {
+		    n = chunkSize(i);
+		    v = arr->elts + i * ABSAVESZ;
+		    del(v, n);
+		    memcpy(v, saved[i], n * sizeof(Value));
+		    FREE(saved[i]);
+		}
+	    }
+	    FREE(saved);
+	} else {
+	    if (arr->elts != (Value *) NULL) {
+		del(arr->elts, arr->size);
+		FREE(arr->elts);
 	    }
-	    FREE(arr->elts);
+	    arr->elts = original;
+	    arr->size = size;
 	}
 
 	if (arr->hashed != (MapHash *) NULL) {
@@ -368,15 +544,16 @@ public:
 	    arr->hashmod = FALSE;
 	}
 
-	arr->elts = original;
-	arr->size = size;
+	arr->bak = prev;
 	arr->del();
     }
 
     Array *arr;			/* array backed up */
     unsigned short size;	/* original size (of mapping) */
     Value *original;		/* original elements */
+    Value **saved;		/* original elements saved so far, by chunk */
     Dataplane *plane;		/* original dataplane */
+    ArrBak *prev;		/* backup on a previous plane */
 };
 
 class Array::Backup : public Chunk<ArrBak, ABCHUNKSZ> {
@@ -384,13 +561,13 @@ public:
     /*
      * add an array backup to the backup chunk
      */
-    static void backup(Backup **ac, Array *a, Value *elts, unsigned int size,
-		       Dataplane *plane) {
+    static void backup(Backup **ac, Array *a, Value *elts, Value **saved,
+		       unsigned int size, Dataplane *plane) {
 	if (*ac == (Backup *) NULL) {
 	    *ac = new Backup;
 	}
 
-	chunknew (**ac) ArrBak(a, elts, size, plane);
+	chunknew (**ac) ArrBak(a, elts, saved, size, plane);
     }
 
     /*
@@ -407,9 +584,11 @@ public:
 	    if (merge) {
 		if (ac != (Backup **) NULL) {
 		    /* backup on previous plane */
-		    backup(ac, ab->arr, ab->original, ab->size, ab->plane);
+		    ab->arr->bak = ab->prev;
+		    backup(ac, ab->arr, ab->original, ab->saved, ab->size,
+			   ab->plane);
 		} else {
-		    ab->commit();
+		    ab->merge();
 		}
 	    }
 	} else {
@@ -445,7 +624,6 @@ private:
     bool merge;				/* merging? */
 };
 
-static Chunk<Array, ARR_CHUNK> achunk;
 unsigned long Array::max_size;		/* max. size of array and mapping */
 Uint Array::atag;			/* current array tag */
 static ArrHash *aht[ARRMERGETABSZ];	/* array merge table */
@@ -467,6 +645,7 @@ Array::Array(unsigned short size)
     refCount = 0;
     objDestrCount = 0;		/* if swapped in, check objects */
     hashed = (MapHash *) NULL;	/* only used for mappings */
+    bak = (ArrBak *) NULL;
 }
 
 Array::~Array()
@@ -491,7 +670,7 @@ Array::~Array()
  */
 Array *Array::alloc(unsigned int size)
 {
-    return chunknew (achunk) Array(size);
+    return new Array(size);
 }
 
 /*
@@ -600,12 +779,12 @@ void Array::freelist()
 }
 
 /*
- * free all array chunks and mapping element chunks
+ * free all array and mapping element slabs, and mapping hash chunks
  */
 void Array::freeall()
 {
-    achunk.clean();
-    echunk.clean();
+    slab.clean();
+    SlabAllocated<MapElt, MELT_CHUNK, SLAB_MAPELT>::slab.clean();
     mchunk.clean();
 }
 
@@ -653,38 +832,46 @@ void Array::clear()
  */
 void Array::backup(Backup **ac)
 {
-    Value *v;
-    unsigned short i;
+    Value *v, **saved;
+    unsigned short n;
 
 # ifdef DEBUG
     if (hashmod) {
 	fatal("backing up unclean mapping");
     }
 # endif
-    if (size != 0) {
+    v = (Value *) NULL;
+    saved = (Value **) NULL;
+    if (size > ABSAVESZ) {
+	/* elements are saved in chunks, as they are modified */
+	n = (size + ABSAVESZ - 1) / ABSAVESZ;
+	memset(saved = ALLOC(Value*, n), '\0', n * sizeof(Value*));
+    } else if (size != 0) {
 	memcpy(v = ALLOC(Value, size), elts, size * sizeof(Value));
-	for (i = size; i != 0; --i) {
-	    switch (v->type) {
-	    case T_STRING:
-		v->u.string->ref();
-		break;
-
-	    case T_ARRAY:
-	    case T_MAPPING:
-	    case T_LWOBJECT:
-		v->u.array->ref();
-		break;
-	    }
-	    v++;
-	}
-	v -= size;
-    } else {
-	v = (Value *) NULL;
+	ArrBak::ref(v, size);
     }
-    Backup::backup(ac, this, v, size, primary->plane);
+    Backup::backup(ac, this, v, saved, size, primary->plane);
     ref();
 }
 
+/*
+ * save an element about to be modified, if it is not backed up yet
+ */
+void Array::backupElt(Value *elt)
+{
+    bak->save(elt);
+}
+
+/*
+ * complete the backup before elements are moved or replaced
+ */
+void Array::backupAll()
+{
+    if (bak != (ArrBak *) NULL) {
+	bak->saveAll();
+    }
+}
+
 /*
  * commit current array values and discard originals
  */
@@ -817,6 +1004,218 @@ static int cmp(cvoid *cv1, cvoid *cv2)
     return 0;
 }
 
+# define SORTRADIX	32	/* min. # elements to sort by radix key */
+# define SORTPREFIX	64	/* max. # string characters sorted by radix key */
+
+struct SortKey {
+    Uint key;			/* radix key */
+    Value *v;			/* element */
+};
+
+/*
+ * NAME:	kcmp()
+ * DESCRIPTION:	compare the elements of two sort keys
+ */
+static int kcmp(SortKey *k1, SortKey *k2)
+{
+    return cmp(k1->v, k2->v);
+}
+
+/*
+ * NAME:	scmp()
+ * DESCRIPTION:	compare the string elements of two sort keys
+ */
+static int scmp(SortKey *k1, SortKey *k2)
+{
+    return k1->v->u.string->cmp(k2->v->u.string);
+}
+
+/*
+ * NAME:	msort()
+ * DESCRIPTION:	stable merge sort of sort keys, using tmp as scratch space
+ */
+static void msort(SortKey *k, SortKey *tmp, Uint n,
+		  int (*comp)(SortKey*, SortKey*))
+{
+    Uint h, i, j, o;
+    SortKey key;
+
+    if (n <= 8) {
+	/*
+	 * insertion sort
+	 */
+	for (i = 1; i < n; i++) {
+	    key = k[i];
+	    for (j = i; j > 0 && (*comp)(&key, &k[j - 1]) < 0; --j) {
+		k[j] = k[j - 1];
+	    }
+	    k[j] = key;
+	}
+	return;
+    }
+
+    h = n >> 1;
+    msort(k, tmp, h, comp);
+    msort(k + h, tmp, n - h, comp);
+    if ((*comp)(&k[h - 1], &k[h]) <= 0) {
+	return;		/* already in order */
+    }
+
+    /*
+     * merge the two halves
+     */
+    memcpy(tmp, k, h * sizeof(SortKey));
+    for (i = 0, j = h, o = 0; i < h && j < n; ) {
+	if ((*comp)(&k[j], &tmp[i]) < 0) {
+	    k[o++] = k[j++];
+	} else {
+	    k[o++] = tmp[i++];
+	}
+    }
+    memcpy(k + o, tmp + i, (h - i) * sizeof(SortKey));
+}
+
+/*
+ * NAME:	radix()
+ * DESCRIPTION:	stable radix sort of sort keys by their radix key, using tmp
+ *		as scratch space
+ */
+static void radix(SortKey *k, SortKey *tmp, Uint n)
+{
+    Uint count[256];
+    Uint i, c, sum, shift;
+    SortKey *from, *to, *t;
+
+    from = k;
+    to = tmp;
+    for (shift = 0; shift < 32; shift += 8) {
+	memset(count, '\0', sizeof(count));
+	for (i = 0; i < n; i++) {
+	    count[(from[i].key >> shift) & 0xff]++;
+	}
+	if (count[(from[0].key >> shift) & 0xff] == n) {
+	    continue;	/* same byte everywhere */
+	}
+
+	for (i = sum = 0; i < 256; i++) {
+	    c = count[i];
+	    count[i] = sum;
+	    sum += c;
+	}
+	for (i = 0; i < n; i++) {
+	    to[count[(from[i].key >> shift) & 0xff]++] = from[i];
+	}
+	t = from;
+	from = to;
+	to = t;
+    }
+
+    if (from != k) {
+	memcpy(k, from, n * sizeof(SortKey));
+    }
+}
+
+/*
+ * NAME:	ssort()
+ * DESCRIPTION:	sort string sort keys, 4 characters at a time from offset
+ */
+static void ssort(SortKey *k, SortKey *tmp, Uint n, ssizet offset)
+{
+    Uint i, j, key;
+    ssizet o;
+    String *str;
+    bool more;
+
+    for (i = 0; i < n; i++) {
+	str = k[i].v->u.string;
+	for (key = 0, o = offset; o < offset + 4; o++) {
+	    key = (key << 8) | ((o < str->len) ? UCHAR(str->text[o]) : 0);
+	}
+	k[i].key = key;
+    }
+    radix(k, tmp, n);
+    offset += 4;
+
+    /*
+     * sort runs with the same prefix
+     */
+    for (i = 0; i < n; i = j) {
+	more = (k[i].v->u.string->len > offset);
+	for (j = i + 1; j < n && k[j].key == k[i].key; j++) {
+	    if (k[j].v->u.string->len > offset) {
+		more = TRUE;
+	    }
+	}
+	if (j - i > 1) {
+	    if (more && j - i >= SORTRADIX && offset < SORTPREFIX) {
+		ssort(k + i, tmp, j - i, offset);
+	    } else {
+		msort(k + i, tmp, j - i, scmp);
+	    }
+	}
+    }
+}
+
+/*
+ * NAME:	vsort()
+ * DESCRIPTION:	sort n elements of step values each.  Integers and objects
+ *		are sorted by radix, strings by prefix, and anything else
+ *		by merging.
+ */
+static void vsort(Value *v, Uint n, int step)
+{
+    SortKey *k;
+    Value *w;
+    Uint i;
+    int type;
+
+    if (n < 2) {
+	return;
+    }
+
+    k = ALLOC(SortKey, n << 1);
+    type = v->type;
+    for (i = 0, w = v; i < n; i++, w += step) {
+	k[i].v = w;
+	if (w->type != type) {
+	    type = -1;
+	} else if (type == T_INT) {
+	    k[i].key = (Uint) w->u.number ^ 0x80000000L;
+	} else if (type == T_OBJECT) {
+	    k[i].key = w->oindex;
+	}
+    }
+
+    if (n < SORTRADIX) {
+	type = -1;
+    }
+    switch (type) {
+    case T_INT:
+    case T_OBJECT:
+	radix(k, k + n, n);
+	break;
+
+    case T_STRING:
+	ssort(k, k + n, n, 0);
+	break;
+
+    default:
+	msort(k, k + n, n, kcmp);
+	break;
+    }
+
+    /*
+     * put the values in order
+     */
+    w = ALLOC(Value, n * step);
+    for (i = 0; i < n; i++) {
+	memcpy(w + i * step, k[i].v, step * sizeof(Value));
+    }
+    memcpy(v, w, n * step * sizeof(Value));
+    FREE(w);
+    FREE(k);
+}
+
 /*
  * NAME:	search()
  * DESCRIPTION:	search for a value in an array
@@ -921,7 +1320,7 @@ Array *Array::sub(Dataspace *data, Array *a2)
 
     /* copy and sort values of subtrahend */
     copytmp(data, v2 = ALLOCA(Value, a2->size), a2);
-    qsort(v2, a2->size, sizeof(Value), cmp);
+    vsort(v2, a2->size, 1);
 
     v1 = d_get_elts(this);
     v3 = a3->elts;
@@ -996,7 +1395,7 @@ Array *Array::intersect(Dataspace *data, Array *a2)
 
     /* copy and sort values of 2nd array */
     copytmp(data, v2 = ALLOCA(Value, a2->size), a2);
-    qsort(v2, a2->size, sizeof(Value), cmp);
+    vsort(v2, a2->size, 1);
 
     v1 = d_get_elts(this);
     v3 = a3->elts;
@@ -1082,7 +1481,7 @@ Array *Array::setAdd(Dataspace *data, Array *a2)
 
     /* copy and sort values of 1st array */
     copytmp(data, v1 = ALLOCA(Value, size), this);
-    qsort(v1, size, sizeof(Value), cmp);
+    vsort(v1, size, 1);
 
     v = v3;
     v2 = d_get_elts(a2);
@@ -1172,7 +1571,7 @@ Array *Array::setXAdd(Dataspace *data, Array *a2)
 
     /* copy and sort values of 2nd array */
     copytmp(data, v2 = ALLOCA(Value, a2->size), a2);
-    qsort(v2, a2->size, sizeof(Value), cmp);
+    vsort(v2, a2->size, 1);
 
     /* room for first half of result */
     v3 = ALLOCA(Value, size);
@@ -1197,7 +1596,7 @@ Array *Array::setXAdd(Dataspace *data, Array *a2)
 
     /* sort copy of 1st array */
     v1 -= size;
-    qsort(v1, sz = w - v1, sizeof(Value), cmp);
+    vsort(v1, sz = w - v1, 1);
 
     v = v2;
     w = a2->elts;
@@ -1314,7 +1713,7 @@ void Array::mapSort()
     }
 
     if (sz != 0) {
-	qsort(v = elts, i = sz >> 1, 2 * sizeof(Value), cmp);
+	vsort(v = elts, i = sz >> 1, 2);
 	while (--i != 0) {
 	    if (cmp((cvoid *) v, (cvoid *) &v[2]) == 0 &&
 		(!T_INDEXED(v->type) || v->u.array == v[2].u.array)) {
@@ -1393,12 +1792,16 @@ void Array::mapDehash(Dataspace *data, bool clean)
 		break;
 	    }
 
+	    if (v1 != v2) {
+		backupAll();
+	    }
 	    *v1++ = *v2++;
 	    *v1++ = *v2++;
 	    sz += 2;
 	}
 
 	if (sz != size) {
+	    backupAll();
 	    d_change_map(this);
 	    size = sz;
 	    if (sz == 0) {
@@ -1422,7 +1825,7 @@ void Array::mapDehash(Dataspace *data, bool clean)
 	hashmod = FALSE;
 
 	if (sz != 0) {
-	    qsort(v2, sz, sizeof(Value) << 1, cmp);
+	    vsort(v2, sz, 2);
 	    sz <<= 1;
 
 	    /*
@@ -1452,6 +1855,7 @@ void Array::mapDehash(Dataspace *data, bool clean)
 
 	    v2 -= (sz - j);
 	    if (size > 0) {
+		backupAll();
 		FREE(elts);
 	    }
 	    size += sz;
@@ -1498,6 +1902,15 @@ void Array::mapCompact(Dataspace *data)
  */
 unsigned short Array::mapSize(Dataspace *data)
 {
+    if (objDestrCount == Object::objDestrCount) {
+	/*
+	 * no destructed objects to remove: the size is known without
+	 * merging the hash table into the array part
+	 */
+	return (size >> 1) +
+	       ((hashed == (MapHash *) NULL) ? 0 : hashed->sizemod);
+    }
+
     mapCompact(data);
     return size >> 1;
 }
@@ -1610,7 +2023,7 @@ Array *Array::mapSub(Dataspace *data, Array *a2)
 
     /* copy and sort values of array */
     copytmp(data, v2 = ALLOCA(Value, a2->size), a2);
-    qsort(v2, a2->size, sizeof(Value), cmp);
+    vsort(v2, a2->size, 1);
 
     v1 = elts;
     v3 = m3->elts;
@@ -1693,7 +2106,7 @@ Array *Array::mapIntersect(Dataspace *data, Array *a2)
 
     /* copy and sort values of array */
     copytmp(data, v2 = ALLOCA(Value, a2->size), a2);
-    qsort(v2, a2->size, sizeof(Value), cmp);
+    vsort(v2, a2->size, 1);
 
     v1 = elts;
     v3 = m3->elts;
@@ -1884,6 +2297,7 @@ Value *Array::mapIndex(Dataspace *data, Value *val, Value *elt, Value *verify)
 		d_assign_elt(data, this, v, &nil_value);
 		d_assign_elt(data, this, v + 1, &nil_value);
 
+		backupAll();
 		size -= 2;
 		if (size == 0) {
 		    /* last element removed */
@@ -1924,11 +2338,6 @@ Value *Array::mapIndex(Dataspace *data, Value *val, Value *elt, Value *verify)
 	     * add hash table to this mapping
 	     */
 	    hashed = chunknew (mchunk) MapHash;
-	} else if (size << 2 >= hashed->tablesize * 3) {
-	    /*
-	     * extend hash table for this mapping
-	     */
-	    hashed->grow();
 	}
 	e = hashed->add(i);
 
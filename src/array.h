@@ -17,7 +17,9 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-class Array : public ChunkAllocated {
+# define ARR_CHUNK	128
+
+class Array : public SlabAllocated<Array, ARR_CHUNK, SLAB_ARRAY> {
 public:
     class Backup;			/* array backup chunk */
 
@@ -31,6 +33,8 @@ public:
     void freelist();
     Uint put(Uint idx);
     void backup(Backup **ac);
+    void backupElt(Value *elt);
+    void backupAll();
     Array *add(Dataspace *data, Array *a2);
     Array *sub(Dataspace *data, Array *a2);
     Array *intersect(Dataspace *data, Array *a2);
@@ -76,6 +80,7 @@ public:
     Value *elts;			/* elements */
     class MapHash *hashed;		/* hashed mapping elements */
     struct arrref *primary;		/* primary reference */
+    class ArrBak *bak;			/* backup on the current plane */
     Array *prev, *next;			/* per-object linked list */
 
 private:
@@ -28,6 +28,11 @@
 # include "comm.h"
 # include "version.h"
 # include <errno.h>
+# if defined(__SSE2__)
+# include <emmintrin.h>
+# elif defined(__ARM_NEON) && defined(__aarch64__)
+# include <arm_neon.h>
+# endif
 
 # ifndef TELOPT_LINEMODE
 # define TELOPT_LINEMODE	34	/* linemode option */
@@ -39,8 +44,8 @@
 
 struct user {
     uindex oindex;		/* associated object index */
-    user *prev;			/* preceding user */
-    user *next;			/* next user */
+    user *prev;			/* preceding ready user, NULL if not ready */
+    user *next;			/* next ready user */
     user *flush;		/* next in flush list */
     short flags;		/* connection flags */
     char state;			/* telnet state */
@@ -48,7 +53,7 @@ struct user {
     connection *conn;		/* connection */
     char *inbuf;		/* input buffer */
     Array *extra;		/* object's extra value */
-    String *outbuf;		/* output buffer string */
+    Value outbuf;		/* output buffer at start of task */
     ssizet inbufsz;		/* bytes in input buffer */
     ssizet osdone;		/* bytes of output string done */
 };
@@ -83,7 +88,7 @@ struct user {
 # define TS_SE		8
 
 static user *users;		/* array of users */
-static user *lastuser;		/* last user checked */
+static user *lastuser;		/* next ready user to check */
 static user *freeuser;		/* linked list of free users */
 static user *flush;		/* flush list */
 static user *outbound;		/* pending outbound list */
@@ -91,6 +96,7 @@ static int maxusers;		/* max # of users */
 static int maxdgram;		/* max # of datagram users */
 static int ndgram;		/* # of datagram users */
 static int nusers;		/* # of users */
+static int nready;		/* # of users with pending I/O */
 static int odone;		/* # of users with output done */
 static long newlines;		/* # of newlines in all input buffers */
 static uindex this_user;	/* current user */
@@ -100,6 +106,8 @@ static int nexttport;		/* next telnet port to check */
 static int nextbport;		/* next binary port to check */
 static int nextdport;		/* next datagram port to check */
 static char ayt[22];		/* are you there? */
+static String *tsrc;		/* last string sent to a telnet user */
+static String *tout;		/* same with telnet translation */
 
 /*
  * NAME:	comm->init()
@@ -120,6 +128,7 @@ bool comm_init(int n, int p, char **thosts, char **bhosts, char **dhosts,
     for (i = n, usr = users + i; i > 0; --i) {
 	--usr;
 	usr->oindex = OBJ_NONE;
+	usr->prev = (user *) NULL;
 	usr->next = usr + 1;
     }
     users[n - 1].next = (user *) NULL;
@@ -127,7 +136,7 @@ bool comm_init(int n, int p, char **thosts, char **bhosts, char **dhosts,
     freeuser = usr;
     lastuser = (user *) NULL;
     flush = outbound = (user *) NULL;
-    nusers = odone = newlines = 0;
+    nusers = nready = odone = newlines = 0;
     this_user = OBJ_NONE;
 
     sprintf(ayt, "\15\12[%s]\15\12", VERSION);
@@ -165,6 +174,48 @@ void comm_listen()
     conn_listen();
 }
 
+/*
+ * NAME:	comm->ready()
+ * DESCRIPTION:	add a user to the ring of users with pending I/O
+ */
+static void comm_ready(user *usr)
+{
+    if (usr->prev == (user *) NULL) {
+	if (lastuser != (user *) NULL) {
+	    usr->prev = lastuser->prev;
+	    usr->prev->next = usr;
+	    usr->next = lastuser;
+	    lastuser->prev = usr;
+	} else {
+	    usr->prev = usr;
+	    usr->next = usr;
+	    lastuser = usr;
+	}
+	nready++;
+    }
+}
+
+/*
+ * NAME:	comm->unready()
+ * DESCRIPTION:	remove a user from the ring of users with pending I/O
+ */
+static void comm_unready(user *usr)
+{
+    if (usr->prev != (user *) NULL) {
+	if (usr->next == usr) {
+	    lastuser = (user *) NULL;
+	} else {
+	    usr->next->prev = usr->prev;
+	    usr->prev->next = usr->next;
+	    if (usr == lastuser) {
+		lastuser = usr->next;
+	    }
+	}
+	usr->prev = (user *) NULL;
+	--nready;
+    }
+}
+
 /*
  * NAME:	addtoflush()
  * DESCRIPTION:	add a user to the flush list
@@ -178,12 +229,83 @@ static void addtoflush(user *usr, Array *arr)
     usr->extra->ref();
 
     /* remember initial buffer */
-    if (d_get_elts(arr)[1].type == T_STRING) {
-	usr->outbuf = arr->elts[1].u.string;
-	usr->outbuf->ref();
+    if (d_get_elts(arr)[1].type == T_STRING ||
+	arr->elts[1].type == T_ARRAY) {
+	usr->outbuf = arr->elts[1];
+	i_ref_value(&usr->outbuf);
     }
 }
 
+/*
+ * NAME:	comm->outbuf()
+ * DESCRIPTION:	check if the output buffer is the same as at the start of
+ *		the task
+ */
+static bool comm_outbuf(user *usr, Value *v)
+{
+    if (usr->outbuf.type == v->type) {
+	switch (v->type) {
+	case T_STRING:
+	    return (usr->outbuf.u.string == v->u.string);
+
+	case T_ARRAY:
+	    return (usr->outbuf.u.array == v->u.array);
+	}
+    }
+    return FALSE;
+}
+
+/*
+ * NAME:	comm->segments()
+ * DESCRIPTION:	return the string segments of an output buffer, which is
+ *		either a single string or an array of strings followed by
+ *		unused nil slots
+ */
+static Value *comm_segments(Value *v, int *nsegs)
+{
+    Value *elts;
+    int l, h, m;
+
+    if (v->type == T_ARRAY) {
+	elts = d_get_elts(v->u.array);
+	l = 0;
+	h = v->u.array->size;
+	while (l < h) {
+	    m = (l + h) >> 1;
+	    if (elts[m].type != T_STRING) {
+		h = m;
+	    } else {
+		l = m + 1;
+	    }
+	}
+	*nsegs = l;
+	return elts;
+    } else {
+	*nsegs = 1;
+	return v;
+    }
+}
+
+/*
+ * NAME:	comm->pending()
+ * DESCRIPTION:	return the number of bytes in an output buffer not yet
+ *		written
+ */
+static Uint comm_pending(user *usr, Value *v)
+{
+    Value *s;
+    int n;
+    Uint len;
+
+    if (v->type != T_STRING && v->type != T_ARRAY) {
+	return 0;
+    }
+    for (s = comm_segments(v, &n), len = 0; n > 0; s++, --n) {
+	len += s->u.string->len;
+    }
+    return (comm_outbuf(usr, v)) ? len - usr->osdone : len;
+}
+
 /*
  * NAME:	comm->setup()
  * DESCRIPTION:	setup a user
@@ -215,7 +337,7 @@ static Array *comm_setup(user *usr, Frame *f, Object *obj)
     obj->flags |= O_USER;
     obj->etabi = usr - users;
     usr->conn = NULL;
-    usr->outbuf = (String *) NULL;
+    usr->outbuf = nil_value;
     usr->osdone = 0;
     usr->flags = 0;
 
@@ -244,19 +366,13 @@ static user *comm_new(Frame *f, Object *obj, connection *conn, int flags)
 
     usr = freeuser;
     freeuser = usr->next;
-    if (lastuser != (user *) NULL) {
-	usr->prev = lastuser->prev;
-	usr->prev->next = usr;
-	usr->next = lastuser;
-	lastuser->prev = usr;
-    } else {
-	usr->prev = usr;
-	usr->next = usr;
-	lastuser = usr;
-    }
+    comm_ready(usr);
 
     arr = comm_setup(usr, f, obj);
     usr->conn = conn;
+    if (conn != (connection *) NULL) {
+	conn_owner(conn, usr - users);
+    }
     usr->flags = flags;
     if (flags & CF_TELNET) {
 	/* initialize connection */
@@ -407,9 +523,11 @@ static int comm_write(user *usr, Object *obj, String *str, char *text,
 	unsigned int len)
 {
     Dataspace *data;
-    Array *arr;
-    Value *v;
+    Array *arr, *a;
+    Value *v, *s;
+    int n, i;
     ssizet osdone, olen;
+    char *p;
     Value val;
 
     arr = d_get_extravar(data = obj->dataspace())->u.array;
@@ -418,11 +536,10 @@ static int comm_write(user *usr, Object *obj, String *str, char *text,
     }
 
     v = arr->elts + 1;
-    if (v->type == T_STRING) {
+    if (v->type == T_STRING || v->type == T_ARRAY) {
 	/* append to existing buffer */
-	osdone = (usr->outbuf == v->u.string) ? usr->osdone : 0;
-	olen = v->u.string->len - osdone;
-	if (olen + len > MAX_STRLEN) {
+	olen = comm_pending(usr, v);
+	if (len > (unsigned int) (MAX_STRLEN - olen)) {
 	    len = MAX_STRLEN - olen;
 	    if (len == 0 ||
 		((usr->flags & CF_TELNET) && text[0] == (char) IAC &&
@@ -430,9 +547,70 @@ static int comm_write(user *usr, Object *obj, String *str, char *text,
 		return 0;
 	    }
 	}
-	str = String::create((char *) NULL, (long) olen + len);
-	memcpy(str->text, v->u.string->text + osdone, olen);
-	memcpy(str->text + olen, text, len);
+	if (len == 0) {
+	    return 0;
+	}
+
+	s = comm_segments(v, &n);
+	if (v->type == T_ARRAY && n < v->u.array->size &&
+	    !comm_outbuf(usr, v)) {
+	    /*
+	     * buffer created in this task: fill the next slot
+	     */
+	    if (str == (String *) NULL || len != str->len) {
+		str = String::create(text, len);
+	    }
+	    PUT_STRVAL_NOREF(&val, str);
+	    d_assign_elt(data, v->u.array, &s[n], &val);
+	    return len;
+	}
+
+	/* skip segments already written */
+	osdone = (comm_outbuf(usr, v)) ? usr->osdone : 0;
+	while (n > 1 && osdone >= s->u.string->len) {
+	    osdone -= s->u.string->len;
+	    s++;
+	    --n;
+	}
+
+	if (n >= OUTBUF_SEGS) {
+	    /*
+	     * merge all segments into a single string
+	     */
+	    str = String::create((char *) NULL, (long) olen + len);
+	    p = str->text;
+	    for (i = 0; i < n; i++, s++) {
+		memcpy(p, s->u.string->text + osdone,
+		       s->u.string->len - osdone);
+		p += s->u.string->len - osdone;
+		osdone = 0;
+	    }
+	    memcpy(p, text, len);
+	    PUT_STRVAL_NOREF(&val, str);
+	} else {
+	    /*
+	     * new buffer with room for more segments, sharing the strings
+	     */
+	    a = Array::create(data, OUTBUF_SEGS);
+	    if (osdone != 0) {
+		PUT_STRVAL(a->elts,
+			   String::create(s->u.string->text + osdone,
+					  (long) s->u.string->len - osdone));
+	    } else {
+		PUT_STRVAL(a->elts, s->u.string);
+	    }
+	    for (i = 1; i < n; i++) {
+		PUT_STRVAL(&a->elts[i], s[i].u.string);
+	    }
+	    if (str == (String *) NULL || len != str->len) {
+		str = String::create(text, len);
+	    }
+	    PUT_STRVAL(&a->elts[n], str);
+	    for (i = n + 1; i < OUTBUF_SEGS; i++) {
+		a->elts[i] = nil_value;
+	    }
+	    PUT_ARRVAL_NOREF(&val, a);
+	}
     } else {
 	/* create new buffer */
 	if (usr->flags & CF_ODONE) {
@@ -443,13 +621,66 @@ static int comm_write(user *usr, Object *obj, String *str, char *text,
 	if (str == (String *) NULL) {
 	    str = String::create(text, len);
 	}
+	PUT_STRVAL_NOREF(&val, str);
     }
 
-    PUT_STRVAL_NOREF(&val, str);
     d_assign_elt(data, arr, v, &val);
     return len;
 }
 
+/*
+ * NAME:	comm->telnet()
+ * DESCRIPTION:	return a string with telnet translation applied, or NULL if
+ *		it would be too long.  The last string translated is kept
+ *		until the end of the task, so that sending the same message
+ *		to many users translates it only once.
+ */
+static String *comm_telnet(String *str)
+{
+    char *p, *q;
+    ssizet len;
+    Uint size;
+
+    if (str == tsrc) {
+	return tout;
+    }
+
+    for (p = str->text, len = str->len, size = len; len > 0; p++, --len) {
+	if (UCHAR(*p) == IAC || *p == LF) {
+	    size++;
+	}
+    }
+    if (size > MAX_STRLEN) {
+	return (String *) NULL;
+    }
+
+    if (tsrc != (String *) NULL) {
+	tsrc->del();
+	tout->del();
+    }
+    tsrc = str;
+    tsrc->ref();
+    if (size == str->len) {
+	tout = str;
+    } else {
+	/*
+	 * double the telnet IAC character, and insert CR before LF
+	 */
+	tout = String::create((char *) NULL, (long) size);
+	for (p = str->text, q = tout->text, len = str->len; len > 0; --len) {
+	    if (UCHAR(*p) == IAC) {
+		*q++ = (char) IAC;
+	    } else if (*p == LF) {
+		*q++ = CR;
+	    }
+	    *q++ = *p++;
+	}
+    }
+    tout->ref();
+
+    return tout;
+}
+
 /*
  * NAME:	comm->send()
  * DESCRIPTION:	send a message to a user
@@ -463,10 +694,22 @@ int comm_send(Object *obj, String *str)
 	char outbuf[OUTBUF_SIZE];
 	char *p, *q;
 	unsigned int len, size, n;
+	String *tstr;
+	Value *v;
 
 	/*
 	 * telnet connection
 	 */
+	tstr = comm_telnet(str);
+	if (tstr != (String *) NULL) {
+	    v = d_get_elts(d_get_extravar(obj->dataspace())->u.array) + 1;
+	    if (tstr->len <= MAX_STRLEN - comm_pending(usr, v)) {
+		/* add as a whole */
+		comm_write(usr, obj, tstr, tstr->text, tstr->len);
+		return str->len;
+	    }
+	}
+
 	p = str->text;
 	len = str->len;
 	q = outbuf;
@@ -530,6 +773,49 @@ int comm_send(Object *obj, String *str)
     }
 }
 
+/*
+ * NAME:	comm->multicast()
+ * DESCRIPTION:	send a message to all users in an array; return the number
+ *		of users the whole message was sent to
+ */
+int comm_multicast(Frame *f, Array *arr, String *str)
+{
+    Value *v;
+    Object *obj;
+    Dataspace *data;
+    user *usr;
+    int n, num;
+
+    num = 0;
+    for (n = arr->size, v = d_get_elts(arr); n > 0; --n, v++) {
+	if (v->type != T_OBJECT || DESTRUCTED(v)) {
+	    continue;
+	}
+	obj = OBJR(v->oindex);
+	if ((obj->flags & O_SPECIAL) != O_USER || obj->count == 0) {
+	    continue;
+	}
+	usr = &users[EINDEX(obj->etabi)];
+	if (!(usr->flags & CF_TELNET) &&
+	    (usr->flags & (CF_UDP | CF_UDPDATA)) == CF_UDPDATA) {
+	    continue;	/* message channel not enabled */
+	}
+
+	data = obj->dataspace();
+	if (data->plane->level != f->level) {
+	    /* let an atomic function undo the output */
+	    d_new_plane(data, f->level);
+	}
+
+	/* the telnet translation of str is shared by all telnet users */
+	if (comm_send(OBJW(obj->index), str) == str->len) {
+	    num++;
+	}
+    }
+
+    return num;
+}
+
 /*
  * NAME:	comm->udpsend()
  * DESCRIPTION:	send a message on the UDP channel of a binary connection
@@ -625,25 +911,43 @@ void comm_block(Object *obj, int block)
  */
 static void comm_uflush(user *usr, Object *obj, Dataspace *data, Array *arr)
 {
-    Value *v;
-    int n;
+    Value *v, *s;
+    int n, nsegs, i;
+    Uint size, done;
+    struct iovec iov[OUTBUF_SEGS];
 
     UNREFERENCED_PARAMETER(obj);
 
     v = d_get_elts(arr);
 
-    if (v[1].type == T_STRING) {
+    if (v[1].type == T_STRING || v[1].type == T_ARRAY) {
 	if (conn_wrdone(usr->conn)) {
-	    n = conn_write(usr->conn, v[1].u.string->text + usr->osdone,
-			   v[1].u.string->len - usr->osdone);
+	    /*
+	     * write all segments at once
+	     */
+	    s = comm_segments(&v[1], &nsegs);
+	    done = usr->osdone;
+	    for (size = 0, i = 0; nsegs > 0; s++, --nsegs) {
+		size += s->u.string->len;
+		if (done >= s->u.string->len) {
+		    done -= s->u.string->len;
+		} else if (i < OUTBUF_SEGS) {
+		    iov[i].iov_base = s->u.string->text + done;
+		    iov[i].iov_len = s->u.string->len - done;
+		    i++;
+		    done = 0;
+		}
+	    }
+	    n = conn_writev(usr->conn, iov, i);
 	    if (n >= 0) {
 		n += usr->osdone;
-		if (n == v[1].u.string->len) {
+		if ((Uint) n == size) {
 		    /* buffer fully drained */
 		    n = 0;
 		    usr->flags &= ~CF_OUTPUT;
 		    usr->flags |= CF_ODONE;
 		    odone++;
+		    comm_ready(usr);
 		    d_assign_elt(data, arr, &v[1], &nil_value);
 		}
 		usr->osdone = n;
@@ -679,6 +983,12 @@ void comm_flush()
     Array *arr;
     Value *v;
 
+    if (tsrc != (String *) NULL) {
+	tsrc->del();
+	tout->del();
+	tsrc = (String *) NULL;
+    }
+
     while (outbound != (user *) NULL) {
 	usr = outbound;
 	outbound = usr->flush;
@@ -692,6 +1002,7 @@ void comm_flush()
 	    if (usr->conn == (connection *) NULL) {
 		fatal("can't connect to server");
 	    }
+	    conn_owner(usr->conn, usr - users);
 
 	    d_assign_elt(obj->data, arr, &arr->elts[1], &nil_value);
 	    arr->del();
@@ -727,8 +1038,9 @@ void comm_flush()
 	    }
 	    if (usr->flags & CF_PROMPT) {
 		usr->flags &= ~CF_PROMPT;
-		if ((usr->flags & CF_GA) && v[1].type == T_STRING &&
-		    usr->outbuf != v[1].u.string) {
+		if ((usr->flags & CF_GA) &&
+		    (v[1].type == T_STRING || v[1].type == T_ARRAY) &&
+		    !comm_outbuf(usr, &v[1])) {
 		    static char ga[] = { (char) IAC, (char) GA };
 
 		    /* append go-ahead */
@@ -739,17 +1051,20 @@ void comm_flush()
 	if ((v->u.number ^ usr->flags) & CF_BLOCKED) {
 	    usr->flags ^= CF_BLOCKED;
 	    conn_block(usr->conn, ((usr->flags & CF_BLOCKED) != 0));
+	    if (!(usr->flags & CF_BLOCKED) && usr->newlines != 0) {
+		comm_ready(usr);	/* lines already buffered */
+	    }
 	}
 
 	/*
 	 * write
 	 */
-	if (usr->outbuf != (String *) NULL) {
-	    if (usr->outbuf != v[1].u.string) {
+	if (usr->outbuf.type == T_STRING || usr->outbuf.type == T_ARRAY) {
+	    if (!comm_outbuf(usr, &v[1])) {
 		usr->osdone = 0;	/* new mesg before buffer drained */
 	    }
-	    usr->outbuf->del();
-	    usr->outbuf = (String *) NULL;
+	    i_del_value(&usr->outbuf);
+	    usr->outbuf = nil_value;
 	}
 	if (usr->flags & CF_OUTPUT) {
 	    comm_uflush(usr, obj, obj->data, arr);
@@ -771,15 +1086,7 @@ void comm_flush()
 	    }
 
 	    usr->oindex = OBJ_NONE;
-	    if (usr->next == usr) {
-		lastuser = (user *) NULL;
-	    } else {
-		usr->next->prev = usr->prev;
-		usr->prev->next = usr->next;
-		if (usr == lastuser) {
-		    lastuser = usr->next;
-		}
-	    }
+	    comm_unready(usr);
 	    usr->next = freeuser;
 	    freeuser = usr;
 	    if ((usr->flags & (CF_TELNET | CF_UDP | CF_UDPDATA)) == CF_UDPDATA)
@@ -895,10 +1202,82 @@ static void comm_daccept(Frame *f, connection *conn, int port)
 }
 
 /*
- * NAME:	comm->receive()
- * DESCRIPTION:	receive a message from a user
+ * NAME:	comm->scan()
+ * DESCRIPTION:	return the length of the leading run of telnet input that
+ *		contains no IAC, CR, LF, BS, DEL or NUL
  */
-void comm_receive(Frame *f, Uint timeout, unsigned int mtime)
+static int comm_scan(char *p, int n)
+{
+    char *q;
+
+    q = p;
+# if defined(__SSE2__)
+    {
+	__m128i iac, cr, lf, bs, del, nul, x, m;
+
+	iac = _mm_set1_epi8((char) IAC);
+	cr = _mm_set1_epi8(CR);
+	lf = _mm_set1_epi8(LF);
+	bs = _mm_set1_epi8(BS);
+	del = _mm_set1_epi8('\177');
+	nul = _mm_setzero_si128();
+	while (n >= 16) {
+	    x = _mm_loadu_si128((__m128i *) q);
+	    m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(x, iac),
+					  _mm_cmpeq_epi8(x, cr)),
+			     _mm_or_si128(_mm_cmpeq_epi8(x, lf),
+					  _mm_cmpeq_epi8(x, bs)));
+	    m = _mm_or_si128(m, _mm_or_si128(_mm_cmpeq_epi8(x, del),
+					     _mm_cmpeq_epi8(x, nul)));
+	    if (_mm_movemask_epi8(m) != 0) {
+		break;	/* locate it below */
+	    }
+	    q += 16;
+	    n -= 16;
+	}
+    }
+# elif defined(__ARM_NEON) && defined(__aarch64__)
+    {
+	uint8x16_t x, m;
+
+	while (n >= 16) {
+	    x = vld1q_u8((uint8_t *) q);
+	    m = vorrq_u8(vorrq_u8(vceqq_u8(x, vdupq_n_u8(IAC)),
+				  vceqq_u8(x, vdupq_n_u8(CR))),
+			 vorrq_u8(vceqq_u8(x, vdupq_n_u8(LF)),
+				  vceqq_u8(x, vdupq_n_u8(BS))));
+	    m = vorrq_u8(m, vorrq_u8(vceqq_u8(x, vdupq_n_u8(0x7f)),
+				     vceqzq_u8(x)));
+	    if (vmaxvq_u8(m) != 0) {
+		break;	/* locate it below */
+	    }
+	    q += 16;
+	    n -= 16;
+	}
+    }
+# endif
+    while (n > 0) {
+	switch (UCHAR(*q)) {
+	case IAC:
+	case CR:
+	case LF:
+	case BS:
+	case 0x7f:
+	case '\0':
+	    return q - p;
+	}
+	q++;
+	--n;
+    }
+    return q - p;
+}
+
+/*
+ * NAME:	comm->tinput()
+ * DESCRIPTION:	process telnet input in place, at the end of the input buffer;
+ *		return the new end of the input buffer
+ */
+static char *comm_tinput(user *usr, Object *obj, char *p, int n)
 {
     static char intr[] =	{ '\177' };
     static char brk[] =		{ '\034' };
@@ -908,18 +1287,212 @@ void comm_receive(Frame *f, Uint timeout, unsigned int mtime)
     static char mode_edit[] =	{ (char) IAC, (char) SB,
 				  (char) TELOPT_LINEMODE, (char) LM_MODE,
 				  (char) MODE_EDIT, (char) IAC, (char) SE };
+    int state, nls;
+    char *q;
+
+    state = usr->state;
+    nls = usr->newlines;
+    q = p;
+    while (n > 0) {
+	if (state == TS_DATA) {
+	    int len;
+
+	    /*
+	     * copy plain data up to the next special byte
+	     */
+	    len = comm_scan(p, n);
+	    if (len != 0) {
+		if (q != p) {
+		    memmove(q, p, len);
+		}
+		p += len;
+		q += len;
+		n -= len;
+		if (n == 0) {
+		    break;
+		}
+	    }
+	}
+
+	switch (state) {
+	case TS_DATA:
+	    switch (UCHAR(*p)) {
+	    case IAC:
+		state = TS_IAC;
+		break;
+
+	    case BS:
+	    case 0x7f:
+		if (q[-1] != LF) {
+		    --q;
+		}
+		break;
+
+	    case CR:
+		nls++;
+		newlines++;
+		*q++ = LF;
+		state = TS_CRDATA;
+		break;
+
+	    case LF:
+		nls++;
+		newlines++;
+		/* fall through */
+	    default:
+		*q++ = *p;
+		/* fall through */
+	    case '\0':
+		break;
+	    }
+	    break;
+
+	case TS_CRDATA:
+	    switch (UCHAR(*p)) {
+	    case IAC:
+		state = TS_IAC;
+		break;
+
+	    case CR:
+		nls++;
+		newlines++;
+		*q++ = LF;
+		break;
+
+	    default:
+		*q++ = *p;
+		/* fall through */
+	    case '\0':
+	    case LF:
+	    case BS:
+	    case 0x7f:
+		state = TS_DATA;
+		break;
+	    }
+	    break;
+
+	case TS_IAC:
+	    switch (UCHAR(*p)) {
+	    case IAC:
+		*q++ = *p;
+		state = TS_DATA;
+		break;
+
+	    case DO:
+		state = TS_DO;
+		break;
+
+	    case DONT:
+		state = TS_DONT;
+		break;
+
+	    case WILL:
+		state = TS_WILL;
+		break;
+
+	    case WONT:
+		state = TS_WONT;
+		break;
+
+	    case SB:
+		state = TS_SB;
+		break;
+
+	    case IP:
+		comm_write(usr, obj, (String *) NULL, intr, sizeof(intr));
+		state = TS_DATA;
+		break;
+
+	    case BREAK:
+		comm_write(usr, obj, (String *) NULL, brk, sizeof(brk));
+		state = TS_DATA;
+		break;
+
+	    case AYT:
+		comm_write(usr, obj, (String *) NULL, ayt, strlen(ayt));
+		state = TS_DATA;
+		break;
+
+	    default:
+		/* let's hope it wasn't important */
+		state = TS_DATA;
+		break;
+	    }
+	    break;
+
+	case TS_DO:
+	    if (UCHAR(*p) == TELOPT_TM) {
+		comm_write(usr, obj, (String *) NULL, tm, sizeof(tm));
+	    } else if (UCHAR(*p) == TELOPT_SGA) {
+		usr->flags &= ~CF_GA;
+		comm_write(usr, obj, (String *) NULL, will_sga,
+			   sizeof(will_sga));
+	    }
+	    state = TS_DATA;
+	    break;
+
+	case TS_DONT:
+	    if (UCHAR(*p) == TELOPT_SGA) {
+		usr->flags |= CF_GA;
+		comm_write(usr, obj, (String *) NULL, wont_sga,
+			   sizeof(wont_sga));
+	    }
+	    state = TS_DATA;
+	    break;
+
+	case TS_WILL:
+	    if (UCHAR(*p) == TELOPT_LINEMODE) {
+		/* linemode confirmed; now request editing */
+		comm_write(usr, obj, (String *) NULL, mode_edit,
+			   sizeof(mode_edit));
+	    }
+	    /* fall through */
+	case TS_WONT:
+	    state = TS_DATA;
+	    break;
+
+	case TS_SB:
+	    /* skip to the end */
+	    if (UCHAR(*p) == IAC) {
+		state = TS_SE;
+	    }
+	    break;
+
+	case TS_SE:
+	    if (UCHAR(*p) == SE) {
+		/* end of subnegotiation */
+		state = TS_DATA;
+	    } else {
+		state = TS_SB;
+	    }
+	    break;
+	}
+	p++;
+	--n;
+    }
+    usr->state = state;
+    usr->newlines = nls;
+
+    return q;
+}
+/*
+ * NAME:	comm->receive()
+ * DESCRIPTION:	receive a message from a user
+ */
+void comm_receive(Frame *f, Uint timeout, unsigned int mtime)
+{
     char buffer[BINBUF_SIZE];
     Object *obj;
     user *usr;
-    int n, i, state, nls;
+    int n, i;
     char *p, *q;
     connection *conn;
 
-    if (newlines != 0 || odone != 0) {
+    if (newlines != 0 || odone != 0 || nready != 0) {
 	timeout = mtime = 0;
     }
     n = conn_select(timeout, mtime);
-    if ((n <= 0) && (newlines == 0) && (odone == 0)) {
+    if ((n <= 0) && (newlines == 0) && (odone == 0) && (nready == 0)) {
 	/*
 	 * call_out to do, or timeout
 	 */
@@ -999,9 +1572,15 @@ void comm_receive(Frame *f, Uint timeout, unsigned int mtime)
 	    } while (n != nextdport);
 	}
 
-	for (i = nusers; lastuser != (user *) NULL && i > 0; --i) {
+	/*
+	 * only visit users with pending I/O
+	 */
+	while ((n = conn_ready()) >= 0) {
+	    comm_ready(&users[n]);
+	}
+	for (i = nready; lastuser != (user *) NULL && i > 0; --i) {
 	    usr = lastuser;
-	    lastuser = usr->next;
+	    comm_unready(usr);
 
 	    obj = OBJ(usr->oindex);
 
@@ -1108,174 +1687,9 @@ void comm_receive(Frame *f, Uint timeout, unsigned int mtime)
 			}
 		    }
 
-		    state = usr->state;
-		    nls = usr->newlines;
-		    q = p;
-		    while (n > 0) {
-			switch (state) {
-			case TS_DATA:
-			    switch (UCHAR(*p)) {
-			    case IAC:
-				state = TS_IAC;
-				break;
-
-			    case BS:
-			    case 0x7f:
-				if (q[-1] != LF) {
-				    --q;
-				}
-				break;
-
-			    case CR:
-				nls++;
-				newlines++;
-				*q++ = LF;
-				state = TS_CRDATA;
-				break;
-
-			    case LF:
-				nls++;
-				newlines++;
-				/* fall through */
-			    default:
-				*q++ = *p;
-				/* fall through */
-			    case '\0':
-				break;
-			    }
-			    break;
-
-			case TS_CRDATA:
-			    switch (UCHAR(*p)) {
-			    case IAC:
-				state = TS_IAC;
-				break;
-
-			    case CR:
-				nls++;
-				newlines++;
-				*q++ = LF;
-				break;
-
-			    default:
-				*q++ = *p;
-				/* fall through */
-			    case '\0':
-			    case LF:
-			    case BS:
-			    case 0x7f:
-				state = TS_DATA;
-				break;
-			    }
-			    break;
-
-			case TS_IAC:
-			    switch (UCHAR(*p)) {
-			    case IAC:
-				*q++ = *p;
-				state = TS_DATA;
-				break;
-
-			    case DO:
-				state = TS_DO;
-				break;
-
-			    case DONT:
-				state = TS_DONT;
-				break;
-
-			    case WILL:
-				state = TS_WILL;
-				break;
-
-			    case WONT:
-				state = TS_WONT;
-				break;
-
-			    case SB:
-				state = TS_SB;
-				break;
-
-			    case IP:
-				comm_write(usr, obj, (String *) NULL, intr,
-					   sizeof(intr));
-				state = TS_DATA;
-				break;
-
-			    case BREAK:
-				comm_write(usr, obj, (String *) NULL, brk,
-					   sizeof(brk));
-				state = TS_DATA;
-				break;
-
-			    case AYT:
-				comm_write(usr, obj, (String *) NULL, ayt,
-					   strlen(ayt));
-				state = TS_DATA;
-				break;
-
-			    default:
-				/* let's hope it wasn't important */
-				state = TS_DATA;
-				break;
-			    }
-			    break;
-
-			case TS_DO:
-			    if (UCHAR(*p) == TELOPT_TM) {
-				comm_write(usr, obj, (String *) NULL, tm,
-					   sizeof(tm));
-			    } else if (UCHAR(*p) == TELOPT_SGA) {
-				usr->flags &= ~CF_GA;
-				comm_write(usr, obj, (String *) NULL, will_sga,
-					   sizeof(will_sga));
-			    }
-			    state = TS_DATA;
-			    break;
-
-			case TS_DONT:
-			    if (UCHAR(*p) == TELOPT_SGA) {
-				usr->flags |= CF_GA;
-				comm_write(usr, obj, (String *) NULL, wont_sga,
-					   sizeof(wont_sga));
-			    }
-			    state = TS_DATA;
-			    break;
-
-			case TS_WILL:
-			    if (UCHAR(*p) == TELOPT_LINEMODE) {
-				/* linemode confirmed; now request editing */
-				comm_write(usr, obj, (String *) NULL, mode_edit,
-					   sizeof(mode_edit));
-			    }
-			    /* fall through */
-			case TS_WONT:
-			    state = TS_DATA;
-			    break;
-
-			case TS_SB:
-			    /* skip to the end */
-			    if (UCHAR(*p) == IAC) {
-				state = TS_SE;
-			    }
-			    break;
-
-			case TS_SE:
-			    if (UCHAR(*p) == SE) {
-				/* end of subnegotiation */
-				state = TS_DATA;
-			    } else {
-				state = TS_SB;
-			    }
-			    break;
-			}
-			p++;
-			--n;
-		    }
-		    usr->state = state;
-		    usr->newlines = nls;
+		    q = comm_tinput(usr, obj, p, n);
 		    usr->inbufsz = q - usr->inbuf;
-		    if (nls == 0) {
+		    if (usr->newlines == 0) {
 			continue;
 		    }
 
@@ -1288,6 +1702,9 @@ void comm_receive(Frame *f, Uint timeout, unsigned int mtime)
 		    n = p - usr->inbuf;
 		    p++;			/* skip \n */
 		    usr->inbufsz -= n + 1;
+		    if (usr->newlines != 0) {
+			comm_ready(usr);	/* more lines to process */
+		    }
 
 		    PUSH_STRVAL(f, String::create(usr->inbuf, n));
 		    for (n = usr->inbufsz; n != 0; --n) {
@@ -1300,6 +1717,7 @@ void comm_receive(Frame *f, Uint timeout, unsigned int mtime)
 		    n = usr->inbufsz;
 		    usr->inbufsz = 0;
 		    PUSH_STRVAL(f, String::create(usr->inbuf, n));
+		    comm_ready(usr);	/* check for more input */
 		}
 		usr->flags |= CF_PROMPT;
 		if (!(usr->flags & CF_FLUSH)) {
@@ -1530,10 +1948,24 @@ bool comm_dump(int fd)
 	du = ALLOC(duser, nusers);
 	bufs = ALLOC(char*, 2 * nusers);
 
+	conn_stop();
 	for (i = nusers, usr = users; i > 0; usr++) {
 	    if (usr->oindex != OBJ_NONE) {
 		int npkts, ubufsz;
 
+		if ((usr->flags & CF_TELNET) && usr->inbufsz != INBUF_SIZE) {
+		    char *p;
+		    int n;
+
+		    /* input received but not yet read */
+		    p = usr->inbuf + usr->inbufsz;
+		    n = conn_pending(usr->conn, p, INBUF_SIZE - usr->inbufsz);
+		    if (n > 0) {
+			usr->inbufsz = comm_tinput(usr, OBJ(usr->oindex), p, n) -
+				       usr->inbuf;
+		    }
+		}
+
 		du->oindex = usr->oindex;
 		du->flags = usr->flags;
 		du->state = usr->state;
@@ -1684,16 +2116,8 @@ bool comm_restore(int fd)
 	    /* allocate user */
 	    usr = freeuser;
 	    freeuser = usr->next;
-	    if (lastuser != (user *) NULL) {
-		usr->prev = lastuser->prev;
-		usr->prev->next = usr;
-		usr->next = lastuser;
-		lastuser->prev = usr;
-	    } else {
-		usr->prev = usr;
-		usr->next = usr;
-		lastuser = usr;
-	    }
+	    comm_ready(usr);
+	    conn_owner(conn, usr - users);
 	    nusers++;
 
 	    /* initialize user */
@@ -1717,7 +2141,7 @@ bool comm_restore(int fd)
 		usr->inbuf = (char *) NULL;
 	    }
 	    usr->extra = (Array *) NULL;
-	    usr->outbuf = (String *) NULL;
+	    usr->outbuf = nil_value;
 	    usr->inbufsz = du->tbufsz;
 	    if (usr->inbufsz != 0) {
 		memcpy(usr->inbuf, tbuf, usr->inbufsz);
@@ -28,6 +28,7 @@ extern bool	   conn_init	 (int, char**, char**, char**, unsigned short*,
 				    int);
 extern void	   conn_clear	 ();
 extern void	   conn_finish	 ();
+extern void	   conn_child	 ();
 extern void	   conn_listen	 ();
 extern connection *conn_tnew6	 (int);
 extern connection *conn_tnew	 (int);
@@ -40,10 +41,13 @@ extern bool	   conn_udp	 (connection*, char*, unsigned int);
 extern void	   conn_del	 (connection*);
 extern void	   conn_block	 (connection*, int);
 extern int	   conn_select	 (Uint, unsigned int);
+extern void	   conn_owner	 (connection*, int);
+extern int	   conn_ready	 ();
 extern bool	   conn_udpcheck (connection*);
 extern int	   conn_read	 (connection*, char*, unsigned int);
 extern int	   conn_udpread	 (connection*, char*, unsigned int);
 extern int	   conn_write	 (connection*, char*, unsigned int);
+extern int	   conn_writev	 (connection*, struct iovec*, int);
 extern int	   conn_udpwrite (connection*, char*, unsigned int);
 extern bool	   conn_wrdone	 (connection*);
 extern void	   conn_ipnum	 (connection*, char*);
@@ -51,6 +55,8 @@ extern void	   conn_ipname	 (connection*, char*);
 extern void	  *conn_host	 (char*, unsigned short, int*);
 extern connection *conn_connect	 (void*, int);
 extern int	   conn_check_connected (connection*, int*);
+extern void	   conn_stop	 ();
+extern int	   conn_pending	 (connection*, char*, unsigned int);
 extern bool	   conn_export	 (connection*, int*, char*, unsigned short*,
 				  short*, int*, int*, char**, char*);
 extern connection *conn_import	 (int, char*, unsigned short, short, int, int,
@@ -67,6 +73,7 @@ extern void	comm_clear	();
 extern void	comm_finish	();
 extern void	comm_listen	();
 extern int	comm_send	(Object*, String*);
+extern int	comm_multicast	(Frame*, Array*, String*);
 extern int	comm_udpsend	(Object*, String*);
 extern bool	comm_echo	(Object*, int);
 extern void	comm_challenge	(Object*, String*);
@@ -606,6 +606,23 @@ static void cg_asgnop(node *n, int op)
     cg_store(n->l.left);
 }
 
+/*
+ * NAME:	codegen->add_local()
+ * DESCRIPTION:	generate code for adding a small constant to an int local,
+ *		if possible
+ */
+static bool cg_add_local(node *n, Int c)
+{
+    if (n->l.left->type != N_LOCAL || c < -128 || c > 127) {
+	return FALSE;
+    }
+    code_instr(I_ADD_LOCAL, n->line);
+    ctrl_vm22();
+    code_byte(nparams - (int) n->l.left->r.number - 1);
+    code_byte(c);
+    return TRUE;
+}
+
 /*
  * NAME:	codegen->aggr()
  * DESCRIPTION:	generate code for an aggregate
@@ -938,6 +955,10 @@ static void cg_expr(node *n, int pop)
 	break;
 
     case N_ADD_EQ_INT:
+	if (pop && n->r.right->type == N_INT &&
+	    cg_add_local(n, n->r.right->l.number)) {
+	    return;
+	}
 	cg_asgnop(n, KF_ADD_INT);
 	break;
 
@@ -952,6 +973,9 @@ static void cg_expr(node *n, int pop)
 	break;
 
     case N_ADD_EQ_1_INT:
+	if (pop && cg_add_local(n, 1)) {
+	    return;
+	}
 	cg_lvalue(n->l.left, TRUE);
 	code_kfun(KF_ADD1_INT, 0);
 	cg_store(n->l.left);
@@ -1177,6 +1201,16 @@ static void cg_expr(node *n, int pop)
 	break;
 
     case N_INDEX:
+	if (!pop && n->l.left->type == N_GLOBAL &&
+	    (n->l.left->r.number >> 8) == ctrl_ninherits() &&
+	    n->r.right->type == N_LOCAL) {
+	    /* index near global with local */
+	    code_instr(I_INDEX_GLOBAL, n->line);
+	    ctrl_vm22();
+	    code_byte((int) n->l.left->r.number);
+	    code_byte(nparams - (int) n->r.right->r.number - 1);
+	    break;
+	}
 	cg_expr(n->l.left, FALSE);
 	cg_expr(n->r.right, FALSE);
 	code_instr(I_INDEX, n->line);
@@ -1562,6 +1596,10 @@ static void cg_expr(node *n, int pop)
 	break;
 
     case N_SUB_EQ_INT:
+	if (pop && n->r.right->type == N_INT && n->r.right->l.number > -128 &&
+	    cg_add_local(n, -n->r.right->l.number)) {
+	    return;
+	}
 	cg_asgnop(n, KF_SUB_INT);
 	break;
 
@@ -1576,6 +1614,9 @@ static void cg_expr(node *n, int pop)
 	break;
 
     case N_SUB_EQ_1_INT:
+	if (pop && cg_add_local(n, -1)) {
+	    return;
+	}
 	cg_lvalue(n->l.left, TRUE);
 	code_kfun(KF_SUB1_INT, 0);
 	cg_store(n->l.left);
@@ -1742,6 +1783,72 @@ static void cg_expr(node *n, int pop)
     }
 }
 
+/*
+ * NAME:	codegen->jump_local()
+ * DESCRIPTION:	generate a combined compare-and-jump for an int local, if
+ *		possible
+ */
+static bool cg_jump_local(node *n, int jmptrue)
+{
+    int op;
+    Int l;
+
+    switch (n->type) {
+    case N_LT_INT:
+	op = JUMP_LT;
+	break;
+
+    case N_LE_INT:
+	op = JUMP_LE;
+	break;
+
+    case N_GT_INT:
+	op = JUMP_GT;
+	break;
+
+    case N_GE_INT:
+	op = JUMP_GE;
+	break;
+
+    case N_EQ_INT:
+	op = JUMP_EQ;
+	break;
+
+    default:
+	op = JUMP_NE;
+	break;
+    }
+    if (n->l.left->type != N_LOCAL) {
+	return FALSE;
+    }
+    if (n->r.right->type == N_INT) {
+	op |= JUMP_CONST;
+    } else if (n->r.right->type != N_LOCAL) {
+	return FALSE;
+    }
+    if (jmptrue) {
+	op |= JUMP_TRUE;
+    }
+
+    code_instr(I_JUMP_LOCAL, n->line);
+    ctrl_vm22();
+    code_byte(nparams - (int) n->l.left->r.number - 1);
+    code_byte(op);
+    if (op & JUMP_CONST) {
+	l = n->r.right->l.number;
+	code_word((int) (l >> 16));
+	code_word((int) l);
+    } else {
+	code_byte(nparams - (int) n->r.right->r.number - 1);
+    }
+    if (jmptrue) {
+	true_list = jump_addr(true_list);
+    } else {
+	false_list = jump_addr(false_list);
+    }
+    return TRUE;
+}
+
 /*
  * NAME:	codegen->cond()
  * DESCRIPTION:	generate code for a condition
@@ -1805,6 +1912,16 @@ static void cg_cond(node *n, int jmptrue)
 	    n = n->r.right;
 	    continue;
 
+	case N_LT_INT:
+	case N_LE_INT:
+	case N_GT_INT:
+	case N_GE_INT:
+	case N_EQ_INT:
+	case N_NE_INT:
+	    if (cg_jump_local(n, jmptrue)) {
+		break;
+	    }
+	    /* fall through */
 	default:
 	    cg_expr(n, FALSE);
 	    if (jmptrue) {
@@ -1250,6 +1250,15 @@ void ctrl_dprogram(char *prog, unsigned int size)
     progsize += size;
 }
 
+/*
+ * NAME:	Control->vm22()
+ * DESCRIPTION:	mark the new program as using VM 2.2 instructions
+ */
+void ctrl_vm22()
+{
+    newctrl->flags |= CTRL_VM_2_2;
+}
+
 /*
  * NAME:	Control->dvar()
  * DESCRIPTION:	define a variable
@@ -26,6 +26,7 @@ extern long		 ctrl_dstring	(String*);
 extern void		 ctrl_dproto	(String*, char*, String*);
 extern void		 ctrl_dfunc	(String*, char*, String*);
 extern void		 ctrl_dprogram	(char*, unsigned int);
+extern void		 ctrl_vm22	();
 extern void		 ctrl_dvar	(String*, unsigned int,
 					   unsigned int, String*);
 extern char		*ctrl_ifcall	(String*, const char*, String**, long*);
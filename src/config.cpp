@@ -54,81 +54,101 @@ struct config {
 };
 
 static config conf[] = {
-# define ARRAY_SIZE	0
+# define ACCOUNT_FILE	0
+				{ "account_file",	STRING_CONST },
+# define ARRAY_SIZE	1
 				{ "array_size",		INT_CONST, FALSE, FALSE,
 							1, USHRT_MAX / 2 },
-# define AUTO_OBJECT	1
+# define AUTO_OBJECT	2
 				{ "auto_object",	STRING_CONST, TRUE },
-# define BINARY_PORT	2
+# define BINARY_PORT	3
 				{ "binary_port",	'[', FALSE, FALSE,
 							1, USHRT_MAX },
-# define CACHE_SIZE	3
+# define CACHE_SIZE	4
 				{ "cache_size",		INT_CONST, FALSE, FALSE,
 							1, UINDEX_MAX },
-# define CALL_OUTS	4
+# define CALL_OUTS	5
 				{ "call_outs",		INT_CONST, FALSE, FALSE,
 							0, UINDEX_MAX - 1 },
-# define CREATE		5
+# define COMPRESSION	6
+				{ "compression",	INT_CONST, FALSE, FALSE,
+							0, 2 },
+# define CREATE		7
 				{ "create",		STRING_CONST },
-# define DATAGRAM_PORT	6
+# define DATAGRAM_PORT	8
 				{ "datagram_port",	'[', FALSE, FALSE,
 							1, USHRT_MAX },
-# define DATAGRAM_USERS	7
+# define DATAGRAM_USERS	9
 				{ "datagram_users",	INT_CONST, FALSE, FALSE,
 							0, EINDEX_MAX },
-# define DIRECTORY	8
+# define DIRECTORY	10
 				{ "directory",		STRING_CONST },
-# define DRIVER_OBJECT	9
+# define DRIVER_OBJECT	11
 				{ "driver_object",	STRING_CONST, TRUE },
-# define DUMP_FILE	10
+# define DUMP_BACKGROUND 12
+				{ "dump_background",	INT_CONST, FALSE, FALSE,
+							0, 1 },
+# define DUMP_FILE	13
 				{ "dump_file",		STRING_CONST },
-# define DUMP_INTERVAL	11
+# define DUMP_INTERVAL	14
 				{ "dump_interval",	INT_CONST },
-# define DYNAMIC_CHUNK	12
+# define DYNAMIC_CHUNK	15
 				{ "dynamic_chunk",	INT_CONST, FALSE, FALSE,
 							1024 },
-# define ED_TMPFILE	13
+# define ED_TMPFILE	16
 				{ "ed_tmpfile",		STRING_CONST },
-# define EDITORS	14
+# define EDITORS	17
 				{ "editors",		INT_CONST, FALSE, FALSE,
 							0, EINDEX_MAX },
-# define HOTBOOT	15
+# define HOTBOOT	18
 				{ "hotboot",		'(' },
-# define INCLUDE_DIRS	16
+# define INCLUDE_DIRS	19
 				{ "include_dirs",	'(' },
-# define INCLUDE_FILE	17
+# define INCLUDE_FILE	20
 				{ "include_file",	STRING_CONST, TRUE },
-# define MODULES	18
+# define MODULES	21
 				{ "modules",		']' },
-# define OBJECTS	19
+# define OBJECTS	22
 				{ "objects",		INT_CONST, FALSE, FALSE,
 							2, UINDEX_MAX },
-# define PORTS		20
+# define PORTS		23
 				{ "ports",		INT_CONST, FALSE, FALSE,
 							1, 32 },
-# define SECTOR_SIZE	21
+# define PROFILE_RATE	24
+				{ "profile_rate",	INT_CONST, FALSE, FALSE,
+							0, 1000 },
+# define SECTOR_SIZE	25
 				{ "sector_size",	INT_CONST, FALSE, FALSE,
 							512, 65535 },
-# define STATIC_CHUNK	22
+# define STATIC_CHUNK	26
 				{ "static_chunk",	INT_CONST },
-# define SWAP_FILE	23
+# define SWAP_BUDGET	27
+				{ "swap_budget",	INT_CONST, FALSE, FALSE,
+							0, 1000000 },
+# define SWAP_FILE	28
 				{ "swap_file",		STRING_CONST },
-# define SWAP_FRAGMENT	24
+# define SWAP_FRAGMENT	29
 				{ "swap_fragment",	INT_CONST, FALSE, FALSE,
 							0, SW_UNUSED },
-# define SWAP_SIZE	25
+# define SWAP_MEMORY	30
+				{ "swap_memory",	INT_CONST, FALSE, FALSE,
+							0, 4194303 },
+# define SWAP_MMAP	31
+				{ "swap_mmap",		INT_CONST, FALSE, FALSE,
+							0, 1 },
+# define SWAP_SIZE	32
 				{ "swap_size",		INT_CONST, FALSE, FALSE,
 							1024, SW_UNUSED },
-# define TELNET_PORT	26
+# define TELNET_PORT	33
 				{ "telnet_port",	'[', FALSE, FALSE,
 							1, USHRT_MAX },
-# define TYPECHECKING	27
+# define TYPECHECKING	34
 				{ "typechecking",	INT_CONST, FALSE, FALSE,
 							0, 2 },
-# define USERS		28
+# define USERS		35
 				{ "users",		INT_CONST, FALSE, FALSE,
 							0, EINDEX_MAX },
-# define NR_OPTIONS	29
+# define NR_OPTIONS	36
 };
 
 
@@ -213,6 +233,7 @@ static int realign;		/* align(eindex) */
 static Uint starttime;		/* start time */
 static Uint elapsed;		/* elapsed time */
 static Uint boottime;		/* boot time */
+static int nconv;		/* max. # threads converting */
 
 /*
  * NAME:	conf->dumpinit()
@@ -266,32 +287,18 @@ static void conf_dumpinit()
 }
 
 /*
- * NAME:	conf->dump()
- * DESCRIPTION:	dump system state on file
+ * NAME:	conf->write()
+ * DESCRIPTION:	write system state to the snapshot
  */
-void conf_dump(bool incr, bool boot)
+static void conf_write(bool incr, bool boot)
 {
     int fd;
-    Uint etime;
-
-    header[DUMP_VERSION] = FORMAT_VERSION;
-    header[DUMP_TYPECHECK] = conf[TYPECHECKING].u.num;
-    header[DUMP_STARTTIME + 0] = starttime >> 24;
-    header[DUMP_STARTTIME + 1] = starttime >> 16;
-    header[DUMP_STARTTIME + 2] = starttime >> 8;
-    header[DUMP_STARTTIME + 3] = starttime;
-    etime = P_time();
-    if (etime < boottime) {
-	etime = boottime;
-    }
-    etime += elapsed - boottime;
-    header[DUMP_ELAPSED + 0] = etime >> 24;
-    header[DUMP_ELAPSED + 1] = etime >> 16;
-    header[DUMP_ELAPSED + 2] = etime >> 8;
-    header[DUMP_ELAPSED + 3] = etime;
 
     if (!incr) {
 	Object::copy(0);
+    } else {
+	/* a new partial snapshot cannot depend on two older ones */
+	Object::copy2();
     }
     d_swapout(1);
     dflags = 0;
@@ -318,6 +325,135 @@ void conf_dump(bool incr, bool boot)
     sw_dump2(header, sizeof(dumpinfo), incr);
 }
 
+static int dumpchild;		/* process creating a snapshot, if any */
+static int dumpdone = -1;	/* result of a background snapshot not yet
+				   reported */
+static bool dumpfull;		/* next snapshot must be a full one */
+
+/*
+ * NAME:	conf->wait()
+ * DESCRIPTION:	wait for the snapshot process; return 1 if it created the
+ *		snapshot, 0 if it failed, and -1 if it is still busy or if
+ *		there is none
+ */
+static int conf_wait(bool wait)
+{
+    int status;
+
+    if (dumpchild <= 0) {
+	return -1;
+    }
+    status = P_wait(dumpchild, wait);
+    if (status < 0) {
+	return -1;
+    }
+    dumpchild = 0;
+    sw_thaw();
+
+    /*
+     * The snapshot process replaced the snapshot that this process still
+     * considers its last full one.  An incremental snapshot would refer to
+     * the wrong base, so the next snapshot made here must be a full one.
+     */
+    dumpfull = TRUE;
+    return (status == 0);
+}
+
+/*
+ * NAME:	conf->dump()
+ * DESCRIPTION:	dump system state on file; return FALSE if the snapshot is
+ *		being created in the background
+ */
+bool conf_dump(bool incr, bool boot, bool background)
+{
+    Uint etime;
+    int n;
+
+    if (dumpchild > 0) {
+	/*
+	 * finish the snapshot being created in the background first, and
+	 * report it later
+	 */
+	n = conf_wait(TRUE);
+	dumpdone = (dumpdone >= 0) ? (dumpdone && n) : n;
+    }
+    if (dumpfull && incr) {
+	/* the snapshot files changed underneath: no incremental one */
+	incr = Object::incr = FALSE;
+    }
+
+    header[DUMP_VERSION] = FORMAT_VERSION;
+    header[DUMP_TYPECHECK] = conf[TYPECHECKING].u.num;
+    header[DUMP_STARTTIME + 0] = starttime >> 24;
+    header[DUMP_STARTTIME + 1] = starttime >> 16;
+    header[DUMP_STARTTIME + 2] = starttime >> 8;
+    header[DUMP_STARTTIME + 3] = starttime;
+    etime = P_time();
+    if (etime < boottime) {
+	etime = boottime;
+    }
+    etime += elapsed - boottime;
+    header[DUMP_ELAPSED + 0] = etime >> 24;
+    header[DUMP_ELAPSED + 1] = etime >> 16;
+    header[DUMP_ELAPSED + 2] = etime >> 8;
+    header[DUMP_ELAPSED + 3] = etime;
+
+    if (background && !boot && conf[DUMP_BACKGROUND].set &&
+	conf[DUMP_BACKGROUND].u.num != 0) {
+	/*
+	 * Let a child process write a full snapshot from its copy of the
+	 * system state, while the swap file sectors it copies are frozen.
+	 */
+	Object::copy(0);
+	if (sw_freeze()) {
+	    dumpchild = P_fork();
+	    if (dumpchild == 0) {
+		conn_child();
+		sw_child();
+		conf_write(FALSE, FALSE);
+		P_exit(0);
+	    }
+	    if (dumpchild > 0) {
+		return FALSE;
+	    }
+	    sw_thaw();
+	}
+    }
+
+    conf_write(incr, boot);
+    dumpfull = FALSE;
+    return TRUE;
+}
+
+/*
+ * NAME:	conf->dumping()
+ * DESCRIPTION:	is a snapshot being created in the background?
+ */
+bool conf_dumping()
+{
+    return (dumpchild > 0);
+}
+
+/*
+ * NAME:	conf->dumped()
+ * DESCRIPTION:	check on the snapshot being created in the background;
+ *		return 1 if it was created, 0 if creating it failed, and
+ *		-1 if it is still busy or if there is none
+ */
+int conf_dumped(bool wait)
+{
+    int status, n;
+
+    status = conf_wait(wait);
+    if (dumpdone >= 0) {
+	/* report the snapshot that finished earlier first */
+	n = dumpdone;
+	dumpdone = status;
+	return n;
+    }
+    return status;
+}
+
 /*
  * NAME:	conf->header()
  * DESCRIPTION:	restore a snapshot header
@@ -427,6 +563,12 @@ static bool conf_restore(int fd, int fd2)
     }
     rpsize &= 0xf;
 
+    /* large arrays are converted by several threads at once */
+    nconv = P_ncpu();
+    if (nconv > CONVTHREADS) {
+	nconv = CONVTHREADS;
+    }
+
     sw_restore(fd, secsize);
     kf_restore(fd);
     Object::restore(fd, rdflags & FLAGS_PARTIAL);
@@ -437,7 +579,7 @@ static bool conf_restore(int fd, int fd2)
     boottime = P_time();
     co_restore(fd, boottime);
 
-    if (fd2 >= 0) {
+    if (fd2 >= 0 && !(rdflags & FLAGS_PARTIAL)) {
 	P_close(fd2);
     }
 
@@ -565,10 +707,10 @@ Uint conf_dsize(const char *layout)
 }
 
 /*
- * NAME:	conf_dconv()
+ * NAME:	conf->convert()
  * DESCRIPTION:	convert structs from snapshot format
  */
-Uint conf_dconv(char *buf, char *rbuf, const char *layout, Uint n)
+static Uint conf_convert(char *buf, char *rbuf, const char *layout, Uint n)
 {
     Uint i, ri, j, size, rsize;
     const char *p;
@@ -701,7 +843,7 @@ Uint conf_dconv(char *buf, char *rbuf, const char *layout, Uint n)
 		j = conf_dsize(++p);
 		i = ALGN(i, j >> 24);
 		ri = ALGN(ri, (j >> 8) & 0xff);
-		j = conf_dconv(buf + i, rbuf + ri, p, (Uint) 1);
+		j = conf_convert(buf + i, rbuf + ri, p, (Uint) 1);
 		i += (j >> 16) & 0xff;
 		ri += j & 0xff;
 		p = strchr(p, ']');
@@ -743,6 +885,64 @@ Uint conf_dconv(char *buf, char *rbuf, const char *layout, Uint n)
     return (size << 16) | rsize;
 }
 
+struct convjob {
+    char *buf;			/* converted structs */
+    char *rbuf;			/* structs in snapshot format */
+    const char *layout;		/* struct layout */
+    Uint n;			/* # structs */
+};
+
+/*
+ * NAME:	conf->convjob()
+ * DESCRIPTION:	convert a part of an array of structs
+ */
+static void conf_convjob(void *arg)
+{
+    convjob *job;
+
+    job = (convjob *) arg;
+    conf_convert(job->buf, job->rbuf, job->layout, job->n);
+}
+
+/*
+ * NAME:	conf_dconv()
+ * DESCRIPTION:	convert structs from snapshot format, dividing a large
+ *		array over several threads
+ */
+Uint conf_dconv(char *buf, char *rbuf, const char *layout, Uint n)
+{
+    convjob *jobs;
+    Uint size, rsize, m;
+    int i, nthreads;
+
+    rsize = conf_dsize(layout);
+    size = (rsize >> 16) & 0xff;
+    rsize &= 0xff;
+    nthreads = n / (CONVCHUNK / rsize);
+    if (nthreads > nconv) {
+	nthreads = nconv;
+    }
+    if (nthreads <= 1) {
+	return conf_convert(buf, rbuf, layout, n);
+    }
+
+    jobs = ALLOCA(convjob, nthreads);
+    for (i = 0; i < nthreads; i++) {
+	m = n / (nthreads - i);
+	jobs[i].buf = buf;
+	jobs[i].rbuf = rbuf;
+	jobs[i].layout = layout;
+	jobs[i].n = m;
+	buf += size * m;
+	rbuf += rsize * m;
+	n -= m;
+    }
+    P_parallel(conf_convjob, jobs, sizeof(convjob), nthreads);
+    AFREE(jobs);
+
+    return (size << 16) | rsize;
+}
+
 /*
  * NAME:	conf->dread()
  * DESCRIPTION:	read from snapshot
@@ -1077,7 +1277,10 @@ static bool conf_config()
 
     for (l = 0; l < NR_OPTIONS; l++) {
 	if (!conf[l].set && l != HOTBOOT && l != MODULES && l != CACHE_SIZE &&
-	    l != DATAGRAM_PORT && l != DATAGRAM_USERS) {
+	    l != DATAGRAM_PORT && l != DATAGRAM_USERS && l != PROFILE_RATE &&
+	    l != ACCOUNT_FILE && l != COMPRESSION &&
+	    l != DUMP_BACKGROUND && l != SWAP_MMAP && l != SWAP_BUDGET &&
+	    l != SWAP_MEMORY) {
 	    char buffer[64];
 
 #ifndef NETWORK_EXTENSIONS
@@ -1260,6 +1463,18 @@ static bool conf_includes()
     cputs("# define ST_DATAGRAMPORTS 24\t/* datagram ports */\012");
     cputs("# define ST_TELNETPORTS\t25\t/* telnet ports */\012");
     cputs("# define ST_BINARYPORTS\t26\t/* binary ports */\012");
+    cputs("# define ST_PROFILE\t27\t/* profiling samples */\012");
+    cputs("# define ST_SWAPHITS\t28\t/* # swap cache hits */\012");
+    cputs("# define ST_SWAPMISSES\t29\t/* # swap cache misses */\012");
+    cputs("# define ST_SWAPEVICTS\t30\t/* # swap cache evictions */\012");
+    cputs("# define ST_SWAPFRAG\t31\t/* current swap fragment */\012");
+    cputs("# define ST_SWAPCUT\t32\t/* # swap-outs cut short */\012");
+    cputs("# define ST_STRMEMSIZE\t33\t/* string slab memory allocated */\012");
+    cputs("# define ST_STRMEMUSED\t34\t/* string slab memory in use */\012");
+    cputs("# define ST_ARRMEMSIZE\t35\t/* array slab memory allocated */\012");
+    cputs("# define ST_ARRMEMUSED\t36\t/* array slab memory in use */\012");
+    cputs("# define ST_ELTMEMSIZE\t37\t/* mapping element slab memory allocated */\012");
+    cputs("# define ST_ELTMEMUSED\t38\t/* mapping element slab memory in use */\012");
 
     cputs("\012# define O_COMPILETIME\t0\t/* time of compilation */\012");
     cputs("# define O_PROGSIZE\t1\t/* program size of object */\012");
@@ -1273,6 +1488,16 @@ static bool conf_includes()
     cputs("# define CO_FUNCTION\t1\t/* function name */\012");
     cputs("# define CO_DELAY\t2\t/* delay */\012");
     cputs("# define CO_FIRSTXARG\t3\t/* first extra argument */\012");
+
+    cputs("\012# define PS_PROGRAM\t0\t/* program name */\012");
+    cputs("# define PS_FUNCTION\t1\t/* function name */\012");
+    cputs("# define PS_LINE\t\t2\t/* line number */\012");
+    cputs("# define PS_SAMPLES\t3\t/* # samples */\012");
+
+    cputs("\012# define FA_FUNCTION\t0\t/* function name */\012");
+    cputs("# define FA_CALLS\t1\t/* # calls */\012");
+    cputs("# define FA_TICKS\t2\t/* ticks used */\012");
+    cputs("# define FA_TIME\t\t3\t/* time used in nanoseconds */\012");
     if (!cclose()) {
 	return FALSE;
     }
@@ -1554,10 +1779,15 @@ bool conf_init(char *configfile, char *snapshot, char *snapshot2, char *module,
     /* initialize swap device */
     cache = (sector) ((conf[CACHE_SIZE].set) ? conf[CACHE_SIZE].u.num : 100);
     sw_init(conf[SWAP_FILE].u.str, (sector) conf[SWAP_SIZE].u.num, cache,
-	    (unsigned int) conf[SECTOR_SIZE].u.num);
+	    (unsigned int) conf[SECTOR_SIZE].u.num,
+	    (conf[SWAP_MMAP].set && conf[SWAP_MMAP].u.num != 0));
 
     /* initialize swapped data handler */
-    d_init();
+    d_init((uindex) conf[OBJECTS].u.num,
+	   (conf[ACCOUNT_FILE].set) ? conf[ACCOUNT_FILE].u.str : (char *) NULL,
+	   (conf[COMPRESSION].set) ? (int) conf[COMPRESSION].u.num : CMP_LZ,
+	   (Uint) ((conf[SWAP_MEMORY].set) ? conf[SWAP_MEMORY].u.num : 0),
+	   (Uint) ((conf[SWAP_BUDGET].set) ? conf[SWAP_BUDGET].u.num : 0));
     *fragment = conf[SWAP_FRAGMENT].u.num;
 
     /* initalize editor */
@@ -1581,7 +1811,9 @@ bool conf_init(char *configfile, char *snapshot, char *snapshot2, char *module,
     }
 
     /* initialize interpreter */
-    i_init(conf[CREATE].u.str, conf[TYPECHECKING].u.num == 2);
+    i_init(conf[CREATE].u.str, conf[TYPECHECKING].u.num == 2,
+	   (unsigned int) ((conf[PROFILE_RATE].set) ?
+			   conf[PROFILE_RATE].u.num : 0));
 
     /* initialize compiler */
     c_init(conf[AUTO_OBJECT].u.str,
@@ -1774,6 +2006,8 @@ bool conf_statusi(Frame *f, Int idx, Value *v)
     uindex ncoshort, ncolong;
     Array *a;
     Uint t;
+    Uuint hits, misses, evictions;
+    unsigned int frag;
     int i;
 
     switch (idx) {
@@ -1904,6 +2138,59 @@ bool conf_statusi(Frame *f, Int idx, Value *v)
 	}
 	break;
 
+    case 27:	/* ST_PROFILE */
+	PUT_ARRVAL(v, i_profile(f->data));
+	break;
+
+    case 28:	/* ST_SWAPHITS */
+	sw_stats(&hits, &misses, &evictions);
+	putval(v, (size_t) hits);
+	break;
+
+    case 29:	/* ST_SWAPMISSES */
+	sw_stats(&hits, &misses, &evictions);
+	putval(v, (size_t) misses);
+	break;
+
+    case 30:	/* ST_SWAPEVICTS */
+	sw_stats(&hits, &misses, &evictions);
+	putval(v, (size_t) evictions);
+	break;
+
+    case 31:	/* ST_SWAPFRAG */
+	d_swapstats(&frag, &t);
+	PUT_INTVAL(v, frag);
+	break;
+
+    case 32:	/* ST_SWAPCUT */
+	d_swapstats(&frag, &t);
+	putval(v, (size_t) t);
+	break;
+
+    case 33:	/* ST_STRMEMSIZE */
+	putval(v, m_info()->slab[SLAB_STRING].memsize);
+	break;
+
+    case 34:	/* ST_STRMEMUSED */
+	putval(v, m_info()->slab[SLAB_STRING].memused);
+	break;
+
+    case 35:	/* ST_ARRMEMSIZE */
+	putval(v, m_info()->slab[SLAB_ARRAY].memsize);
+	break;
+
+    case 36:	/* ST_ARRMEMUSED */
+	putval(v, m_info()->slab[SLAB_ARRAY].memused);
+	break;
+
+    case 37:	/* ST_ELTMEMSIZE */
+	putval(v, m_info()->slab[SLAB_MAPELT].memsize);
+	break;
+
+    case 38:	/* ST_ELTMEMUSED */
+	putval(v, m_info()->slab[SLAB_MAPELT].memused);
+	break;
+
     default:
 	return FALSE;
     }
@@ -1923,8 +2210,8 @@ Array *conf_status(Frame *f)
 
     try {
 	ec_push((ec_ftn) NULL);
-	a = Array::createNil(f->data, 27);
-	for (i = 0, v = a->elts; i < 27; i++, v++) {
+	a = Array::createNil(f->data, 39);
+	for (i = 0, v = a->elts; i < 39; i++, v++) {
 	    conf_statusi(f, i, v);
 	}
 	ec_pop();
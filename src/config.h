@@ -18,15 +18,30 @@
  */
 
 /* these may be changed, but sizeof(type) <= sizeof(int) */
+# ifdef LARGE_STRINGS
+#  ifndef LARGE_INDEX
+#   define LARGE_INDEX		/* sizeof(ssizet) <= sizeof(uindex) */
+#  endif
+# endif
+# ifdef LARGE_INDEX
+typedef unsigned int uindex;
+# define UINDEX_MAX	UINT_MAX
+# else
 typedef unsigned short uindex;
 # define UINDEX_MAX	USHRT_MAX
+# endif
 
 typedef uindex sector;
 # define SW_UNUSED	UINDEX_MAX
 
 /* sizeof(ssizet) <= sizeof(uindex) */
+# ifdef LARGE_STRINGS
+typedef unsigned int ssizet;
+# define SSIZET_MAX	INT_MAX		/* string length must fit in an Int */
+# else
 typedef unsigned short ssizet;
 # define SSIZET_MAX	USHRT_MAX
+# endif
 
 /* eindex can be anything */
 typedef unsigned char eindex;
@@ -52,24 +67,29 @@ typedef unsigned short kfindex;
 # define ARRMERGETABSZ	1024	/* general array merge table size */
 # define OBJHASHSZ	256	/* # characters in object names to hash */
 # define COPATCHHTABSZ	1024	/* callout patch hash table size */
-# define OBJPATCHHTABSZ	256	/* object patch hash table size */
+# define OBJPATCHHTABSZ	256	/* object patch table size (power of 2) */
 # define CMPLIMIT	2048	/* compress strings if >= CMPLIMIT */
 # define SWAPCHUNKSZ	10	/* # objects reconstructed in main loop */
+# define CONVCHUNK	32768	/* min. # snapshot bytes converted per thread */
+# define CONVTHREADS	8	/* max. # threads converting a snapshot */
 
 /* comm */
 # define INBUF_SIZE	2048	/* telnet input buffer size */
 # define OUTBUF_SIZE	8192	/* telnet output buffer size */
+# define OUTBUF_SEGS	64	/* max. # segments in output buffer */
 # define BINBUF_SIZE	8192	/* binary/UDP input buffer size */
 # define UDPHASHSZ	10	/* # characters in UDP challenge to hash */
 
 /* swap */
 # define SWAPCHUNK	(128 * 1024 * 1024)
+# define SWAPRUN	64	/* max. # sectors in a single swap I/O */
 
 /* interpreter */
 # define MIN_STACK	5	/* minimal stack, # arguments in driver calls */
 # define EXTRA_STACK	32	/* extra space in stack frames */
 # define MAX_STRLEN	SSIZET_MAX	/* max string length, >= 65535 */
 # define INHASHSZ	4096	/* instanceof hashtable size */
+# define PROFTABSZ	2048	/* profiling samples hashtable size */
 
 /* parser */
 # define MAX_AUTOMSZ	6	/* DFA/PDA storage size, in strings */
@@ -107,7 +127,9 @@ extern int		conf_typechecking ();
 extern unsigned short	conf_array_size	();
 extern bool		conf_attach	(int);
 
-extern void   conf_dump		(bool, bool);
+extern bool   conf_dump		(bool, bool, bool);
+extern bool   conf_dumping	();
+extern int    conf_dumped	(bool);
 extern Uint   conf_dsize	(const char*);
 extern Uint   conf_dconv	(char*, char*, const char*, Uint);
 extern void   conf_dread	(int, char*, const char*, Uint);
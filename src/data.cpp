@@ -1064,6 +1064,10 @@ void d_assign_elt(Dataspace *data, Array *arr, Value *elt, Value *val)
 	    arr->primary = &data->plane->alocal;
 	}
     }
+    if (arr->bak != (ArrBak *) NULL) {
+	/* save element, if only part of the array was backed up */
+	arr->backupElt(elt);
+    }
 
     if (arr->primary->arr != (Array *) NULL) {
 	/*
@@ -1605,6 +1609,7 @@ Object *d_upgrade_lwobj(Array *lwobj, Object *obj)
 
     a = lwobj->primary;
     update = obj->update;
+    lwobj->backupAll();
     vmap = d_get_varmap(&obj, (Uint) lwobj->elts[1].u.number, &nvar);
     --nvar;
 
@@ -1895,6 +1900,7 @@ void d_del_control(Control *ctrl)
 	sw_wipev(ctrl->sectors, ctrl->nsectors);
 	sw_delv(ctrl->sectors, ctrl->nsectors);
     }
+    d_del_account(ctrl);
     d_free_control(ctrl);
 }
 
@@ -60,6 +60,21 @@ struct dsymbol {
 
 # define DSYM_LAYOUT	"ccs"
 
+struct dcallcache {
+    String *name;		/* function name */
+    char inherit;		/* function object index */
+    char index;			/* function index */
+    short sclass;		/* function class, C_UNDEFINED if absent */
+};
+
+# define CALLCACHESZ	16	/* call_other cache entries per program */
+
+struct dacct {
+    Uuint calls;		/* # calls */
+    Uuint ticks;		/* ticks used */
+    Uuint time;			/* time used, in nanoseconds */
+};
+
 struct Control {
     Control *prev, *next;
     uindex ndata;		/* # of data blocks using this control block */
@@ -117,6 +132,8 @@ struct Control {
 
     unsigned short vmapsize;	/* i/o size of variable mapping */
     unsigned short *vmap;	/* variable mapping */
+
+    dcallcache *callcache;	/* call_other lookup cache */
 };
 
 # define NEW_INT		((unsigned short) -1)
@@ -231,7 +248,7 @@ struct Dataspace {
 
 /* sdata.c */
 
-extern void		d_init		 ();
+extern void		d_init		 (uindex, char*, int, Uint, Uint);
 extern void		d_init_conv	 (bool);
 
 extern Control	       *d_new_control	 ();
@@ -247,6 +264,12 @@ extern dfuncdef        *d_get_funcdefs	 (Control*);
 extern dvardef	       *d_get_vardefs	 (Control*);
 extern char	       *d_get_funcalls	 (Control*);
 extern dsymbol	       *d_get_symbols	 (Control*);
+extern dcallcache      *d_get_callcache	 (Control*);
+extern void		d_del_callcache	 (Control*);
+extern dacct	       *d_get_account	 (Control*, bool);
+extern void		d_del_account	 (Control*);
+extern void		d_clear_account	 ();
+extern void		d_dump_account	 ();
 extern Uint		d_get_progsize	 (Control*);
 
 extern void		d_new_variables	 (Control*, Value*);
@@ -255,12 +278,15 @@ extern Value	       *d_get_elts	 (Array*);
 extern void		d_get_callouts	 (Dataspace*);
 
 extern sector		d_swapout	 (unsigned int);
+extern sector		d_swaptask	 (unsigned int);
+extern void		d_swapstats	 (unsigned int*, Uint*);
 extern void		d_upgrade_mem	 (Object*, Object*);
 extern Control	       *d_restore_ctrl	 (Object*, Uint,
 					  void(*)(char*, sector*, Uint, Uint));
 extern Dataspace       *d_restore_data	 (Object*, Uint*,
 					  void(*)(char*, sector*, Uint, Uint));
-extern void		d_restore_obj	 (Object*, Uint, Uint*, bool, bool);
+extern void		d_restore_obj	 (Object*, Uint, Uint*, bool, bool,
+					  bool);
 extern void		d_converted	 ();
 
 extern void		d_free_control	 (Control*);
@@ -306,6 +332,7 @@ extern void		d_del_dataspace	(Dataspace*);
 # define CTRL_UNDEFINED		0x010	/* has undefined functions */
 # define CTRL_VM_2_1		0x020	/* uses VM 2.1 or later */
 # define CTRL_VARMAP		0x040	/* varmap updated */
+# define CTRL_VM_2_2		0x080	/* uses superinstructions */
 
 /* bit values for dataspace->flags */
 # define DATA_STRCMP		0x03	/* strings compressed */
@@ -325,6 +352,7 @@ extern void		d_del_dataspace	(Dataspace*);
 # define CMP_TYPE		0x03
 # define CMP_NONE		0x00	/* no compression */
 # define CMP_PRED		0x01	/* predictor compression */
+# define CMP_LZ			0x02	/* LZ77 compression */
 
 # define ARR_MOD		0x80000000L	/* in arrref->ref */
 
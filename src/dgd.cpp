@@ -86,11 +86,12 @@ void endtask()
     ed_clear();
     ec_clear();
 
-    co_swapcount(d_swapout(fragment));
+    co_swapcount(d_swaptask(fragment));
 
     if (Object::stop) {
 	comm_clear();
 	ed_finish();
+	d_dump_account();
 # ifdef DEBUG
 	Object::swap = TRUE;
 # endif
@@ -108,20 +109,28 @@ void endtask()
     }
 
     if (Object::dump) {
-	/*
-	 * create a snapshot
-	 */
-	conf_dump(Object::incr, Object::boot);
-	Object::dump = FALSE;
-	if (!Object::incr) {
+	if (conf_dumping() && !Object::stop) {
+	    /*
+	     * a snapshot is still being created in the background: try
+	     * again later
+	     */
+	    Object::dumpState(Object::incr);
+	} else if (conf_dump(Object::incr, Object::boot, !Object::stop) &&
+		   !Object::incr) {
+	    /*
+	     * created a snapshot
+	     */
 	    rebuild = TRUE;
 	    dindex = UINDEX_MAX;
 	}
+	Object::dump = FALSE;
     }
 
     if (Object::stop) {
+	conf_dumped(TRUE);
 	sw_finish();
 	conf_mod_finish();
+	i_finish();
 
 	if (Object::boot) {
 	    char **hotboot;
@@ -161,6 +170,7 @@ int dgd_main(int argc, char **argv)
     char *program, *module;
     Uint rtime, timeout;
     unsigned short rmtime, mtime;
+    int n;
 
     rmtime = 0;
 
@@ -201,7 +211,7 @@ int dgd_main(int argc, char **argv)
 	    timeout = co_time(&mtime);
 	    if (timeout > rtime || (timeout == rtime && mtime >= rmtime)) {
 		rebuild = Object::copy(timeout);
-		co_swapcount(d_swapout(fragment));
+		co_swapcount(d_swaptask(fragment));
 		if (rebuild) {
 		    rtime = timeout + 1;
 		    rmtime = mtime;
@@ -223,6 +233,18 @@ int dgd_main(int argc, char **argv)
 	    endtask();
 	}
 
+	/* snapshot created in the background */
+	if ((n = conf_dumped(FALSE)) >= 0) {
+	    try {
+		ec_push((ec_ftn) errhandler);
+		PUSH_INTVAL(cframe, n);
+		call_driver_object(cframe, "snapshot_done", 1);
+		i_del_value(cframe->sp++);
+		ec_pop();
+	    } catch (...) { }
+	    endtask();
+	}
+
 	/* handle user input */
 	timeout = co_delay(rtime, rmtime, &mtime);
 	comm_receive(cframe, timeout, mtime);
@@ -485,7 +485,8 @@ bool ext_execute(const Frame *f, int func, Value *val)
 	return FALSE;
     }
     ctrl = f->p_ctrl;
-    if (ctrl->instance == 0) {
+    if (ctrl->instance == 0 || (ctrl->flags & CTRL_VM_2_2)) {
+	/* not instantiated, or using instructions unknown to the JIT */
 	return FALSE;
     }
     result = (*jit_execute)(ctrl->oindex, ctrl->instance, func, val);
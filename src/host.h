@@ -151,6 +151,7 @@ typedef unsigned int Uint;
 # ifdef INCLUDE_FILE_IO
 # include <fcntl.h>
 # include <sys/stat.h>
+# include <sys/uio.h>
 # endif
 
 # ifdef INCLUDE_CTYPE
@@ -193,6 +194,7 @@ typedef unsigned int Uint;
 # ifdef INCLUDE_FILE_IO
 # include <fcntl.h>
 # include <sys/stat.h>
+# include <sys/uio.h>
 # ifndef FNDELAY
 # define FNDELAY	O_NDELAY
 # endif
@@ -263,6 +265,9 @@ extern void  P_message	(const char*);
 # define P_rmdir	rmdir
 # define P_chdir	chdir
 # define P_execv	execv
+# define P_preadv	preadv
+# define P_pwritev	pwritev
+# define P_ftruncate	ftruncate
 # else
 	/* filename translation */
 typedef long off_t;
@@ -282,7 +287,20 @@ extern int P_mkdir	(const char*, int);
 extern int P_rmdir	(const char*);
 extern int P_chdir	(const char*);
 extern int P_execv	(const char*, char**);
+
+struct iovec {
+    void *iov_base;		/* start of buffer */
+    size_t iov_len;		/* size of buffer */
+};
+
+extern long P_preadv	(int, const struct iovec*, int, off_t);
+extern long P_pwritev	(int, const struct iovec*, int, off_t);
+extern int P_ftruncate	(int, off_t);
 # endif
+
+extern char *P_mmap	(int, off_t);
+extern void  P_munmap	(char*, off_t);
+extern void  P_msync	(char*, off_t);
 # endif /* INCLUDE_FILE_IO */
 
 extern bool  P_opendir	(const char*);
@@ -300,7 +318,16 @@ extern long  P_random	();
 
 extern Uint  P_time	();
 extern Uint  P_mtime	(unsigned short*);
+extern Uuint P_ntime	();
 extern char *P_ctime	(char*, Uint);
+extern void  P_timer	(unsigned int, void (*)());
+
+extern int   P_fork	();
+extern int   P_wait	(int, bool);
+extern void  P_exit	(int);
+
+extern int   P_ncpu	();
+extern void  P_parallel	(void (*)(void*), void*, size_t, int);
 
 /* these must be the same on all hosts */
 # define BEL	'\007'
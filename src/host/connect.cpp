@@ -0,0 +1,3509 @@
+/*
+ * This file is part of DGD, https://github.com/dworkin/dgd
+ * Copyright (C) 1993-2010 Dworkin B.V.
+ * Copyright (C) 2010-2018 DGD Authors (see the commit log for details)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+# include <sys/time.h>
+# include <sys/stat.h>
+# include <sys/socket.h>
+# include <netinet/in.h>
+# include <arpa/inet.h>
+# include <netdb.h>
+# include <signal.h>
+# include <pthread.h>
+# include <errno.h>
+# define INCLUDE_FILE_IO
+# include "dgd.h"
+# include "hash.h"
+# include "comm.h"
+
+# ifdef INET6		/* INET6 defined */
+#  if INET6 == 0
+#   undef INET6		/* ... but turned off */
+#  endif
+# else
+#  ifdef AF_INET6	/* define INET6 if AF_INET6 exists */
+#   define INET6
+#  endif
+# endif
+
+# ifdef EPOLL		/* EPOLL defined */
+#  if EPOLL == 0
+#   undef EPOLL		/* ... but turned off */
+#  endif
+# else
+#  ifdef LINUX		/* define EPOLL on Linux */
+#   define EPOLL
+#  endif
+# endif
+
+# ifdef EPOLL
+# include <sys/epoll.h>
+# else
+#  undef NETTHREAD	/* the network I/O thread requires epoll */
+# endif
+# ifdef NETTHREAD
+# include <poll.h>
+# endif
+
+# ifndef MAXHOSTNAMELEN
+# define MAXHOSTNAMELEN	1025
+# endif
+
+# ifndef INADDR_NONE
+# define INADDR_NONE	0xffffffffL
+# endif
+
+# define NFREE		32
+
+struct in46addr {
+    union {
+# ifdef INET6
+	struct in6_addr addr6;		/* IPv6 addr */
+# endif
+	struct in_addr addr;		/* IPv4 addr */
+    } in;
+    bool ipv6;				/* IPv6? */
+};
+
+struct ipaddr {
+    ipaddr *link;			/* next in hash table */
+    ipaddr *prev;			/* previous in linked list */
+    ipaddr *next;			/* next in linked list */
+    Uint ref;				/* reference count */
+    in46addr ipnum;			/* ip number */
+    char name[MAXHOSTNAMELEN];		/* ip name */
+};
+
+struct pipes {
+    int in;				/* input file descriptor */
+    int out;				/* output file descriptor */
+};
+
+static int in = -1, out = -1;		/* pipe to/from name resolver */
+static pipes inout;			/* name resolver side of the pipes */
+static int addrtype;			/* network address family */
+static ipaddr **ipahtab;		/* ip address hash table */
+static unsigned int ipahtabsz;		/* hash table size */
+static ipaddr *qhead, *qtail;		/* request queue */
+static ipaddr *ffirst, *flast;		/* free list */
+static int nfree;			/* # in free list */
+static ipaddr *lastreq;			/* last request */
+static bool busy;			/* name resolver busy */
+static pthread_t lookup;		/* name lookup thread */
+
+/*
+ * NAME:	conn->thread()
+ * DESCRIPTION:	start a helper thread, leaving signals to the main thread
+ */
+static int conn_thread(pthread_t *thread, void *(*func)(void*), void *arg)
+{
+    sigset_t mask, omask;
+    int result;
+
+    sigfillset(&mask);
+    pthread_sigmask(SIG_BLOCK, &mask, &omask);
+    result = pthread_create(thread, NULL, func, arg);
+    pthread_sigmask(SIG_SETMASK, &omask, (sigset_t *) NULL);
+    return result;
+}
+
+extern "C" {
+
+/*
+ * NAME:	ipaddr->run()
+ * DESCRIPTION:	host name lookup thread
+ */
+static void *ipa_run(void *arg)
+{
+    char buf[sizeof(in46addr)];
+    struct pipes *inout;
+    struct hostent *host;
+    int len;
+
+    inout = (pipes *) arg;
+
+    while (read(inout->in, buf, sizeof(in46addr)) > 0) {
+	/* lookup host */
+# ifdef INET6
+	if (((in46addr *) &buf)->ipv6) {
+	    host = gethostbyaddr(buf, sizeof(struct in6_addr), AF_INET6);
+	    if (host == (struct hostent *) NULL) {
+		sleep(2);
+		host = gethostbyaddr(buf, sizeof(struct in6_addr), AF_INET6);
+	    }
+	} else
+# endif
+	{
+	    host = gethostbyaddr(buf, sizeof(struct in_addr), AF_INET);
+	    if (host == (struct hostent *) NULL) {
+		sleep(2);
+		host = gethostbyaddr(buf, sizeof(struct in_addr), AF_INET);
+	    }
+	}
+
+	if (host != (struct hostent *) NULL) {
+	    char *name;
+
+	    /* write host name */
+	    name = (char *) host->h_name;
+	    len = strlen(name);
+	    if (len >= MAXHOSTNAMELEN) {
+		len = MAXHOSTNAMELEN - 1;
+	    }
+	    (void) write(inout->out, name, len);
+	    name[0] = '\0';
+	} else {
+	    (void) write(inout->out, "", 1);	/* failure */
+	}
+    }
+
+    close(inout->in);
+    close(inout->out);
+    return NULL;
+}
+
+}
+
+/*
+ * NAME:	ipaddr->init()
+ * DESCRIPTION:	initialize name lookup
+ */
+static bool ipa_init(int maxusers)
+{
+    if (in < 0) {
+	int fd[4];
+
+	if (pipe(fd) < 0) {
+	    perror("pipe");
+	    return FALSE;
+	}
+	if (pipe(fd + 2) < 0) {
+	    perror("pipe");
+	    close(fd[0]);
+	    close(fd[1]);
+	    return FALSE;
+	}
+	inout.in = fd[0];
+	inout.out = fd[3];
+	if (conn_thread(&lookup, &ipa_run, &inout) < 0) {
+	    perror("pthread_create");
+	    close(fd[0]);
+	    close(fd[1]);
+	    close(fd[2]);
+	    close(fd[3]);
+	    return FALSE;
+	}
+	in = fd[2];
+	out = fd[1];
+    } else if (busy) {
+	char buf[MAXHOSTNAMELEN];
+
+	/* discard ip name */
+	(void) read(in, buf, MAXHOSTNAMELEN);
+    }
+
+    ipahtab = ALLOC(ipaddr*, ipahtabsz = maxusers);
+    memset(ipahtab, '\0', ipahtabsz * sizeof(ipaddr*));
+    qhead = qtail = ffirst = flast = lastreq = (ipaddr *) NULL;
+    nfree = 0;
+    busy = FALSE;
+
+    return TRUE;
+}
+
+/*
+ * NAME:	ipaddr->finish()
+ * DESCRIPTION:	stop name lookup
+ */
+static void ipa_finish()
+{
+    close(out);
+    close(in);
+}
+
+/*
+ * NAME:	ipaddr->new()
+ * DESCRIPTION:	return a new ipaddr
+ */
+static ipaddr *ipa_new(in46addr *ipnum)
+{
+    ipaddr *ipa, **hash;
+
+    /* check hash table */
+# ifdef INET6
+    if (ipnum->ipv6) {
+	hash = &ipahtab[Hashtab::hashmem((char *) ipnum,
+					 sizeof(struct in6_addr)) % ipahtabsz];
+    } else
+# endif
+    {
+	hash = &ipahtab[(Uint) ipnum->in.addr.s_addr % ipahtabsz];
+    }
+    while (*hash != (ipaddr *) NULL) {
+	ipa = *hash;
+# ifdef INET6
+	if (ipnum->ipv6 == ipa->ipnum.ipv6 &&
+	    ((ipnum->ipv6) ?
+	      memcmp(&ipnum->in.addr6, &ipa->ipnum.in.addr6,
+		     sizeof(struct in6_addr)) == 0 :
+	      ipnum->in.addr.s_addr == ipa->ipnum.in.addr.s_addr)) {
+# else
+	if (ipnum->in.addr.s_addr == ipa->ipnum.in.addr.s_addr) {
+# endif
+	    /*
+	     * found it
+	     */
+	    if (ipa->ref == 0) {
+		/* remove from free list */
+		if (ipa->prev == (ipaddr *) NULL) {
+		    ffirst = ipa->next;
+		} else {
+		    ipa->prev->next = ipa->next;
+		}
+		if (ipa->next == (ipaddr *) NULL) {
+		    flast = ipa->prev;
+		} else {
+		    ipa->next->prev = ipa->prev;
+		}
+		ipa->prev = ipa->next = (ipaddr *) NULL;
+		--nfree;
+	    }
+	    ipa->ref++;
+
+	    if (ipa->name[0] == '\0' && ipa != lastreq &&
+		ipa->prev == (ipaddr *) NULL && ipa != qhead) {
+		if (!busy) {
+		    /* send query to name resolver */
+		    (void) write(out, (char *) ipnum, sizeof(in46addr));
+		    lastreq = ipa;
+		    busy = TRUE;
+		} else {
+		    /* put in request queue */
+		    ipa->prev = qtail;
+		    if (qtail == (ipaddr *) NULL) {
+			qhead = ipa;
+		    } else {
+			qtail->next = ipa;
+		    }
+		    qtail = ipa;
+		}
+	    }
+	    return ipa;
+	}
+	hash = &ipa->link;
+    }
+
+    if (nfree >= NFREE) {
+	ipaddr **h;
+
+	/*
+	 * use first ipaddr in free list
+	 */
+	ipa = ffirst;
+	ffirst = ipa->next;
+	ffirst->prev = (ipaddr *) NULL;
+	--nfree;
+
+	if (ipa == lastreq) {
+	    lastreq = (ipaddr *) NULL;
+	}
+
+	if (hash != &ipa->link) {
+	    /* remove from hash table */
+# ifdef INET6
+	    if (ipa->ipnum.ipv6) {
+		h = &ipahtab[Hashtab::hashmem((char *) &ipa->ipnum,
+					      sizeof(struct in6_addr)) %
+								    ipahtabsz];
+	    } else
+# endif
+	    {
+		h = &ipahtab[(Uint) ipa->ipnum.in.addr.s_addr % ipahtabsz];
+	    }
+	    while (*h != ipa) {
+		h = &(*h)->link;
+	    }
+	    *h = ipa->link;
+
+	    /* put in hash table */
+	    ipa->link = *hash;
+	    *hash = ipa;
+	}
+    } else {
+	/*
+	 * allocate new ipaddr
+	 */
+	m_static();
+	ipa = ALLOC(ipaddr, 1);
+	m_dynamic();
+
+	/* put in hash table */
+	ipa->link = *hash;
+	*hash = ipa;
+    }
+
+    ipa->ref = 1;
+    ipa->ipnum = *ipnum;
+    ipa->name[0] = '\0';
+    ipa->prev = ipa->next = (ipaddr *) NULL;
+
+    if (!busy) {
+	/* send query to name resolver */
+	(void) write(out, (char *) ipnum, sizeof(in46addr));
+	lastreq = ipa;
+	busy = TRUE;
+    } else {
+	/* put in request queue */
+	ipa->prev = qtail;
+	if (qtail == (ipaddr *) NULL) {
+	    qhead = ipa;
+	} else {
+	    qtail->next = ipa;
+	}
+	qtail = ipa;
+    }
+
+    return ipa;
+}
+
+/*
+ * NAME:	ipaddr->del()
+ * DESCRIPTION:	delete an ipaddr
+ */
+static void ipa_del(ipaddr *ipa)
+{
+    if (--ipa->ref == 0) {
+	if (ipa->prev != (ipaddr *) NULL || qhead == ipa) {
+	    /* remove from queue */
+	    if (ipa->prev != (ipaddr *) NULL) {
+		ipa->prev->next = ipa->next;
+	    } else {
+		qhead = ipa->next;
+	    }
+	    if (ipa->next != (ipaddr *) NULL) {
+		ipa->next->prev = ipa->prev;
+	    } else {
+		qtail = ipa->prev;
+	    }
+	}
+
+	/* add to free list */
+	if (flast != (ipaddr *) NULL) {
+	    flast->next = ipa;
+	    ipa->prev = flast;
+	    flast = ipa;
+	} else {
+	    ffirst = flast = ipa;
+	    ipa->prev = (ipaddr *) NULL;
+	}
+	ipa->next = (ipaddr *) NULL;
+	nfree++;
+    }
+}
+
+/*
+ * NAME:	ipaddr->lookup()
+ * DESCRIPTION:	lookup another ip name
+ */
+static void ipa_lookup()
+{
+    ipaddr *ipa;
+
+    if (lastreq != (ipaddr *) NULL) {
+	/* read ip name */
+	lastreq->name[read(in, lastreq->name, MAXHOSTNAMELEN)] = '\0';
+    } else {
+	char buf[MAXHOSTNAMELEN];
+
+	/* discard ip name */
+	(void) read(in, buf, MAXHOSTNAMELEN);
+    }
+
+    /* if request queue not empty, write new query */
+    if (qhead != (ipaddr *) NULL) {
+	ipa = qhead;
+	(void) write(out, (char *) &ipa->ipnum, sizeof(in46addr));
+	qhead = ipa->next;
+	if (qhead == (ipaddr *) NULL) {
+	    qtail = (ipaddr *) NULL;
+	} else {
+	    qhead->prev = (ipaddr *) NULL;
+	}
+	ipa->prev = ipa->next = (ipaddr *) NULL;
+	lastreq = ipa;
+	busy = TRUE;
+    } else {
+	lastreq = (ipaddr *) NULL;
+	busy = FALSE;
+    }
+}
+
+struct netbuf;
+
+struct connection : public Hashtab::Entry {
+    int fd;				/* file descriptor */
+    int owner;				/* index of owning user */
+# ifdef EPOLL
+    connection *rprev;			/* previous in ready list */
+    connection *rnext;			/* next in ready list */
+# endif
+# ifdef NETTHREAD
+    netbuf *net;			/* buffers shared with the I/O thread */
+    int kicked;				/* queued for the I/O thread */
+    int readied;			/* queued for the interpreter */
+# endif
+    int npkts;				/* # packets in buffer */
+    int bufsz;				/* # bytes in buffer */
+    char *udpbuf;			/* datagram buffer */
+    ipaddr *addr;			/* internet address of connection */
+    unsigned short port;		/* UDP port of connection */
+    short at;				/* port connection was accepted at */
+};
+
+struct portdesc {
+    int in6;				/* IPv6 port descriptor */
+    int in4;				/* IPv4 port descriptor */
+};
+
+struct udpdesc {
+    struct portdesc fd;			/* port descriptors */
+    in46addr addr;			/* source of new packet */
+    unsigned short port;		/* source port of new datagram */
+    bool accept;			/* datagram ready to accept? */
+    unsigned short hashval;		/* address hash */
+    int size;				/* size in buffer */
+    char buffer[BINBUF_SIZE];		/* buffer */
+};
+
+static connection **udphtab;		/* UDP hash table */
+static int udphtabsz;			/* UDP hash table size */
+static Hashtab *chtab;			/* challenge hash table */
+static udpdesc *udescs;			/* UDP port descriptor array */
+static int nudescs;			/* # datagram ports */
+static int inpkts, outpkts;		/* UDP packet notification pipe */
+static pthread_t udp;			/* UDP thread */
+static pthread_mutex_t udpmutex;	/* UDP mutex */
+static bool udpstop;			/* stop UDP thread? */
+
+# ifdef INET6
+/*
+ * NAME:	udp->recv6()
+ * DESCRIPTION:	receive an UDP packet
+ */
+static void udp_recv6(int n)
+{
+    char buffer[BINBUF_SIZE];
+    struct sockaddr_in6 from;
+    socklen_t fromlen;
+    int size;
+    unsigned short hashval;
+    connection **hash, *conn;
+    char *p;
+
+    memset(buffer, '\0', UDPHASHSZ);
+    fromlen = sizeof(struct sockaddr_in6);
+    size = recvfrom(udescs[n].fd.in6, buffer, BINBUF_SIZE, 0,
+		    (struct sockaddr *) &from, &fromlen);
+    if (size < 0) {
+	return;
+    }
+
+    hashval = (Hashtab::hashmem((char *) &from.sin6_addr,
+				sizeof(struct in6_addr)) ^ from.sin6_port) %
+								    udphtabsz;
+    hash = &udphtab[hashval];
+    pthread_mutex_lock(&udpmutex);
+    for (;;) {
+	conn = *hash;
+	if (conn == (connection *) NULL) {
+	    if (!conf_attach(n)) {
+		if (!udescs[n].accept) {
+		    if (IN6_IS_ADDR_V4MAPPED(&from.sin6_addr)) {
+			/* convert to IPv4 address */
+			udescs[n].addr.in.addr = *(struct in_addr *)
+						    &from.sin6_addr.s6_addr[12];
+			udescs[n].addr.ipv6 = FALSE;
+		    } else {
+			udescs[n].addr.in.addr6 = from.sin6_addr;
+			udescs[n].addr.ipv6 = TRUE;
+		    }
+		    udescs[n].port = from.sin6_port;
+		    udescs[n].hashval = hashval;
+		    udescs[n].size = size;
+		    memcpy(udescs[n].buffer, buffer, size);
+		    udescs[n].accept = TRUE;
+		    write(outpkts, buffer, 1);
+		}
+		break;
+	    }
+
+	    /*
+	     * see if the packet matches an outstanding challenge
+	     */
+	    hash = (connection **) chtab->lookup(buffer, FALSE);
+	    while ((conn=*hash) != (connection *) NULL &&
+		   memcmp(conn->name, buffer, UDPHASHSZ) == 0) {
+		if (conn->bufsz == size &&
+		    memcmp(conn->udpbuf, buffer, size) == 0 &&
+		    conn->addr->ipnum.ipv6 &&
+		    memcmp(&conn->addr->ipnum, &from.sin6_addr,
+			   sizeof(struct in6_addr)) == 0) {
+		    /*
+		     * attach new UDP channel
+		     */
+		    *hash = (connection *) conn->next;
+		    conn->name = (char *) NULL;
+		    conn->bufsz = 0;
+		    conn->port = from.sin6_port;
+		    hash = &udphtab[hashval];
+		    conn->next = *hash;
+		    *hash = conn;
+
+		    break;
+		}
+		hash = (connection **) &conn->next;
+	    }
+	    break;
+	}
+
+	if (conn->at == n && conn->port == from.sin6_port &&
+	    memcmp(&conn->addr->ipnum, &from.sin6_addr,
+		   sizeof(struct in6_addr)) == 0) {
+	    /*
+	     * packet from known correspondent
+	     */
+	    if (conn->bufsz + size <= BINBUF_SIZE) {
+		p = conn->udpbuf + conn->bufsz;
+		*p++ = size >> 8;
+		*p++ = size;
+		memcpy(p, buffer, size);
+		conn->bufsz += size + 2;
+		conn->npkts++;
+		write(outpkts, buffer, 1);
+	    }
+	    break;
+	}
+	hash = (connection **) &conn->next;
+    }
+    pthread_mutex_unlock(&udpmutex);
+}
+# endif
+
+/*
+ * NAME:	udp->recv()
+ * DESCRIPTION:	receive an UDP packet
+ */
+static void udp_recv(int n)
+{
+    char buffer[BINBUF_SIZE];
+    struct sockaddr_in from;
+    socklen_t fromlen;
+    int size;
+    unsigned short hashval;
+    connection **hash, *conn;
+    char *p;
+
+    memset(buffer, '\0', UDPHASHSZ);
+    fromlen = sizeof(struct sockaddr_in);
+    size = recvfrom(udescs[n].fd.in4, buffer, BINBUF_SIZE, 0,
+		    (struct sockaddr *) &from, &fromlen);
+    if (size < 0) {
+	return;
+    }
+
+    hashval = ((Uint) from.sin_addr.s_addr ^ from.sin_port) % udphtabsz;
+    hash = &udphtab[hashval];
+    pthread_mutex_lock(&udpmutex);
+    for (;;) {
+	conn = *hash;
+	if (conn == (connection *) NULL) {
+	    if (!conf_attach(n)) {
+		if (!udescs[n].accept) {
+		    udescs[n].addr.in.addr = from.sin_addr;
+		    udescs[n].addr.ipv6 = FALSE;
+		    udescs[n].port = from.sin_port;
+		    udescs[n].hashval = hashval;
+		    udescs[n].size = size;
+		    memcpy(udescs[n].buffer, buffer, size);
+		    udescs[n].accept = TRUE;
+		    write(outpkts, buffer, 1);
+		}
+		break;
+	    }
+
+	    /*
+	     * see if the packet matches an outstanding challenge
+	     */
+	    hash = (connection **) chtab->lookup(buffer, FALSE);
+	    while ((conn=*hash) != (connection *) NULL &&
+		   memcmp((*hash)->name, buffer, UDPHASHSZ) == 0) {
+		if (conn->bufsz == size &&
+		    memcmp(conn->udpbuf, buffer, size) == 0 &&
+		    !conn->addr->ipnum.ipv6 &&
+		    conn->addr->ipnum.in.addr.s_addr == from.sin_addr.s_addr) {
+		    /*
+		     * attach new UDP channel
+		     */
+		    *hash = (connection *) conn->next;
+		    conn->name = (char *) NULL;
+		    conn->bufsz = 0;
+		    conn->port = from.sin_port;
+		    hash = &udphtab[hashval];
+		    conn->next = *hash;
+		    *hash = conn;
+
+		    break;
+		}
+		hash = (connection **) &conn->next;
+	    }
+	    break;
+	}
+
+	if (conn->at == n &&
+	    conn->addr->ipnum.in.addr.s_addr == from.sin_addr.s_addr &&
+	    conn->port == from.sin_port) {
+	    /*
+	     * packet from known correspondent
+	     */
+	    if (conn->bufsz + size <= BINBUF_SIZE) {
+		p = conn->udpbuf + conn->bufsz;
+		*p++ = size >> 8;
+		*p++ = size;
+		memcpy(p, buffer, size);
+		conn->bufsz += size + 2;
+		conn->npkts++;
+		write(outpkts, buffer, 1);
+	    }
+	    break;
+	}
+	hash = (connection **) &conn->next;
+    }
+    pthread_mutex_unlock(&udpmutex);
+}
+
+extern "C" {
+
+/*
+ * NAME:	udp->run()
+ * DESCRIPTION:	UDP thread
+ */
+static void *udp_run(void *arg)
+{
+    fd_set udpfds;
+    fd_set readfds;
+    fd_set errorfds;
+    int maxufd, n, retval;
+
+    FD_ZERO(&udpfds);
+    maxufd = 0;
+    for (n = 0; n < nudescs; n++) {
+# ifdef INET6
+	if (udescs[n].fd.in6 >= 0) {
+	    FD_SET(udescs[n].fd.in6, &udpfds);
+	    if (udescs[n].fd.in6 > maxufd) {
+		maxufd = udescs[n].fd.in6;
+	    }
+	}
+# endif
+	if (udescs[n].fd.in4 >= 0) {
+	    FD_SET(udescs[n].fd.in4, &udpfds);
+	    if (udescs[n].fd.in4 > maxufd) {
+		maxufd = udescs[n].fd.in4;
+	    }
+	}
+    }
+
+    for (;;) {
+	memcpy(&readfds, &udpfds, sizeof(fd_set));
+	memcpy(&errorfds, &udpfds, sizeof(fd_set));
+	retval = select(maxufd + 1, &readfds, (fd_set *) NULL, &errorfds,
+		        (struct timeval *) NULL);
+	if (udpstop) {
+	    break;
+	}
+
+	if (retval > 0) {
+	    for (n = 0; n < nudescs; n++) {
+# ifdef INET6
+		if (udescs[n].fd.in6 >= 0 &&
+		    FD_ISSET(udescs[n].fd.in6, &readfds)) {
+		    udp_recv6(n);
+		}
+# endif
+		if (udescs[n].fd.in4 >= 0 &&
+		    FD_ISSET(udescs[n].fd.in4, &readfds)) {
+		    udp_recv(n);
+		}
+	    }
+	}
+    }
+
+    pthread_mutex_destroy(&udpmutex);
+    close(inpkts);
+    close(outpkts);
+    return (void *) NULL;
+}
+
+}
+
+# define CONN_READF	0x01	/* read flag set */
+# define CONN_WRITEF	0x02	/* write flag set */
+# define CONN_WAITF	0x04	/* wait flag set */
+# define CONN_UCHAL	0x08	/* UDP challenge issued */
+# define CONN_UCHAN	0x10	/* UDP channel established */
+# define CONN_ADDR	0x20	/* has an address */
+# define CONN_BLOCKF	0x40	/* input blocked (not exported) */
+
+static int nusers;			/* # of users */
+static connection *connections;		/* connections array */
+static connection *flist;		/* list of free connections */
+static portdesc *tdescs, *bdescs;	/* telnet & binary descriptor arrays */
+static int ntdescs, nbdescs;		/* # telnet & binary ports */
+# ifdef EPOLL
+struct fdstate {
+    connection *conn;			/* connection using this descriptor */
+    char flags;				/* readiness flags */
+};
+
+# define NEVENTS	256		/* max # of events per epoll_wait() */
+
+static int epfd;			/* epoll descriptor */
+static fdstate *fdtab;			/* file descriptor state table */
+static int fdtabsz;			/* size of file descriptor state table */
+static connection *rhead, *rtail;	/* list of ready connections */
+# else
+static fd_set infds;			/* file descriptor input bitmap */
+static fd_set outfds;			/* file descriptor output bitmap */
+static fd_set waitfds;			/* file descriptor wait-write bitmap */
+static fd_set readfds;			/* file descriptor read bitmap */
+static fd_set writefds;			/* file descriptor write map */
+static int maxfd;			/* largest fd opened yet */
+static int nextrdy;			/* next connection to check if ready */
+# endif
+static int closed;			/* #fds closed in write */
+# ifdef NETTHREAD
+# define NETIN_SIZE	16384		/* size of network input ring */
+# define NETOUT_SIZE	65536		/* size of network output ring */
+# define NET_LINGER	60		/* seconds to flush output after close */
+
+/* I/O thread state */
+# define NET_EOF	0x01	/* end of input, or read error */
+# define NET_ERROR	0x02	/* write error */
+# define NET_RFULL	0x04	/* input ring full, reading suspended */
+# define NET_WAIT	0x08	/* interpreter waiting for output space */
+
+struct ringbuf {
+    Uint head;				/* consumer position */
+    Uint tail;				/* producer position */
+    Uint size;				/* size of buffer, a power of 2 */
+    char *buf;				/* ring buffer */
+};
+
+struct netbuf {
+    ringbuf in;				/* input, filled by the I/O thread */
+    ringbuf out;			/* output, drained by the I/O thread */
+    netbuf *next;			/* next in close or linger list */
+    int fd;				/* file descriptor */
+    int index;				/* connection index, -1 when closed */
+    int state;				/* I/O thread state */
+    bool linger;			/* flush output before closing */
+    time_t expire;			/* end of linger period */
+};
+
+struct netqueue {
+    int *idx;				/* connection indices */
+    int size;				/* size of queue */
+    int head;				/* consumer position */
+    int tail;				/* producer position */
+};
+
+static int netfd;			/* I/O thread epoll descriptor */
+static int netwake[2];			/* pipe to wake up the I/O thread */
+static int netready[2];			/* pipe to wake up the interpreter */
+static netqueue kickq;			/* connections for the I/O thread */
+static netqueue readyq;			/* connections for the interpreter */
+static netbuf *netclose;		/* connections closed by interpreter */
+static netbuf *netlinger;		/* closed connections flushing output */
+static bool netnotify;			/* wake up the interpreter? */
+static int netidle;			/* I/O thread waiting for events? */
+static bool netstop;			/* stop I/O thread? */
+static pthread_t netthread;		/* I/O thread */
+static pthread_mutex_t netmutex;	/* I/O thread mutex */
+# endif
+
+# ifdef EPOLL
+# define FD_READY(fd, f)	(fdtab[fd].flags & (f))
+# define FD_MARK(fd, f)		(fdtab[fd].flags |= (f))
+# define FD_UNMARK(fd, f)	(fdtab[fd].flags &= ~(f))
+
+/*
+ * NAME:	conn->rdyadd()
+ * DESCRIPTION:	add a connection to the ready list
+ */
+static void conn_rdyadd(connection *conn)
+{
+    if (conn->rprev == (connection *) NULL && rhead != conn) {
+	conn->rnext = (connection *) NULL;
+	if (rtail != (connection *) NULL) {
+	    rtail->rnext = conn;
+	    conn->rprev = rtail;
+	} else {
+	    rhead = conn;
+	}
+	rtail = conn;
+    }
+}
+
+/*
+ * NAME:	conn->rdydel()
+ * DESCRIPTION:	remove a connection from the ready list
+ */
+static void conn_rdydel(connection *conn)
+{
+    if (conn->rprev != (connection *) NULL || rhead == conn) {
+	if (conn->rprev != (connection *) NULL) {
+	    conn->rprev->rnext = conn->rnext;
+	} else {
+	    rhead = conn->rnext;
+	}
+	if (conn->rnext != (connection *) NULL) {
+	    conn->rnext->rprev = conn->rprev;
+	} else {
+	    rtail = conn->rprev;
+	}
+	conn->rprev = conn->rnext = (connection *) NULL;
+    }
+}
+# else
+# define FD_READY(fd, f)	FD_ISSET(fd, conn_fdset(f))
+# define FD_MARK(fd, f)		FD_SET(fd, conn_fdset(f))
+# define FD_UNMARK(fd, f)	FD_CLR(fd, conn_fdset(f))
+
+/*
+ * NAME:	conn->fdset()
+ * DESCRIPTION:	return the bitmap corresponding to a readiness flag
+ */
+static fd_set *conn_fdset(int flag)
+{
+    switch (flag) {
+    case CONN_READF:
+	return &readfds;
+
+    case CONN_WRITEF:
+	return &writefds;
+
+    default:
+	return &waitfds;
+    }
+}
+# endif
+
+/*
+ * NAME:	conn->watch()
+ * DESCRIPTION:	start watching a file descriptor, edge-triggered if possible
+ */
+static void conn_watch(int fd, connection *conn, bool edge)
+{
+# ifdef EPOLL
+    struct epoll_event ev;
+
+    if (fd >= fdtabsz) {
+	int size;
+
+	size = (fd < 2 * fdtabsz) ? 2 * fdtabsz : fd + 1;
+	fdtab = REALLOC(fdtab, fdstate, fdtabsz, size);
+	memset(fdtab + fdtabsz, '\0', (size - fdtabsz) * sizeof(fdstate));
+	fdtabsz = size;
+    }
+    fdtab[fd].conn = conn;
+    fdtab[fd].flags = 0;
+
+    memset(&ev, '\0', sizeof(struct epoll_event));
+    ev.events = (conn != (connection *) NULL) ? EPOLLIN | EPOLLOUT : EPOLLIN;
+    if (edge) {
+	ev.events |= EPOLLET;
+    }
+    ev.data.fd = fd;
+# ifdef NETTHREAD
+    if (conn != (connection *) NULL && conn->net != (netbuf *) NULL) {
+	/* reading and writing is done by the I/O thread */
+	ev.data.ptr = conn->net;
+	if (epoll_ctl(netfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+	    perror("epoll_ctl");
+	}
+	return;
+    }
+# endif
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+	perror("epoll_ctl");
+    }
+# else
+    UNREFERENCED_PARAMETER(edge);
+
+    FD_SET(fd, &infds);
+    if (conn != (connection *) NULL) {
+	FD_SET(fd, &outfds);
+    }
+    if (fd > maxfd) {
+	maxfd = fd;
+    }
+# endif
+}
+
+/*
+ * NAME:	conn->unwatch()
+ * DESCRIPTION:	stop watching a file descriptor, before it is closed
+ */
+static void conn_unwatch(int fd)
+{
+# ifdef EPOLL
+    struct epoll_event ev;
+
+    epoll_ctl(epfd, EPOLL_CTL_DEL, fd, &ev);
+    fdtab[fd].conn = (connection *) NULL;
+    fdtab[fd].flags = 0;
+# else
+    FD_CLR(fd, &infds);
+    FD_CLR(fd, &outfds);
+    FD_CLR(fd, &waitfds);
+    FD_CLR(fd, &readfds);
+    FD_CLR(fd, &writefds);
+# endif
+}
+
+# ifdef NETTHREAD
+/*
+ * NAME:	ring->iov()
+ * DESCRIPTION:	describe a range of a ring buffer with at most two iovecs
+ */
+static int ring_iov(ringbuf *r, Uint pos, Uint len, struct iovec *iov)
+{
+    Uint offset;
+
+    offset = pos & (r->size - 1);
+    iov[0].iov_base = r->buf + offset;
+    if (offset + len <= r->size) {
+	iov[0].iov_len = len;
+	return 1;
+    }
+    iov[0].iov_len = r->size - offset;
+    iov[1].iov_base = r->buf;
+    iov[1].iov_len = len - (r->size - offset);
+    return 2;
+}
+
+/*
+ * NAME:	ring->used()
+ * DESCRIPTION:	return the number of bytes in a ring buffer
+ */
+static Uint ring_used(ringbuf *r)
+{
+    return __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) -
+	   __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+}
+
+/*
+ * NAME:	ring->put()
+ * DESCRIPTION:	add as much as fits to a ring buffer, as the producer
+ */
+static Uint ring_put(ringbuf *r, struct iovec *iov, int iovcnt)
+{
+    struct iovec riov[2];
+    Uint tail, space, len, size;
+    char *p;
+    int i, n;
+
+    tail = r->tail;
+    space = r->size - (tail - __atomic_load_n(&r->head, __ATOMIC_ACQUIRE));
+    for (size = 0; iovcnt > 0 && space != 0; iov++, --iovcnt) {
+	p = (char *) iov->iov_base;
+	len = (iov->iov_len < space) ? iov->iov_len : space;
+	if (len == 0) {
+	    continue;
+	}
+	n = ring_iov(r, tail, len, riov);
+	for (i = 0; i < n; i++) {
+	    memcpy(riov[i].iov_base, p, riov[i].iov_len);
+	    p += riov[i].iov_len;
+	}
+	tail += len;
+	space -= len;
+	size += len;
+    }
+    __atomic_store_n(&r->tail, tail, __ATOMIC_RELEASE);
+
+    return size;
+}
+
+/*
+ * NAME:	ring->get()
+ * DESCRIPTION:	take bytes from a ring buffer, as the consumer
+ */
+static Uint ring_get(ringbuf *r, char *buf, Uint len)
+{
+    struct iovec riov[2];
+    Uint head, size;
+    int i, n;
+
+    head = r->head;
+    size = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) - head;
+    if (size > len) {
+	size = len;
+    }
+    if (size != 0) {
+	n = ring_iov(r, head, size, riov);
+	for (i = 0; i < n; i++) {
+	    memcpy(buf, riov[i].iov_base, riov[i].iov_len);
+	    buf += riov[i].iov_len;
+	}
+	__atomic_store_n(&r->head, head + size, __ATOMIC_RELEASE);
+    }
+
+    return size;
+}
+
+/*
+ * NAME:	netqueue->put()
+ * DESCRIPTION:	add a connection index to a queue, as the producer
+ */
+static void netq_put(netqueue *q, int i)
+{
+    int tail;
+
+    tail = q->tail;
+    q->idx[tail] = i;
+    __atomic_store_n(&q->tail, (tail + 1) % q->size, __ATOMIC_RELEASE);
+}
+
+/*
+ * NAME:	netqueue->get()
+ * DESCRIPTION:	take a connection index from a queue, as the consumer;
+ *		return -1 if the queue is empty
+ */
+static int netq_get(netqueue *q)
+{
+    int head, i;
+
+    head = q->head;
+    if (head == __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE)) {
+	return -1;
+    }
+    i = q->idx[head];
+    __atomic_store_n(&q->head, (head + 1) % q->size, __ATOMIC_RELEASE);
+    return i;
+}
+
+/*
+ * NAME:	net->notify()
+ * DESCRIPTION:	tell the interpreter to look at a connection
+ */
+static void net_notify(netbuf *net)
+{
+    connection *conn;
+
+    if (net->index >= 0) {
+	conn = &connections[net->index];
+	if (__atomic_exchange_n(&conn->readied, 1, __ATOMIC_SEQ_CST) == 0) {
+	    netq_put(&readyq, net->index);
+	    netnotify = TRUE;
+	}
+    }
+}
+
+/*
+ * NAME:	net->fill()
+ * DESCRIPTION:	read from a connection until the socket or the input ring
+ *		is exhausted
+ */
+static void net_fill(netbuf *net)
+{
+    struct iovec iov[2];
+    Uint head, tail;
+    int size;
+
+    if (__atomic_load_n(&net->state, __ATOMIC_SEQ_CST) & NET_EOF) {
+	return;
+    }
+    for (;;) {
+	head = __atomic_load_n(&net->in.head, __ATOMIC_SEQ_CST);
+	tail = net->in.tail;
+	if (tail - head == net->in.size) {
+	    /* suspend reading until the interpreter catches up */
+	    __atomic_fetch_or(&net->state, NET_RFULL, __ATOMIC_SEQ_CST);
+	    if (__atomic_load_n(&net->in.head, __ATOMIC_SEQ_CST) == head) {
+		return;
+	    }
+	    __atomic_fetch_and(&net->state, ~NET_RFULL, __ATOMIC_SEQ_CST);
+	    continue;
+	}
+
+	size = readv(net->fd, iov,
+		     ring_iov(&net->in, tail, net->in.size - (tail - head), iov));
+	if (size > 0) {
+	    __atomic_store_n(&net->in.tail, tail + size, __ATOMIC_RELEASE);
+	    net_notify(net);
+	} else if (size == 0 ||
+		   (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK)) {
+	    __atomic_fetch_or(&net->state, NET_EOF, __ATOMIC_SEQ_CST);
+	    net_notify(net);
+	    return;
+	} else if (errno != EINTR) {
+	    return;	/* drained */
+	}
+    }
+}
+
+/*
+ * NAME:	net->drain()
+ * DESCRIPTION:	write the output ring of a connection to the socket
+ */
+static void net_drain(netbuf *net)
+{
+    struct iovec iov[2];
+    Uint head, tail;
+    int size;
+
+    if (__atomic_load_n(&net->state, __ATOMIC_SEQ_CST) & NET_ERROR) {
+	return;
+    }
+    for (;;) {
+	tail = __atomic_load_n(&net->out.tail, __ATOMIC_ACQUIRE);
+	head = net->out.head;
+	if (head == tail) {
+	    break;
+	}
+
+	size = writev(net->fd, iov, ring_iov(&net->out, head, tail - head, iov));
+	if (size > 0) {
+	    __atomic_store_n(&net->out.head, head + size, __ATOMIC_RELEASE);
+	} else if (size == 0 ||
+		   (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK)) {
+	    __atomic_fetch_or(&net->state, NET_ERROR, __ATOMIC_SEQ_CST);
+	    net_notify(net);
+	    return;
+	} else if (errno != EINTR) {
+	    break;	/* socket full */
+	}
+    }
+
+    if ((__atomic_load_n(&net->state, __ATOMIC_SEQ_CST) & NET_WAIT) &&
+	ring_used(&net->out) <= NETOUT_SIZE / 2) {
+	__atomic_fetch_and(&net->state, ~NET_WAIT, __ATOMIC_SEQ_CST);
+	net_notify(net);
+    }
+}
+
+/*
+ * NAME:	net->done()
+ * DESCRIPTION:	close the descriptor of a released connection
+ */
+static void net_done(netbuf *net)
+{
+    struct epoll_event ev;
+
+    epoll_ctl(netfd, EPOLL_CTL_DEL, net->fd, &ev);
+    if (net->linger) {
+	shutdown(net->fd, SHUT_WR);
+    }
+    close(net->fd);
+}
+
+extern "C" {
+
+/*
+ * NAME:	net->run()
+ * DESCRIPTION:	network I/O thread
+ */
+static void *net_run(void *arg)
+{
+    struct epoll_event events[NEVENTS];
+    char buf[64];
+    int retval, timeout, n;
+    netbuf *net, **l;
+    time_t now;
+
+    UNREFERENCED_PARAMETER(arg);
+
+    timeout = 0;
+    for (;;) {
+	retval = epoll_wait(netfd, events, NEVENTS, timeout);
+	__atomic_store_n(&netidle, FALSE, __ATOMIC_SEQ_CST);
+	pthread_mutex_lock(&netmutex);
+	if (netstop) {
+	    pthread_mutex_unlock(&netmutex);
+	    break;
+	}
+	netnotify = FALSE;
+
+	for (n = 0; n < retval; n++) {
+	    net = (netbuf *) events[n].data.ptr;
+	    if (net == (netbuf *) NULL) {
+		/* woken up by the interpreter */
+		while (read(netwake[0], buf, sizeof(buf)) > 0) ;
+		continue;
+	    }
+	    if (net->index >= 0 &&
+		(events[n].events & (EPOLLIN | EPOLLHUP | EPOLLERR))) {
+		net_fill(net);
+	    }
+	    if (events[n].events & (EPOLLOUT | EPOLLHUP | EPOLLERR)) {
+		net_drain(net);
+	    }
+	}
+
+	/* connections with new output, or room for more input */
+	while ((n = netq_get(&kickq)) >= 0) {
+	    __atomic_store_n(&connections[n].kicked, 0, __ATOMIC_SEQ_CST);
+	    net = connections[n].net;
+	    if (net != (netbuf *) NULL) {
+		net_fill(net);
+		net_drain(net);
+	    }
+	}
+
+	/* connections closed by the interpreter */
+	while (netclose != (netbuf *) NULL) {
+	    net = netclose;
+	    netclose = net->next;
+	    net->next = netlinger;
+	    netlinger = net;
+	    net->expire = 0;
+	}
+	if (netlinger != (netbuf *) NULL) {
+	    now = time((time_t *) NULL);
+	    for (l = &netlinger; (net=*l) != (netbuf *) NULL; ) {
+		if (net->linger) {
+		    net_drain(net);
+		    if (net->expire == 0) {
+			net->expire = now + NET_LINGER;
+		    }
+		}
+		if (!net->linger || ring_used(&net->out) == 0 ||
+		    (net->state & NET_ERROR) || now >= net->expire) {
+		    *l = net->next;
+		    net_done(net);
+		    free(net);
+		} else {
+		    l = &net->next;
+		}
+	    }
+	}
+
+	/*
+	 * Announce going idle before checking for more work, so that either
+	 * this thread sees the work, or the interpreter wakes it up.
+	 */
+	__atomic_store_n(&netidle, TRUE, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&kickq.tail, __ATOMIC_SEQ_CST) != kickq.head ||
+	    netclose != (netbuf *) NULL) {
+	    timeout = 0;
+	} else {
+	    timeout = (netlinger != (netbuf *) NULL) ? 1000 : -1;
+	}
+	pthread_mutex_unlock(&netmutex);
+
+	if (netnotify) {
+	    (void) write(netready[1], "", 1);
+	}
+    }
+
+    return (void *) NULL;
+}
+
+}
+
+/*
+ * NAME:	net->init()
+ * DESCRIPTION:	start the network I/O thread
+ */
+static bool net_init(int maxusers)
+{
+    struct epoll_event ev;
+
+    netfd = epoll_create1(EPOLL_CLOEXEC);
+    if (netfd < 0) {
+	perror("epoll_create1");
+	return FALSE;
+    }
+    if (pipe(netwake) < 0 || pipe(netready) < 0) {
+	perror("pipe");
+	return FALSE;
+    }
+    fcntl(netwake[0], F_SETFL, O_NONBLOCK);
+    fcntl(netwake[1], F_SETFL, O_NONBLOCK);
+    fcntl(netready[0], F_SETFL, O_NONBLOCK);
+    fcntl(netready[1], F_SETFL, O_NONBLOCK);
+
+    kickq.idx = ALLOC(int, kickq.size = maxusers + 1);
+    kickq.head = kickq.tail = 0;
+    readyq.idx = ALLOC(int, readyq.size = maxusers + 1);
+    readyq.head = readyq.tail = 0;
+    netclose = netlinger = (netbuf *) NULL;
+    netidle = FALSE;
+    netstop = FALSE;
+
+    memset(&ev, '\0', sizeof(struct epoll_event));
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;
+    if (epoll_ctl(netfd, EPOLL_CTL_ADD, netwake[0], &ev) < 0) {
+	perror("epoll_ctl");
+	return FALSE;
+    }
+    conn_watch(netready[0], (connection *) NULL, FALSE);
+
+    pthread_mutex_init(&netmutex, NULL);
+    if (conn_thread(&netthread, &net_run, (void *) NULL) != 0) {
+	perror("pthread_create");
+	return FALSE;
+    }
+    return TRUE;
+}
+
+/*
+ * NAME:	net->wake()
+ * DESCRIPTION:	wake up the I/O thread, if it is waiting for events
+ */
+static void net_wake()
+{
+    if (__atomic_exchange_n(&netidle, FALSE, __ATOMIC_SEQ_CST)) {
+	(void) write(netwake[1], "", 1);
+    }
+}
+
+/*
+ * NAME:	net->kick()
+ * DESCRIPTION:	have the I/O thread service a connection
+ */
+static void net_kick(connection *conn)
+{
+    if (__atomic_exchange_n(&conn->kicked, 1, __ATOMIC_SEQ_CST) == 0) {
+	netq_put(&kickq, conn - connections);
+	net_wake();
+    }
+}
+
+/*
+ * NAME:	net->new()
+ * DESCRIPTION:	hand a new connection to the I/O thread
+ */
+static void net_new(connection *conn, int fd)
+{
+    netbuf *net;
+
+    net = (netbuf *) malloc(sizeof(netbuf) + NETIN_SIZE + NETOUT_SIZE);
+    if (net == (netbuf *) NULL) {
+	fatal("out of memory");
+    }
+    net->in.head = net->in.tail = 0;
+    net->in.size = NETIN_SIZE;
+    net->in.buf = (char *) (net + 1);
+    net->out.head = net->out.tail = 0;
+    net->out.size = NETOUT_SIZE;
+    net->out.buf = net->in.buf + NETIN_SIZE;
+    net->next = (netbuf *) NULL;
+    net->fd = fd;
+    net->index = conn - connections;
+    net->state = 0;
+    net->linger = FALSE;
+
+    pthread_mutex_lock(&netmutex);
+    conn->net = net;
+    pthread_mutex_unlock(&netmutex);
+}
+
+/*
+ * NAME:	net->release()
+ * DESCRIPTION:	let the I/O thread close a connection, after flushing its
+ *		output if linger is set
+ */
+static void net_release(connection *conn, bool linger)
+{
+    netbuf *net;
+
+    fdtab[conn->fd].conn = (connection *) NULL;
+    fdtab[conn->fd].flags = 0;
+
+    pthread_mutex_lock(&netmutex);
+    net = conn->net;
+    net->index = -1;
+    net->linger = linger;
+    net->next = netclose;
+    netclose = net;
+    conn->net = (netbuf *) NULL;
+    pthread_mutex_unlock(&netmutex);
+    net_wake();
+}
+
+/*
+ * NAME:	net->ready()
+ * DESCRIPTION:	update the readiness of connections the I/O thread reported
+ */
+static void net_ready()
+{
+    char buf[64];
+    connection *conn;
+    netbuf *net;
+    int n, state;
+
+    while (read(netready[0], buf, sizeof(buf)) > 0) ;
+    while ((n = netq_get(&readyq)) >= 0) {
+	conn = &connections[n];
+	__atomic_store_n(&conn->readied, 0, __ATOMIC_SEQ_CST);
+	net = conn->net;
+	if (net == (netbuf *) NULL) {
+	    continue;
+	}
+	state = __atomic_load_n(&net->state, __ATOMIC_SEQ_CST);
+	if (ring_used(&net->in) != 0 || (state & (NET_EOF | NET_ERROR))) {
+	    FD_MARK(conn->fd, CONN_READF);
+	}
+	if (ring_used(&net->out) <= NETOUT_SIZE / 2 || (state & NET_ERROR)) {
+	    FD_MARK(conn->fd, CONN_WRITEF);
+	}
+	if ((FD_READY(conn->fd, CONN_READF | CONN_BLOCKF) == CONN_READF) ||
+	    (FD_READY(conn->fd, CONN_WAITF | CONN_WRITEF) ==
+					    (CONN_WAITF | CONN_WRITEF))) {
+	    conn_rdyadd(conn);
+	}
+    }
+}
+
+/*
+ * NAME:	net->read()
+ * DESCRIPTION:	read from the input ring of a connection
+ */
+static int net_read(connection *conn, char *buf, unsigned int len)
+{
+    netbuf *net;
+    int size, state;
+
+    net = conn->net;
+    size = ring_get(&net->in, buf, len);
+    state = __atomic_load_n(&net->state, __ATOMIC_SEQ_CST);
+    if (size == 0) {
+	if (state & (NET_EOF | NET_ERROR)) {
+	    net_release(conn, FALSE);
+	    conn->fd = -1;
+	    closed++;
+	    conn_rdyadd(conn);	/* let the owner discover the close */
+	    return -1;
+	}
+	FD_UNMARK(conn->fd, CONN_READF);
+	return 0;
+    }
+
+    if (state & NET_RFULL) {
+	/* there is room again */
+	__atomic_fetch_and(&net->state, ~NET_RFULL, __ATOMIC_SEQ_CST);
+	net_kick(conn);
+    }
+    if (ring_used(&net->in) != 0 || (state & (NET_EOF | NET_ERROR))) {
+	conn_rdyadd(conn);	/* more input, or end of file to report */
+    } else {
+	FD_UNMARK(conn->fd, CONN_READF);
+    }
+    return size;
+}
+
+/*
+ * NAME:	net->writev()
+ * DESCRIPTION:	add output to the output ring of a connection
+ */
+static int net_writev(connection *conn, struct iovec *iov, int iovcnt,
+		      unsigned int len)
+{
+    netbuf *net;
+    unsigned int size;
+
+    net = conn->net;
+    if (__atomic_load_n(&net->state, __ATOMIC_SEQ_CST) & NET_ERROR) {
+	net_release(conn, FALSE);
+	conn->fd = -1;
+	closed++;
+	conn_rdyadd(conn);
+	return -1;
+    }
+
+    size = ring_put(&net->out, iov, iovcnt);
+    if (size != 0) {
+	net_kick(conn);
+    }
+    if (size != len) {
+	/* waiting for wrdone */
+	FD_MARK(conn->fd, CONN_WAITF);
+	FD_UNMARK(conn->fd, CONN_WRITEF);
+	__atomic_fetch_or(&net->state, NET_WAIT, __ATOMIC_SEQ_CST);
+	if (ring_used(&net->out) <= NETOUT_SIZE / 2) {
+	    /* drained in the meantime */
+	    FD_MARK(conn->fd, CONN_WRITEF);
+	    conn_rdyadd(conn);
+	}
+    }
+    return size;
+}
+
+/*
+ * NAME:	net->stop()
+ * DESCRIPTION:	stop the I/O thread before the connections are exported,
+ *		flushing the output of all connections for up to the linger
+ *		period
+ */
+static void net_stop()
+{
+    struct pollfd *pfds;
+    int i, n;
+    connection *conn;
+    netbuf *net;
+    time_t expire;
+
+    pthread_mutex_lock(&netmutex);
+    netstop = TRUE;
+    pthread_mutex_unlock(&netmutex);
+    net_wake();
+    pthread_join(netthread, (void **) NULL);
+
+    /* connections closed by the interpreter */
+    n = nusers;
+    while (netclose != (netbuf *) NULL) {
+	net = netclose;
+	netclose = net->next;
+	net->next = netlinger;
+	netlinger = net;
+    }
+    for (net = netlinger; net != (netbuf *) NULL; net = net->next) {
+	n++;
+    }
+
+    /*
+     * flush all output rings at once
+     */
+    pfds = ALLOC(struct pollfd, n);
+    expire = time((time_t *) NULL) + NET_LINGER;
+    for (;;) {
+	n = 0;
+	for (i = nusers, conn = connections; i > 0; --i, conn++) {
+	    net = conn->net;
+	    if (net != (netbuf *) NULL) {
+		net_drain(net);
+		if (ring_used(&net->out) != 0 && !(net->state & NET_ERROR)) {
+		    pfds[n].fd = net->fd;
+		    pfds[n++].events = POLLOUT;
+		}
+	    }
+	}
+	for (net = netlinger; net != (netbuf *) NULL; net = net->next) {
+	    if (net->linger) {
+		net_drain(net);
+		if (ring_used(&net->out) != 0 && !(net->state & NET_ERROR)) {
+		    pfds[n].fd = net->fd;
+		    pfds[n++].events = POLLOUT;
+		}
+	    }
+	}
+	if (n == 0 || time((time_t *) NULL) >= expire) {
+	    break;
+	}
+	(void) poll(pfds, n, 1000);
+    }
+    FREE(pfds);
+
+    /* close connections that were closed already */
+    while (netlinger != (netbuf *) NULL) {
+	net = netlinger;
+	netlinger = net->next;
+	net_done(net);
+	free(net);
+    }
+}
+
+/*
+ * NAME:	net->finish()
+ * DESCRIPTION:	stop the I/O thread, flushing what output can be flushed
+ */
+static void net_finish()
+{
+    int n;
+    connection *conn;
+    netbuf *net;
+
+    pthread_mutex_lock(&netmutex);
+    netstop = TRUE;
+    for (n = nusers, conn = connections; n > 0; --n, conn++) {
+	if (conn->net != (netbuf *) NULL) {
+	    net_drain(conn->net);
+	}
+    }
+    while (netclose != (netbuf *) NULL) {
+	net = netclose;
+	netclose = net->next;
+	net->next = netlinger;
+	netlinger = net;
+    }
+    for (net = netlinger; net != (netbuf *) NULL; net = net->next) {
+	if (net->linger) {
+	    net_drain(net);
+	}
+	net_done(net);
+    }
+    netlinger = (netbuf *) NULL;
+    pthread_mutex_unlock(&netmutex);
+    net_wake();
+}
+# endif
+
+/*
+ * NAME:	conn->shut()
+ * DESCRIPTION:	stop watching a connection and close its descriptor, after
+ *		flushing pending output if linger is set
+ */
+static void conn_shut(connection *conn, bool linger)
+{
+# ifdef NETTHREAD
+    if (conn->net != (netbuf *) NULL) {
+	net_release(conn, linger);
+	return;
+    }
+# endif
+    if (linger) {
+	shutdown(conn->fd, SHUT_WR);
+    }
+    conn_unwatch(conn->fd);
+    close(conn->fd);
+}
+
+# ifdef INET6
+/*
+ * NAME:	conn->port6()
+ * DESCRIPTION:	open an IPv6 port
+ */
+static int conn_port6(int *fd, int type, struct sockaddr_in6 *sin6, unsigned int port)
+{
+    int on;
+
+    if ((*fd=socket(AF_INET6, type, 0)) < 0) {
+	perror("socket IPv6");
+	return FALSE;
+    }
+    on = 1;
+    if (setsockopt(*fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) < 0) {
+	perror("setsockopt");
+	return FALSE;
+    }
+# if defined(IPPROTO_IPV6) && defined(IPV6_V6ONLY)
+    on = 1;
+    if (setsockopt(*fd, IPPROTO_IPV6, IPV6_V6ONLY, &on, sizeof(on)) < 0) {
+	perror("setsockopt");
+	return FALSE;
+    }
+# endif
+# ifdef SO_OOBINLINE
+    if (type == SOCK_STREAM) {
+	on = 1;
+	if (setsockopt(*fd, SOL_SOCKET, SO_OOBINLINE, &on, sizeof(on)) < 0) {
+	    perror("setsockopt");
+	    return FALSE;
+	}
+    }
+# endif
+    sin6->sin6_port = htons(port);
+    if (bind(*fd, (struct sockaddr *) sin6, sizeof(struct sockaddr_in6)) < 0) {
+	perror("bind");
+	return FALSE;
+    }
+
+    if (type == SOCK_STREAM) {
+	conn_watch(*fd, (connection *) NULL, TRUE);
+    }
+    return TRUE;
+}
+# endif
+
+/*
+ * NAME:	conn->port()
+ * DESCRIPTION:	open an IPv4 port
+ */
+static int conn_port(int *fd, int type, struct sockaddr_in *sin, unsigned int port)
+{
+    int on;
+
+    if ((*fd=socket(AF_INET, type, 0)) < 0) {
+	perror("socket");
+	return FALSE;
+    }
+    on = 1;
+    if (setsockopt(*fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) < 0) {
+	perror("setsockopt");
+	return FALSE;
+    }
+# ifdef SO_OOBINLINE
+    if (type == SOCK_STREAM) {
+	on = 1;
+	if (setsockopt(*fd, SOL_SOCKET, SO_OOBINLINE, &on, sizeof(on)) < 0) {
+	    perror("setsockopt");
+	    return FALSE;
+	}
+    }
+# endif
+    sin->sin_port = htons(port);
+    if (bind(*fd, (struct sockaddr *) sin, sizeof(struct sockaddr_in)) < 0) {
+	perror("bind");
+	return FALSE;
+    }
+
+    if (type == SOCK_STREAM) {
+	conn_watch(*fd, (connection *) NULL, TRUE);
+    }
+    return TRUE;
+}
+
+/*
+ * NAME:	conn->init()
+ * DESCRIPTION:	initialize connection handling
+ */
+bool conn_init(int maxusers, char **thosts, char **bhosts, char **dhosts,
+	unsigned short *tports, unsigned short *bports, unsigned short *dports,
+	int ntports, int nbports, int ndports)
+{
+# ifdef INET6
+    struct sockaddr_in6 sin6;
+# endif
+    struct sockaddr_in sin;
+    struct hostent *host;
+    int n, fds[2];
+    connection *conn;
+    bool ipv6, ipv4;
+# ifdef AI_DEFAULT
+    int err;
+# endif
+
+    if (!ipa_init(maxusers)) {
+	return FALSE;
+    }
+
+    addrtype = PF_INET;
+
+    nusers = 0;
+
+# ifdef EPOLL
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0) {
+	perror("epoll_create1");
+	return FALSE;
+    }
+    fdtab = ALLOC(fdstate, fdtabsz = 2 * maxusers + 16);
+    memset(fdtab, '\0', fdtabsz * sizeof(fdstate));
+    rhead = rtail = (connection *) NULL;
+# else
+    maxfd = 0;
+    FD_ZERO(&infds);
+    FD_ZERO(&outfds);
+    FD_ZERO(&waitfds);
+    nextrdy = 0;
+# endif
+    conn_watch(in, (connection *) NULL, FALSE);
+    closed = 0;
+
+    pipe(fds);
+    inpkts = fds[0];
+    outpkts = fds[1];
+    conn_watch(inpkts, (connection *) NULL, FALSE);
+
+    ntdescs = ntports;
+    if (ntports != 0) {
+	tdescs = ALLOC(portdesc, ntports);
+	memset(tdescs, -1, ntports * sizeof(portdesc));
+    }
+    nbdescs = nbports;
+    if (nbports != 0) {
+	bdescs = ALLOC(portdesc, nbports);
+	memset(bdescs, -1, nbports * sizeof(portdesc));
+    }
+    nudescs = ndports;
+    if (ndports != 0) {
+	udescs = ALLOC(udpdesc, ndports);
+	memset(udescs, -1, ndports * sizeof(udpdesc));
+    }
+
+# ifdef INET6
+    memset(&sin6, '\0', sizeof(sin6));
+    sin6.sin6_family = AF_INET6;
+# endif
+    memset(&sin, '\0', sizeof(sin));
+    sin.sin_family = AF_INET;
+
+    for (n = 0; n < ntdescs; n++) {
+	/* telnet ports */
+	ipv6 = FALSE;
+	ipv4 = FALSE;
+	if (thosts[n] == (char *) NULL) {
+# ifdef INET6
+	    sin6.sin6_addr = in6addr_any;
+	    ipv6 = TRUE;
+# endif
+	    sin.sin_addr.s_addr = htonl(INADDR_ANY);
+	    ipv4 = TRUE;
+	} else {
+# ifdef INET6
+	    if (inet_pton(AF_INET6, thosts[n], &sin6) > 0) {
+		sin6.sin6_family = AF_INET6;
+		ipv6 = TRUE;
+	    } else {
+# ifdef AI_DEFAULT
+		host = getipnodebyname(thosts[n], AF_INET6, 0, &err);
+		if (host != (struct hostent *) NULL) {
+		    if (host->h_length != 4) {
+			memcpy(&sin6.sin6_addr, host->h_addr, host->h_length);
+			ipv6 = TRUE;
+		    }
+		    freehostent(host);
+		}
+# else
+		host = gethostbyname2(thosts[n], AF_INET6);
+		if (host != (struct hostent *) NULL && host->h_length != 4) {
+		    memcpy(&sin6.sin6_addr, host->h_addr, host->h_length);
+		    ipv6 = TRUE;
+		}
+# endif
+	    }
+# endif
+	    if ((sin.sin_addr.s_addr=inet_addr(thosts[n])) != INADDR_NONE) {
+		ipv4 = TRUE;
+	    } else {
+		host = gethostbyname(thosts[n]);
+		if (host != (struct hostent *) NULL) {
+		    memcpy(&sin.sin_addr, host->h_addr, host->h_length);
+		    ipv4 = TRUE;
+		}
+	    }
+	}
+
+	if (!ipv6 && !ipv4) {
+	    message("unknown host %s\012", thosts[n]);	/* LF */
+	    return FALSE;
+	}
+
+# ifdef INET6
+	if (ipv6 && !conn_port6(&tdescs[n].in6, SOCK_STREAM, &sin6, tports[n]))
+	{
+	    return FALSE;
+	}
+# endif
+	if (ipv4 && !conn_port(&tdescs[n].in4, SOCK_STREAM, &sin, tports[n])) {
+	    return FALSE;
+	}
+    }
+
+    for (n = 0; n < nbdescs; n++) {
+	/* binary ports */
+	ipv6 = FALSE;
+	ipv4 = FALSE;
+	if (bhosts[n] == (char *) NULL) {
+# ifdef INET6
+	    sin6.sin6_addr = in6addr_any;
+	    ipv6 = TRUE;
+# endif
+	    sin.sin_addr.s_addr = htonl(INADDR_ANY);
+	    ipv4 = TRUE;
+	} else {
+# ifdef INET6
+	    if (inet_pton(AF_INET6, bhosts[n], &sin6) > 0) {
+		sin6.sin6_family = AF_INET6;
+		ipv6 = TRUE;
+	    } else {
+# ifdef AI_DEFAULT
+		host = getipnodebyname(bhosts[n], AF_INET6, 0, &err);
+		if (host != (struct hostent *) NULL) {
+		    if (host->h_length != 4) {
+			memcpy(&sin6.sin6_addr, host->h_addr, host->h_length);
+			ipv6 = TRUE;
+		    }
+		    freehostent(host);
+		}
+# else
+		host = gethostbyname2(bhosts[n], AF_INET6);
+		if (host != (struct hostent *) NULL && host->h_length != 4) {
+		    memcpy(&sin6.sin6_addr, host->h_addr, host->h_length);
+		    ipv6 = TRUE;
+		}
+# endif
+	    }
+# endif
+	    if ((sin.sin_addr.s_addr=inet_addr(bhosts[n])) != INADDR_NONE) {
+		ipv4 = TRUE;
+	    } else {
+		host = gethostbyname(bhosts[n]);
+		if (host != (struct hostent *) NULL) {
+		    memcpy(&sin.sin_addr, host->h_addr, host->h_length);
+		    ipv4 = TRUE;
+		}
+	    }
+	}
+
+	if (!ipv6 && !ipv4) {
+	    message("unknown host %s\012", bhosts[n]);	/* LF */
+	    return FALSE;
+	}
+
+# ifdef INET6
+	if (ipv6 && !conn_port6(&bdescs[n].in6, SOCK_STREAM, &sin6, bports[n]))
+	{
+	    return FALSE;
+	}
+# endif
+	if (ipv4 && !conn_port(&bdescs[n].in4, SOCK_STREAM, &sin, bports[n])) {
+	    return FALSE;
+	}
+    }
+
+    for (n = 0; n < nudescs; n++) {
+	/* datagram ports */
+	ipv6 = FALSE;
+	ipv4 = FALSE;
+	if (dhosts[n] == (char *) NULL) {
+# ifdef INET6
+	    sin6.sin6_addr = in6addr_any;
+	    ipv6 = TRUE;
+# endif
+	    sin.sin_addr.s_addr = htonl(INADDR_ANY);
+	    ipv4 = TRUE;
+	} else {
+# ifdef INET6
+	    if (inet_pton(AF_INET6, dhosts[n], &sin6) > 0) {
+		sin6.sin6_family = AF_INET6;
+		ipv6 = TRUE;
+	    } else {
+# ifdef AI_DEFAULT
+		host = getipnodebyname(dhosts[n], AF_INET6, 0, &err);
+		if (host != (struct hostent *) NULL) {
+		    if (host->h_length != 4) {
+			memcpy(&sin6.sin6_addr, host->h_addr, host->h_length);
+			ipv6 = TRUE;
+		    }
+		    freehostent(host);
+		}
+# else
+		host = gethostbyname2(dhosts[n], AF_INET6);
+		if (host != (struct hostent *) NULL && host->h_length != 4) {
+		    memcpy(&sin6.sin6_addr, host->h_addr, host->h_length);
+		    ipv6 = TRUE;
+		}
+# endif
+	    }
+# endif
+	    if ((sin.sin_addr.s_addr=inet_addr(dhosts[n])) != INADDR_NONE) {
+		ipv4 = TRUE;
+	    } else {
+		host = gethostbyname(dhosts[n]);
+		if (host != (struct hostent *) NULL) {
+		    memcpy(&sin.sin_addr, host->h_addr, host->h_length);
+		    ipv4 = TRUE;
+		}
+	    }
+	}
+
+	if (!ipv6 && !ipv4) {
+	    message("unknown host %s\012", dhosts[n]);	/* LF */
+	    return FALSE;
+	}
+
+# ifdef INET6
+	if (ipv6 &&
+	    !conn_port6(&udescs[n].fd.in6, SOCK_DGRAM, &sin6, dports[n])) {
+	    return FALSE;
+	}
+# endif
+	if (ipv4 &&
+	    !conn_port(&udescs[n].fd.in4, SOCK_DGRAM, &sin, dports[n])) {
+	    return FALSE;
+	}
+
+	udescs[n].accept = FALSE;
+    }
+
+    flist = (connection *) NULL;
+    connections = ALLOC(connection, nusers = maxusers);
+    for (n = nusers, conn = connections; n > 0; --n, conn++) {
+	conn->fd = -1;
+	conn->owner = -1;
+# ifdef EPOLL
+	conn->rprev = conn->rnext = (connection *) NULL;
+# endif
+# ifdef NETTHREAD
+	conn->net = (netbuf *) NULL;
+	conn->kicked = conn->readied = 0;
+# endif
+	conn->next = flist;
+	flist = conn;
+    }
+# ifdef NETTHREAD
+    if (!net_init(maxusers)) {
+	return FALSE;
+    }
+# endif
+
+    udphtab = ALLOC(connection*, udphtabsz = maxusers);
+    memset(udphtab, '\0', udphtabsz * sizeof(connection*));
+    chtab = Hashtab::create(maxusers, UDPHASHSZ, TRUE);
+    if (nudescs != 0) {
+	udpstop = FALSE;
+	pthread_mutex_init(&udpmutex, NULL);
+	if (conn_thread(&udp, &udp_run, (void *) NULL) < 0) {
+	    perror("pthread_create");
+	    return FALSE;
+	}
+    }
+
+    return TRUE;
+}
+
+/*
+ * NAME:	conn->clear()
+ * DESCRIPTION:	clean up connections
+ */
+void conn_clear()
+{
+    int n;
+
+    for (n = 0; n < ntdescs; n++) {
+	if (tdescs[n].in6 >= 0) {
+	    close(tdescs[n].in6);
+	}
+	if (tdescs[n].in4 >= 0) {
+	    close(tdescs[n].in4);
+	}
+    }
+    for (n = 0; n < nbdescs; n++) {
+	if (bdescs[n].in6 >= 0) {
+	    close(bdescs[n].in6);
+	}
+	if (bdescs[n].in4 >= 0) {
+	    close(bdescs[n].in4);
+	}
+    }
+    udpstop = TRUE;
+    for (n = 0; n < nudescs; n++) {
+	if (udescs[n].fd.in6 >= 0) {
+	    close(udescs[n].fd.in6);
+	}
+	if (udescs[n].fd.in4 >= 0) {
+	    close(udescs[n].fd.in4);
+	}
+    }
+
+    ipa_finish();
+}
+
+/*
+ * NAME:	conn->finish()
+ * DESCRIPTION:	terminate connections
+ */
+void conn_finish()
+{
+    int n;
+    connection *conn;
+
+# ifdef NETTHREAD
+    net_finish();
+# endif
+    for (n = nusers, conn = connections; n > 0; --n, conn++) {
+	if (conn->fd >= 0) {
+	    shutdown(conn->fd, SHUT_WR);
+	    close(conn->fd);
+	}
+    }
+}
+
+/*
+ * NAME:	conn->portclose()
+ * DESCRIPTION:	close the descriptors of a port
+ */
+static void conn_portclose(portdesc *desc)
+{
+    if (desc->in6 >= 0) {
+	close(desc->in6);
+    }
+    if (desc->in4 >= 0) {
+	close(desc->in4);
+    }
+}
+
+/*
+ * NAME:	conn->child()
+ * DESCRIPTION:	close the network descriptors inherited by a child process,
+ *		without affecting them in the parent
+ */
+void conn_child()
+{
+    int n;
+    struct stat st;
+
+    /*
+     * close connection sockets, including those of closed connections
+     * that the I/O thread is still flushing
+     */
+# ifdef EPOLL
+    n = fdtabsz;
+# else
+    n = maxfd + 1;
+# endif
+    while (--n > 2) {
+	if (fstat(n, &st) == 0 && S_ISSOCK(st.st_mode)) {
+	    close(n);
+	}
+    }
+
+    /* ports, which may not have been included above */
+    for (n = 0; n < ntdescs; n++) {
+	conn_portclose(&tdescs[n]);
+    }
+    for (n = 0; n < nbdescs; n++) {
+	conn_portclose(&bdescs[n]);
+    }
+    for (n = 0; n < nudescs; n++) {
+	conn_portclose(&udescs[n].fd);
+    }
+
+    /* pipes to other threads */
+    close(in);
+    close(out);
+    close(inout.in);
+    close(inout.out);
+    close(inpkts);
+    close(outpkts);
+# ifdef EPOLL
+    close(epfd);
+# endif
+# ifdef NETTHREAD
+    close(netfd);
+    close(netwake[0]);
+    close(netwake[1]);
+    close(netready[0]);
+    close(netready[1]);
+# endif
+}
+
+/*
+ * NAME:	conn->listen()
+ * DESCRIPTION:	start listening on telnet port and binary port
+ */
+void conn_listen()
+{
+    int n;
+
+    for (n = 0; n < ntdescs; n++) {
+	if (tdescs[n].in6 >= 0) {
+	    if (listen(tdescs[n].in6, 64) < 0) {
+		perror("listen");
+	    } else if (fcntl(tdescs[n].in6, F_SETFL, FNDELAY) < 0) {
+		perror("fcntl");
+	    } else {
+		continue;
+	    }
+	    fatal("conn_listen failed");
+	}
+    }
+    for (n = 0; n < ntdescs; n++) {
+	if (tdescs[n].in4 >= 0) {
+	    if (listen(tdescs[n].in4, 64) < 0) {
+# ifdef INET6
+		conn_unwatch(tdescs[n].in4);
+		close(tdescs[n].in4);
+		tdescs[n].in4 = -1;
+		continue;
+# else
+		perror("listen");
+# endif
+	    } else if (fcntl(tdescs[n].in4, F_SETFL, FNDELAY) < 0) {
+		perror("fcntl");
+	    } else {
+		continue;
+	    }
+	    fatal("conn_listen failed");
+	}
+    }
+    for (n = 0; n < nbdescs; n++) {
+	if (bdescs[n].in6 >= 0) {
+	    if (listen(bdescs[n].in6, 64) < 0) {
+		perror("listen");
+	    } else if (fcntl(bdescs[n].in6, F_SETFL, FNDELAY) < 0) {
+		perror("fcntl");
+	    } else {
+		continue;
+	    }
+	    fatal("conn_listen failed");
+	}
+    }
+    for (n = 0; n < nbdescs; n++) {
+	if (bdescs[n].in4 >= 0) {
+	    if (listen(bdescs[n].in4, 64) < 0) {
+# ifdef INET6
+		conn_unwatch(bdescs[n].in4);
+		close(bdescs[n].in4);
+		bdescs[n].in4 = -1;
+		continue;
+# else
+		perror("listen");
+# endif
+	    } else if (fcntl(bdescs[n].in4, F_SETFL, FNDELAY) < 0) {
+		perror("fcntl");
+	    } else {
+		continue;
+	    }
+	    fatal("conn_listen failed");
+	}
+    }
+}
+
+# ifdef INET6
+/*
+ * NAME:	conn->accept6()
+ * DESCRIPTION:	accept a new ipv6 connection
+ */
+static connection *conn_accept6(int portfd, int port)
+{
+    int fd;
+    socklen_t len;
+    struct sockaddr_in6 sin6;
+    in46addr addr;
+    connection *conn;
+
+    if (!FD_READY(portfd, CONN_READF)) {
+	return (connection *) NULL;
+    }
+    len = sizeof(sin6);
+    fd = accept(portfd, (struct sockaddr *) &sin6, &len);
+    if (fd < 0) {
+	FD_UNMARK(portfd, CONN_READF);
+	return (connection *) NULL;
+    }
+    fcntl(fd, F_SETFL, FNDELAY);
+
+    conn = flist;
+    flist = (connection *) conn->next;
+    conn->name = (char *) NULL;
+    conn->fd = fd;
+    conn->udpbuf = (char *) NULL;
+    if (IN6_IS_ADDR_V4MAPPED(&sin6.sin6_addr)) {
+	/* convert to IPv4 address */
+	addr.in.addr = *(struct in_addr *) &sin6.sin6_addr.s6_addr[12];
+	addr.ipv6 = FALSE;
+    } else {
+	addr.in.addr6 = sin6.sin6_addr;
+	addr.ipv6 = TRUE;
+    }
+    conn->addr = ipa_new(&addr);
+    conn->at = port;
+# ifdef NETTHREAD
+    net_new(conn, fd);
+# endif
+    conn_watch(fd, conn, TRUE);
+    FD_UNMARK(fd, CONN_READF);
+    FD_MARK(fd, CONN_WRITEF);
+
+    return conn;
+}
+# endif
+
+/*
+ * NAME:	conn->accept()
+ * DESCRIPTION:	accept a new ipv4 connection
+ */
+static connection *conn_accept(int portfd, int port)
+{
+    int fd;
+    socklen_t len;
+    struct sockaddr_in sin;
+    in46addr addr;
+    connection *conn;
+
+    if (!FD_READY(portfd, CONN_READF)) {
+	return (connection *) NULL;
+    }
+    len = sizeof(sin);
+    fd = accept(portfd, (struct sockaddr *) &sin, &len);
+    if (fd < 0) {
+	FD_UNMARK(portfd, CONN_READF);
+	return (connection *) NULL;
+    }
+    fcntl(fd, F_SETFL, FNDELAY);
+
+    conn = flist;
+    flist = (connection *) conn->next;
+    conn->name = (char *) NULL;
+    conn->fd = fd;
+    conn->udpbuf = (char *) NULL;
+    addr.in.addr = sin.sin_addr;
+    addr.ipv6 = FALSE;
+    conn->addr = ipa_new(&addr);
+    conn->at = port;
+# ifdef NETTHREAD
+    net_new(conn, fd);
+# endif
+    conn_watch(fd, conn, TRUE);
+    FD_UNMARK(fd, CONN_READF);
+    FD_MARK(fd, CONN_WRITEF);
+
+    return conn;
+}
+
+/*
+ * NAME:	conn->udpaccept()
+ * DESCRIPTION:	accept a new UDP connection
+ */
+static connection *conn_udpaccept(int port)
+{
+    connection *conn, **hash;
+
+    conn = flist;
+    flist = (connection *) conn->next;
+    conn->name = (char *) NULL;
+    m_static();
+    conn->udpbuf = ALLOC(char, BINBUF_SIZE + 2);
+    m_dynamic();
+    hash = &udphtab[udescs[port].hashval];
+    pthread_mutex_lock(&udpmutex);
+    conn->next = *hash;
+    *hash = conn;
+    conn->fd = -2;
+    conn->addr = ipa_new(&udescs[port].addr);
+    conn->port = udescs[port].port;
+    conn->at = port;
+    conn->udpbuf[0] = udescs[port].size >> 8;
+    conn->udpbuf[1] = udescs[port].size;
+    memcpy(conn->udpbuf + 2, udescs[port].buffer, udescs[port].size);
+    conn->bufsz = udescs[port].size + 2;
+    conn->npkts = 1;
+    udescs[port].accept = FALSE;
+    pthread_mutex_unlock(&udpmutex);
+
+    return conn;
+}
+
+/*
+ * NAME:	conn->tnew6()
+ * DESCRIPTION:	accept a new telnet connection
+ */
+connection *conn_tnew6(int port)
+{
+# ifdef INET6
+    int fd;
+
+    fd = tdescs[port].in6;
+    if (fd >= 0) {
+	return conn_accept6(fd, port);
+    }
+# endif
+    return (connection *) NULL;
+}
+
+/*
+ * NAME:	conn->bnew6()
+ * DESCRIPTION:	accept a new binary connection
+ */
+connection *conn_bnew6(int port)
+{
+# ifdef INET6
+    int fd;
+
+    fd = bdescs[port].in6;
+    if (fd >= 0) {
+	return conn_accept6(fd, port);
+    }
+# endif
+    return (connection *) NULL;
+}
+
+/*
+ * NAME:	conn->dnew6()
+ * DESCRIPTION:	accept a new datagram connection
+ */
+connection *conn_dnew6(int port)
+{
+# ifdef INET6
+    if (udescs[port].accept) {
+	return conn_udpaccept(port);
+    }
+# endif
+    return (connection *) NULL;
+}
+
+/*
+ * NAME:	conn->tnew()
+ * DESCRIPTION:	accept a new telnet connection
+ */
+connection *conn_tnew(int port)
+{
+    int fd;
+
+    fd = tdescs[port].in4;
+    if (fd >= 0) {
+	return conn_accept(fd, port);
+    }
+    return (connection *) NULL;
+}
+
+/*
+ * NAME:	conn->bnew()
+ * DESCRIPTION:	accept a new binary connection
+ */
+connection *conn_bnew(int port)
+{
+    int fd;
+
+    fd = bdescs[port].in4;
+    if (fd >= 0) {
+	return conn_accept(fd, port);
+    }
+    return (connection *) NULL;
+}
+
+/*
+ * NAME:	conn->dnew()
+ * DESCRIPTION:	accept a new datagram connection
+ */
+connection *conn_dnew(int port)
+{
+    if (udescs[port].accept) {
+	return conn_udpaccept(port);
+    }
+    return (connection *) NULL;
+}
+
+/*
+ * NAME:	conn->attach()
+ * DESCRIPTION:	can datagram channe be attached to this connection?
+ */
+bool conn_attach(connection *conn)
+{
+    return conf_attach(conn->at);
+}
+
+/*
+ * NAME:	conn->udp()
+ * DESCRIPTION:	set the challenge for attaching a UDP channel
+ */
+bool conn_udp(connection *conn, char *challenge, unsigned int len)
+{
+    char buffer[UDPHASHSZ];
+    connection **hash;
+
+    if (len == 0 || len > BINBUF_SIZE || conn->udpbuf != (char *) NULL) {
+	return FALSE;	/* invalid challenge */
+    }
+
+    if (len >= UDPHASHSZ) {
+	memcpy(buffer, challenge, UDPHASHSZ);
+    } else {
+	memset(buffer, '\0', UDPHASHSZ);
+	memcpy(buffer, challenge, len);
+    }
+    pthread_mutex_lock(&udpmutex);
+    hash = (connection **) chtab->lookup(buffer, FALSE);
+    while (*hash != (connection *) NULL &&
+	   memcmp((*hash)->name, buffer, UDPHASHSZ) == 0) {
+	if ((*hash)->bufsz == len &&
+	    memcmp((*hash)->udpbuf, challenge, len) == 0) {
+	    pthread_mutex_unlock(&udpmutex);
+	    return FALSE;	/* duplicate challenge */
+	}
+    }
+
+    conn->next = *hash;
+    *hash = conn;
+    conn->npkts = 0;
+    m_static();
+    conn->udpbuf = ALLOC(char, BINBUF_SIZE + 2);
+    m_dynamic();
+    memset(conn->udpbuf, '\0', UDPHASHSZ);
+    conn->name = (const char *) memcpy(conn->udpbuf, challenge, conn->bufsz = len);
+    pthread_mutex_unlock(&udpmutex);
+
+    return TRUE;
+}
+
+/*
+ * NAME:	conn->del()
+ * DESCRIPTION:	delete a connection
+ */
+void conn_del(connection *conn)
+{
+    connection **hash;
+
+    if (conn->fd >= 0) {
+	conn_shut(conn, TRUE);
+	conn->fd = -1;
+    } else if (conn->fd == -1) {
+	--closed;
+    }
+# ifdef EPOLL
+    conn_rdydel(conn);
+# endif
+    conn->owner = -1;
+    if (conn->udpbuf != (char *) NULL) {
+	pthread_mutex_lock(&udpmutex);
+	if (conn->name != (char *) NULL) {
+	    hash = (connection **) chtab->lookup(conn->name, FALSE);
+# ifdef INET6
+	} else if (conn->addr->ipnum.ipv6) {
+	    hash = &udphtab[(Hashtab::hashmem((char *) &conn->addr->ipnum,
+			    sizeof(struct in6_addr)) ^ conn->port) % udphtabsz];
+# endif
+	} else {
+	    hash = &udphtab[(((Uint) conn->addr->ipnum.in.addr.s_addr) ^
+						    conn->port) % udphtabsz];
+	}
+	while (*hash != conn) {
+	    hash = (connection **) &(*hash)->next;
+	}
+	*hash = (connection *) conn->next;
+	if (conn->npkts != 0) {
+	    read(inpkts, conn->udpbuf, conn->npkts);
+	}
+	pthread_mutex_unlock(&udpmutex);
+	FREE(conn->udpbuf);
+    }
+    if (conn->addr != (ipaddr *) NULL) {
+      ipa_del(conn->addr);
+    }
+    conn->next = flist;
+    flist = conn;
+}
+
+/*
+ * NAME:	conn->block()
+ * DESCRIPTION:	block or unblock input from connection
+ */
+void conn_block(connection *conn, int flag)
+{
+# ifdef EPOLL
+    if (flag) {
+	if (conn->fd >= 0) {
+	    FD_MARK(conn->fd, CONN_BLOCKF);
+	}
+    } else if (conn->fd < 0) {
+	conn_rdyadd(conn);	/* let the owner discover what happened */
+    } else {
+	FD_UNMARK(conn->fd, CONN_BLOCKF);
+	if (FD_READY(conn->fd, CONN_READF)) {
+	    conn_rdyadd(conn);	/* input arrived while blocked */
+	}
+    }
+# else
+    if (conn->fd >= 0) {
+	if (flag) {
+	    FD_CLR(conn->fd, &infds);
+	    FD_CLR(conn->fd, &readfds);
+	} else {
+	    FD_SET(conn->fd, &infds);
+	}
+    }
+# endif
+}
+
+# ifdef EPOLL
+/*
+ * NAME:	conn->accepting()
+ * DESCRIPTION:	check for connections waiting to be accepted
+ */
+static bool conn_accepting(portdesc *descs, int n)
+{
+    while (n != 0) {
+	--n;
+	if ((descs[n].in6 >= 0 && FD_READY(descs[n].in6, CONN_READF)) ||
+	    (descs[n].in4 >= 0 && FD_READY(descs[n].in4, CONN_READF))) {
+	    return TRUE;
+	}
+    }
+    return FALSE;
+}
+
+/*
+ * NAME:	conn->select()
+ * DESCRIPTION:	wait for input from connections
+ */
+int conn_select(Uint t, unsigned int mtime)
+{
+    struct epoll_event events[NEVENTS];
+    int timeout, retval, n, fd;
+    connection *conn;
+    bool accepting;
+
+    /*
+     * Edge-triggered descriptors only report changes, so anything left
+     * pending from the previous cycle must be handled without waiting.
+     */
+    accepting = (flist != (connection *) NULL &&
+		 (conn_accepting(tdescs, ntdescs) ||
+		  conn_accepting(bdescs, nbdescs)));
+    if (closed != 0 || rhead != (connection *) NULL || accepting) {
+	timeout = 0;
+    } else if (mtime != 0xffff) {
+	timeout = (t >= 86400) ? 86400000 : t * 1000 + mtime;
+    } else {
+	timeout = -1;
+    }
+    retval = epoll_wait(epfd, events, NEVENTS, timeout);
+    if (retval < 0) {
+	retval = 0;
+    }
+
+    for (n = 0; n < retval; n++) {
+	fd = events[n].data.fd;
+	if (events[n].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+	    FD_MARK(fd, CONN_READF);
+	}
+	if (events[n].events & (EPOLLOUT | EPOLLHUP | EPOLLERR)) {
+	    FD_MARK(fd, CONN_WRITEF);
+	}
+	conn = fdtab[fd].conn;
+	if (conn != (connection *) NULL &&
+	    ((FD_READY(fd, CONN_READF | CONN_BLOCKF) == CONN_READF) ||
+	     (FD_READY(fd, CONN_WAITF | CONN_WRITEF) ==
+					    (CONN_WAITF | CONN_WRITEF)))) {
+	    conn_rdyadd(conn);
+	}
+    }
+
+    if (FD_READY(inpkts, CONN_READF)) {
+	/* find the connections with datagrams waiting */
+	FD_UNMARK(inpkts, CONN_READF);
+	pthread_mutex_lock(&udpmutex);
+	for (n = nusers, conn = connections; n > 0; --n, conn++) {
+	    if (conn->udpbuf != (char *) NULL && conn->npkts != 0) {
+		conn_rdyadd(conn);
+	    }
+	}
+	pthread_mutex_unlock(&udpmutex);
+    }
+
+# ifdef NETTHREAD
+    if (FD_READY(netready[0], CONN_READF)) {
+	/* connections serviced by the I/O thread */
+	FD_UNMARK(netready[0], CONN_READF);
+	net_ready();
+    }
+# endif
+
+    /* handle ip name lookup */
+    if (FD_READY(in, CONN_READF)) {
+	FD_UNMARK(in, CONN_READF);
+	ipa_lookup();
+    }
+
+    retval += closed;
+    if (retval == 0 && (rhead != (connection *) NULL || accepting)) {
+	retval = 1;
+    }
+    return retval;
+}
+# else
+
+/*
+ * NAME:	conn->select()
+ * DESCRIPTION:	wait for input from connections
+ */
+int conn_select(Uint t, unsigned int mtime)
+{
+    struct timeval timeout;
+    int retval;
+    int n;
+
+    /*
+     * First, check readability and writability for binary sockets with pending
+     * data only.
+     */
+    memcpy(&readfds, &infds, sizeof(fd_set));
+    if (flist == (connection *) NULL) {
+	/* can't accept new connections, so don't check for them */
+	for (n = ntdescs; n != 0; ) {
+	    --n;
+	    if (tdescs[n].in6 >= 0) {
+		FD_CLR(tdescs[n].in6, &readfds);
+	    }
+	    if (tdescs[n].in4 >= 0) {
+		FD_CLR(tdescs[n].in4, &readfds);
+	    }
+	}
+	for (n = nbdescs; n != 0; ) {
+	    --n;
+	    if (bdescs[n].in6 >= 0) {
+		FD_CLR(bdescs[n].in6, &readfds);
+	    }
+	    if (bdescs[n].in4 >= 0) {
+		FD_CLR(bdescs[n].in4, &readfds);
+	    }
+	}
+    }
+    memcpy(&writefds, &waitfds, sizeof(fd_set));
+    if (closed != 0) {
+	t = 0;
+	mtime = 0;
+    }
+    if (mtime != 0xffff) {
+	timeout.tv_sec = t;
+	timeout.tv_usec = mtime * 1000L;
+	retval = select(maxfd + 1, &readfds, &writefds, (fd_set *) NULL,
+			&timeout);
+    } else {
+	retval = select(maxfd + 1, &readfds, &writefds, (fd_set *) NULL,
+			(struct timeval *) NULL);
+    }
+    if (retval < 0) {
+	FD_ZERO(&readfds);
+	retval = 0;
+    }
+    retval += closed;
+
+    /*
+     * Now check writability for all sockets in a polling call.
+     */
+    memcpy(&writefds, &outfds, sizeof(fd_set));
+    timeout.tv_sec = 0;
+    timeout.tv_usec = 0;
+    select(maxfd + 1, (fd_set *) NULL, &writefds, (fd_set *) NULL, &timeout);
+
+    /* handle ip name lookup */
+    if (FD_ISSET(in, &readfds)) {
+	ipa_lookup();
+    }
+
+    nextrdy = 0;
+    return retval;
+}
+# endif
+
+/*
+ * NAME:	conn->owner()
+ * DESCRIPTION:	set the index of the user that owns a connection
+ */
+void conn_owner(connection *conn, int owner)
+{
+    conn->owner = owner;
+}
+
+/*
+ * NAME:	conn->ready()
+ * DESCRIPTION:	return the owner of the next connection with pending I/O,
+ *		or -1 if there are no more
+ */
+int conn_ready()
+{
+    connection *conn;
+
+# ifdef EPOLL
+    while (rhead != (connection *) NULL) {
+	conn = rhead;
+	conn_rdydel(conn);
+	if (conn->owner >= 0) {
+	    return conn->owner;
+	}
+    }
+# else
+    bool ready;
+
+    while (nextrdy < nusers) {
+	conn = &connections[nextrdy++];
+	if (conn->owner < 0) {
+	    continue;
+	}
+	if (conn->fd >= 0) {
+	    ready = (FD_ISSET(conn->fd, &readfds) ||
+		     (FD_ISSET(conn->fd, &waitfds) &&
+		      FD_ISSET(conn->fd, &writefds)));
+	} else {
+	    ready = (conn->fd == -1);	/* closed */
+	}
+	if (!ready && conn->udpbuf != (char *) NULL) {
+	    pthread_mutex_lock(&udpmutex);
+	    ready = (conn->npkts != 0);
+	    pthread_mutex_unlock(&udpmutex);
+	}
+	if (ready) {
+	    return conn->owner;
+	}
+    }
+# endif
+    return -1;
+}
+
+/*
+ * NAME:	conn->udpcheck()
+ * DESCRIPTION:	check if UDP challenge met
+ */
+bool conn_udpcheck(connection *conn)
+{
+    return (conn->name == (char *) NULL);
+}
+
+/*
+ * NAME:	conn->read()
+ * DESCRIPTION:	read from a connection
+ */
+int conn_read(connection *conn, char *buf, unsigned int len)
+{
+    int size;
+
+    if (conn->fd < 0) {
+	return -1;
+    }
+    if (!FD_READY(conn->fd, CONN_READF)) {
+	return 0;
+    }
+# ifdef NETTHREAD
+    if (conn->net != (netbuf *) NULL) {
+	return net_read(conn, buf, len);
+    }
+# endif
+    size = read(conn->fd, buf, len);
+    if (size < 0) {
+# ifdef EPOLL
+	if (errno == EINTR) {
+	    conn_rdyadd(conn);
+	    return 0;
+	}
+	if (errno == EAGAIN || errno == EWOULDBLOCK) {
+	    FD_UNMARK(conn->fd, CONN_READF);
+	    return 0;
+	}
+# endif
+	conn_shut(conn, FALSE);
+	conn->fd = -1;
+	closed++;
+# ifdef EPOLL
+	conn_rdyadd(conn);	/* let the owner discover the error */
+    } else if (size == (int) len || size == 0) {
+	conn_rdyadd(conn);	/* more input, or end of file to report */
+    } else {
+	FD_UNMARK(conn->fd, CONN_READF);	/* drained */
+# endif
+    }
+    return (size == 0) ? -1 : size;
+}
+
+/*
+ * NAME:	conn->udpread()
+ * DESCRIPTION:	read a message from a UDP channel
+ */
+int conn_udpread(connection *conn, char *buf, unsigned int len)
+{
+    unsigned short size, n;
+    char *p, *q, discard;
+
+    pthread_mutex_lock(&udpmutex);
+    while (conn->bufsz != 0) {
+	/* udp buffer is not empty */
+	size = (UCHAR(conn->udpbuf[0]) << 8) | UCHAR(conn->udpbuf[1]);
+	if (size <= len) {
+	    memcpy(buf, conn->udpbuf + 2, len = size);
+	}
+	--conn->npkts;
+	read(inpkts, &discard, 1);
+	conn->bufsz -= size + 2;
+	for (p = conn->udpbuf, q = p + size + 2, n = conn->bufsz; n != 0; --n) {
+	    *p++ = *q++;
+	}
+	if (len == size) {
+	    pthread_mutex_unlock(&udpmutex);
+	    return len;
+	}
+    }
+    pthread_mutex_unlock(&udpmutex);
+    return -1;
+}
+
+/*
+ * NAME:	conn->write()
+ * DESCRIPTION:	write to a connection; return the amount of bytes written
+ */
+int conn_write(connection *conn, char *buf, unsigned int len)
+{
+    int size;
+
+    if (conn->fd < 0) {
+	return -1;
+    }
+    if (len == 0) {
+	return 0;
+    }
+    if (!FD_READY(conn->fd, CONN_WRITEF)) {
+	/* the write would fail */
+	FD_MARK(conn->fd, CONN_WAITF);
+	return 0;
+    }
+# ifdef NETTHREAD
+    if (conn->net != (netbuf *) NULL) {
+	struct iovec iov;
+
+	iov.iov_base = buf;
+	iov.iov_len = len;
+	return net_writev(conn, &iov, 1, len);
+    }
+# endif
+    if ((size=write(conn->fd, buf, len)) < 0 && errno != EWOULDBLOCK) {
+	conn_shut(conn, FALSE);
+	conn->fd = -1;
+	closed++;
+# ifdef EPOLL
+	conn_rdyadd(conn);
+# endif
+    } else if (size != len) {
+	/* waiting for wrdone */
+	FD_MARK(conn->fd, CONN_WAITF);
+	FD_UNMARK(conn->fd, CONN_WRITEF);
+	if (size < 0) {
+	    return 0;
+	}
+    }
+    return size;
+}
+
+/*
+ * NAME:	conn->writev()
+ * DESCRIPTION:	write several buffers to a connection; return the amount of
+ *		bytes written
+ */
+int conn_writev(connection *conn, struct iovec *iov, int iovcnt)
+{
+    int size, i;
+    unsigned int len;
+
+    if (conn->fd < 0) {
+	return -1;
+    }
+    for (len = 0, i = 0; i < iovcnt; i++) {
+	len += iov[i].iov_len;
+    }
+    if (len == 0) {
+	return 0;
+    }
+    if (!FD_READY(conn->fd, CONN_WRITEF)) {
+	/* the write would fail */
+	FD_MARK(conn->fd, CONN_WAITF);
+	return 0;
+    }
+# ifdef NETTHREAD
+    if (conn->net != (netbuf *) NULL) {
+	return net_writev(conn, iov, iovcnt, len);
+    }
+# endif
+    if ((size=writev(conn->fd, iov, iovcnt)) < 0 && errno != EWOULDBLOCK) {
+	conn_shut(conn, FALSE);
+	conn->fd = -1;
+	closed++;
+# ifdef EPOLL
+	conn_rdyadd(conn);
+# endif
+    } else if (size != (int) len) {
+	/* waiting for wrdone */
+	FD_MARK(conn->fd, CONN_WAITF);
+	FD_UNMARK(conn->fd, CONN_WRITEF);
+	if (size < 0) {
+	    return 0;
+	}
+    }
+    return size;
+}
+
+/*
+ * NAME:	conn->udpwrite()
+ * DESCRIPTION:	write a message to a UDP channel
+ */
+int conn_udpwrite(connection *conn, char *buf, unsigned int len)
+{
+    if (conn->fd != -1) {
+# ifdef INET6
+	if (conn->addr->ipnum.ipv6) {
+	    struct sockaddr_in6 to;
+
+	    memset(&to, '\0', sizeof(struct sockaddr_in6));
+	    to.sin6_family = AF_INET6;
+	    memcpy(&to.sin6_addr, &conn->addr->ipnum.in.addr6,
+		   sizeof(struct in6_addr));
+	    to.sin6_port = conn->port;
+	    return sendto(udescs[conn->at].fd.in6, buf, len, 0,
+			  (struct sockaddr *) &to, sizeof(struct sockaddr_in6));
+	} else
+# endif
+	{
+	    struct sockaddr_in to;
+
+	    memset(&to, '\0', sizeof(struct sockaddr_in));
+	    to.sin_family = AF_INET;
+	    to.sin_addr = conn->addr->ipnum.in.addr;
+	    to.sin_port = conn->port;
+	    return sendto(udescs[conn->at].fd.in4, buf, len, 0,
+			  (struct sockaddr *) &to, sizeof(struct sockaddr_in));
+	}
+    }
+    return -1;
+}
+
+/*
+ * NAME:	conn->wrdone()
+ * DESCRIPTION:	return TRUE if a connection is ready for output
+ */
+bool conn_wrdone(connection *conn)
+{
+    if (conn->fd < 0 || !FD_READY(conn->fd, CONN_WAITF)) {
+	return TRUE;
+    }
+    if (FD_READY(conn->fd, CONN_WRITEF)) {
+	FD_UNMARK(conn->fd, CONN_WAITF);
+	return TRUE;
+    }
+    return FALSE;
+}
+
+/*
+ * NAME:	conn->ipnum()
+ * DESCRIPTION:	return the ip number of a connection
+ */
+void conn_ipnum(connection *conn, char *buf)
+{
+# ifdef INET6
+    /* IPv6: maxlen 39 */
+    if (conn->addr->ipnum.ipv6) {
+	inet_ntop(AF_INET6, &conn->addr->ipnum, buf, 40);
+    } else
+# endif
+    {
+	strcpy(buf, inet_ntoa(conn->addr->ipnum.in.addr));
+    }
+
+}
+
+/*
+ * NAME:	conn->ipname()
+ * DESCRIPTION:	return the ip name of a connection
+ */
+void conn_ipname(connection *conn, char *buf)
+{
+    if (conn->addr->name[0] != '\0') {
+	strcpy(buf, conn->addr->name);
+    } else {
+	conn_ipnum(conn, buf);
+    }
+}
+
+/*
+ * NAME:	conn->host()
+ * DESCRIPTION:	look up a host
+ */
+void *conn_host(char *addr, unsigned short port, int *len)
+{
+    struct hostent *host;
+    static union {
+	struct sockaddr_in sin;
+# ifdef INET6
+	struct sockaddr_in6 sin6;
+# endif
+    } inaddr;
+
+    memset(&inaddr.sin, '\0', sizeof(struct sockaddr_in));
+    inaddr.sin.sin_family = AF_INET;
+    inaddr.sin.sin_port = htons(port);
+    *len = sizeof(struct sockaddr_in);
+    if ((inaddr.sin.sin_addr.s_addr=inet_addr(addr)) != INADDR_NONE) {
+	return &inaddr;
+    } else {
+	host = gethostbyname(addr);
+	if (host != (struct hostent *) NULL) {
+	    memcpy(&inaddr.sin.sin_addr, host->h_addr, host->h_length);
+	    return &inaddr;
+	}
+    }
+
+# ifdef INET6
+    memset(&inaddr.sin6, '\0', sizeof(struct sockaddr_in6));
+    inaddr.sin6.sin6_family = AF_INET6;
+    *len = sizeof(struct sockaddr_in6);
+    if (inet_pton(AF_INET6, addr, &inaddr.sin6) > 0) {
+	inaddr.sin6.sin6_family = AF_INET6;
+	inaddr.sin6.sin6_port = htons(port);
+	return &inaddr;
+    } else {
+# ifdef AI_DEFAULT
+	int err;
+
+	host = getipnodebyname(addr, AF_INET6, 0, &err);
+# else
+	host = gethostbyname2(addr, AF_INET6);
+# endif
+	if (host != (struct hostent *) NULL) {
+	    if (host->h_length != 4) {
+		memcpy(&inaddr.sin6.sin6_addr, host->h_addr, host->h_length);
+# ifdef AI_DEFAULT
+		freehostent(host);
+# endif
+		inaddr.sin6.sin6_port = htons(port);
+		return &inaddr;
+	    }
+# ifdef AI_DEFAULT
+	    freehostent(host);
+# endif
+	}
+    }
+# endif
+
+    return (void *) NULL;
+}
+
+/*
+ * NAME:	conn->connect()
+ * DESCRIPTION:	establish an oubound connection
+ */
+connection *conn_connect(void *addr, int len)
+{
+    connection *conn;
+    int sock;
+    int on;
+    long arg;
+
+    if (flist == (connection *) NULL) {
+       return NULL;
+    }
+
+    sock = socket(((struct sockaddr_in *) addr)->sin_family, SOCK_STREAM, 0);
+    if (sock < 0) {
+	perror("socket");
+	return NULL;
+    }
+    on = 1;
+    if (setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, (char *) &on,
+		   sizeof(on)) < 0) {
+	perror("setsockopt");
+	close(sock);
+	return NULL;
+    }
+#ifdef SO_OOBINLINE
+    on = 1;
+    if (setsockopt(sock, SOL_SOCKET, SO_OOBINLINE, (char *) &on,
+		   sizeof(on)) < 0) {
+	perror("setsockopt");
+	close(sock);
+	return NULL;
+    }
+#endif
+    if ((arg = fcntl(sock, F_GETFL, NULL)) < 0) {
+       perror("fcntl");
+       close(sock);
+       return NULL;
+    }
+    arg |= O_NONBLOCK;
+    if (fcntl(sock, F_SETFL, arg) < 0) {
+       perror("fcntl");
+       close(sock);
+       return NULL;
+    }
+
+    connect(sock, (struct sockaddr *) addr, len);
+
+    conn = flist;
+    flist = (connection *) conn->next;
+    conn->fd = sock;
+    conn->name = (char *) NULL;
+    conn->udpbuf = (char *) NULL;
+    conn->addr = (ipaddr *) NULL;
+    conn->at = -1;
+    conn_watch(sock, conn, TRUE);
+    FD_UNMARK(sock, CONN_READF);
+    FD_UNMARK(sock, CONN_WRITEF);
+    FD_MARK(sock, CONN_WAITF);
+    return conn;
+}
+
+/*
+ * check for a connection in pending state and see if it is connected.
+ */
+int conn_check_connected(connection *conn, int *errcode)
+{
+    int optval;
+    socklen_t lon;
+
+    /*
+     * indicate that our fd became invalid.
+     */
+    if (conn->fd < 0) {
+	return -2;
+    }
+
+    if (!FD_READY(conn->fd, CONN_WRITEF)) {
+	return 0;
+    }
+    FD_UNMARK(conn->fd, CONN_WAITF);
+
+    /*
+     * Delayed connect completed, check for errors
+     */
+    lon = sizeof(int);
+    /*
+     * Get error state for the socket
+     */
+    *errcode = 0;
+    if (getsockopt(conn->fd, SOL_SOCKET, SO_ERROR, (void *)(&optval), &lon) < 0)
+    {
+	return -1;
+    }
+    if (optval != 0) {
+	switch (optval) {
+	case ECONNREFUSED:
+	    *errcode = 1;
+	    break;
+
+	case EHOSTUNREACH:
+	    *errcode = 2;
+	    break;
+
+	case ENETUNREACH:
+	    *errcode = 3;
+	    break;
+
+	case ETIMEDOUT:
+	    *errcode = 4;
+	    break;
+	}
+	errno = optval;
+	return -1;
+    } else {
+# ifdef INET6
+	struct sockaddr_in6 sin;
+# else
+	struct sockaddr_in sin;
+# endif
+	socklen_t len;
+	in46addr inaddr;
+
+	len = sizeof(sin);
+	getpeername(conn->fd, (struct sockaddr *) &sin, &len);
+	inaddr.ipv6 = FALSE;
+# ifdef INET6
+	if (sin.sin6_family == AF_INET6) {
+	    inaddr.in.addr6 = sin.sin6_addr;
+	    inaddr.ipv6 = TRUE;
+	} else
+# endif
+	inaddr.in.addr = ((struct sockaddr_in *) &sin)->sin_addr;
+	conn->addr = ipa_new(&inaddr);
+	errno = 0;
+	return 1;
+    }
+}
+
+/*
+ * NAME:	conn->stop()
+ * DESCRIPTION:	prepare for exporting connections: stop network I/O in the
+ *		background
+ */
+void conn_stop()
+{
+# ifdef NETTHREAD
+    if (!netstop) {
+	net_stop();
+    }
+# endif
+}
+
+/*
+ * NAME:	conn->pending()
+ * DESCRIPTION:	retrieve input that was received but not yet read, after
+ *		conn_stop()
+ */
+int conn_pending(connection *conn, char *buf, unsigned int len)
+{
+# ifdef NETTHREAD
+    if (conn->fd >= 0 && conn->net != (netbuf *) NULL) {
+	return ring_get(&conn->net->in, buf, len);
+    }
+# else
+    UNREFERENCED_PARAMETER(conn);
+    UNREFERENCED_PARAMETER(buf);
+    UNREFERENCED_PARAMETER(len);
+# endif
+    return 0;
+}
+
+/*
+ * NAME:	conn->export()
+ * DESCRIPTION:	export a connection
+ */
+bool conn_export(connection *conn, int *fd, char *addr, unsigned short *port,
+		 short *at, int *npkts, int *bufsz, char **buf, char *flags)
+{
+    *fd = conn->fd;
+    *port = conn->port;
+    if (conn->fd != -1) {
+	*flags = 0;
+	*at = conn->at;
+	*npkts = conn->npkts;
+	*bufsz = conn->bufsz;
+	*buf = conn->udpbuf;
+	if (conn->fd >= 0) {
+	    if (FD_READY(conn->fd, CONN_READF)) {
+		*flags |= CONN_READF;
+	    }
+	    if (FD_READY(conn->fd, CONN_WRITEF)) {
+		*flags |= CONN_WRITEF;
+	    }
+	    if (FD_READY(conn->fd, CONN_WAITF)) {
+		*flags |= CONN_WAITF;
+	    }
+	}
+	if (conn->udpbuf != (char *) NULL) {
+	    if (conn->name != NULL) {
+		*flags |= CONN_UCHAL;
+	    } else {
+		*flags |= CONN_UCHAN;
+	    }
+	}
+	if (conn->addr != (ipaddr *) NULL) {
+	    memcpy(addr, &conn->addr->ipnum, sizeof(in46addr));
+	    *flags |= CONN_ADDR;
+	}
+    }
+
+    return TRUE;
+}
+
+/*
+ * NAME:	conn->import()
+ * DESCRIPTION:	import a connection
+ */
+connection *conn_import(int fd, char *addr, unsigned short port, short at,
+			int npkts, int bufsz, char *buf, char flags,
+			bool telnet)
+{
+    in46addr inaddr;
+    connection *conn;
+
+    conn = flist;
+    flist = (connection *) conn->next;
+    conn->fd = fd;
+    conn->name = (char *) NULL;
+    conn->udpbuf = (char *) NULL;
+    conn->addr = (ipaddr *) NULL;
+    conn->bufsz = 0;
+    conn->npkts = 0;
+    conn->port = port;
+    conn->at = -1;
+
+    if (fd >= 0) {
+# ifdef NETTHREAD
+	net_new(conn, fd);
+# endif
+	conn_watch(fd, conn, TRUE);
+	if (flags & CONN_READF) {
+	    FD_MARK(fd, CONN_READF);
+# ifdef EPOLL
+	    conn_rdyadd(conn);
+# endif
+	}
+	if (flags & CONN_WRITEF) {
+	    FD_MARK(fd, CONN_WRITEF);
+	}
+	if (flags & CONN_WAITF) {
+	    FD_MARK(fd, CONN_WAITF);
+	}
+    }
+
+    if (fd != -1) {
+	if (at >= 0 && at >= ((telnet) ? ntdescs : nbdescs)) {
+	    at = -1;
+	}
+	conn->at = at;
+	if (flags & CONN_ADDR) {
+	    memcpy(&inaddr, addr, sizeof(in46addr));
+	    conn->addr = ipa_new(&inaddr);
+	}
+
+	if (at >= 0) {
+	    if (flags & CONN_UCHAL) {
+		conn_udp(conn, buf, bufsz);
+	    }
+	    if (flags & CONN_UCHAN) {
+		connection **hash;
+
+		conn->bufsz = bufsz;
+		m_static();
+		conn->udpbuf = ALLOC(char, BINBUF_SIZE + 2);
+		m_dynamic();
+		memcpy(conn->udpbuf, buf, bufsz);
+# ifdef INET6
+		if (inaddr.ipv6) {
+		    hash = &udphtab[(Hashtab::hashmem((char *) &inaddr.in.addr6,
+			   sizeof(struct in6_addr)) ^ conn->port) % udphtabsz];
+		} else
+# endif
+		hash = &udphtab[((Uint) inaddr.in.addr.s_addr ^ conn->port) %
+								    udphtabsz];
+		conn->next = *hash;
+		*hash = conn;
+	    }
+	    conn->npkts = npkts;
+	    write(outpkts, conn->udpbuf, npkts);
+	}
+    } else {
+	closed++;
+    }
+
+    return conn;
+}
+
+/*
+ * NAME:	conn->fdcount()
+ * DESCRIPTION:	return the number of restored connections
+ */
+int conn_fdcount()
+{
+    int count, n;
+    connection *conn;
+
+    count = 0;
+    for (conn = connections, n = nusers; n > 0; conn++, --n) {
+	if (conn->fd >= 0) {
+	    count++;
+	}
+    }
+    return count;
+}
+
+/*
+ * NAME:	conn->fdlist()
+ * DESCRIPTION:	pass on a list of connection descriptors
+ */
+void conn_fdlist(int *list)
+{
+    int n;
+    connection *conn;
+
+    for (conn = connections, n = nusers; n > 0; conn++, --n) {
+	if (conn->fd >= 0) {
+	    *list++ = conn->fd;
+	}
+    }
+}
+
+/*
+ * NAME:	conn->fdclose()
+ * DESCRIPTION:	close a list of connection descriptors
+ */
+void conn_fdclose(int *list, int n)
+{
+    while (n > 0) {
+	close(list[--n]);
+    }
+}
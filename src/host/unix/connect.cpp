@@ -18,6 +18,7 @@
  */
 
 # include <sys/time.h>
+# include <sys/stat.h>
 # include <sys/socket.h>
 # include <netinet/in.h>
 # include <arpa/inet.h>
@@ -40,6 +41,25 @@
 #  endif
 # endif
 
+# ifdef EPOLL		/* EPOLL defined */
+#  if EPOLL == 0
+#   undef EPOLL		/* ... but turned off */
+#  endif
+# else
+#  ifdef LINUX		/* define EPOLL on Linux */
+#   define EPOLL
+#  endif
+# endif
+
+# ifdef EPOLL
+# include <sys/epoll.h>
+# else
+#  undef NETTHREAD	/* the network I/O thread requires epoll */
+# endif
+# ifdef NETTHREAD
+# include <poll.h>
+# endif
+
 # ifndef MAXHOSTNAMELEN
 # define MAXHOSTNAMELEN	1025
 # endif
@@ -75,6 +95,7 @@ struct pipes {
 };
 
 static int in = -1, out = -1;		/* pipe to/from name resolver */
+static pipes inout;			/* name resolver side of the pipes */
 static int addrtype;			/* network address family */
 static ipaddr **ipahtab;		/* ip address hash table */
 static unsigned int ipahtabsz;		/* hash table size */
@@ -85,6 +106,21 @@ static ipaddr *lastreq;			/* last request */
 static bool busy;			/* name resolver busy */
 static pthread_t lookup;		/* name lookup thread */
 
+/*
+ * NAME:	conn->thread()
+ * DESCRIPTION:	start a helper thread, leaving signals to the main thread
+ */
+static int conn_thread(pthread_t *thread, void *(*func)(void*), void *arg)
+{
+    sigset_t mask, omask;
+    int result;
+
+    sigfillset(&mask);
+    pthread_sigmask(SIG_BLOCK, &mask, &omask);
+    result = pthread_create(thread, NULL, func, arg);
+    pthread_sigmask(SIG_SETMASK, &omask, (sigset_t *) NULL);
+    return result;
+}
 
 extern "C" {
 
@@ -151,7 +187,6 @@ static bool ipa_init(int maxusers)
 {
     if (in < 0) {
 	int fd[4];
-	static pipes inout;
 
 	if (pipe(fd) < 0) {
 	    perror("pipe");
@@ -165,7 +200,7 @@ static bool ipa_init(int maxusers)
 	}
 	inout.in = fd[0];
 	inout.out = fd[3];
-	if (pthread_create(&lookup, NULL, &ipa_run, &inout) < 0) {
+	if (conn_thread(&lookup, &ipa_run, &inout) < 0) {
 	    perror("pthread_create");
 	    close(fd[0]);
 	    close(fd[1]);
@@ -418,8 +453,20 @@ static void ipa_lookup()
     }
 }
 
+struct netbuf;
+
 struct connection : public Hashtab::Entry {
     int fd;				/* file descriptor */
+    int owner;				/* index of owning user */
+# ifdef EPOLL
+    connection *rprev;			/* previous in ready list */
+    connection *rnext;			/* next in ready list */
+# endif
+# ifdef NETTHREAD
+    netbuf *net;			/* buffers shared with the I/O thread */
+    int kicked;				/* queued for the I/O thread */
+    int readied;			/* queued for the interpreter */
+# endif
     int npkts;				/* # packets in buffer */
     int bufsz;				/* # bytes in buffer */
     char *udpbuf;			/* datagram buffer */
@@ -706,26 +753,938 @@ static void *udp_run(void *arg)
 	}
     }
 
-    pthread_mutex_destroy(&udpmutex);
-    close(inpkts);
-    close(outpkts);
-    return (void *) NULL;
+    pthread_mutex_destroy(&udpmutex);
+    close(inpkts);
+    close(outpkts);
+    return (void *) NULL;
+}
+
+}
+
+# define CONN_READF	0x01	/* read flag set */
+# define CONN_WRITEF	0x02	/* write flag set */
+# define CONN_WAITF	0x04	/* wait flag set */
+# define CONN_UCHAL	0x08	/* UDP challenge issued */
+# define CONN_UCHAN	0x10	/* UDP channel established */
+# define CONN_ADDR	0x20	/* has an address */
+# define CONN_BLOCKF	0x40	/* input blocked (not exported) */
+
+static int nusers;			/* # of users */
+static connection *connections;		/* connections array */
+static connection *flist;		/* list of free connections */
+static portdesc *tdescs, *bdescs;	/* telnet & binary descriptor arrays */
+static int ntdescs, nbdescs;		/* # telnet & binary ports */
+# ifdef EPOLL
+struct fdstate {
+    connection *conn;			/* connection using this descriptor */
+    char flags;				/* readiness flags */
+};
+
+# define NEVENTS	256		/* max # of events per epoll_wait() */
+
+static int epfd;			/* epoll descriptor */
+static fdstate *fdtab;			/* file descriptor state table */
+static int fdtabsz;			/* size of file descriptor state table */
+static connection *rhead, *rtail;	/* list of ready connections */
+# else
+static fd_set infds;			/* file descriptor input bitmap */
+static fd_set outfds;			/* file descriptor output bitmap */
+static fd_set waitfds;			/* file descriptor wait-write bitmap */
+static fd_set readfds;			/* file descriptor read bitmap */
+static fd_set writefds;			/* file descriptor write map */
+static int maxfd;			/* largest fd opened yet */
+static int nextrdy;			/* next connection to check if ready */
+# endif
+static int closed;			/* #fds closed in write */
+# ifdef NETTHREAD
+# define NETIN_SIZE	16384		/* size of network input ring */
+# define NETOUT_SIZE	65536		/* size of network output ring */
+# define NET_LINGER	60		/* seconds to flush output after close */
+
+/* I/O thread state */
+# define NET_EOF	0x01	/* end of input, or read error */
+# define NET_ERROR	0x02	/* write error */
+# define NET_RFULL	0x04	/* input ring full, reading suspended */
+# define NET_WAIT	0x08	/* interpreter waiting for output space */
+
+struct ringbuf {
+    Uint head;				/* consumer position */
+    Uint tail;				/* producer position */
+    Uint size;				/* size of buffer, a power of 2 */
+    char *buf;				/* ring buffer */
+};
+
+struct netbuf {
+    ringbuf in;				/* input, filled by the I/O thread */
+    ringbuf out;			/* output, drained by the I/O thread */
+    netbuf *next;			/* next in close or linger list */
+    int fd;				/* file descriptor */
+    int index;				/* connection index, -1 when closed */
+    int state;				/* I/O thread state */
+    bool linger;			/* flush output before closing */
+    time_t expire;			/* end of linger period */
+};
+
+struct netqueue {
+    int *idx;				/* connection indices */
+    int size;				/* size of queue */
+    int head;				/* consumer position */
+    int tail;				/* producer position */
+};
+
+static int netfd;			/* I/O thread epoll descriptor */
+static int netwake[2];			/* pipe to wake up the I/O thread */
+static int netready[2];			/* pipe to wake up the interpreter */
+static netqueue kickq;			/* connections for the I/O thread */
+static netqueue readyq;			/* connections for the interpreter */
+static netbuf *netclose;		/* connections closed by interpreter */
+static netbuf *netlinger;		/* closed connections flushing output */
+static bool netnotify;			/* wake up the interpreter? */
+static int netidle;			/* I/O thread waiting for events? */
+static bool netstop;			/* stop I/O thread? */
+static pthread_t netthread;		/* I/O thread */
+static pthread_mutex_t netmutex;	/* I/O thread mutex */
+# endif
+
+# ifdef EPOLL
+# define FD_READY(fd, f)	(fdtab[fd].flags & (f))
+# define FD_MARK(fd, f)		(fdtab[fd].flags |= (f))
+# define FD_UNMARK(fd, f)	(fdtab[fd].flags &= ~(f))
+
+/*
+ * NAME:	conn->rdyadd()
+ * DESCRIPTION:	add a connection to the ready list
+ */
+static void conn_rdyadd(connection *conn)
+{
+    if (conn->rprev == (connection *) NULL && rhead != conn) {
+	conn->rnext = (connection *) NULL;
+	if (rtail != (connection *) NULL) {
+	    rtail->rnext = conn;
+	    conn->rprev = rtail;
+	} else {
+	    rhead = conn;
+	}
+	rtail = conn;
+    }
+}
+
+/*
+ * NAME:	conn->rdydel()
+ * DESCRIPTION:	remove a connection from the ready list
+ */
+static void conn_rdydel(connection *conn)
+{
+    if (conn->rprev != (connection *) NULL || rhead == conn) {
+	if (conn->rprev != (connection *) NULL) {
+	    conn->rprev->rnext = conn->rnext;
+	} else {
+	    rhead = conn->rnext;
+	}
+	if (conn->rnext != (connection *) NULL) {
+	    conn->rnext->rprev = conn->rprev;
+	} else {
+	    rtail = conn->rprev;
+	}
+	conn->rprev = conn->rnext = (connection *) NULL;
+    }
+}
+# else
+# define FD_READY(fd, f)	FD_ISSET(fd, conn_fdset(f))
+# define FD_MARK(fd, f)		FD_SET(fd, conn_fdset(f))
+# define FD_UNMARK(fd, f)	FD_CLR(fd, conn_fdset(f))
+
+/*
+ * NAME:	conn->fdset()
+ * DESCRIPTION:	return the bitmap corresponding to a readiness flag
+ */
+static fd_set *conn_fdset(int flag)
+{
+    switch (flag) {
+    case CONN_READF:
+	return &readfds;
+
+    case CONN_WRITEF:
+	return &writefds;
+
+    default:
+	return &waitfds;
+    }
+}
+# endif
+
+/*
+ * NAME:	conn->watch()
+ * DESCRIPTION:	start watching a file descriptor, edge-triggered if possible
+ */
+static void conn_watch(int fd, connection *conn, bool edge)
+{
+# ifdef EPOLL
+    struct epoll_event ev;
+
+    if (fd >= fdtabsz) {
+	int size;
+
+	size = (fd < 2 * fdtabsz) ? 2 * fdtabsz : fd + 1;
+	fdtab = REALLOC(fdtab, fdstate, fdtabsz, size);
+	memset(fdtab + fdtabsz, '\0', (size - fdtabsz) * sizeof(fdstate));
+	fdtabsz = size;
+    }
+    fdtab[fd].conn = conn;
+    fdtab[fd].flags = 0;
+
+    memset(&ev, '\0', sizeof(struct epoll_event));
+    ev.events = (conn != (connection *) NULL) ? EPOLLIN | EPOLLOUT : EPOLLIN;
+    if (edge) {
+	ev.events |= EPOLLET;
+    }
+    ev.data.fd = fd;
+# ifdef NETTHREAD
+    if (conn != (connection *) NULL && conn->net != (netbuf *) NULL) {
+	/* reading and writing is done by the I/O thread */
+	ev.data.ptr = conn->net;
+	if (epoll_ctl(netfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+	    perror("epoll_ctl");
+	}
+	return;
+    }
+# endif
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+	perror("epoll_ctl");
+    }
+# else
+    UNREFERENCED_PARAMETER(edge);
+
+    FD_SET(fd, &infds);
+    if (conn != (connection *) NULL) {
+	FD_SET(fd, &outfds);
+    }
+    if (fd > maxfd) {
+	maxfd = fd;
+    }
+# endif
+}
+
+/*
+ * NAME:	conn->unwatch()
+ * DESCRIPTION:	stop watching a file descriptor, before it is closed
+ */
+static void conn_unwatch(int fd)
+{
+# ifdef EPOLL
+    struct epoll_event ev;
+
+    epoll_ctl(epfd, EPOLL_CTL_DEL, fd, &ev);
+    fdtab[fd].conn = (connection *) NULL;
+    fdtab[fd].flags = 0;
+# else
+    FD_CLR(fd, &infds);
+    FD_CLR(fd, &outfds);
+    FD_CLR(fd, &waitfds);
+    FD_CLR(fd, &readfds);
+    FD_CLR(fd, &writefds);
+# endif
+}
+
+# ifdef NETTHREAD
+/*
+ * NAME:	ring->iov()
+ * DESCRIPTION:	describe a range of a ring buffer with at most two iovecs
+ */
+static int ring_iov(ringbuf *r, Uint pos, Uint len, struct iovec *iov)
+{
+    Uint offset;
+
+    offset = pos & (r->size - 1);
+    iov[0].iov_base = r->buf + offset;
+    if (offset + len <= r->size) {
+	iov[0].iov_len = len;
+	return 1;
+    }
+    iov[0].iov_len = r->size - offset;
+    iov[1].iov_base = r->buf;
+    iov[1].iov_len = len - (r->size - offset);
+    return 2;
+}
+
+/*
+ * NAME:	ring->used()
+ * DESCRIPTION:	return the number of bytes in a ring buffer
+ */
+static Uint ring_used(ringbuf *r)
+{
+    return __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) -
+	   __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+}
+
+/*
+ * NAME:	ring->put()
+ * DESCRIPTION:	add as much as fits to a ring buffer, as the producer
+ */
+static Uint ring_put(ringbuf *r, struct iovec *iov, int iovcnt)
+{
+    struct iovec riov[2];
+    Uint tail, space, len, size;
+    char *p;
+    int i, n;
+
+    tail = r->tail;
+    space = r->size - (tail - __atomic_load_n(&r->head, __ATOMIC_ACQUIRE));
+    for (size = 0; iovcnt > 0 && space != 0; iov++, --iovcnt) {
+	p = (char *) iov->iov_base;
+	len = (iov->iov_len < space) ? iov->iov_len : space;
+	if (len == 0) {
+	    continue;
+	}
+	n = ring_iov(r, tail, len, riov);
+	for (i = 0; i < n; i++) {
+	    memcpy(riov[i].iov_base, p, riov[i].iov_len);
+	    p += riov[i].iov_len;
+	}
+	tail += len;
+	space -= len;
+	size += len;
+    }
+    __atomic_store_n(&r->tail, tail, __ATOMIC_RELEASE);
+
+    return size;
+}
+
+/*
+ * NAME:	ring->get()
+ * DESCRIPTION:	take bytes from a ring buffer, as the consumer
+ */
+static Uint ring_get(ringbuf *r, char *buf, Uint len)
+{
+    struct iovec riov[2];
+    Uint head, size;
+    int i, n;
+
+    head = r->head;
+    size = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) - head;
+    if (size > len) {
+	size = len;
+    }
+    if (size != 0) {
+	n = ring_iov(r, head, size, riov);
+	for (i = 0; i < n; i++) {
+	    memcpy(buf, riov[i].iov_base, riov[i].iov_len);
+	    buf += riov[i].iov_len;
+	}
+	__atomic_store_n(&r->head, head + size, __ATOMIC_RELEASE);
+    }
+
+    return size;
+}
+
+/*
+ * NAME:	netqueue->put()
+ * DESCRIPTION:	add a connection index to a queue, as the producer
+ */
+static void netq_put(netqueue *q, int i)
+{
+    int tail;
+
+    tail = q->tail;
+    q->idx[tail] = i;
+    __atomic_store_n(&q->tail, (tail + 1) % q->size, __ATOMIC_RELEASE);
+}
+
+/*
+ * NAME:	netqueue->get()
+ * DESCRIPTION:	take a connection index from a queue, as the consumer;
+ *		return -1 if the queue is empty
+ */
+static int netq_get(netqueue *q)
+{
+    int head, i;
+
+    head = q->head;
+    if (head == __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE)) {
+	return -1;
+    }
+    i = q->idx[head];
+    __atomic_store_n(&q->head, (head + 1) % q->size, __ATOMIC_RELEASE);
+    return i;
+}
+
+/*
+ * NAME:	net->notify()
+ * DESCRIPTION:	tell the interpreter to look at a connection
+ */
+static void net_notify(netbuf *net)
+{
+    connection *conn;
+
+    if (net->index >= 0) {
+	conn = &connections[net->index];
+	if (__atomic_exchange_n(&conn->readied, 1, __ATOMIC_SEQ_CST) == 0) {
+	    netq_put(&readyq, net->index);
+	    netnotify = TRUE;
+	}
+    }
+}
+
+/*
+ * NAME:	net->fill()
+ * DESCRIPTION:	read from a connection until the socket or the input ring
+ *		is exhausted
+ */
+static void net_fill(netbuf *net)
+{
+    struct iovec iov[2];
+    Uint head, tail;
+    int size;
+
+    if (__atomic_load_n(&net->state, __ATOMIC_SEQ_CST) & NET_EOF) {
+	return;
+    }
+    for (;;) {
+	head = __atomic_load_n(&net->in.head, __ATOMIC_SEQ_CST);
+	tail = net->in.tail;
+	if (tail - head == net->in.size) {
+	    /* suspend reading until the interpreter catches up */
+	    __atomic_fetch_or(&net->state, NET_RFULL, __ATOMIC_SEQ_CST);
+	    if (__atomic_load_n(&net->in.head, __ATOMIC_SEQ_CST) == head) {
+		return;
+	    }
+	    __atomic_fetch_and(&net->state, ~NET_RFULL, __ATOMIC_SEQ_CST);
+	    continue;
+	}
+
+	size = readv(net->fd, iov,
+		     ring_iov(&net->in, tail, net->in.size - (tail - head), iov));
+	if (size > 0) {
+	    __atomic_store_n(&net->in.tail, tail + size, __ATOMIC_RELEASE);
+	    net_notify(net);
+	} else if (size == 0 ||
+		   (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK)) {
+	    __atomic_fetch_or(&net->state, NET_EOF, __ATOMIC_SEQ_CST);
+	    net_notify(net);
+	    return;
+	} else if (errno != EINTR) {
+	    return;	/* drained */
+	}
+    }
+}
+
+/*
+ * NAME:	net->drain()
+ * DESCRIPTION:	write the output ring of a connection to the socket
+ */
+static void net_drain(netbuf *net)
+{
+    struct iovec iov[2];
+    Uint head, tail;
+    int size;
+
+    if (__atomic_load_n(&net->state, __ATOMIC_SEQ_CST) & NET_ERROR) {
+	return;
+    }
+    for (;;) {
+	tail = __atomic_load_n(&net->out.tail, __ATOMIC_ACQUIRE);
+	head = net->out.head;
+	if (head == tail) {
+	    break;
+	}
+
+	size = writev(net->fd, iov, ring_iov(&net->out, head, tail - head, iov));
+	if (size > 0) {
+	    __atomic_store_n(&net->out.head, head + size, __ATOMIC_RELEASE);
+	} else if (size == 0 ||
+		   (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK)) {
+	    __atomic_fetch_or(&net->state, NET_ERROR, __ATOMIC_SEQ_CST);
+	    net_notify(net);
+	    return;
+	} else if (errno != EINTR) {
+	    break;	/* socket full */
+	}
+    }
+
+    if ((__atomic_load_n(&net->state, __ATOMIC_SEQ_CST) & NET_WAIT) &&
+	ring_used(&net->out) <= NETOUT_SIZE / 2) {
+	__atomic_fetch_and(&net->state, ~NET_WAIT, __ATOMIC_SEQ_CST);
+	net_notify(net);
+    }
+}
+
+/*
+ * NAME:	net->done()
+ * DESCRIPTION:	close the descriptor of a released connection
+ */
+static void net_done(netbuf *net)
+{
+    struct epoll_event ev;
+
+    epoll_ctl(netfd, EPOLL_CTL_DEL, net->fd, &ev);
+    if (net->linger) {
+	shutdown(net->fd, SHUT_WR);
+    }
+    close(net->fd);
+}
+
+extern "C" {
+
+/*
+ * NAME:	net->run()
+ * DESCRIPTION:	network I/O thread
+ */
+static void *net_run(void *arg)
+{
+    struct epoll_event events[NEVENTS];
+    char buf[64];
+    int retval, timeout, n;
+    netbuf *net, **l;
+    time_t now;
+
+    UNREFERENCED_PARAMETER(arg);
+
+    timeout = 0;
+    for (;;) {
+	retval = epoll_wait(netfd, events, NEVENTS, timeout);
+	__atomic_store_n(&netidle, FALSE, __ATOMIC_SEQ_CST);
+	pthread_mutex_lock(&netmutex);
+	if (netstop) {
+	    pthread_mutex_unlock(&netmutex);
+	    break;
+	}
+	netnotify = FALSE;
+
+	for (n = 0; n < retval; n++) {
+	    net = (netbuf *) events[n].data.ptr;
+	    if (net == (netbuf *) NULL) {
+		/* woken up by the interpreter */
+		while (read(netwake[0], buf, sizeof(buf)) > 0) ;
+		continue;
+	    }
+	    if (net->index >= 0 &&
+		(events[n].events & (EPOLLIN | EPOLLHUP | EPOLLERR))) {
+		net_fill(net);
+	    }
+	    if (events[n].events & (EPOLLOUT | EPOLLHUP | EPOLLERR)) {
+		net_drain(net);
+	    }
+	}
+
+	/* connections with new output, or room for more input */
+	while ((n = netq_get(&kickq)) >= 0) {
+	    __atomic_store_n(&connections[n].kicked, 0, __ATOMIC_SEQ_CST);
+	    net = connections[n].net;
+	    if (net != (netbuf *) NULL) {
+		net_fill(net);
+		net_drain(net);
+	    }
+	}
+
+	/* connections closed by the interpreter */
+	while (netclose != (netbuf *) NULL) {
+	    net = netclose;
+	    netclose = net->next;
+	    net->next = netlinger;
+	    netlinger = net;
+	    net->expire = 0;
+	}
+	if (netlinger != (netbuf *) NULL) {
+	    now = time((time_t *) NULL);
+	    for (l = &netlinger; (net=*l) != (netbuf *) NULL; ) {
+		if (net->linger) {
+		    net_drain(net);
+		    if (net->expire == 0) {
+			net->expire = now + NET_LINGER;
+		    }
+		}
+		if (!net->linger || ring_used(&net->out) == 0 ||
+		    (net->state & NET_ERROR) || now >= net->expire) {
+		    *l = net->next;
+		    net_done(net);
+		    free(net);
+		} else {
+		    l = &net->next;
+		}
+	    }
+	}
+
+	/*
+	 * Announce going idle before checking for more work, so that either
+	 * this thread sees the work, or the interpreter wakes it up.
+	 */
+	__atomic_store_n(&netidle, TRUE, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&kickq.tail, __ATOMIC_SEQ_CST) != kickq.head ||
+	    netclose != (netbuf *) NULL) {
+	    timeout = 0;
+	} else {
+	    timeout = (netlinger != (netbuf *) NULL) ? 1000 : -1;
+	}
+	pthread_mutex_unlock(&netmutex);
+
+	if (netnotify) {
+	    (void) write(netready[1], "", 1);
+	}
+    }
+
+    return (void *) NULL;
+}
+
+}
+
+/*
+ * NAME:	net->init()
+ * DESCRIPTION:	start the network I/O thread
+ */
+static bool net_init(int maxusers)
+{
+    struct epoll_event ev;
+
+    netfd = epoll_create1(EPOLL_CLOEXEC);
+    if (netfd < 0) {
+	perror("epoll_create1");
+	return FALSE;
+    }
+    if (pipe(netwake) < 0 || pipe(netready) < 0) {
+	perror("pipe");
+	return FALSE;
+    }
+    fcntl(netwake[0], F_SETFL, O_NONBLOCK);
+    fcntl(netwake[1], F_SETFL, O_NONBLOCK);
+    fcntl(netready[0], F_SETFL, O_NONBLOCK);
+    fcntl(netready[1], F_SETFL, O_NONBLOCK);
+
+    kickq.idx = ALLOC(int, kickq.size = maxusers + 1);
+    kickq.head = kickq.tail = 0;
+    readyq.idx = ALLOC(int, readyq.size = maxusers + 1);
+    readyq.head = readyq.tail = 0;
+    netclose = netlinger = (netbuf *) NULL;
+    netidle = FALSE;
+    netstop = FALSE;
+
+    memset(&ev, '\0', sizeof(struct epoll_event));
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;
+    if (epoll_ctl(netfd, EPOLL_CTL_ADD, netwake[0], &ev) < 0) {
+	perror("epoll_ctl");
+	return FALSE;
+    }
+    conn_watch(netready[0], (connection *) NULL, FALSE);
+
+    pthread_mutex_init(&netmutex, NULL);
+    if (conn_thread(&netthread, &net_run, (void *) NULL) != 0) {
+	perror("pthread_create");
+	return FALSE;
+    }
+    return TRUE;
+}
+
+/*
+ * NAME:	net->wake()
+ * DESCRIPTION:	wake up the I/O thread, if it is waiting for events
+ */
+static void net_wake()
+{
+    if (__atomic_exchange_n(&netidle, FALSE, __ATOMIC_SEQ_CST)) {
+	(void) write(netwake[1], "", 1);
+    }
+}
+
+/*
+ * NAME:	net->kick()
+ * DESCRIPTION:	have the I/O thread service a connection
+ */
+static void net_kick(connection *conn)
+{
+    if (__atomic_exchange_n(&conn->kicked, 1, __ATOMIC_SEQ_CST) == 0) {
+	netq_put(&kickq, conn - connections);
+	net_wake();
+    }
+}
+
+/*
+ * NAME:	net->new()
+ * DESCRIPTION:	hand a new connection to the I/O thread
+ */
+static void net_new(connection *conn, int fd)
+{
+    netbuf *net;
+
+    net = (netbuf *) malloc(sizeof(netbuf) + NETIN_SIZE + NETOUT_SIZE);
+    if (net == (netbuf *) NULL) {
+	fatal("out of memory");
+    }
+    net->in.head = net->in.tail = 0;
+    net->in.size = NETIN_SIZE;
+    net->in.buf = (char *) (net + 1);
+    net->out.head = net->out.tail = 0;
+    net->out.size = NETOUT_SIZE;
+    net->out.buf = net->in.buf + NETIN_SIZE;
+    net->next = (netbuf *) NULL;
+    net->fd = fd;
+    net->index = conn - connections;
+    net->state = 0;
+    net->linger = FALSE;
+
+    pthread_mutex_lock(&netmutex);
+    conn->net = net;
+    pthread_mutex_unlock(&netmutex);
+}
+
+/*
+ * NAME:	net->release()
+ * DESCRIPTION:	let the I/O thread close a connection, after flushing its
+ *		output if linger is set
+ */
+static void net_release(connection *conn, bool linger)
+{
+    netbuf *net;
+
+    fdtab[conn->fd].conn = (connection *) NULL;
+    fdtab[conn->fd].flags = 0;
+
+    pthread_mutex_lock(&netmutex);
+    net = conn->net;
+    net->index = -1;
+    net->linger = linger;
+    net->next = netclose;
+    netclose = net;
+    conn->net = (netbuf *) NULL;
+    pthread_mutex_unlock(&netmutex);
+    net_wake();
+}
+
+/*
+ * NAME:	net->ready()
+ * DESCRIPTION:	update the readiness of connections the I/O thread reported
+ */
+static void net_ready()
+{
+    char buf[64];
+    connection *conn;
+    netbuf *net;
+    int n, state;
+
+    while (read(netready[0], buf, sizeof(buf)) > 0) ;
+    while ((n = netq_get(&readyq)) >= 0) {
+	conn = &connections[n];
+	__atomic_store_n(&conn->readied, 0, __ATOMIC_SEQ_CST);
+	net = conn->net;
+	if (net == (netbuf *) NULL) {
+	    continue;
+	}
+	state = __atomic_load_n(&net->state, __ATOMIC_SEQ_CST);
+	if (ring_used(&net->in) != 0 || (state & (NET_EOF | NET_ERROR))) {
+	    FD_MARK(conn->fd, CONN_READF);
+	}
+	if (ring_used(&net->out) <= NETOUT_SIZE / 2 || (state & NET_ERROR)) {
+	    FD_MARK(conn->fd, CONN_WRITEF);
+	}
+	if ((FD_READY(conn->fd, CONN_READF | CONN_BLOCKF) == CONN_READF) ||
+	    (FD_READY(conn->fd, CONN_WAITF | CONN_WRITEF) ==
+					    (CONN_WAITF | CONN_WRITEF))) {
+	    conn_rdyadd(conn);
+	}
+    }
+}
+
+/*
+ * NAME:	net->read()
+ * DESCRIPTION:	read from the input ring of a connection
+ */
+static int net_read(connection *conn, char *buf, unsigned int len)
+{
+    netbuf *net;
+    int size, state;
+
+    net = conn->net;
+    size = ring_get(&net->in, buf, len);
+    state = __atomic_load_n(&net->state, __ATOMIC_SEQ_CST);
+    if (size == 0) {
+	if (state & (NET_EOF | NET_ERROR)) {
+	    net_release(conn, FALSE);
+	    conn->fd = -1;
+	    closed++;
+	    conn_rdyadd(conn);	/* let the owner discover the close */
+	    return -1;
+	}
+	FD_UNMARK(conn->fd, CONN_READF);
+	return 0;
+    }
+
+    if (state & NET_RFULL) {
+	/* there is room again */
+	__atomic_fetch_and(&net->state, ~NET_RFULL, __ATOMIC_SEQ_CST);
+	net_kick(conn);
+    }
+    if (ring_used(&net->in) != 0 || (state & (NET_EOF | NET_ERROR))) {
+	conn_rdyadd(conn);	/* more input, or end of file to report */
+    } else {
+	FD_UNMARK(conn->fd, CONN_READF);
+    }
+    return size;
+}
+
+/*
+ * NAME:	net->writev()
+ * DESCRIPTION:	add output to the output ring of a connection
+ */
+static int net_writev(connection *conn, struct iovec *iov, int iovcnt,
+		      unsigned int len)
+{
+    netbuf *net;
+    unsigned int size;
+
+    net = conn->net;
+    if (__atomic_load_n(&net->state, __ATOMIC_SEQ_CST) & NET_ERROR) {
+	net_release(conn, FALSE);
+	conn->fd = -1;
+	closed++;
+	conn_rdyadd(conn);
+	return -1;
+    }
+
+    size = ring_put(&net->out, iov, iovcnt);
+    if (size != 0) {
+	net_kick(conn);
+    }
+    if (size != len) {
+	/* waiting for wrdone */
+	FD_MARK(conn->fd, CONN_WAITF);
+	FD_UNMARK(conn->fd, CONN_WRITEF);
+	__atomic_fetch_or(&net->state, NET_WAIT, __ATOMIC_SEQ_CST);
+	if (ring_used(&net->out) <= NETOUT_SIZE / 2) {
+	    /* drained in the meantime */
+	    FD_MARK(conn->fd, CONN_WRITEF);
+	    conn_rdyadd(conn);
+	}
+    }
+    return size;
+}
+
+/*
+ * NAME:	net->stop()
+ * DESCRIPTION:	stop the I/O thread before the connections are exported,
+ *		flushing the output of all connections for up to the linger
+ *		period
+ */
+static void net_stop()
+{
+    struct pollfd *pfds;
+    int i, n;
+    connection *conn;
+    netbuf *net;
+    time_t expire;
+
+    pthread_mutex_lock(&netmutex);
+    netstop = TRUE;
+    pthread_mutex_unlock(&netmutex);
+    net_wake();
+    pthread_join(netthread, (void **) NULL);
+
+    /* connections closed by the interpreter */
+    n = nusers;
+    while (netclose != (netbuf *) NULL) {
+	net = netclose;
+	netclose = net->next;
+	net->next = netlinger;
+	netlinger = net;
+    }
+    for (net = netlinger; net != (netbuf *) NULL; net = net->next) {
+	n++;
+    }
+
+    /*
+     * flush all output rings at once
+     */
+    pfds = ALLOC(struct pollfd, n);
+    expire = time((time_t *) NULL) + NET_LINGER;
+    for (;;) {
+	n = 0;
+	for (i = nusers, conn = connections; i > 0; --i, conn++) {
+	    net = conn->net;
+	    if (net != (netbuf *) NULL) {
+		net_drain(net);
+		if (ring_used(&net->out) != 0 && !(net->state & NET_ERROR)) {
+		    pfds[n].fd = net->fd;
+		    pfds[n++].events = POLLOUT;
+		}
+	    }
+	}
+	for (net = netlinger; net != (netbuf *) NULL; net = net->next) {
+	    if (net->linger) {
+		net_drain(net);
+		if (ring_used(&net->out) != 0 && !(net->state & NET_ERROR)) {
+		    pfds[n].fd = net->fd;
+		    pfds[n++].events = POLLOUT;
+		}
+	    }
+	}
+	if (n == 0 || time((time_t *) NULL) >= expire) {
+	    break;
+	}
+	(void) poll(pfds, n, 1000);
+    }
+    FREE(pfds);
+
+    /* close connections that were closed already */
+    while (netlinger != (netbuf *) NULL) {
+	net = netlinger;
+	netlinger = net->next;
+	net_done(net);
+	free(net);
+    }
 }
 
+/*
+ * NAME:	net->finish()
+ * DESCRIPTION:	stop the I/O thread, flushing what output can be flushed
+ */
+static void net_finish()
+{
+    int n;
+    connection *conn;
+    netbuf *net;
+
+    pthread_mutex_lock(&netmutex);
+    netstop = TRUE;
+    for (n = nusers, conn = connections; n > 0; --n, conn++) {
+	if (conn->net != (netbuf *) NULL) {
+	    net_drain(conn->net);
+	}
+    }
+    while (netclose != (netbuf *) NULL) {
+	net = netclose;
+	netclose = net->next;
+	net->next = netlinger;
+	netlinger = net;
+    }
+    for (net = netlinger; net != (netbuf *) NULL; net = net->next) {
+	if (net->linger) {
+	    net_drain(net);
+	}
+	net_done(net);
+    }
+    netlinger = (netbuf *) NULL;
+    pthread_mutex_unlock(&netmutex);
+    net_wake();
 }
+# endif
 
-static int nusers;			/* # of users */
-static connection *connections;		/* connections array */
-static connection *flist;		/* list of free connections */
-static portdesc *tdescs, *bdescs;	/* telnet & binary descriptor arrays */
-static int ntdescs, nbdescs;		/* # telnet & binary ports */
-static fd_set infds;			/* file descriptor input bitmap */
-static fd_set outfds;			/* file descriptor output bitmap */
-static fd_set waitfds;			/* file descriptor wait-write bitmap */
-static fd_set readfds;			/* file descriptor read bitmap */
-static fd_set writefds;			/* file descriptor write map */
-static int maxfd;			/* largest fd opened yet */
-static int closed;			/* #fds closed in write */
+/*
+ * NAME:	conn->shut()
+ * DESCRIPTION:	stop watching a connection and close its descriptor, after
+ *		flushing pending output if linger is set
+ */
+static void conn_shut(connection *conn, bool linger)
+{
+# ifdef NETTHREAD
+    if (conn->net != (netbuf *) NULL) {
+	net_release(conn, linger);
+	return;
+    }
+# endif
+    if (linger) {
+	shutdown(conn->fd, SHUT_WR);
+    }
+    conn_unwatch(conn->fd);
+    close(conn->fd);
+}
 
 # ifdef INET6
 /*
@@ -768,10 +1727,7 @@ static int conn_port6(int *fd, int type, struct sockaddr_in6 *sin6, unsigned int
     }
 
     if (type == SOCK_STREAM) {
-	if (*fd > maxfd) {
-	    maxfd = *fd;
-	}
-	FD_SET(*fd, &infds);
+	conn_watch(*fd, (connection *) NULL, TRUE);
     }
     return TRUE;
 }
@@ -810,10 +1766,7 @@ static int conn_port(int *fd, int type, struct sockaddr_in *sin, unsigned int po
     }
 
     if (type == SOCK_STREAM) {
-	if (*fd > maxfd) {
-	    maxfd = *fd;
-	}
-	FD_SET(*fd, &infds);
+	conn_watch(*fd, (connection *) NULL, TRUE);
     }
     return TRUE;
 }
@@ -846,20 +1799,29 @@ bool conn_init(int maxusers, char **thosts, char **bhosts, char **dhosts,
 
     nusers = 0;
 
+# ifdef EPOLL
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0) {
+	perror("epoll_create1");
+	return FALSE;
+    }
+    fdtab = ALLOC(fdstate, fdtabsz = 2 * maxusers + 16);
+    memset(fdtab, '\0', fdtabsz * sizeof(fdstate));
+    rhead = rtail = (connection *) NULL;
+# else
     maxfd = 0;
     FD_ZERO(&infds);
     FD_ZERO(&outfds);
     FD_ZERO(&waitfds);
-    FD_SET(in, &infds);
+    nextrdy = 0;
+# endif
+    conn_watch(in, (connection *) NULL, FALSE);
     closed = 0;
 
     pipe(fds);
     inpkts = fds[0];
     outpkts = fds[1];
-    FD_SET(inpkts, &infds);
-    if (inpkts > maxfd) {
-	maxfd = inpkts;
-    }
+    conn_watch(inpkts, (connection *) NULL, FALSE);
 
     ntdescs = ntports;
     if (ntports != 0) {
@@ -1077,9 +2039,22 @@ bool conn_init(int maxusers, char **thosts, char **bhosts, char **dhosts,
     connections = ALLOC(connection, nusers = maxusers);
     for (n = nusers, conn = connections; n > 0; --n, conn++) {
 	conn->fd = -1;
+	conn->owner = -1;
+# ifdef EPOLL
+	conn->rprev = conn->rnext = (connection *) NULL;
+# endif
+# ifdef NETTHREAD
+	conn->net = (netbuf *) NULL;
+	conn->kicked = conn->readied = 0;
+# endif
 	conn->next = flist;
 	flist = conn;
     }
+# ifdef NETTHREAD
+    if (!net_init(maxusers)) {
+	return FALSE;
+    }
+# endif
 
     udphtab = ALLOC(connection*, udphtabsz = maxusers);
     memset(udphtab, '\0', udphtabsz * sizeof(connection*));
@@ -1087,7 +2062,7 @@ bool conn_init(int maxusers, char **thosts, char **bhosts, char **dhosts,
     if (nudescs != 0) {
 	udpstop = FALSE;
 	pthread_mutex_init(&udpmutex, NULL);
-	if (pthread_create(&udp, NULL, &udp_run, (void *) NULL) < 0) {
+	if (conn_thread(&udp, &udp_run, (void *) NULL) < 0) {
 	    perror("pthread_create");
 	    return FALSE;
 	}
@@ -1142,6 +2117,9 @@ void conn_finish()
     int n;
     connection *conn;
 
+# ifdef NETTHREAD
+    net_finish();
+# endif
     for (n = nusers, conn = connections; n > 0; --n, conn++) {
 	if (conn->fd >= 0) {
 	    shutdown(conn->fd, SHUT_WR);
@@ -1150,6 +2128,75 @@ void conn_finish()
     }
 }
 
+/*
+ * NAME:	conn->portclose()
+ * DESCRIPTION:	close the descriptors of a port
+ */
+static void conn_portclose(portdesc *desc)
+{
+    if (desc->in6 >= 0) {
+	close(desc->in6);
+    }
+    if (desc->in4 >= 0) {
+	close(desc->in4);
+    }
+}
+
+/*
+ * NAME:	conn->child()
+ * DESCRIPTION:	close the network descriptors inherited by a child process,
+ *		without affecting them in the parent
+ */
+void conn_child()
+{
+    int n;
+    struct stat st;
+
+    /*
+     * close connection sockets, including those of closed connections
+     * that the I/O thread is still flushing
+     */
+# ifdef EPOLL
+    n = fdtabsz;
+# else
+    n = maxfd + 1;
+# endif
+    while (--n > 2) {
+	if (fstat(n, &st) == 0 && S_ISSOCK(st.st_mode)) {
+	    close(n);
+	}
+    }
+
+    /* ports, which may not have been included above */
+    for (n = 0; n < ntdescs; n++) {
+	conn_portclose(&tdescs[n]);
+    }
+    for (n = 0; n < nbdescs; n++) {
+	conn_portclose(&bdescs[n]);
+    }
+    for (n = 0; n < nudescs; n++) {
+	conn_portclose(&udescs[n].fd);
+    }
+
+    /* pipes to other threads */
+    close(in);
+    close(out);
+    close(inout.in);
+    close(inout.out);
+    close(inpkts);
+    close(outpkts);
+# ifdef EPOLL
+    close(epfd);
+# endif
+# ifdef NETTHREAD
+    close(netfd);
+    close(netwake[0]);
+    close(netwake[1]);
+    close(netready[0]);
+    close(netready[1]);
+# endif
+}
+
 /*
  * NAME:	conn->listen()
  * DESCRIPTION:	start listening on telnet port and binary port
@@ -1174,8 +2221,8 @@ void conn_listen()
 	if (tdescs[n].in4 >= 0) {
 	    if (listen(tdescs[n].in4, 64) < 0) {
 # ifdef INET6
+		conn_unwatch(tdescs[n].in4);
 		close(tdescs[n].in4);
-		FD_CLR(tdescs[n].in4, &infds);
 		tdescs[n].in4 = -1;
 		continue;
 # else
@@ -1205,8 +2252,8 @@ void conn_listen()
 	if (bdescs[n].in4 >= 0) {
 	    if (listen(bdescs[n].in4, 64) < 0) {
 # ifdef INET6
+		conn_unwatch(bdescs[n].in4);
 		close(bdescs[n].in4);
-		FD_CLR(bdescs[n].in4, &infds);
 		bdescs[n].in4 = -1;
 		continue;
 # else
@@ -1235,13 +2282,13 @@ static connection *conn_accept6(int portfd, int port)
     in46addr addr;
     connection *conn;
 
-    if (!FD_ISSET(portfd, &readfds)) {
+    if (!FD_READY(portfd, CONN_READF)) {
 	return (connection *) NULL;
     }
     len = sizeof(sin6);
     fd = accept(portfd, (struct sockaddr *) &sin6, &len);
     if (fd < 0) {
-	FD_CLR(portfd, &readfds);
+	FD_UNMARK(portfd, CONN_READF);
 	return (connection *) NULL;
     }
     fcntl(fd, F_SETFL, FNDELAY);
@@ -1261,13 +2308,12 @@ static connection *conn_accept6(int portfd, int port)
     }
     conn->addr = ipa_new(&addr);
     conn->at = port;
-    FD_SET(fd, &infds);
-    FD_SET(fd, &outfds);
-    FD_CLR(fd, &readfds);
-    FD_SET(fd, &writefds);
-    if (fd > maxfd) {
-	maxfd = fd;
-    }
+# ifdef NETTHREAD
+    net_new(conn, fd);
+# endif
+    conn_watch(fd, conn, TRUE);
+    FD_UNMARK(fd, CONN_READF);
+    FD_MARK(fd, CONN_WRITEF);
 
     return conn;
 }
@@ -1285,13 +2331,13 @@ static connection *conn_accept(int portfd, int port)
     in46addr addr;
     connection *conn;
 
-    if (!FD_ISSET(portfd, &readfds)) {
+    if (!FD_READY(portfd, CONN_READF)) {
 	return (connection *) NULL;
     }
     len = sizeof(sin);
     fd = accept(portfd, (struct sockaddr *) &sin, &len);
     if (fd < 0) {
-	FD_CLR(portfd, &readfds);
+	FD_UNMARK(portfd, CONN_READF);
 	return (connection *) NULL;
     }
     fcntl(fd, F_SETFL, FNDELAY);
@@ -1305,13 +2351,12 @@ static connection *conn_accept(int portfd, int port)
     addr.ipv6 = FALSE;
     conn->addr = ipa_new(&addr);
     conn->at = port;
-    FD_SET(fd, &infds);
-    FD_SET(fd, &outfds);
-    FD_CLR(fd, &readfds);
-    FD_SET(fd, &writefds);
-    if (fd > maxfd) {
-	maxfd = fd;
-    }
+# ifdef NETTHREAD
+    net_new(conn, fd);
+# endif
+    conn_watch(fd, conn, TRUE);
+    FD_UNMARK(fd, CONN_READF);
+    FD_MARK(fd, CONN_WRITEF);
 
     return conn;
 }
@@ -1500,15 +2545,15 @@ void conn_del(connection *conn)
     connection **hash;
 
     if (conn->fd >= 0) {
-	shutdown(conn->fd, SHUT_WR);
-	close(conn->fd);
-	FD_CLR(conn->fd, &infds);
-	FD_CLR(conn->fd, &outfds);
-	FD_CLR(conn->fd, &waitfds);
+	conn_shut(conn, TRUE);
 	conn->fd = -1;
     } else if (conn->fd == -1) {
 	--closed;
     }
+# ifdef EPOLL
+    conn_rdydel(conn);
+# endif
+    conn->owner = -1;
     if (conn->udpbuf != (char *) NULL) {
 	pthread_mutex_lock(&udpmutex);
 	if (conn->name != (char *) NULL) {
@@ -1545,6 +2590,20 @@ void conn_del(connection *conn)
  */
 void conn_block(connection *conn, int flag)
 {
+# ifdef EPOLL
+    if (flag) {
+	if (conn->fd >= 0) {
+	    FD_MARK(conn->fd, CONN_BLOCKF);
+	}
+    } else if (conn->fd < 0) {
+	conn_rdyadd(conn);	/* let the owner discover what happened */
+    } else {
+	FD_UNMARK(conn->fd, CONN_BLOCKF);
+	if (FD_READY(conn->fd, CONN_READF)) {
+	    conn_rdyadd(conn);	/* input arrived while blocked */
+	}
+    }
+# else
     if (conn->fd >= 0) {
 	if (flag) {
 	    FD_CLR(conn->fd, &infds);
@@ -1553,7 +2612,106 @@ void conn_block(connection *conn, int flag)
 	    FD_SET(conn->fd, &infds);
 	}
     }
+# endif
+}
+
+# ifdef EPOLL
+/*
+ * NAME:	conn->accepting()
+ * DESCRIPTION:	check for connections waiting to be accepted
+ */
+static bool conn_accepting(portdesc *descs, int n)
+{
+    while (n != 0) {
+	--n;
+	if ((descs[n].in6 >= 0 && FD_READY(descs[n].in6, CONN_READF)) ||
+	    (descs[n].in4 >= 0 && FD_READY(descs[n].in4, CONN_READF))) {
+	    return TRUE;
+	}
+    }
+    return FALSE;
+}
+
+/*
+ * NAME:	conn->select()
+ * DESCRIPTION:	wait for input from connections
+ */
+int conn_select(Uint t, unsigned int mtime)
+{
+    struct epoll_event events[NEVENTS];
+    int timeout, retval, n, fd;
+    connection *conn;
+    bool accepting;
+
+    /*
+     * Edge-triggered descriptors only report changes, so anything left
+     * pending from the previous cycle must be handled without waiting.
+     */
+    accepting = (flist != (connection *) NULL &&
+		 (conn_accepting(tdescs, ntdescs) ||
+		  conn_accepting(bdescs, nbdescs)));
+    if (closed != 0 || rhead != (connection *) NULL || accepting) {
+	timeout = 0;
+    } else if (mtime != 0xffff) {
+	timeout = (t >= 86400) ? 86400000 : t * 1000 + mtime;
+    } else {
+	timeout = -1;
+    }
+    retval = epoll_wait(epfd, events, NEVENTS, timeout);
+    if (retval < 0) {
+	retval = 0;
+    }
+
+    for (n = 0; n < retval; n++) {
+	fd = events[n].data.fd;
+	if (events[n].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+	    FD_MARK(fd, CONN_READF);
+	}
+	if (events[n].events & (EPOLLOUT | EPOLLHUP | EPOLLERR)) {
+	    FD_MARK(fd, CONN_WRITEF);
+	}
+	conn = fdtab[fd].conn;
+	if (conn != (connection *) NULL &&
+	    ((FD_READY(fd, CONN_READF | CONN_BLOCKF) == CONN_READF) ||
+	     (FD_READY(fd, CONN_WAITF | CONN_WRITEF) ==
+					    (CONN_WAITF | CONN_WRITEF)))) {
+	    conn_rdyadd(conn);
+	}
+    }
+
+    if (FD_READY(inpkts, CONN_READF)) {
+	/* find the connections with datagrams waiting */
+	FD_UNMARK(inpkts, CONN_READF);
+	pthread_mutex_lock(&udpmutex);
+	for (n = nusers, conn = connections; n > 0; --n, conn++) {
+	    if (conn->udpbuf != (char *) NULL && conn->npkts != 0) {
+		conn_rdyadd(conn);
+	    }
+	}
+	pthread_mutex_unlock(&udpmutex);
+    }
+
+# ifdef NETTHREAD
+    if (FD_READY(netready[0], CONN_READF)) {
+	/* connections serviced by the I/O thread */
+	FD_UNMARK(netready[0], CONN_READF);
+	net_ready();
+    }
+# endif
+
+    /* handle ip name lookup */
+    if (FD_READY(in, CONN_READF)) {
+	FD_UNMARK(in, CONN_READF);
+	ipa_lookup();
+    }
+
+    retval += closed;
+    if (retval == 0 && (rhead != (connection *) NULL || accepting)) {
+	retval = 1;
+    }
+    return retval;
 }
+# else
 
 /*
  * NAME:	conn->select()
@@ -1623,8 +2781,65 @@ int conn_select(Uint t, unsigned int mtime)
     if (FD_ISSET(in, &readfds)) {
 	ipa_lookup();
     }
+
+    nextrdy = 0;
     return retval;
 }
+# endif
+
+/*
+ * NAME:	conn->owner()
+ * DESCRIPTION:	set the index of the user that owns a connection
+ */
+void conn_owner(connection *conn, int owner)
+{
+    conn->owner = owner;
+}
+
+/*
+ * NAME:	conn->ready()
+ * DESCRIPTION:	return the owner of the next connection with pending I/O,
+ *		or -1 if there are no more
+ */
+int conn_ready()
+{
+    connection *conn;
+
+# ifdef EPOLL
+    while (rhead != (connection *) NULL) {
+	conn = rhead;
+	conn_rdydel(conn);
+	if (conn->owner >= 0) {
+	    return conn->owner;
+	}
+    }
+# else
+    bool ready;
+
+    while (nextrdy < nusers) {
+	conn = &connections[nextrdy++];
+	if (conn->owner < 0) {
+	    continue;
+	}
+	if (conn->fd >= 0) {
+	    ready = (FD_ISSET(conn->fd, &readfds) ||
+		     (FD_ISSET(conn->fd, &waitfds) &&
+		      FD_ISSET(conn->fd, &writefds)));
+	} else {
+	    ready = (conn->fd == -1);	/* closed */
+	}
+	if (!ready && conn->udpbuf != (char *) NULL) {
+	    pthread_mutex_lock(&udpmutex);
+	    ready = (conn->npkts != 0);
+	    pthread_mutex_unlock(&udpmutex);
+	}
+	if (ready) {
+	    return conn->owner;
+	}
+    }
+# endif
+    return -1;
+}
 
 /*
  * NAME:	conn->udpcheck()
@@ -1646,17 +2861,36 @@ int conn_read(connection *conn, char *buf, unsigned int len)
     if (conn->fd < 0) {
 	return -1;
     }
-    if (!FD_ISSET(conn->fd, &readfds)) {
+    if (!FD_READY(conn->fd, CONN_READF)) {
 	return 0;
     }
+# ifdef NETTHREAD
+    if (conn->net != (netbuf *) NULL) {
+	return net_read(conn, buf, len);
+    }
+# endif
     size = read(conn->fd, buf, len);
     if (size < 0) {
-	close(conn->fd);
-	FD_CLR(conn->fd, &infds);
-	FD_CLR(conn->fd, &outfds);
-	FD_CLR(conn->fd, &waitfds);
+# ifdef EPOLL
+	if (errno == EINTR) {
+	    conn_rdyadd(conn);
+	    return 0;
+	}
+	if (errno == EAGAIN || errno == EWOULDBLOCK) {
+	    FD_UNMARK(conn->fd, CONN_READF);
+	    return 0;
+	}
+# endif
+	conn_shut(conn, FALSE);
 	conn->fd = -1;
 	closed++;
+# ifdef EPOLL
+	conn_rdyadd(conn);	/* let the owner discover the error */
+    } else if (size == (int) len || size == 0) {
+	conn_rdyadd(conn);	/* more input, or end of file to report */
+    } else {
+	FD_UNMARK(conn->fd, CONN_READF);	/* drained */
+# endif
     }
     return (size == 0) ? -1 : size;
 }
@@ -1706,21 +2940,78 @@ int conn_write(connection *conn, char *buf, unsigned int len)
     if (len == 0) {
 	return 0;
     }
-    if (!FD_ISSET(conn->fd, &writefds)) {
+    if (!FD_READY(conn->fd, CONN_WRITEF)) {
 	/* the write would fail */
-	FD_SET(conn->fd, &waitfds);
+	FD_MARK(conn->fd, CONN_WAITF);
 	return 0;
     }
+# ifdef NETTHREAD
+    if (conn->net != (netbuf *) NULL) {
+	struct iovec iov;
+
+	iov.iov_base = buf;
+	iov.iov_len = len;
+	return net_writev(conn, &iov, 1, len);
+    }
+# endif
     if ((size=write(conn->fd, buf, len)) < 0 && errno != EWOULDBLOCK) {
-	close(conn->fd);
-	FD_CLR(conn->fd, &infds);
-	FD_CLR(conn->fd, &outfds);
+	conn_shut(conn, FALSE);
 	conn->fd = -1;
 	closed++;
+# ifdef EPOLL
+	conn_rdyadd(conn);
+# endif
     } else if (size != len) {
 	/* waiting for wrdone */
-	FD_SET(conn->fd, &waitfds);
-	FD_CLR(conn->fd, &writefds);
+	FD_MARK(conn->fd, CONN_WAITF);
+	FD_UNMARK(conn->fd, CONN_WRITEF);
+	if (size < 0) {
+	    return 0;
+	}
+    }
+    return size;
+}
+
+/*
+ * NAME:	conn->writev()
+ * DESCRIPTION:	write several buffers to a connection; return the amount of
+ *		bytes written
+ */
+int conn_writev(connection *conn, struct iovec *iov, int iovcnt)
+{
+    int size, i;
+    unsigned int len;
+
+    if (conn->fd < 0) {
+	return -1;
+    }
+    for (len = 0, i = 0; i < iovcnt; i++) {
+	len += iov[i].iov_len;
+    }
+    if (len == 0) {
+	return 0;
+    }
+    if (!FD_READY(conn->fd, CONN_WRITEF)) {
+	/* the write would fail */
+	FD_MARK(conn->fd, CONN_WAITF);
+	return 0;
+    }
+# ifdef NETTHREAD
+    if (conn->net != (netbuf *) NULL) {
+	return net_writev(conn, iov, iovcnt, len);
+    }
+# endif
+    if ((size=writev(conn->fd, iov, iovcnt)) < 0 && errno != EWOULDBLOCK) {
+	conn_shut(conn, FALSE);
+	conn->fd = -1;
+	closed++;
+# ifdef EPOLL
+	conn_rdyadd(conn);
+# endif
+    } else if (size != (int) len) {
+	/* waiting for wrdone */
+	FD_MARK(conn->fd, CONN_WAITF);
+	FD_UNMARK(conn->fd, CONN_WRITEF);
 	if (size < 0) {
 	    return 0;
 	}
@@ -1768,11 +3059,11 @@ int conn_udpwrite(connection *conn, char *buf, unsigned int len)
  */
 bool conn_wrdone(connection *conn)
 {
-    if (conn->fd < 0 || !FD_ISSET(conn->fd, &waitfds)) {
+    if (conn->fd < 0 || !FD_READY(conn->fd, CONN_WAITF)) {
 	return TRUE;
     }
-    if (FD_ISSET(conn->fd, &writefds)) {
-	FD_CLR(conn->fd, &waitfds);
+    if (FD_READY(conn->fd, CONN_WRITEF)) {
+	FD_UNMARK(conn->fd, CONN_WAITF);
 	return TRUE;
     }
     return FALSE;
@@ -1929,14 +3220,10 @@ connection *conn_connect(void *addr, int len)
     conn->udpbuf = (char *) NULL;
     conn->addr = (ipaddr *) NULL;
     conn->at = -1;
-    FD_SET(sock, &infds);
-    FD_SET(sock, &outfds);
-    FD_CLR(sock, &readfds);
-    FD_CLR(sock, &writefds);
-    FD_SET(sock, &waitfds);
-    if (sock > maxfd) {
-	maxfd = sock;
-    }
+    conn_watch(sock, conn, TRUE);
+    FD_UNMARK(sock, CONN_READF);
+    FD_UNMARK(sock, CONN_WRITEF);
+    FD_MARK(sock, CONN_WAITF);
     return conn;
 }
 
@@ -1955,10 +3242,10 @@ int conn_check_connected(connection *conn, int *errcode)
 	return -2;
     }
 
-    if (!FD_ISSET(conn->fd, &writefds)) {
+    if (!FD_READY(conn->fd, CONN_WRITEF)) {
 	return 0;
     }
-    FD_CLR(conn->fd, &waitfds);
+    FD_UNMARK(conn->fd, CONN_WAITF);
 
     /*
      * Delayed connect completed, check for errors
@@ -2017,13 +3304,38 @@ int conn_check_connected(connection *conn, int *errcode)
     }
 }
 
+/*
+ * NAME:	conn->stop()
+ * DESCRIPTION:	prepare for exporting connections: stop network I/O in the
+ *		background
+ */
+void conn_stop()
+{
+# ifdef NETTHREAD
+    if (!netstop) {
+	net_stop();
+    }
+# endif
+}
 
-# define CONN_READF	0x01	/* read flag set */
-# define CONN_WRITEF	0x02	/* write flag set */
-# define CONN_WAITF	0x04	/* wait flag set */
-# define CONN_UCHAL	0x08	/* UDP challenge issued */
-# define CONN_UCHAN	0x10	/* UDP channel established */
-# define CONN_ADDR	0x20	/* has an address */
+/*
+ * NAME:	conn->pending()
+ * DESCRIPTION:	retrieve input that was received but not yet read, after
+ *		conn_stop()
+ */
+int conn_pending(connection *conn, char *buf, unsigned int len)
+{
+# ifdef NETTHREAD
+    if (conn->fd >= 0 && conn->net != (netbuf *) NULL) {
+	return ring_get(&conn->net->in, buf, len);
+    }
+# else
+    UNREFERENCED_PARAMETER(conn);
+    UNREFERENCED_PARAMETER(buf);
+    UNREFERENCED_PARAMETER(len);
+# endif
+    return 0;
+}
 
 /*
  * NAME:	conn->export()
@@ -2040,14 +3352,16 @@ bool conn_export(connection *conn, int *fd, char *addr, unsigned short *port,
 	*npkts = conn->npkts;
 	*bufsz = conn->bufsz;
 	*buf = conn->udpbuf;
-	if (FD_ISSET(conn->fd, &readfds)) {
-	    *flags |= CONN_READF;
-	}
-	if (FD_ISSET(conn->fd, &writefds)) {
-	    *flags |= CONN_WRITEF;
-	}
-	if (FD_ISSET(conn->fd, &waitfds)) {
-	    *flags |= CONN_WAITF;
+	if (conn->fd >= 0) {
+	    if (FD_READY(conn->fd, CONN_READF)) {
+		*flags |= CONN_READF;
+	    }
+	    if (FD_READY(conn->fd, CONN_WRITEF)) {
+		*flags |= CONN_WRITEF;
+	    }
+	    if (FD_READY(conn->fd, CONN_WAITF)) {
+		*flags |= CONN_WAITF;
+	    }
 	}
 	if (conn->udpbuf != (char *) NULL) {
 	    if (conn->name != NULL) {
@@ -2088,19 +3402,21 @@ connection *conn_import(int fd, char *addr, unsigned short port, short at,
     conn->at = -1;
 
     if (fd >= 0) {
-	FD_SET(fd, &infds);
-	FD_SET(fd, &outfds);
+# ifdef NETTHREAD
+	net_new(conn, fd);
+# endif
+	conn_watch(fd, conn, TRUE);
 	if (flags & CONN_READF) {
-	    FD_SET(fd, &readfds);
+	    FD_MARK(fd, CONN_READF);
+# ifdef EPOLL
+	    conn_rdyadd(conn);
+# endif
 	}
 	if (flags & CONN_WRITEF) {
-	    FD_SET(fd, &writefds);
+	    FD_MARK(fd, CONN_WRITEF);
 	}
 	if (flags & CONN_WAITF) {
-	    FD_SET(fd, &waitfds);
-	}
-	if (fd > maxfd) {
-	    maxfd = fd;
+	    FD_MARK(fd, CONN_WAITF);
 	}
     }
 
@@ -17,8 +17,13 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+# define INCLUDE_FILE_IO
 # include "dgd.h"
 # include <signal.h>
+# include <pthread.h>
+# include <sys/mman.h>
+# include <sys/wait.h>
+# include <errno.h>
 
 extern "C" {
 
@@ -32,6 +37,15 @@ static void term(int arg)
     interrupt();
 }
 
+/*
+ * NAME:	child()
+ * DESCRIPTION:	catch SIGCHLD, interrupting a wait for events
+ */
+static void child(int arg)
+{
+    UNREFERENCED_PARAMETER(arg);
+}
+
 }
 
 /*
@@ -59,3 +73,160 @@ void P_message(const char *mess)
     fputs(mess, stderr);
     fflush(stderr);
 }
+
+/*
+ * NAME:	P->fork()
+ * DESCRIPTION:	create a child process; return its pid in the parent, 0 in
+ *		the child and -1 on failure
+ */
+int P_fork()
+{
+    struct sigaction act;
+    int pid;
+
+    memset(&act, '\0', sizeof(struct sigaction));
+    act.sa_handler = child;
+    act.sa_flags = SA_RESTART;
+    sigemptyset(&act.sa_mask);
+    sigaction(SIGCHLD, &act, (struct sigaction *) NULL);
+
+    pid = fork();
+    if (pid == 0) {
+	signal(SIGTERM, SIG_IGN);
+	signal(SIGCHLD, SIG_DFL);
+    }
+    return pid;
+}
+
+/*
+ * NAME:	P->wait()
+ * DESCRIPTION:	check whether a child process has terminated; return 0 if
+ *		it exited successfully, 1 if it failed, and -1 if it is still
+ *		running
+ */
+int P_wait(int pid, bool block)
+{
+    int status, result;
+
+    do {
+	result = waitpid(pid, &status, (block) ? 0 : WNOHANG);
+    } while (result < 0 && errno == EINTR);
+    if (result == 0) {
+	return -1;
+    }
+    return (result < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0);
+}
+
+/*
+ * NAME:	P->exit()
+ * DESCRIPTION:	terminate a child process
+ */
+void P_exit(int status)
+{
+    _exit(status);
+}
+
+/*
+ * NAME:	P->ncpu()
+ * DESCRIPTION:	return the number of processors available
+ */
+int P_ncpu()
+{
+    long n;
+
+    n = sysconf(_SC_NPROCESSORS_ONLN);
+    return (n > 1) ? (int) n : 1;
+}
+
+struct ptask {
+    void (*func)(void*);	/* function to call */
+    void *arg;			/* argument */
+    pthread_t thread;		/* thread calling it */
+};
+
+extern "C" {
+
+/*
+ * NAME:	run()
+ * DESCRIPTION:	call a function in a thread of its own
+ */
+static void *run(void *arg)
+{
+    ptask *task;
+
+    task = (ptask *) arg;
+    (*task->func)(task->arg);
+    return NULL;
+}
+
+}
+
+/*
+ * NAME:	P->parallel()
+ * DESCRIPTION:	call func for n arguments of the given size at once, each
+ *		in its own thread, and wait until all calls are done
+ */
+void P_parallel(void (*func)(void*), void *args, size_t size, int n)
+{
+    ptask *tasks;
+    sigset_t mask, omask;
+    bool *started;
+    int i;
+
+    tasks = (ptask *) alloca(n * sizeof(ptask));
+    started = (bool *) alloca(n * sizeof(bool));
+
+    /* leave signals to the main thread */
+    sigfillset(&mask);
+    pthread_sigmask(SIG_BLOCK, &mask, &omask);
+    for (i = 1; i < n; i++) {
+	tasks[i].func = func;
+	tasks[i].arg = (char *) args + i * size;
+	started[i] = (pthread_create(&tasks[i].thread,
+				     (pthread_attr_t *) NULL, run,
+				     &tasks[i]) == 0);
+    }
+    pthread_sigmask(SIG_SETMASK, &omask, (sigset_t *) NULL);
+
+    (*func)(args);
+    for (i = 1; i < n; i++) {
+	if (started[i]) {
+	    pthread_join(tasks[i].thread, (void **) NULL);
+	} else {
+	    /* no thread: do it here */
+	    (*func)(tasks[i].arg);
+	}
+    }
+}
+
+/*
+ * NAME:	P->mmap()
+ * DESCRIPTION:	map a file in memory for reading and writing; the mapping
+ *		may extend beyond the end of the file
+ */
+char *P_mmap(int fd, off_t size)
+{
+    void *mem;
+
+    mem = mmap((void *) NULL, (size_t) size, PROT_READ | PROT_WRITE,
+	       MAP_SHARED, fd, 0);
+    return (mem != MAP_FAILED) ? (char *) mem : (char *) NULL;
+}
+
+/*
+ * NAME:	P->munmap()
+ * DESCRIPTION:	remove a file mapping
+ */
+void P_munmap(char *mem, off_t size)
+{
+    munmap(mem, (size_t) size);
+}
+
+/*
+ * NAME:	P->msync()
+ * DESCRIPTION:	start writing back the modified pages of a file mapping
+ */
+void P_msync(char *mem, off_t size)
+{
+    msync(mem, (size_t) size, MS_ASYNC);
+}
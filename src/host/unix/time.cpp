@@ -20,6 +20,7 @@
 # include "dgd.h"
 # include <time.h>
 # include <sys/time.h>
+# include <signal.h>
 
 /*
  * NAME:	P->time()
@@ -43,6 +44,18 @@ Uint P_mtime(unsigned short *milli)
     return (Uint) time.tv_sec;
 }
 
+/*
+ * NAME:	P->ntime()
+ * DESCRIPTION:	return a monotonic time in nanoseconds
+ */
+Uuint P_ntime()
+{
+    struct timespec time;
+
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (Uuint) time.tv_sec * 1000000000 + time.tv_nsec;
+}
+
 /*
  * NAME:	P->ctime()
  * DESCRIPTION:	convert the given time to a string
@@ -72,3 +85,44 @@ char *P_ctime(char *buf, Uint time)
     }
     return buf;
 }
+
+static void (*timerfunc)();	/* function called by profiling timer */
+
+extern "C" {
+
+/*
+ * NAME:	prof()
+ * DESCRIPTION:	catch SIGPROF
+ */
+static void prof(int arg)
+{
+    UNREFERENCED_PARAMETER(arg);
+    (*timerfunc)();
+}
+
+}
+
+/*
+ * NAME:	P->timer()
+ * DESCRIPTION:	call a function rate times per second of CPU time, or stop
+ *		doing so if rate is 0
+ */
+void P_timer(unsigned int rate, void (*func)())
+{
+    struct sigaction act;
+    struct itimerval it;
+
+    memset(&it, '\0', sizeof(struct itimerval));
+    if (rate != 0) {
+	timerfunc = func;
+	memset(&act, '\0', sizeof(struct sigaction));
+	act.sa_handler = prof;
+	act.sa_flags = SA_RESTART;
+	sigemptyset(&act.sa_mask);
+	sigaction(SIGPROF, &act, (struct sigaction *) NULL);
+	it.it_interval.tv_sec = 1 / rate;
+	it.it_interval.tv_usec = (1000000L / rate) % 1000000L;
+	it.it_value = it.it_interval;
+    }
+    setitimer(ITIMER_PROF, &it, (struct itimerval *) NULL);
+}
@@ -349,6 +349,7 @@ static void ipa_lookup()
 
 struct connection : public Hashtab::Entry {
     SOCKET fd;				/* file descriptor */
+    int owner;				/* index of owning user */
     bool udp;				/* datagram only? */
     int bufsz;				/* # bytes in buffer */
     int npkts;				/* # packets in buffer */
@@ -631,6 +632,7 @@ static fd_set waitfds;			/* file descriptor wait-write bitmap */
 static fd_set readfds;			/* file descriptor read bitmap */
 static fd_set writefds;			/* file descriptor write map */
 static int closed;			/* #fds closed in write */
+static int nextrdy;			/* next connection to check if ready */
 static SOCKET self;			/* socket to self */
 static bool self6;			/* self socket IPv6? */
 static SOCKET cintr;			/* interrupt socket */
@@ -982,6 +984,7 @@ bool conn_init(int maxusers, char **thosts, char **bhosts, char **dhosts,
     connections = ALLOC(connection, nusers = maxusers);
     for (n = nusers, conn = connections; n > 0; --n, conn++) {
 	conn->fd = INVALID_SOCKET;
+	conn->owner = -1;
 	conn->next = flist;
 	flist = conn;
     }
@@ -1012,6 +1015,14 @@ void conn_finish()
     WSACleanup();
 }
 
+/*
+ * NAME:	conn->child()
+ * DESCRIPTION:	there are no child processes
+ */
+void conn_child()
+{
+}
+
 /*
  * NAME:	conn->listen()
  * DESCRIPTION:	start listening on telnet port and binary port
@@ -1413,6 +1424,7 @@ void conn_del(connection *conn)
     if (conn->addr != (ipaddr *) NULL) {
       ipa_del(conn->addr);
     }
+    conn->owner = -1;
     conn->next = flist;
     flist = conn;
 }
@@ -1506,9 +1518,54 @@ int conn_select(Uint t, unsigned int mtime)
     if (FD_ISSET(in, &readfds)) {
 	ipa_lookup();
     }
+
+    nextrdy = 0;
     return retval;
 }
 
+/*
+ * NAME:	conn->owner()
+ * DESCRIPTION:	set the index of the user that owns a connection
+ */
+void conn_owner(connection *conn, int owner)
+{
+    conn->owner = owner;
+}
+
+/*
+ * NAME:	conn->ready()
+ * DESCRIPTION:	return the owner of the next connection with pending I/O,
+ *		or -1 if there are no more
+ */
+int conn_ready()
+{
+    connection *conn;
+    bool ready;
+
+    while (nextrdy < nusers) {
+	conn = &connections[nextrdy++];
+	if (conn->owner < 0) {
+	    continue;
+	}
+	if (conn->fd != INVALID_SOCKET) {
+	    ready = (FD_ISSET(conn->fd, &readfds) ||
+		     (FD_ISSET(conn->fd, &waitfds) &&
+		      FD_ISSET(conn->fd, &writefds)));
+	} else {
+	    ready = !conn->udp;		/* closed */
+	}
+	if (!ready && conn->udpbuf != (char *) NULL) {
+	    EnterCriticalSection(&udpmutex);
+	    ready = (conn->npkts != 0);
+	    LeaveCriticalSection(&udpmutex);
+	}
+	if (ready) {
+	    return conn->owner;
+	}
+    }
+    return -1;
+}
+
 /*
  * NAME:	conn->udpcheck()
  * DESCRIPTION:	check if UDP challenge met
@@ -1613,6 +1670,57 @@ int conn_write(connection *conn, char *buf, unsigned int len)
     return (size == SOCKET_ERROR) ? -1 : size;
 }
 
+/*
+ * NAME:	conn->writev()
+ * DESCRIPTION:	write several buffers to a connection; return the amount of
+ *		bytes written
+ */
+int conn_writev(connection *conn, struct iovec *iov, int iovcnt)
+{
+    WSABUF *bufs;
+    DWORD size;
+    unsigned int len;
+    int i, result;
+
+    if (conn->fd == INVALID_SOCKET) {
+	return -1;
+    }
+    for (len = 0, i = 0; i < iovcnt; i++) {
+	len += iov[i].iov_len;
+    }
+    if (len == 0) {
+	return 0;
+    }
+    if (!FD_ISSET(conn->fd, &writefds)) {
+	/* the write would fail */
+	FD_SET(conn->fd, &waitfds);
+	return 0;
+    }
+    bufs = ALLOCA(WSABUF, iovcnt);
+    for (i = 0; i < iovcnt; i++) {
+	bufs[i].buf = (char *) iov[i].iov_base;
+	bufs[i].len = iov[i].iov_len;
+    }
+    result = WSASend(conn->fd, bufs, iovcnt, &size, 0, NULL, NULL);
+    AFREE(bufs);
+    if (result == SOCKET_ERROR && WSAGetLastError() != WSAEWOULDBLOCK) {
+	closesocket(conn->fd);
+	FD_CLR(conn->fd, &infds);
+	FD_CLR(conn->fd, &outfds);
+	conn->fd = INVALID_SOCKET;
+	closed++;
+	return -1;
+    } else if (result == SOCKET_ERROR || size != len) {
+	/* waiting for wrdone */
+	FD_SET(conn->fd, &waitfds);
+	FD_CLR(conn->fd, &writefds);
+	if (result == SOCKET_ERROR) {
+	    return 0;
+	}
+    }
+    return size;
+}
+
 /*
  * NAME:	conn->udpwrite()
  * DESCRIPTION:	write a message to a UDP channel
@@ -1879,6 +1987,26 @@ int conn_check_connected(connection *conn, int *errcode)
 }
 
 
+/*
+ * NAME:	conn->stop()
+ * DESCRIPTION:	prepare for exporting connections
+ */
+void conn_stop()
+{
+}
+
+/*
+ * NAME:	conn->pending()
+ * DESCRIPTION:	retrieve input that was received but not yet read
+ */
+int conn_pending(connection *conn, char *buf, unsigned int len)
+{
+    UNREFERENCED_PARAMETER(conn);
+    UNREFERENCED_PARAMETER(buf);
+    UNREFERENCED_PARAMETER(len);
+    return 0;
+}
+
 /*
  * NAME:	conn->export()
  * DESCRIPTION:	export a connection
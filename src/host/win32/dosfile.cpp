@@ -113,6 +113,65 @@ int P_write(int fd, const char *buf, int nbytes)
     return _write(fd, buf, nbytes);
 }
 
+/*
+ * NAME:	P->preadv()
+ * DESCRIPTION:	read from a file at an offset into several buffers
+ */
+long P_preadv(int fd, const struct iovec *iov, int iovcnt, off_t offset)
+{
+    long size;
+    int n;
+
+    if (_lseek(fd, offset, SEEK_SET) < 0) {
+	return -1;
+    }
+    for (size = 0; iovcnt > 0; iov++, --iovcnt) {
+	n = _read(fd, iov->iov_base, (unsigned int) iov->iov_len);
+	if (n < 0) {
+	    return -1;
+	}
+	size += n;
+	if (n != iov->iov_len) {
+	    break;
+	}
+    }
+    return size;
+}
+
+/*
+ * NAME:	P->pwritev()
+ * DESCRIPTION:	write to a file at an offset from several buffers
+ */
+long P_pwritev(int fd, const struct iovec *iov, int iovcnt, off_t offset)
+{
+    long size;
+    int n;
+
+    if (_lseek(fd, offset, SEEK_SET) < 0) {
+	return -1;
+    }
+    for (size = 0; iovcnt > 0; iov++, --iovcnt) {
+	n = _write(fd, iov->iov_base, (unsigned int) iov->iov_len);
+	if (n < 0) {
+	    return -1;
+	}
+	size += n;
+	if (n != iov->iov_len) {
+	    break;
+	}
+    }
+    return size;
+}
+
+/*
+ * NAME:	P->ftruncate()
+ * DESCRIPTION:	change the size of a file
+ */
+int P_ftruncate(int fd, off_t size)
+{
+    return (_chsize(fd, size) == 0) ? 0 : -1;
+}
+
 /*
  * NAME:	P->lseek()
  * DESCRIPTION:	seek on a file
@@ -302,3 +361,34 @@ int P_execv(const char *path, char **argv)
     P_message("Hotbooting not supported on Windows\012");	/* LF */
     return -1;
 }
+
+/*
+ * NAME:	P->mmap()
+ * DESCRIPTION:	mapping files in memory is not supported
+ */
+char *P_mmap(int fd, off_t size)
+{
+    UNREFERENCED_PARAMETER(fd);
+    UNREFERENCED_PARAMETER(size);
+    return (char *) NULL;
+}
+
+/*
+ * NAME:	P->munmap()
+ * DESCRIPTION:	remove a file mapping
+ */
+void P_munmap(char *mem, off_t size)
+{
+    UNREFERENCED_PARAMETER(mem);
+    UNREFERENCED_PARAMETER(size);
+}
+
+/*
+ * NAME:	P->msync()
+ * DESCRIPTION:	write back a file mapping
+ */
+void P_msync(char *mem, off_t size)
+{
+    UNREFERENCED_PARAMETER(mem);
+    UNREFERENCED_PARAMETER(size);
+}
@@ -17,6 +17,7 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+# include <windows.h>
 # include "dgd.h"
 
 /*
@@ -36,3 +37,59 @@ long P_random()
 {
     return (long) (rand() ^ (rand() << 9) ^ (rand() << 16));
 }
+
+/*
+ * NAME:	P->fork()
+ * DESCRIPTION:	child processes are not supported
+ */
+int P_fork()
+{
+    return -1;
+}
+
+/*
+ * NAME:	P->wait()
+ * DESCRIPTION:	there are no child processes to wait for
+ */
+int P_wait(int pid, bool block)
+{
+    UNREFERENCED_PARAMETER(pid);
+    UNREFERENCED_PARAMETER(block);
+    return 1;
+}
+
+/*
+ * NAME:	P->exit()
+ * DESCRIPTION:	terminate the process
+ */
+void P_exit(int status)
+{
+    _exit(status);
+}
+
+/*
+ * NAME:	P->ncpu()
+ * DESCRIPTION:	return the number of processors available
+ */
+int P_ncpu()
+{
+    SYSTEM_INFO info;
+
+    GetSystemInfo(&info);
+    return (info.dwNumberOfProcessors > 1) ?
+	    (int) info.dwNumberOfProcessors : 1;
+}
+
+/*
+ * NAME:	P->parallel()
+ * DESCRIPTION:	call func for n arguments of the given size, one after
+ *		another
+ */
+void P_parallel(void (*func)(void*), void *args, size_t size, int n)
+{
+    while (n > 0) {
+	(*func)(args);
+	args = (char *) args + size;
+	--n;
+    }
+}
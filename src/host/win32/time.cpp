@@ -56,6 +56,24 @@ Uint P_mtime(unsigned short *milli)
     return (Uint) (time / 10000000);
 }
 
+/*
+ * NAME:	P->ntime()
+ * DESCRIPTION:	return a monotonic time in nanoseconds
+ */
+Uuint P_ntime()
+{
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER count;
+
+    if (freq.QuadPart == 0) {
+	QueryPerformanceFrequency(&freq);
+    }
+    QueryPerformanceCounter(&count);
+    return (Uuint) (count.QuadPart / freq.QuadPart) * 1000000000 +
+	   (Uuint) (count.QuadPart % freq.QuadPart) * 1000000000 /
+	   freq.QuadPart;
+}
+
 /*
  * NAME:	P->ctime()
  * DESCRIPTION:	return time as string
@@ -88,3 +106,35 @@ char *P_ctime(char *buf, Uint time)
     }
     return buf;
 }
+
+static void (*timerfunc)();	/* function called by profiling timer */
+static HANDLE timer;		/* profiling timer */
+
+/*
+ * NAME:	prof()
+ * DESCRIPTION:	profiling timer callback
+ */
+static VOID CALLBACK prof(PVOID arg, BOOLEAN fired)
+{
+    UNREFERENCED_PARAMETER(arg);
+    UNREFERENCED_PARAMETER(fired);
+    (*timerfunc)();
+}
+
+/*
+ * NAME:	P->timer()
+ * DESCRIPTION:	call a function rate times per second, or stop doing so if
+ *		rate is 0
+ */
+void P_timer(unsigned int rate, void (*func)())
+{
+    if (timer != NULL) {
+	DeleteTimerQueueTimer(NULL, timer, NULL);
+	timer = NULL;
+    }
+    if (rate != 0) {
+	timerfunc = func;
+	CreateTimerQueueTimer(&timer, NULL, prof, NULL, 1000 / rate,
+			      1000 / rate, WT_EXECUTEINTIMERTHREAD);
+    }
+}
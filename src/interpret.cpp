@@ -42,6 +42,22 @@ static unsigned int clen;	/* creator function name length */
 static bool stricttc;		/* strict typechecking */
 static char ihash[INHASHSZ];	/* instanceof hashtable */
 
+struct profsample {
+    char *prog;			/* program name */
+    char *func;			/* function name */
+    unsigned short line;	/* line number */
+    unsigned short hash;	/* hash value */
+    Uint count;			/* # samples */
+};
+
+static profsample proftab[PROFTABSZ]; /* profiling samples */
+static Uint nprofsamples;	/* # entries in proftab */
+static volatile bool sample;	/* take a profiling sample */
+static bool account;		/* function accounting enabled */
+
+static void i_sample		(Frame*);
+static void i_account_call	(Frame*, Object*, Array*, int, int, int);
+
 int nil_type;			/* type of nil value */
 Value zero_int = { T_INT, TRUE };
 Value zero_float = { T_FLOAT, TRUE };
@@ -51,7 +67,7 @@ Value nil_value = { T_NIL, TRUE };
  * NAME:	interpret->init()
  * DESCRIPTION:	initialize the interpreter
  */
-void i_init(char *create, bool flag)
+void i_init(char *create, bool flag, unsigned int rate)
 {
     topframe.oindex = OBJ_NONE;
     topframe.fp = topframe.sp = stack + MIN_STACK;
@@ -70,6 +86,10 @@ void i_init(char *create, bool flag)
     stricttc = flag;
 
     nil_value.type = nil_type = (stricttc) ? T_NIL : T_INT;
+
+    if (rate != 0) {
+	P_timer(rate, i_prof_timer);
+    }
 }
 
 /*
@@ -1574,9 +1594,53 @@ void i_catcherr(Frame *f, Int depth)
     i_runtime_error(f, depth);
 }
 
+# ifdef THREADED		/* THREADED defined */
+#  if THREADED == 0
+#   undef THREADED		/* ... but turned off */
+#  endif
+# else
+#  ifdef __GNUC__		/* define THREADED for GCC and Clang */
+#   define THREADED
+#  endif
+# endif
+
+# ifdef THREADED
+/*
+ * direct-threaded dispatch, using labels as values
+ */
+# define LABEL(op)	LABEL2(op)
+# define LABEL2(op)	op_##op
+# define CASE(op)	LABEL(op)
+# define CASE_POP(op)	LABEL(op)
+# ifdef DEBUG
+# define NEXT								\
+    do {								\
+	if (f->sp < f->stack + MIN_STACK) {				\
+	    fatal("out of value stack");				\
+	}								\
+	instr = FETCH1U(pc);						\
+	goto *optab[instr & I_INSTR_MASK];				\
+    } while (FALSE)
+# else
+# define NEXT								\
+    do {								\
+	instr = FETCH1U(pc);						\
+	goto *optab[instr & I_INSTR_MASK];				\
+    } while (FALSE)
+# endif
+# define NEXT_POP	goto pop
+# else
+# define CASE(op)	case op
+# define CASE_POP(op)	case op: case op | I_POP_BIT
+# define NEXT		continue
+# define NEXT_POP	break
+# endif
+
 /*
  * NAME:	interpret->interpret()
  * DESCRIPTION:	Main interpreter function. Interpret stack machine code.
+ *		f->pc is only updated where an error or a function call can
+ *		observe it.
  */
 static void i_interpret(Frame *f, char *pc)
 {
@@ -1585,15 +1649,87 @@ static void i_interpret(Frame *f, char *pc)
     char *p;
     kfunc *kf;
     int size, instance;
-    bool atomic;
-    Int newdepth, newticks;
-    Value val;
+    bool atomic, cond;
+    Int newdepth, newticks, num, num2;
+    Value *var, val;
+
+# ifdef THREADED
+    static void *optab[] = {
+	&&LABEL(I_PUSH_INT1),			/* 0x00 */
+	&&LABEL(I_PUSH_INT4),			/* 0x01 */
+	&&LABEL(I_JUMP_LOCAL),			/* 0x02 */
+	&&LABEL(I_PUSH_FLOAT6),			/* 0x03 */
+	&&LABEL(I_PUSH_STRING),			/* 0x04 */
+	&&LABEL(I_PUSH_FAR_STRING),		/* 0x05 */
+	&&LABEL(I_PUSH_GLOBAL),			/* 0x06 */
+	&&LABEL(I_INDEX),			/* 0x07 */
+	&&LABEL(I_INDEX2),			/* 0x08 */
+	&&LABEL(I_AGGREGATE),			/* 0x09 */
+	&&LABEL(I_CAST),			/* 0x0a */
+	&&LABEL(I_INSTANCEOF),			/* 0x0b */
+	&&LABEL(I_STORES),			/* 0x0c */
+	&&LABEL(I_STORE_GLOBAL_INDEX),		/* 0x0d */
+	&&LABEL(I_CALL_EFUNC),			/* 0x0e */
+	&&LABEL(I_CALL_CEFUNC),			/* 0x0f */
+	&&LABEL(I_CALL_CKFUNC),			/* 0x10 */
+	&&LABEL(I_STORE_LOCAL),			/* 0x11 */
+	&&LABEL(I_STORE_GLOBAL),		/* 0x12 */
+	&&LABEL(I_STORE_FAR_GLOBAL),		/* 0x13 */
+	&&LABEL(I_STORE_INDEX),			/* 0x14 */
+	&&LABEL(I_STORE_LOCAL_INDEX),		/* 0x15 */
+	&&LABEL(I_STORE_FAR_GLOBAL_INDEX),	/* 0x16 */
+	&&LABEL(I_STORE_INDEX_INDEX),		/* 0x17 */
+	&&LABEL(I_JUMP_ZERO),			/* 0x18 */
+	&&LABEL(I_JUMP),			/* 0x19 */
+	&&LABEL(I_CALL_KFUNC),			/* 0x1a */
+	&&LABEL(I_CALL_AFUNC),			/* 0x1b */
+	&&LABEL(I_CALL_DFUNC),			/* 0x1c */
+	&&LABEL(I_CALL_FUNC),			/* 0x1d */
+	&&LABEL(I_CATCH),			/* 0x1e */
+	&&LABEL(I_RLIMITS),			/* 0x1f */
+	&&LABEL(I_PUSH_INT2),			/* 0x20 */
+	&&illegal,				/* 0x21 */
+	&&LABEL(I_ADD_LOCAL),			/* 0x22 */
+	&&illegal,				/* 0x23 */
+	&&LABEL(I_PUSH_NEAR_STRING),		/* 0x24 */
+	&&LABEL(I_PUSH_LOCAL),			/* 0x25 */
+	&&LABEL(I_PUSH_FAR_GLOBAL),		/* 0x26 */
+	&&LABEL(I_INDEX),			/* 0x27 */
+	&&LABEL(I_SPREAD),			/* 0x28 */
+	&&LABEL(I_AGGREGATE),			/* 0x29 */
+	&&LABEL(I_CAST),			/* 0x2a */
+	&&LABEL(I_INSTANCEOF),			/* 0x2b */
+	&&LABEL(I_INDEX_GLOBAL),		/* 0x2c */
+	&&LABEL(I_STORE_GLOBAL_INDEX),		/* 0x2d */
+	&&LABEL(I_CALL_EFUNC),			/* 0x2e */
+	&&LABEL(I_CALL_CEFUNC),			/* 0x2f */
+	&&LABEL(I_CALL_CKFUNC),			/* 0x30 */
+	&&LABEL(I_STORE_LOCAL),			/* 0x31 */
+	&&LABEL(I_STORE_GLOBAL),		/* 0x32 */
+	&&LABEL(I_STORE_FAR_GLOBAL),		/* 0x33 */
+	&&LABEL(I_STORE_INDEX),			/* 0x34 */
+	&&LABEL(I_STORE_LOCAL_INDEX),		/* 0x35 */
+	&&LABEL(I_STORE_FAR_GLOBAL_INDEX),	/* 0x36 */
+	&&LABEL(I_STORE_INDEX_INDEX),		/* 0x37 */
+	&&LABEL(I_JUMP_NONZERO),		/* 0x38 */
+	&&LABEL(I_SWITCH),			/* 0x39 */
+	&&LABEL(I_CALL_KFUNC),			/* 0x3a */
+	&&LABEL(I_CALL_AFUNC),			/* 0x3b */
+	&&LABEL(I_CALL_DFUNC),			/* 0x3c */
+	&&LABEL(I_CALL_FUNC),			/* 0x3d */
+	&&LABEL(I_CATCH),			/* 0x3e */
+	&&LABEL(I_RETURN)			/* 0x3f */
+    };
+# endif
 
     size = 0;
     l = 0;
 
 # define CHECK_LOOP_TICKS()						\
     do {								\
+	if (sample) {							\
+	    i_sample(f);						\
+	}								\
 	if ((f->rlim->ticks -= 5) <= 0) {				\
 	    if (f->rlim->noticks) {					\
 		f->rlim->ticks = 0x7fffffff;				\
@@ -1603,6 +1739,10 @@ static void i_interpret(Frame *f, char *pc)
 	}								\
     } while (FALSE)
 
+    f->pc = pc;
+# ifdef THREADED
+    NEXT;
+# else
     for (;;) {
 # ifdef DEBUG
 	if (f->sp < f->stack + MIN_STACK) {
@@ -1610,91 +1750,102 @@ static void i_interpret(Frame *f, char *pc)
 	}
 # endif
 	instr = FETCH1U(pc);
-	f->pc = pc;
 
 	switch (instr & I_INSTR_MASK) {
-	case I_PUSH_INT1:
+# endif
+	CASE(I_PUSH_INT1):
 	    PUSH_INTVAL(f, FETCH1S(pc));
-	    continue;
+	    NEXT;
 
-	case I_PUSH_INT2:
+	CASE(I_PUSH_INT2):
 	    PUSH_INTVAL(f, FETCH2S(pc, u));
-	    continue;
+	    NEXT;
 
-	case I_PUSH_INT4:
+	CASE(I_PUSH_INT4):
 	    PUSH_INTVAL(f, FETCH4S(pc, l));
-	    continue;
+	    NEXT;
 
-	case I_PUSH_FLOAT6:
+	CASE(I_PUSH_FLOAT6):
 	    FETCH2U(pc, u);
 	    PUSH_FLTCONST(f, u, FETCH4U(pc, l));
-	    continue;
+	    NEXT;
 
-	case I_PUSH_STRING:
+	CASE(I_PUSH_STRING):
 	    PUSH_STRVAL(f, d_get_strconst(f->p_ctrl, f->p_ctrl->ninherits - 1,
 					  FETCH1U(pc)));
-	    continue;
+	    NEXT;
 
-	case I_PUSH_NEAR_STRING:
+	CASE(I_PUSH_NEAR_STRING):
 	    u = FETCH1U(pc);
 	    PUSH_STRVAL(f, d_get_strconst(f->p_ctrl, u, FETCH1U(pc)));
-	    continue;
+	    NEXT;
 
-	case I_PUSH_FAR_STRING:
+	CASE(I_PUSH_FAR_STRING):
 	    u = FETCH1U(pc);
 	    PUSH_STRVAL(f, d_get_strconst(f->p_ctrl, u, FETCH2U(pc, u2)));
-	    continue;
+	    NEXT;
 
-	case I_PUSH_LOCAL:
+	CASE(I_PUSH_LOCAL):
 	    u = FETCH1S(pc);
 	    i_push_value(f, ((short) u < 0) ? f->fp + (short) u : f->argp + u);
-	    continue;
+	    NEXT;
 
-	case I_PUSH_GLOBAL:
+	CASE(I_PUSH_GLOBAL):
 	    i_global(f, f->p_ctrl->ninherits - 1, FETCH1U(pc));
-	    continue;
+	    NEXT;
 
-	case I_PUSH_FAR_GLOBAL:
+	CASE(I_PUSH_FAR_GLOBAL):
 	    u = FETCH1U(pc);
 	    i_global(f, u, FETCH1U(pc));
-	    continue;
+	    NEXT;
 
-	case I_INDEX:
-	case I_INDEX | I_POP_BIT:
+	CASE_POP(I_INDEX):
+	    f->pc = pc;
 	    i_index(f, f->sp + 1, f->sp, &val, FALSE);
 	    *++f->sp = val;
-	    break;
+	    NEXT_POP;
 
-	case I_INDEX2:
+	CASE(I_INDEX2):
+	    f->pc = pc;
 	    i_index(f, f->sp + 1, f->sp, &val, TRUE);
 	    *--f->sp = val;
-	    continue;
+	    NEXT;
 
-	case I_AGGREGATE:
-	case I_AGGREGATE | I_POP_BIT:
+	CASE(I_INDEX_GLOBAL):
+	    f->pc = pc;
+	    i_global(f, f->p_ctrl->ninherits - 1, FETCH1U(pc));
+	    u = FETCH1S(pc);
+	    i_push_value(f, ((short) u < 0) ? f->fp + (short) u : f->argp + u);
+	    i_index(f, f->sp + 1, f->sp, &val, FALSE);
+	    *++f->sp = val;
+	    NEXT;
+
+	CASE_POP(I_AGGREGATE):
+	    f->pc = pc;
 	    if (FETCH1U(pc) == 0) {
 		i_aggregate(f, FETCH2U(pc, u));
 	    } else {
 		i_map_aggregate(f, FETCH2U(pc, u));
 	    }
-	    break;
+	    NEXT_POP;
 
-	case I_SPREAD:
+	CASE(I_SPREAD):
+	    f->pc = pc;
 	    u = FETCH1S(pc);
 	    size = i_spread(f, -(short) u - 2);
-	    continue;
+	    NEXT;
 
-	case I_CAST:
-	case I_CAST | I_POP_BIT:
+	CASE_POP(I_CAST):
+	    f->pc = pc;
 	    u = FETCH1U(pc);
 	    if (u == T_CLASS) {
 		FETCH3U(pc, l);
 	    }
 	    i_cast(f, f->sp, u, l);
-	    break;
+	    NEXT_POP;
 
-	case I_INSTANCEOF:
-	case I_INSTANCEOF | I_POP_BIT:
+	CASE_POP(I_INSTANCEOF):
+	    f->pc = pc;
 	    FETCH3U(pc, l);
 	    switch (f->sp->type) {
 	    case T_OBJECT:
@@ -1717,10 +1868,11 @@ static void i_interpret(Frame *f, char *pc)
 	    }
 
 	    PUT_INTVAL(f->sp, instance);
-	    break;
+	    NEXT_POP;
 
-	case I_STORES:
+	CASE(I_STORES):
 	    u = FETCH1U(pc);
+	    f->pc = pc;
 	    if (f->sp->type != T_ARRAY) {
 		error("Value is not an array");
 	    }
@@ -1728,30 +1880,29 @@ static void i_interpret(Frame *f, char *pc)
 		error("Wrong number of lvalues");
 	    }
 	    d_get_elts(f->sp->u.array);
-	    f->pc = pc;
 	    i_stores(f, 0, u);
 	    pc = f->pc;
-	    continue;
+	    NEXT;
 
-	case I_STORE_LOCAL:
-	case I_STORE_LOCAL | I_POP_BIT:
+	CASE_POP(I_STORE_LOCAL):
+	    f->pc = pc;
 	    i_store_local(f, FETCH1S(pc), f->sp, NULL);
-	    break;
+	    NEXT_POP;
 
-	case I_STORE_GLOBAL:
-	case I_STORE_GLOBAL | I_POP_BIT:
+	CASE_POP(I_STORE_GLOBAL):
+	    f->pc = pc;
 	    i_store_global(f, f->p_ctrl->ninherits - 1, FETCH1U(pc), f->sp,
 			   NULL);
-	    break;
+	    NEXT_POP;
 
-	case I_STORE_FAR_GLOBAL:
-	case I_STORE_FAR_GLOBAL | I_POP_BIT:
+	CASE_POP(I_STORE_FAR_GLOBAL):
+	    f->pc = pc;
 	    u = FETCH1U(pc);
 	    i_store_global(f, u, FETCH1U(pc), f->sp, NULL);
-	    break;
+	    NEXT_POP;
 
-	case I_STORE_INDEX:
-	case I_STORE_INDEX | I_POP_BIT:
+	CASE_POP(I_STORE_INDEX):
+	    f->pc = pc;
 	    val = nil_value;
 	    if (i_store_index(f, &val, f->sp + 2, f->sp + 1, f->sp)) {
 		f->sp[2].u.string->del();
@@ -1759,10 +1910,10 @@ static void i_interpret(Frame *f, char *pc)
 	    }
 	    f->sp[2] = f->sp[0];
 	    f->sp += 2;
-	    break;
+	    NEXT_POP;
 
-	case I_STORE_LOCAL_INDEX:
-	case I_STORE_LOCAL_INDEX | I_POP_BIT:
+	CASE_POP(I_STORE_LOCAL_INDEX):
+	    f->pc = pc;
 	    u = FETCH1S(pc);
 	    val = nil_value;
 	    if (i_store_index(f, &val, f->sp + 2, f->sp + 1, f->sp)) {
@@ -1772,10 +1923,10 @@ static void i_interpret(Frame *f, char *pc)
 	    }
 	    f->sp[2] = f->sp[0];
 	    f->sp += 2;
-	    break;
+	    NEXT_POP;
 
-	case I_STORE_GLOBAL_INDEX:
-	case I_STORE_GLOBAL_INDEX | I_POP_BIT:
+	CASE_POP(I_STORE_GLOBAL_INDEX):
+	    f->pc = pc;
 	    u = FETCH1U(pc);
 	    val = nil_value;
 	    if (i_store_index(f, &val, f->sp + 2, f->sp + 1, f->sp)) {
@@ -1785,10 +1936,10 @@ static void i_interpret(Frame *f, char *pc)
 	    }
 	    f->sp[2] = f->sp[0];
 	    f->sp += 2;
-	    break;
+	    NEXT_POP;
 
-	case I_STORE_FAR_GLOBAL_INDEX:
-	case I_STORE_FAR_GLOBAL_INDEX | I_POP_BIT:
+	CASE_POP(I_STORE_FAR_GLOBAL_INDEX):
+	    f->pc = pc;
 	    u = FETCH1U(pc);
 	    u2 = FETCH1U(pc);
 	    val = nil_value;
@@ -1799,10 +1950,10 @@ static void i_interpret(Frame *f, char *pc)
 	    }
 	    f->sp[2] = f->sp[0];
 	    f->sp += 2;
-	    break;
+	    NEXT_POP;
 
-	case I_STORE_INDEX_INDEX:
-	case I_STORE_INDEX_INDEX | I_POP_BIT:
+	CASE_POP(I_STORE_INDEX_INDEX):
+	    f->pc = pc;
 	    val = nil_value;
 	    if (i_store_index(f, &val, f->sp + 2, f->sp + 1, f->sp)) {
 		f->sp[1] = val;
@@ -1815,39 +1966,97 @@ static void i_interpret(Frame *f, char *pc)
 	    }
 	    f->sp[4] = f->sp[0];
 	    f->sp += 4;
-	    break;
+	    NEXT_POP;
 
-	case I_JUMP_ZERO:
+	CASE(I_JUMP_ZERO):
 	    p = f->prog + FETCH2U(pc, u);
 	    if (!VAL_TRUE(f->sp)) {
 		if (p < pc) {
+		    f->pc = pc;
 		    CHECK_LOOP_TICKS();
 		}
 		pc = p;
 	    }
 	    i_del_value(f->sp++);
-	    continue;
+	    NEXT;
 
-	case I_JUMP_NONZERO:
+	CASE(I_JUMP_NONZERO):
 	    p = f->prog + FETCH2U(pc, u);
 	    if (VAL_TRUE(f->sp)) {
 		if (p < pc) {
+		    f->pc = pc;
 		    CHECK_LOOP_TICKS();
 		}
 		pc = p;
 	    }
 	    i_del_value(f->sp++);
-	    continue;
+	    NEXT;
 
-	case I_JUMP:
+	CASE(I_JUMP_LOCAL):
+	    u = FETCH1S(pc);
+	    num = (((short) u < 0) ? f->fp + (short) u : f->argp + u)->u.number;
+	    u2 = FETCH1U(pc);
+	    if (u2 & JUMP_CONST) {
+		num2 = FETCH4S(pc, l);
+	    } else {
+		u = FETCH1S(pc);
+		num2 = (((short) u < 0) ?
+			 f->fp + (short) u : f->argp + u)->u.number;
+	    }
+	    switch (u2 & JUMP_CMP_MASK) {
+	    case JUMP_LT:
+		cond = (num < num2);
+		break;
+
+	    case JUMP_LE:
+		cond = (num <= num2);
+		break;
+
+	    case JUMP_GT:
+		cond = (num > num2);
+		break;
+
+	    case JUMP_GE:
+		cond = (num >= num2);
+		break;
+
+	    case JUMP_EQ:
+		cond = (num == num2);
+		break;
+
+	    default:
+		cond = (num != num2);
+		break;
+	    }
+	    p = f->prog + FETCH2U(pc, u);
+	    if (cond == ((u2 & JUMP_TRUE) != 0)) {
+		if (p < pc) {
+		    f->pc = pc;
+		    CHECK_LOOP_TICKS();
+		}
+		pc = p;
+	    }
+	    NEXT;
+
+	CASE(I_ADD_LOCAL):
+	    u = FETCH1S(pc);
+	    var = ((short) u < 0) ? f->fp + (short) u : f->argp + u;
+	    i_add_ticks(f, 1);
+	    var->u.number += FETCH1S(pc);
+	    var->modified = TRUE;
+	    NEXT;
+
+	CASE(I_JUMP):
 	    p = f->prog + FETCH2U(pc, u);
 	    if (p < pc) {
+		f->pc = pc;
 		CHECK_LOOP_TICKS();
 	    }
 	    pc = p;
-	    continue;
+	    NEXT;
 
-	case I_SWITCH:
+	CASE(I_SWITCH):
+	    f->pc = pc;
 	    switch (FETCH1U(pc)) {
 	    case SWITCH_INT:
 		p = f->prog + i_switch_int(f, pc);
@@ -1866,10 +2075,9 @@ static void i_interpret(Frame *f, char *pc)
 	    }
 	    pc = p;
 	    i_del_value(f->sp++);
-	    continue;
+	    NEXT;
 
-	case I_CALL_KFUNC:
-	case I_CALL_KFUNC | I_POP_BIT:
+	CASE_POP(I_CALL_KFUNC):
 	    kf = &KFUN(FETCH1U(pc));
 	    if (PROTO_VARGS(kf->proto) != 0) {
 		/* variable # of arguments */
@@ -1879,11 +2087,11 @@ static void i_interpret(Frame *f, char *pc)
 		/* fixed # of arguments */
 		u = PROTO_NARGS(kf->proto);
 	    }
+	    f->pc = pc;
 	    if (PROTO_CLASS(kf->proto) & C_TYPECHECKED) {
 		i_typecheck(f, (Frame *) NULL, kf->name, "kfun", kf->proto, u,
 			    TRUE);
 	    }
-	    f->pc = pc;
 	    u = (*kf->func)(f, u, kf);
 	    if (u != 0) {
 		if ((short) u < 0) {
@@ -1896,10 +2104,9 @@ static void i_interpret(Frame *f, char *pc)
 		}
 	    }
 	    pc = f->pc;
-	    break;
+	    NEXT_POP;
 
-	case I_CALL_EFUNC:
-	case I_CALL_EFUNC | I_POP_BIT:
+	CASE_POP(I_CALL_EFUNC):
 	    kf = &KFUN(FETCH2U(pc, u));
 	    if (PROTO_VARGS(kf->proto) != 0) {
 		/* variable # of arguments */
@@ -1909,11 +2116,11 @@ static void i_interpret(Frame *f, char *pc)
 		/* fixed # of arguments */
 		u = PROTO_NARGS(kf->proto);
 	    }
+	    f->pc = pc;
 	    if (PROTO_CLASS(kf->proto) & C_TYPECHECKED) {
 		i_typecheck(f, (Frame *) NULL, kf->name, "kfun", kf->proto, u,
 			    TRUE);
 	    }
-	    f->pc = pc;
 	    u = (*kf->func)(f, u, kf);
 	    if (u != 0) {
 		if ((short) u < 0) {
@@ -1926,13 +2133,13 @@ static void i_interpret(Frame *f, char *pc)
 		}
 	    }
 	    pc = f->pc;
-	    break;
+	    NEXT_POP;
 
-	case I_CALL_CKFUNC:
-	case I_CALL_CKFUNC | I_POP_BIT:
+	CASE_POP(I_CALL_CKFUNC):
 	    kf = &KFUN(FETCH1U(pc));
 	    u = FETCH1U(pc) + size;
 	    size = 0;
+	    f->pc = pc;
 	    if (u != PROTO_NARGS(kf->proto)) {
 		if (u < PROTO_NARGS(kf->proto)) {
 		    error("Too few arguments for kfun %s", kf->name);
@@ -1944,19 +2151,18 @@ static void i_interpret(Frame *f, char *pc)
 		i_typecheck(f, (Frame *) NULL, kf->name, "kfun", kf->proto, u,
 			    TRUE);
 	    }
-	    f->pc = pc;
 	    u = (*kf->func)(f, u, kf);
 	    if (u != 0) {
 		error("Bad argument %d for kfun %s", u, kf->name);
 	    }
 	    pc = f->pc;
-	    break;
+	    NEXT_POP;
 
-	case I_CALL_CEFUNC:
-	case I_CALL_CEFUNC | I_POP_BIT:
+	CASE_POP(I_CALL_CEFUNC):
 	    kf = &KFUN(FETCH2U(pc, u));
 	    u = FETCH1U(pc) + size;
 	    size = 0;
+	    f->pc = pc;
 	    if (u != PROTO_NARGS(kf->proto)) {
 		if (u < PROTO_NARGS(kf->proto)) {
 		    error("Too few arguments for kfun %s", kf->name);
@@ -1968,42 +2174,40 @@ static void i_interpret(Frame *f, char *pc)
 		i_typecheck(f, (Frame *) NULL, kf->name, "kfun", kf->proto, u,
 			    TRUE);
 	    }
-	    f->pc = pc;
 	    u = (*kf->func)(f, u, kf);
 	    if (u != 0) {
 		error("Bad argument %d for kfun %s", u, kf->name);
 	    }
 	    pc = f->pc;
-	    break;
+	    NEXT_POP;
 
-	case I_CALL_AFUNC:
-	case I_CALL_AFUNC | I_POP_BIT:
+	CASE_POP(I_CALL_AFUNC):
+	    f->pc = pc;
 	    u = FETCH1U(pc);
 	    i_funcall(f, (Object *) NULL, (Array *) NULL, 0, u,
 		      FETCH1U(pc) + size);
 	    size = 0;
-	    break;
+	    NEXT_POP;
 
-	case I_CALL_DFUNC:
-	case I_CALL_DFUNC | I_POP_BIT:
+	CASE_POP(I_CALL_DFUNC):
+	    f->pc = pc;
 	    u = FETCH1U(pc);
 	    u2 = FETCH1U(pc);
 	    i_funcall(f, (Object *) NULL, (Array *) NULL,
 		      UCHAR(f->ctrl->imap[f->p_index + u]), u2,
 		      FETCH1U(pc) + size);
 	    size = 0;
-	    break;
+	    NEXT_POP;
 
-	case I_CALL_FUNC:
-	case I_CALL_FUNC | I_POP_BIT:
+	CASE_POP(I_CALL_FUNC):
+	    f->pc = pc;
 	    p = &f->ctrl->funcalls[2L * (f->foffset + FETCH2U(pc, u))];
 	    i_funcall(f, (Object *) NULL, (Array *) NULL, UCHAR(p[0]),
 		      UCHAR(p[1]), FETCH1U(pc) + size);
 	    size = 0;
-	    break;
+	    NEXT_POP;
 
-	case I_CATCH:
-	case I_CATCH | I_POP_BIT:
+	CASE_POP(I_CATCH):
 	    atomic = f->atomic;
 	    p = f->prog + FETCH2U(pc, u);
 	    try {
@@ -2023,9 +2227,10 @@ static void i_interpret(Frame *f, char *pc)
 		PUSH_STRVAL(f, errorstr());
 	    }
 	    f->atomic = atomic;
-	    break;
+	    NEXT_POP;
 
-	case I_RLIMITS:
+	CASE(I_RLIMITS):
+	    f->pc = pc;
 	    if (f->sp[1].type != T_INT) {
 		error("Bad rlimits depth type");
 	    }
@@ -2045,11 +2250,24 @@ static void i_interpret(Frame *f, char *pc)
 	    i_interpret(f, pc);
 	    pc = f->pc;
 	    i_set_rlimits(f, f->rlim->next);
-	    continue;
+	    NEXT;
 
-	case I_RETURN:
+	CASE(I_RETURN):
+	    f->pc = pc;
 	    return;
 
+# ifdef THREADED
+	illegal:
+# ifdef DEBUG
+	    fatal("illegal instruction");
+# endif
+	pop:
+	    if (instr & I_POP_BIT) {
+		/* pop the result of the last operation (never an lvalue) */
+		i_del_value(f->sp++);
+	    }
+	    NEXT;
+# else
 # ifdef DEBUG
 	default:
 	    fatal("illegal instruction");
@@ -2061,16 +2279,18 @@ static void i_interpret(Frame *f, char *pc)
 	    i_del_value(f->sp++);
 	}
     }
+# endif
 }
 
 extern bool ext_execute(const Frame*, int, Value*);
 
 /*
- * NAME:	interpret->funcall()
+ * NAME:	funcall()
  * DESCRIPTION:	Call a function in an object. The arguments must be on the
  *		stack already.
  */
-void i_funcall(Frame *prev_f, Object *obj, Array *lwobj, int p_ctrli, int funci, int nargs)
+static void funcall(Frame *prev_f, Object *obj, Array *lwobj, int p_ctrli,
+		    int funci, int nargs)
 {
     char *pc;
     unsigned short n;
@@ -2314,6 +2534,25 @@ void i_funcall(Frame *prev_f, Object *obj, Array *lwobj, int p_ctrli, int funci,
     }
 }
 
+/*
+ * NAME:	interpret->funcall()
+ * DESCRIPTION:	Call a function in an object. The arguments must be on the
+ *		stack already.
+ */
+void i_funcall(Frame *prev_f, Object *obj, Array *lwobj, int p_ctrli, int funci, int nargs)
+{
+    if (sample | account) {
+	if (sample) {
+	    i_sample(prev_f);
+	}
+	if (account) {
+	    i_account_call(prev_f, obj, lwobj, p_ctrli, funci, nargs);
+	    return;
+	}
+    }
+    funcall(prev_f, obj, lwobj, p_ctrli, funci, nargs);
+}
+
 /*
  * NAME:	interpret->call()
  * DESCRIPTION:	Attempt to call a function in an object. Return TRUE if
@@ -2323,7 +2562,7 @@ bool i_call(Frame *f, Object *obj, Array *lwobj, const char *func,
 	    unsigned int len, int call_static, int nargs)
 {
     dsymbol *symb;
-    dfuncdef *fdef;
+    dcallcache *cc;
     Control *ctrl;
 
     if (lwobj != (Array *) NULL) {
@@ -2391,27 +2630,43 @@ bool i_call(Frame *f, Object *obj, Array *lwobj, const char *func,
 	len = clen;
     }
 
-    /* find the function in the symbol table */
+    /* look in the call_other cache first */
     ctrl = obj->control();
-    symb = ctrl_symb(ctrl, func, len);
-    if (symb == (dsymbol *) NULL) {
-	/* function doesn't exist in symbol table */
+    cc = d_get_callcache(ctrl) +
+	 (len + UCHAR(func[0]) + UCHAR(func[len >> 1])) % CALLCACHESZ;
+    if (cc->name == (String *) NULL || cc->name->len != len ||
+	memcmp(cc->name->text, func, len) != 0) {
+	/* find the function in the symbol table */
+	if (cc->name != (String *) NULL) {
+	    cc->name->del();
+	}
+	cc->name = String::create(func, len);
+	cc->name->ref();
+	symb = ctrl_symb(ctrl, func, len);
+	if (symb == (dsymbol *) NULL) {
+	    /* function doesn't exist in symbol table */
+	    cc->sclass = C_UNDEFINED;
+	} else {
+	    cc->inherit = symb->inherit;
+	    cc->index = symb->index;
+	    ctrl = OBJR(ctrl->inherits[UCHAR(symb->inherit)].oindex)->ctrl;
+	    cc->sclass = d_get_funcdefs(ctrl)[UCHAR(symb->index)].sclass;
+	}
+    }
+    if (cc->sclass & C_UNDEFINED) {
 	i_pop(f, nargs);
 	return FALSE;
     }
 
-    ctrl = OBJR(ctrl->inherits[UCHAR(symb->inherit)].oindex)->ctrl;
-    fdef = &d_get_funcdefs(ctrl)[UCHAR(symb->index)];
-
     /* check if the function can be called */
-    if (!call_static && (fdef->sclass & C_STATIC) &&
+    if (!call_static && (cc->sclass & C_STATIC) &&
 	(f->oindex != obj->index || f->lwobj != lwobj)) {
 	i_pop(f, nargs);
 	return FALSE;
     }
 
     /* call the function */
-    i_funcall(f, obj, lwobj, UCHAR(symb->inherit), UCHAR(symb->index), nargs);
+    i_funcall(f, obj, lwobj, UCHAR(cc->inherit), UCHAR(cc->index), nargs);
 
     return TRUE;
 }
@@ -2506,8 +2761,15 @@ static unsigned short i_line(Frame *f)
 	    }
 	    break;
 
+	case I_JUMP_LOCAL:
+	    pc++;
+	    pc += (FETCH1U(pc) & JUMP_CONST) ? 6 : 3;
+	    break;
+
 	case I_PUSH_INT2:
 	case I_PUSH_NEAR_STRING:
+	case I_INDEX_GLOBAL:
+	case I_ADD_LOCAL:
 	case I_PUSH_FAR_GLOBAL:
 	case I_STORE_FAR_GLOBAL:
 	case I_STORE_FAR_GLOBAL | I_POP_BIT:
@@ -2690,6 +2952,286 @@ Array *i_call_trace(Frame *ftop)
     return a;
 }
 
+/*
+ * NAME:	interpret->prof_timer()
+ * DESCRIPTION:	called by the profiling timer
+ */
+void i_prof_timer()
+{
+    sample = TRUE;
+}
+
+/*
+ * NAME:	interpret->prof_age()
+ * DESCRIPTION:	halve the profiling sample counts, removing samples that drop
+ *		to zero, until there is room for new samples
+ */
+static void i_prof_age()
+{
+    profsample *tab, *ps, *p;
+    unsigned int n, i;
+
+    do {
+	for (ps = proftab, i = PROFTABSZ; i > 0; ps++, --i) {
+	    if (ps->prog != (char *) NULL && (ps->count >>= 1) == 0) {
+		FREE(ps->prog);
+		FREE(ps->func);
+		ps->prog = (char *) NULL;
+		--nprofsamples;
+	    }
+	}
+    } while (nprofsamples == PROFTABSZ / 2);
+
+    /* rehash the remaining samples */
+    tab = ALLOCA(profsample, nprofsamples + 1);
+    for (ps = proftab, p = tab, i = PROFTABSZ; i > 0; ps++, --i) {
+	if (ps->prog != (char *) NULL) {
+	    *p++ = *ps;
+	    ps->prog = (char *) NULL;
+	}
+    }
+    for (p = tab, n = nprofsamples; n > 0; p++, --n) {
+	for (i = p->hash % PROFTABSZ; proftab[i].prog != (char *) NULL;
+	     i = (i + 1) % PROFTABSZ) ;
+	proftab[i] = *p;
+    }
+    AFREE(tab);
+}
+
+/*
+ * NAME:	interpret->sample()
+ * DESCRIPTION:	add a profiling sample for the current function and line
+ */
+static void i_sample(Frame *f)
+{
+    const char *prog;
+    String *func;
+    unsigned short line, hash;
+    unsigned int len, i;
+    profsample *ps;
+
+    if (f->oindex == OBJ_NONE) {
+	return;		/* keep sample pending */
+    }
+    sample = FALSE;
+
+    prog = OBJR(f->p_ctrl->oindex)->name;
+    len = strlen(prog);
+    func = d_get_strconst(f->p_ctrl, f->func->inherit, f->func->index);
+    line = i_line(f);
+
+    hash = Hashtab::hashstr(prog, len) ^
+	   Hashtab::hashstr(func->text, func->len) ^ line;
+    i = hash % PROFTABSZ;
+    for (;;) {
+	ps = &proftab[i];
+	if (ps->prog == (char *) NULL) {
+	    if (nprofsamples == PROFTABSZ / 2) {
+		/* table is full: age the old samples */
+		i_prof_age();
+		i = hash % PROFTABSZ;
+		continue;
+	    }
+	    nprofsamples++;
+	    m_static();
+	    ps->prog = strcpy(ALLOC(char, len + 1), prog);
+	    ps->func = strcpy(ALLOC(char, func->len + 1), func->text);
+	    m_dynamic();
+	    ps->line = line;
+	    ps->hash = hash;
+	    ps->count = 0;
+	    break;
+	}
+	if (ps->line == line && strcmp(ps->func, func->text) == 0 &&
+	    strcmp(ps->prog, prog) == 0) {
+	    break;
+	}
+	i = (i + 1) % PROFTABSZ;
+    }
+    ps->count++;
+}
+
+/*
+ * NAME:	cmp()
+ * DESCRIPTION:	compare two profiling samples
+ */
+static int cmp(cvoid *cv1, cvoid *cv2)
+{
+    Uint c1, c2;
+
+    c1 = (*(profsample **) cv1)->count;
+    c2 = (*(profsample **) cv2)->count;
+    return (c1 < c2) - (c1 > c2);
+}
+
+/*
+ * NAME:	interpret->profile()
+ * DESCRIPTION:	return the profiling samples, most frequent first
+ */
+Array *i_profile(Dataspace *data)
+{
+    profsample **tab, **t, *ps;
+    Value *v, *w;
+    unsigned int n, i;
+    Array *a, *b;
+
+    tab = ALLOCA(profsample*, nprofsamples + 1);
+    for (ps = proftab, t = tab, i = PROFTABSZ; i > 0; ps++, --i) {
+	if (ps->prog != (char *) NULL) {
+	    *t++ = ps;
+	}
+    }
+    qsort(tab, nprofsamples, sizeof(profsample*), cmp);
+
+    n = (nprofsamples < conf_array_size()) ? nprofsamples : conf_array_size();
+    a = Array::create(data, n);
+    for (t = tab, v = a->elts; n > 0; t++, v++, --n) {
+	b = Array::create(data, 4);
+	PUT_ARRVAL(v, b);
+	w = b->elts;
+	PUT_STRVAL(w, String::create((char *) NULL,
+				     strlen((*t)->prog) + 1L));
+	w->u.string->text[0] = '/';
+	strcpy(w->u.string->text + 1, (*t)->prog);
+	w++;
+	PUT_STRVAL(w, String::create((*t)->func, strlen((*t)->func)));
+	w++;
+	PUT_INTVAL(w, (*t)->line);
+	w++;
+	PUT_INTVAL(w, (*t)->count);
+    }
+    AFREE(tab);
+
+    return a;
+}
+
+/*
+ * accounting for one function call, done when the call ends, also if it
+ * ends with an error
+ */
+class CallAccount {
+public:
+    CallAccount(Control *ctrl, int funci, rlinfo *rlim) {
+	this->ctrl = ctrl;
+	this->funci = funci;
+	this->rlim = rlim;
+	ticks = rlim->ticks;
+	time = P_ntime();
+    }
+
+    ~CallAccount() {
+	rlinfo *r;
+	dacct *acct;
+
+	time = P_ntime() - time;
+	acct = d_get_account(ctrl, TRUE) + funci;
+	acct->calls++;
+	acct->time += time;
+
+	/* after an error, the rlimits of the caller may be gone */
+	for (r = cframe->rlim; r != (rlinfo *) NULL; r = r->next) {
+	    if (r == rlim) {
+		ticks -= rlim->ticks;
+		if (ticks > 0) {
+		    acct->ticks += ticks;
+		}
+		break;
+	    }
+	}
+    }
+
+private:
+    Control *ctrl;		/* program */
+    int funci;			/* function index */
+    rlinfo *rlim;		/* rlimits of the caller */
+    Int ticks;			/* ticks left at start */
+    Uuint time;			/* time at start */
+};
+
+/*
+ * NAME:	interpret->account_call()
+ * DESCRIPTION:	call a function, and account for the calls, ticks and time
+ *		used by it, including the functions that it calls
+ */
+static void i_account_call(Frame *prev_f, Object *obj, Array *lwobj,
+			   int p_ctrli, int funci, int nargs)
+{
+    Control *ctrl;
+
+    ctrl = (obj != (Object *) NULL) ? obj->ctrl : prev_f->ctrl;
+    ctrl = OBJR(ctrl->inherits[p_ctrli].oindex)->control();
+    CallAccount acct(ctrl, funci, prev_f->rlim);
+
+    funcall(prev_f, obj, lwobj, p_ctrli, funci, nargs);
+}
+
+/*
+ * NAME:	interpret->set_account()
+ * DESCRIPTION:	start or stop function accounting; starting it again
+ *		discards the previous results
+ */
+void i_set_account(bool flag)
+{
+    if (flag && !account) {
+	d_clear_account();
+    }
+    account = flag;
+}
+
+/*
+ * NAME:	interpret->get_account()
+ * DESCRIPTION:	return the function accounting for a program
+ */
+Array *i_get_account(Dataspace *data, Control *ctrl)
+{
+    dacct *acct, *a;
+    dfuncdef *func;
+    unsigned short i, n;
+    Value *v, *w;
+    Array *list, *entry;
+    Float flt1, flt2;
+
+    acct = d_get_account(ctrl, FALSE);
+    if (acct == (dacct *) NULL) {
+	return Array::create(data, 0);
+    }
+    for (a = acct, i = ctrl->nfuncdefs, n = 0; i > 0; a++, --i) {
+	if (a->calls != 0) {
+	    n++;
+	}
+    }
+
+    list = Array::create(data, n);
+    func = d_get_funcdefs(ctrl);
+    for (v = list->elts; n > 0; acct++, func++) {
+	if (acct->calls == 0) {
+	    continue;
+	}
+	entry = Array::create(data, 4);
+	PUT_ARRVAL(v, entry);
+	v++;
+	w = entry->elts;
+	PUT_STRVAL(w, d_get_strconst(ctrl, func->inherit, func->index));
+	w++;
+	PUT_INTVAL(w, (acct->calls > 0x7fffffff) ? 0x7fffffff : acct->calls);
+	w++;
+	Float::itof((Int) (acct->ticks >> 31), &flt1);
+	flt1.ldexp(31);
+	Float::itof((Int) (acct->ticks & 0x7fffffff), &flt2);
+	flt1.add(flt2);
+	PUT_FLTVAL(w, flt1);
+	w++;
+	Float::itof((Int) (acct->time >> 31), &flt1);
+	flt1.ldexp(31);
+	Float::itof((Int) (acct->time & 0x7fffffff), &flt2);
+	flt1.add(flt2);
+	PUT_FLTVAL(w, flt1);
+	--n;
+    }
+
+    return list;
+}
+
 /*
  * NAME:	emptyhandler()
  * DESCRIPTION:	fake error handler
@@ -2793,6 +3335,26 @@ Frame *i_restore(Frame *ftop, Int level)
     return f;
 }
 
+/*
+ * NAME:	interpret->finish()
+ * DESCRIPTION:	stop profiling and remove the samples
+ */
+void i_finish()
+{
+    profsample *ps;
+    int i;
+
+    P_timer(0, (void (*)()) NULL);
+    for (ps = proftab, i = PROFTABSZ; i > 0; ps++, --i) {
+	if (ps->prog != (char *) NULL) {
+	    FREE(ps->prog);
+	    FREE(ps->func);
+	    ps->prog = (char *) NULL;
+	}
+    }
+    nprofsamples = 0;
+}
+
 /*
  * NAME:	interpret->clear()
  * DESCRIPTION:	clean up the interpreter state
@@ -23,6 +23,9 @@
 # define I_PUSH_INT2		0x20	/* 2 signed */
 # define I_PUSH_INT4		0x01	/* 4 signed */
 # define I_PUSH_INT8		0x21	/* reserved */
+# define I_JUMP_LOCAL		0x02	/* 1 signed, 1 unsigned, 1/4 signed,
+					   2 unsigned */
+# define I_ADD_LOCAL		0x22	/* 1 signed, 1 signed */
 # define I_PUSH_FLOAT6		0x03	/* 6 unsigned */
 # define I_PUSH_FLOAT12		0x23	/* reserved */
 # define I_PUSH_STRING		0x04	/* 1 unsigned */
@@ -38,6 +41,7 @@
 # define I_CAST			0x0a	/* 1+3 unsigned */
 # define I_INSTANCEOF		0x0b	/* 1 unsigned, 2 unsigned */
 # define I_STORES		0x0c	/* 1 unsigned */
+# define I_INDEX_GLOBAL		0x2c	/* 1 unsigned, 1 signed */
 # define I_STORE_GLOBAL_INDEX	0x0d	/* 1 unsigned */
 # define I_CALL_EFUNC		0x0e	/* 2 unsigned (+ 1 unsigned) */
 # define I_CALL_CEFUNC		0x0f	/* 2 unsigned, 1 unsigned */
@@ -68,6 +72,16 @@
 # define VERSION_VM_MAJOR	2
 # define VERSION_VM_MINOR	1
 
+# define JUMP_LT		0	/* I_JUMP_LOCAL comparisons */
+# define JUMP_LE		1
+# define JUMP_GT		2
+# define JUMP_GE		3
+# define JUMP_EQ		4
+# define JUMP_NE		5
+# define JUMP_CMP_MASK		0x07
+# define JUMP_CONST		0x08	/* compare with 4 signed constant */
+# define JUMP_TRUE		0x10	/* jump if comparison holds */
+
 
 # define FETCH1S(pc)	SCHAR(*(pc)++)
 # define FETCH1U(pc)	UCHAR(*(pc)++)
@@ -228,7 +242,7 @@ struct Frame {
     bool atomic;		/* within uncaught atomic code */
 };
 
-extern void	i_init		(char*, bool);
+extern void	i_init		(char*, bool, unsigned int);
 extern void	i_ref_value	(Value*);
 extern void	i_del_value	(Value*);
 extern void	i_copy		(Value*, Value*, unsigned int);
@@ -265,11 +279,16 @@ extern bool	i_call		(Frame*, Object*, Array*, const char*,
 				 unsigned int, int, int);
 extern bool	i_call_tracei	(Frame*, Int, Value*);
 extern Array   *i_call_trace	(Frame*);
+extern void	i_prof_timer	();
+extern Array   *i_profile	(Dataspace*);
+extern void	i_set_account	(bool);
+extern Array   *i_get_account	(Dataspace*, Control*);
 extern bool	i_call_critical	(Frame*, const char*, int, int);
 extern void	i_runtime_error	(Frame*, Int);
 extern void	i_atomic_error	(Frame*, Int);
 extern Frame   *i_restore	(Frame*, Int);
 extern void	i_clear		();
+extern void	i_finish	();
 
 extern Frame *cframe;
 extern int nil_type;
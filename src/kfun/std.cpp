@@ -1079,6 +1079,32 @@ int kf_send_message(Frame *f, int n, kfunc *kf)
 }
 # endif
 
+# ifdef FUNCDEF
+FUNCDEF("send_multicast", kf_send_multicast, pt_send_multicast, 0)
+# else
+char pt_send_multicast[] = { C_TYPECHECKED | C_STATIC, 2, 0, 0, 8, T_INT,
+			     T_OBJECT | (1 << REFSHIFT), T_STRING };
+
+/*
+ * NAME:	kfun->send_multicast()
+ * DESCRIPTION:	send a message to several users
+ */
+int kf_send_multicast(Frame *f, int n, kfunc *kf)
+{
+    int num;
+
+    UNREFERENCED_PARAMETER(n);
+    UNREFERENCED_PARAMETER(kf);
+
+    i_add_ticks(f, f->sp[1].u.array->size);
+    num = comm_multicast(f, f->sp[1].u.array, f->sp->u.string);
+    (f->sp++)->u.string->del();
+    f->sp->u.array->del();
+    PUT_INTVAL(f->sp, num);
+    return 0;
+}
+# endif
+
 # ifdef FUNCDEF
 FUNCDEF("send_datagram", kf_send_datagram, pt_send_datagram, 0)
 # else
@@ -1502,6 +1528,67 @@ int kf_status(Frame *f, int nargs, kfunc *kf)
 # endif
 
 
+# ifdef FUNCDEF
+FUNCDEF("account_functions", kf_account_functions, pt_account_functions, 0)
+# else
+char pt_account_functions[] = { C_TYPECHECKED | C_STATIC, 1, 0, 0, 7, T_VOID,
+				T_INT };
+
+/*
+ * NAME:	kfun->account_functions()
+ * DESCRIPTION:	start or stop accounting calls, ticks and time per function
+ */
+int kf_account_functions(Frame *f, int nargs, kfunc *kf)
+{
+    UNREFERENCED_PARAMETER(nargs);
+    UNREFERENCED_PARAMETER(kf);
+
+    i_set_account(f->sp->u.number != 0);
+    *f->sp = nil_value;
+    return 0;
+}
+# endif
+
+
+# ifdef FUNCDEF
+FUNCDEF("function_account", kf_function_account, pt_function_account, 0)
+# else
+char pt_function_account[] = { C_TYPECHECKED | C_STATIC, 1, 0, 0, 7,
+			       T_MIXED | (2 << REFSHIFT), T_OBJECT };
+
+/*
+ * NAME:	kfun->function_account()
+ * DESCRIPTION:	return the accounting for the functions defined in the
+ *		program of an object
+ */
+int kf_function_account(Frame *f, int nargs, kfunc *kf)
+{
+    Array *a;
+    uindex n;
+
+    UNREFERENCED_PARAMETER(nargs);
+    UNREFERENCED_PARAMETER(kf);
+
+    if (f->sp->type == T_OBJECT) {
+	n = f->sp->oindex;
+    } else {
+	if (f->sp->u.array->elts[0].type != T_OBJECT) {
+	    /* builtin type */
+	    f->sp->u.array->del();
+	    PUT_ARRVAL(f->sp, Array::create(f->data, 0));
+	    return 0;
+	}
+	n = f->sp->u.array->elts[0].oindex;
+	f->sp->u.array->del();
+    }
+    a = i_get_account(f->data, OBJR(n)->control());
+    i_add_ticks(f, 10 + 4 * a->size);
+    PUT_ARRVAL(f->sp, a);
+    return 0;
+}
+# endif
+
+
 # ifdef CLOSURES
 # ifdef FUNCDEF
 FUNCDEF("new.function", kf_new_function, pt_new_function, 0)
@@ -29,67 +29,24 @@
 
 class ObjPatch : public ChunkAllocated {
 public:
-    ObjPatch(class ObjPlane *plane, ObjPatch **o, ObjPatch *prev, Object *obj) :
-	plane(plane), prev(prev), obj(*obj) {
-	next = *o;
-	*o = this;
-    }
+    ObjPatch(class ObjPlane *plane, ObjPatch *prev, Object *obj) :
+	plane(plane), prev(prev), obj(*obj) { }
 
     class ObjPlane *plane;		/* plane that patch is on */
     ObjPatch *prev;			/* previous patch */
-    ObjPatch *next;			/* next in linked list */
+    ObjPatch *next;			/* next on the same plane */
     Object obj;				/* new object value */
 };
 
-# define OPCHUNKSZ		32
-
-class ObjPatchTable : public Allocated {
-public:
-    /*
-     * initialize ObjPatch table
-     */
-    ObjPatchTable() {
-	memset(&op, '\0', OBJPATCHHTABSZ * sizeof(ObjPatch*));
-    }
-
-    /*
-     * find object patch, or create a new one
-     */
-    ObjPatch *patch(unsigned int index, int access, class ObjPlane *plane) {
-	ObjPatch **oo, *o;
-
-	oo = &op[index % OBJPATCHHTABSZ];
-	for (o = *oo; o->obj.index != index; o = o->next) ;
-	if (access == OACC_READ || o->plane == plane) {
-	    return o;
-	}
-
-	/* create new patch on current plane */
-	return chunknew (chunk) ObjPatch(plane, oo, o, &o->obj);
-    }
-
-    /*
-     * add first patch for object
-     */
-    ObjPatch *addPatch(unsigned int index, class ObjPlane *plane) {
-	return chunknew (chunk) ObjPatch(plane, &op[index % OBJPATCHHTABSZ],
-					 (ObjPatch *) NULL, OBJ(index));
-    }
-
-    Chunk<ObjPatch, OPCHUNKSZ> chunk; 	/* object patch chunk */
-    ObjPatch *op[OBJPATCHHTABSZ];	/* hash table of object patches */
-};
-
 class ObjPlane : public Allocated {
 public:
     ObjPlane(ObjPlane *prev) {
 	htab = (Hashtab *) NULL;
-	optab = (ObjPatchTable *) NULL;
+	patches = (ObjPatch *) NULL;
 
 	if (prev != (ObjPlane *) NULL) {
-	    if (prev->optab != (ObjPatchTable *) NULL) {
+	    if (prev->prev != (ObjPlane *) NULL) {
 		htab = prev->htab;
-		optab = prev->optab;
 	    }
 	    clean = prev->clean;
 	    upgrade = prev->upgrade;
@@ -108,15 +65,11 @@ public:
     }
 
     virtual ~ObjPlane() {
-	if (optab != (ObjPatchTable *) NULL) {
-	    if (prev != (ObjPlane *) NULL && prev->prev != (ObjPlane *) NULL) {
+	if (prev != (ObjPlane *) NULL) {
+	    if (prev->prev != (ObjPlane *) NULL) {
 		prev->htab = htab;
-		prev->optab = optab;
-	    } else {
-		if (htab != (Hashtab *) NULL) {
-		    delete htab;
-		}
-		delete optab;
+	    } else if (htab != (Hashtab *) NULL) {
+		delete htab;
 	    }
 	}
     }
@@ -140,7 +93,7 @@ public:
     }
 
     Hashtab *htab;		/* object name hash table */
-    ObjPatchTable *optab;	/* object patch table */
+    ObjPatch *patches;		/* object patches on this plane */
     uintptr_t clean;		/* list of objects to clean */
     uintptr_t upgrade;		/* list of upgrade objects */
     uindex destruct;		/* destructed object list */
@@ -152,6 +105,135 @@ public:
     ObjPlane *prev;		/* previous object plane */
 };
 
+# define OPCHUNKSZ		32
+
+class ObjPatchTable {
+public:
+    /*
+     * initialize ObjPatch table
+     */
+    ObjPatchTable() {
+	base = table = (Slot *) NULL;
+	size = used = 0;
+	gen = 1;
+    }
+
+    /*
+     * allocate the initial table
+     */
+    void init() {
+	base = table = ALLOC(Slot, size = OBJPATCHHTABSZ);
+	memset(table, '\0', size * sizeof(Slot));
+    }
+
+    /*
+     * find the slot for the latest patch of an object
+     */
+    ObjPatch **slot(unsigned int index) {
+	Slot *s;
+
+	if (used >= size >> 1) {
+	    grow();
+	}
+	for (s = first(index); s->gen == gen; s = next(s)) {
+	    if (s->index == index) {
+		return &s->patch;
+	    }
+	}
+	s->gen = gen;
+	s->index = index;
+	s->patch = (ObjPatch *) NULL;
+	used++;
+	return &s->patch;
+    }
+
+    /*
+     * add a patch for an object on the given plane
+     */
+    ObjPatch *addPatch(ObjPatch **s, unsigned int index, ObjPlane *plane) {
+	ObjPatch *op;
+
+	op = chunknew (chunk) ObjPatch(plane, *s,
+				       (*s != (ObjPatch *) NULL) ?
+					&(*s)->obj : OBJ(index));
+	op->next = plane->patches;
+	plane->patches = op;
+	return *s = op;
+    }
+
+    /*
+     * remove all patches at once
+     */
+    void clear() {
+	if (used != 0) {
+	    chunk.clean();
+	    if (table != base) {
+		FREE(table);
+		table = base;
+		size = OBJPATCHHTABSZ;
+	    }
+	    if (++gen == 0) {
+		memset(table, '\0', size * sizeof(Slot));
+		gen = 1;
+	    }
+	    used = 0;
+	}
+    }
+
+private:
+    /*
+     * double the size of the table, dropping unused slots; the larger
+     * table lasts only until the outermost atomic function ends
+     */
+    void grow() {
+	Slot *old, *s, *t;
+	Uint n;
+
+	old = table;
+	n = size;
+	table = ALLOC(Slot, size <<= 1);
+	memset(table, '\0', size * sizeof(Slot));
+	used = 0;
+	for (s = old; n != 0; s++, --n) {
+	    if (s->gen == gen && s->patch != (ObjPatch *) NULL) {
+		for (t = first(s->index); t->gen == gen; t = next(t)) ;
+		*t = *s;
+		used++;
+	    }
+	}
+	if (old != base) {
+	    FREE(old);
+	}
+    }
+
+    struct Slot {
+	Uint gen;		/* generation this slot is valid in */
+	uindex index;		/* object index */
+	ObjPatch *patch;	/* latest patch */
+    };
+
+    /*
+     * first slot to probe for an object
+     */
+    Slot *first(unsigned int index) {
+	return &table[((Uint) index * 0x9e3779b1U) & (size - 1)];
+    }
+
+    /*
+     * next slot to probe
+     */
+    Slot *next(Slot *s) {
+	return &table[(s - table + 1) & (size - 1)];
+    }
+
+    Chunk<ObjPatch, OPCHUNKSZ> chunk; 	/* object patch chunk */
+    Slot *base;			/* initial table */
+    Slot *table;		/* open-addressed patch table */
+    Uint size;			/* table size, a power of 2 */
+    Uint used;			/* # slots used in this generation */
+    Uint gen;			/* current generation */
+};
+
 Object *Object::objTable;	/* object table */
 Uint *Object::ocmap;		/* object change map */
 bool Object::base;		/* object base plane flag */
@@ -162,11 +244,14 @@ uindex Object::otabsize;	/* size of object table */
 uindex Object::uobjects;	/* objects to check for upgrades */
 static ObjPlane baseplane(NULL);/* base object plane */
 static ObjPlane *oplane;	/* current object plane */
+static ObjPatchTable optab;	/* object patch table */
 Uint *Object::omap;		/* object dump bitmap */
+Uint *Object::omap2;		/* secondary snapshot bitmap */
 Uint *Object::counttab;		/* object count table */
 Uint *Object::insttab;		/* object instance table */
 Object *Object::upgradeList;	/* list of upgraded objects */
 uindex Object::ndobject, Object::dobject; /* objects to copy */
+uindex Object::ndobject2;	/* objects to copy from secondary snapshot */
 uindex Object::mobjects;	/* max objects to copy */
 uindex Object::dchunksz;	/* copy chunk size */
 Uint Object::dinterval;		/* copy interval */
@@ -184,6 +269,7 @@ void Object::init(unsigned int n, Uint interval)
     memset(ocmap, '\0', BMAP(n) * sizeof(Uint));
     for (n = 4; n < otabsize; n <<= 1) ;
     baseplane.htab = Hashtab::create(n >> 2, OBJHASHSZ, FALSE);
+    optab.init();
     baseplane.upgrade = baseplane.clean = OBJ_NONE;
     baseplane.destruct = baseplane.free = OBJ_NONE;
     baseplane.nobjects = 0;
@@ -200,7 +286,8 @@ void Object::init(unsigned int n, Uint interval)
 	insttab[--n] = 1;
     } while (n != 0);
     upgradeList = (Object *) NULL;
-    uobjects = ndobject = mobjects = 0;
+    omap2 = (Uint *) NULL;
+    uobjects = ndobject = ndobject2 = mobjects = 0;
     dinterval = ((interval + 1) * 19) / 20;
     objDestrCount = 1;
     base = TRUE;
@@ -212,42 +299,32 @@ void Object::init(unsigned int n, Uint interval)
  */
 Object *Object::access(unsigned int index, int access)
 {
+    ObjPatch **s;
     Object *obj;
 
+    s = optab.slot(index);
     if (BTST(ocmap, index)) {
 	/*
 	 * object already patched
 	 */
-	obj = &oplane->optab->patch(index, access, oplane)->obj;
-	if (obj->name != (char *) NULL && obj->count != 0) {
+	if (access == OACC_READ || (*s)->plane == oplane) {
+	    return &(*s)->obj;
+	}
+
+	/* create new patch on current plane */
+	obj = &optab.addPatch(s, index, oplane)->obj;
+	if (obj->name != (char *) NULL && obj->count != 0 &&
+	    OBJ(index)->name == (char *) NULL) {
+	    /* move name to current plane */
 	    *oplane->htab->lookup(obj->name, FALSE) = obj;
 	}
     } else {
 	/*
-	 * first patch for object
+	 * first patch for object; the name, if any, remains shared with
+	 * the base plane, where find() will look for it
 	 */
 	BSET(ocmap, index);
-	if (oplane->optab == (ObjPatchTable *) NULL) {
-	    oplane->optab = new ObjPatchTable;
-	}
-	obj = &oplane->optab->addPatch(index, oplane)->obj;
-	if (obj->name != (char *) NULL) {
-	    char *name;
-	    Hashtab::Entry **h;
-
-	    /* copy object name to higher plane */
-	    strcpy(name = ALLOC(char, strlen(obj->name) + 1), obj->name);
-	    obj->name = name;
-	    if (obj->count != 0) {
-		if (oplane->htab == (Hashtab *) NULL) {
-		    oplane->htab = Hashtab::create(OBJPATCHHTABSZ, OBJHASHSZ,
-						   FALSE);
-		}
-		h = oplane->htab->lookup(name, FALSE);
-		obj->next = *h;
-		*h = obj;
-	    }
-	}
+	obj = &optab.addPatch(s, index, oplane)->obj;
     }
     return obj;
 }
@@ -310,102 +387,85 @@ void Object::newPlane()
 void Object::commitPlane()
 {
     ObjPlane *prev;
-    ObjPatch **t, **o, *op;
-    int i;
+    ObjPatch *op, *next;
     Object *obj;
 
     prev = oplane->prev;
-    if (oplane->optab != (ObjPatchTable *) NULL) {
-	for (i = OBJPATCHHTABSZ, t = oplane->optab->op; --i >= 0; t++) {
-	    o = t;
-	    while (*o != (ObjPatch *) NULL && (*o)->plane == oplane) {
-		op = *o;
-		if (op->prev != (ObjPatch *) NULL) {
-		    obj = &op->prev->obj;
-		} else {
-		    obj = OBJ(op->obj.index);
-		}
-		if (op->obj.count == 0 && obj->count != 0) {
-		    /* remove object from stackframe above atomic function */
-		    i_odest(cframe, obj);
-		}
+    for (op = oplane->patches; op != (ObjPatch *) NULL; op = next) {
+	next = op->next;
+	if (op->prev != (ObjPatch *) NULL) {
+	    obj = &op->prev->obj;
+	} else {
+	    obj = OBJ(op->obj.index);
+	}
+	if (op->obj.count == 0 && obj->count != 0) {
+	    /* remove object from stackframe above atomic function */
+	    i_odest(cframe, obj);
+	}
+
+	if (prev == &baseplane) {
+	    /*
+	     * commit to base plane
+	     */
+	    if (op->obj.name != (char *) NULL) {
+		Hashtab::Entry **h;
+
+		if (obj->name == (char *) NULL) {
+		    char *name;
 
-		if (prev == &baseplane) {
 		    /*
-		     * commit to base plane
+		     * make object name static
 		     */
-		    if (op->obj.name != (char *) NULL) {
-			Hashtab::Entry **h;
-
-			if (obj->name == (char *) NULL) {
-			    char *name;
-
-			    /*
-			     * make object name static
-			     */
-			    m_static();
-			    name = ALLOC(char, strlen(op->obj.name) + 1);
-			    m_dynamic();
-			    strcpy(name, op->obj.name);
-			    FREE(op->obj.name);
-			    op->obj.name = name;
-			    if (op->obj.count != 0) {
-				/* put name in static hash table */
-				h = prev->htab->lookup(name, FALSE);
-				op->obj.next = *h;
-				*h = obj;
-			    }
-			} else {
-			    /*
-			     * same name
-			     */
-			    FREE(op->obj.name);
-			    op->obj.name = obj->name;
-			    if (op->obj.count != 0) {
-				/* keep this name */
-				op->obj.next = obj->next;
-			    } else if (obj->count != 0) {
-				/* remove from hash table */
-				h = prev->htab->lookup(obj->name, FALSE);
-				if (*h != obj) {
-				    /* new object was compiled also */
-				    h = &(*h)->next;
-				}
-				*h = obj->next;
-			    }
-			}
+		    m_static();
+		    name = ALLOC(char, strlen(op->obj.name) + 1);
+		    m_dynamic();
+		    strcpy(name, op->obj.name);
+		    FREE(op->obj.name);
+		    op->obj.name = name;
+		    if (op->obj.count != 0) {
+			/* put name in static hash table */
+			h = prev->htab->lookup(name, FALSE);
+			op->obj.next = *h;
+			*h = obj;
 		    }
-		    if (obj->count != 0) {
-			op->obj.update = obj->update;
-		    }
-		    BCLR(ocmap, op->obj.index);
-		    *obj = op->obj;
-		    *o = op->next;
-		    delete op;
-		} else {
-		    /*
-		     * commit to previous plane
-		     */
-		    if (op->prev == (ObjPatch *) NULL ||
-			op->prev->plane != prev) {
-			/* move to previous plane */
-			op->plane = prev;
-			o = &op->next;
-		    } else {
-			/*
-			 * copy onto previous plane
-			 */
-			if (op->obj.name != (char *) NULL && op->obj.count != 0)
-			{
-			    /* move name to previous plane */
-			    *oplane->htab->lookup(op->obj.name, FALSE) = obj;
-			}
-			*obj = op->obj;
-			*o = op->next;
-			delete op;
+		} else if (op->obj.count != 0) {
+		    /* keep this name */
+		    op->obj.next = obj->next;
+		} else if (obj->count != 0) {
+		    /* remove from hash table */
+		    h = prev->htab->lookup(obj->name, FALSE);
+		    if (*h != obj) {
+			/* new object was compiled also */
+			h = &(*h)->next;
 		    }
+		    *h = obj->next;
 		}
 	    }
+	    if (obj->count != 0) {
+		op->obj.update = obj->update;
+	    }
+	    BCLR(ocmap, op->obj.index);
+	    *obj = op->obj;
+	    delete op;
+	} else if (op->prev == (ObjPatch *) NULL || op->prev->plane != prev) {
+	    /*
+	     * move to previous plane
+	     */
+	    op->plane = prev;
+	    op->next = prev->patches;
+	    prev->patches = op;
+	} else {
+	    /*
+	     * copy onto previous plane
+	     */
+	    if (op->obj.name != (char *) NULL && op->obj.count != 0 &&
+		OBJ(op->obj.index)->name == (char *) NULL) {
+		/* move name to previous plane */
+		*oplane->htab->lookup(op->obj.name, FALSE) = obj;
+	    }
+	    *obj = op->obj;
+	    *optab.slot(op->obj.index) = op->prev;
+	    delete op;
 	}
     }
 
@@ -414,6 +474,9 @@ void Object::commitPlane()
     oplane = prev;
 
     base = (prev == &baseplane);
+    if (base) {
+	optab.clear();
+    }
 }
 
 /*
@@ -421,93 +484,86 @@ void Object::commitPlane()
  */
 void Object::discardPlane()
 {
-    ObjPatch **o, *op;
-    int i;
+    ObjPatch *op, *next;
     Object *obj, *clist;
     ObjPlane *p;
 
-    if (oplane->optab != (ObjPatchTable *) NULL) {
-	clist = (Object *) NULL;
-	for (i = OBJPATCHHTABSZ, o = oplane->optab->op; --i >= 0; o++) {
-	    while (*o != (ObjPatch *) NULL && (*o)->plane == oplane) {
-		op = *o;
-		if (op->prev != (ObjPatch *) NULL) {
-		    obj = &op->prev->obj;
-		} else {
-		    BCLR(ocmap, op->obj.index);
-		    obj = OBJ(op->obj.index);
-		}
+    clist = (Object *) NULL;
+    for (op = oplane->patches; op != (ObjPatch *) NULL; op = next) {
+	next = op->next;
+	if (op->prev != (ObjPatch *) NULL) {
+	    obj = &op->prev->obj;
+	} else {
+	    BCLR(ocmap, op->obj.index);
+	    obj = OBJ(op->obj.index);
+	}
 
-		if (op->obj.name != (char *) NULL) {
-		    if (obj->name == (char *) NULL ||
-			op->prev == (ObjPatch *) NULL) {
-			/*
-			 * remove new name
-			 */
-			if (op->obj.count != 0) {
-			    /* remove from hash table */
-			    *oplane->htab->lookup(op->obj.name, FALSE)
-								= op->obj.next;
-			}
-			FREE(op->obj.name);
-		    } else {
-			Hashtab::Entry **h;
-
-			if (op->obj.count != 0) {
-			    /*
-			     * move name to previous plane
-			     */
-			    h = oplane->htab->lookup(obj->name, FALSE);
-			    obj->next = op->obj.next;
-			    *h = obj;
-			} else if (obj->count != 0) {
-			    /*
-			     * put name back in hashtable
-			     */
-			    h = oplane->htab->lookup(obj->name, FALSE);
-			    obj->next = *h;
-			    *h = obj;
-			}
-		    }
+	if (op->obj.name != (char *) NULL &&
+	    OBJ(op->obj.index)->name == (char *) NULL) {
+	    if (obj->name == (char *) NULL) {
+		/*
+		 * remove new name
+		 */
+		if (op->obj.count != 0) {
+		    /* remove from hash table */
+		    *oplane->htab->lookup(op->obj.name, FALSE) = op->obj.next;
 		}
+		FREE(op->obj.name);
+	    } else {
+		Hashtab::Entry **h;
 
-		if (obj->index == OBJ_NONE) {
+		if (op->obj.count != 0) {
 		    /*
-		     * discard newly created object
+		     * move name to previous plane
 		     */
-		    if ((op->obj.flags & O_MASTER) &&
-			op->obj.ctrl != (Control *) NULL) {
-			op->obj.next = clist;
-			clist = &op->obj;
-		    }
-		    if (op->obj.data != (Dataspace *) NULL) {
-			/* discard new data block */
-			d_del_dataspace(op->obj.data);
-		    }
-		    obj->index = op->obj.index;
-		} else {
-		    /* pass on control block and dataspace */
-		    obj->ctrl = op->obj.ctrl;
-		    if (obj->data != op->obj.data) {
-			if (obj->dfirst != SW_UNUSED) {
-			    obj->data = op->obj.data;
-			} else {
-			    /* discard new initialized data block */
-			    d_del_dataspace(op->obj.data);
-			}
-		    }
+		    h = oplane->htab->lookup(obj->name, FALSE);
+		    obj->next = op->obj.next;
+		    *h = obj;
+		} else if (obj->count != 0) {
+		    /*
+		     * put name back in hashtable
+		     */
+		    h = oplane->htab->lookup(obj->name, FALSE);
+		    obj->next = *h;
+		    *h = obj;
 		}
-		*o = op->next;
-		delete op;
 	    }
 	}
 
-	/* discard new control blocks */
-	while (clist != (Object *) NULL) {
-	    obj = clist;
-	    clist = (Object *) obj->next;
-	    d_del_control(obj->ctrl);
+	if (obj->index == OBJ_NONE) {
+	    /*
+	     * discard newly created object
+	     */
+	    if ((op->obj.flags & O_MASTER) && op->obj.ctrl != (Control *) NULL) {
+		op->obj.next = clist;
+		clist = &op->obj;
+	    }
+	    if (op->obj.data != (Dataspace *) NULL) {
+		/* discard new data block */
+		d_del_dataspace(op->obj.data);
+	    }
+	    obj->index = op->obj.index;
+	} else {
+	    /* pass on control block and dataspace */
+	    obj->ctrl = op->obj.ctrl;
+	    if (obj->data != op->obj.data) {
+		if (obj->dfirst != SW_UNUSED) {
+		    obj->data = op->obj.data;
+		} else {
+		    /* discard new initialized data block */
+		    d_del_dataspace(op->obj.data);
+		}
+	    }
 	}
+	*optab.slot(op->obj.index) = op->prev;
+	delete op;
+    }
+
+    /* discard new control blocks */
+    while (clist != (Object *) NULL) {
+	obj = clist;
+	clist = (Object *) obj->next;
+	d_del_control(obj->ctrl);
     }
 
     p = oplane;
@@ -515,6 +571,9 @@ void Object::discardPlane()
     delete p;
 
     base = (oplane == &baseplane);
+    if (base) {
+	optab.clear();
+    }
 }
 
 
@@ -706,8 +765,10 @@ void Object::del(Frame *f)
     objDestrCount++;
 
     if (flags & O_MASTER) {
-	/* remove from object name hash table */
-	*oplane->htab->lookup(name, FALSE) = next;
+	if (base || OBJ(index)->name == (char *) NULL) {
+	    /* remove from object name hash table */
+	    *oplane->htab->lookup(name, FALSE) = next;
+	}
 
 	if (--ref == 0 && !O_UPGRADING(this)) {
 	    remove(f);
@@ -858,8 +919,20 @@ void Object::restoreObject(bool cactive, bool dactive)
 {
     BCLR(omap, index);
     --ndobject;
-    d_restore_obj(this, insttab[index], (rcount) ? counttab : (Uint *) NULL,
-		  cactive, dactive);
+    if (ndobject2 != 0 && BTST(omap2, index)) {
+	/* not yet copied when the partial snapshot was made */
+	BCLR(omap2, index);
+	d_restore_obj(this, insttab[index], counttab, cactive, dactive, TRUE);
+	if (--ndobject2 == 0) {
+	    FREE(omap2);
+	    omap2 = (Uint *) NULL;
+	    sw_close2();
+	}
+    } else {
+	d_restore_obj(this, insttab[index],
+		      (rcount) ? counttab : (Uint *) NULL, cactive, dactive,
+		      FALSE);
+    }
 }
 
 /*
@@ -1060,6 +1133,10 @@ void Object::clean()
 	    }
 
 	    /* swap control blocks */
+	    d_del_callcache(o->ctrl);
+	    d_del_callcache(ctrl);
+	    d_del_account(o->ctrl);
+	    d_del_account(ctrl);
 	    up->ctrl = o->ctrl;
 	    up->ctrl->oindex = up->index;
 	    up->ctrl->instance = ++insttab[up->index];
@@ -1355,27 +1432,35 @@ void Object::restore(int fd, bool part)
 
     if (part) {
 	MapHeader mh;
-	off_t offset;
-	Uint *cmap, *dmap;
-	uindex nctrl, ndata;
+	Uint *dmap;
+	uindex n;
 
 	conf_dread(fd, (char *) &mh, mh_layout, (Uint) 1);
-	nctrl = mh.nctrl;
-	ndata = mh.ndata;
 	count = mh.count;
 
-	cmap = dmap = (Uint *) NULL;
-	if (nctrl != 0) {
-	    cmap = ALLOC(Uint, BMAP(dh.nobjects));
-	    memset(cmap, '\0', BMAP(dh.nobjects) * sizeof(Uint));
-	    conf_dread(fd, (char *) (cmap + BOFF(mh.cobject)), "i",
-		       BMAP(dh.nobjects) - BOFF(mh.cobject));
+	/*
+	 * The objects that still have to be copied from the secondary
+	 * snapshot are restored on demand, like those in the primary one.
+	 */
+	n = BMAP(dh.nobjects);
+	m_static();
+	omap2 = ALLOC(Uint, n);
+	m_dynamic();
+	memset(omap2, '\0', n * sizeof(Uint));
+	if (mh.nctrl != 0) {
+	    conf_dread(fd, (char *) (omap2 + BOFF(mh.cobject)), "i",
+		       n - BOFF(mh.cobject));
 	}
-	if (ndata != 0) {
-	    dmap = ALLOC(Uint, BMAP(dh.nobjects));
-	    memset(dmap, '\0', BMAP(dh.nobjects) * sizeof(Uint));
+	if (mh.ndata != 0) {
+	    dmap = ALLOC(Uint, n);
+	    memset(dmap, '\0', n * sizeof(Uint));
 	    conf_dread(fd, (char *) (dmap + BOFF(mh.dobject)), "i",
-		       BMAP(dh.nobjects) - BOFF(mh.dobject));
+		       n - BOFF(mh.dobject));
+	    while (n != 0) {
+		--n;
+		omap2[n] |= dmap[n];
+	    }
+	    FREE(dmap);
 	}
 
 	if (count != 0) {
@@ -1385,56 +1470,25 @@ void Object::restore(int fd, bool part)
 	    count = recount(baseplane.nobjects);
 	}
 
-	/*
-	 * copy all objects from the secondary restore file
-	 */
-	offset = P_lseek(fd, (off_t) 0, SEEK_CUR);
-	i = mh.cobject;
-	while (nctrl > 0) {
-	    while (!BTST(cmap, i)) {
-		i++;
-	    }
-	    BCLR(cmap, i);
-
-	    o = OBJ(i);
-	    if (o->cfirst != SW_UNUSED) {
-		if (BTST(omap, i)) {
-		    BCLR(omap, i);
-		    --ndobject;
-		}
-		d_restore_ctrl(o, insttab[o->index], &sw_conv2);
-		d_swapout(1);
-	    }
-	    i++;
-	    --nctrl;
-	}
-	i = mh.dobject;
-	while (ndata > 0) {
-	    while (!BTST(dmap, i)) {
-		i++;
-	    }
-	    BCLR(dmap, i);
-
-	    o = OBJ(i);
-	    if (o->dfirst != SW_UNUSED) {
-		if (BTST(omap, i)) {
-		    BCLR(omap, i);
-		    --ndobject;
+	for (i = 0, o = objTable; i < dh.nobjects; i++, o++) {
+	    if (BTST(omap2, i)) {
+		if (o->cfirst != SW_UNUSED || o->dfirst != SW_UNUSED) {
+		    if (!BTST(omap, i)) {
+			BSET(omap, i);
+			ndobject++;
+		    }
+		    ndobject2++;
+		} else {
+		    BCLR(omap2, i);
 		}
-		d_restore_data(o, counttab, &sw_conv2);
-		d_swapout(1);
 	    }
-	    i++;
-	    --ndata;
-	}
-
-	if (cmap != (Uint *) NULL) {
-	    FREE(cmap);
 	}
-	if (dmap != (Uint *) NULL) {
-	    FREE(dmap);
+	mobjects = ndobject;
+	if (ndobject2 == 0) {
+	    FREE(omap2);
+	    omap2 = (Uint *) NULL;
+	    sw_close2();
 	}
-	P_lseek(fd, offset, SEEK_SET);
     } else {
 	count = recount(baseplane.nobjects);
     }
@@ -1442,6 +1496,22 @@ void Object::restore(int fd, bool part)
     baseplane.ocount = count;
 }
 
+/*
+ * copy the objects left in the secondary snapshot to swap
+ */
+void Object::copy2()
+{
+    Object *obj;
+
+    for (obj = objTable; ndobject2 != 0; obj++) {
+	if (BTST(omap2, obj->index)) {
+	    obj->restoreObject(FALSE, FALSE);
+	    Object::clean();
+	    d_swapout(1);
+	}
+    }
+}
+
 /*
  * copy objects from dump to swap
  */
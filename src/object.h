@@ -73,6 +73,7 @@ public:
     static bool save(int, bool);
     static void restore(int, bool);
     static bool	copy(Uint);
+    static void	copy2();
 
     static void	swapout();
     static void	dumpState(bool);
@@ -99,10 +100,12 @@ private:
     static uindex otabsize;
     static uindex uobjects;
     static Uint *omap;
+    static Uint *omap2;
     static Uint *counttab;
     static Uint *insttab;
     static Object *upgradeList;
     static uindex ndobject, dobject;
+    static uindex ndobject2;
     static uindex mobjects;
     static uindex dchunksz;
     static Uint dinterval;
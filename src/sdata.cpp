@@ -17,6 +17,7 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+# define INCLUDE_FILE_IO
 # include "dgd.h"
 # include "str.h"
 # include "array.h"
@@ -155,13 +156,23 @@ static sector nctrl;			/* # control blocks */
 static sector ndata;			/* # dataspace blocks */
 static bool conv_14;			/* convert arrays & strings? */
 static bool converted;			/* conversion complete? */
+static dacct **acctab;			/* function accounting, per program */
+static uindex nacct;			/* size of function accounting table */
+static char *acctfile;			/* function accounting file */
+static int cmptype;			/* compression type for new blocks */
+static size_t swapmem;			/* memory ceiling, or 0 */
+static Uuint swapbudget;		/* swap-out time budget, in ns */
+static Uuint deadline;			/* end of swap-out, or 0 */
+static unsigned int swapfrag;		/* current adaptive swap fragment */
+static Uint swapcut;			/* # swap-outs cut short */
 
 
 /*
  * NAME:	data->init()
  * DESCRIPTION:	initialize swapped data handling
  */
-void d_init()
+void d_init(uindex nobjects, char *file, int compression, Uint memory,
+	    Uint budget)
 {
     chead = ctail = (Control *) NULL;
     dhead = dtail = (Dataspace *) NULL;
@@ -169,6 +180,15 @@ void d_init()
     nctrl = ndata = 0;
     conv_14 = FALSE;
     converted = FALSE;
+    acctab = (dacct **) NULL;
+    nacct = nobjects;
+    acctfile = file;
+    cmptype = compression;
+    swapmem = (size_t) memory << 20;
+    swapbudget = (Uuint) budget * 1000;
+    deadline = 0;
+    swapfrag = 0;
+    swapcut = 0;
 }
 
 /*
@@ -236,6 +256,7 @@ Control *d_new_control()
     ctrl->vtypes = (char *) NULL;
     ctrl->vmapsize = 0;
     ctrl->vmap = (unsigned short *) NULL;
+    ctrl->callcache = (dcallcache *) NULL;
 
     return ctrl;
 }
@@ -583,20 +604,14 @@ void d_ref_dataspace(Dataspace *data)
 
 
 /*
- * NAME:	compress()
- * DESCRIPTION:	compress data
+ * NAME:	pred_compress()
+ * DESCRIPTION:	compress data with a predictor
  */
-static Uint compress(char *data, char *text, Uint size)
+static Uint pred_compress(char *data, char *text, Uint size, Uint cspace)
 {
     char htab[16384];
     unsigned short buf, bufsize, x;
     char *p, *q;
-    Uint cspace;
-
-    if (size <= 4 + 1) {
-	/* can't get smaller than this */
-	return 0;
-    }
 
     /* clear the hash table */
     memset(htab, '\0', sizeof(htab));
@@ -605,11 +620,6 @@ static Uint compress(char *data, char *text, Uint size)
     x = 0;
     p = text;
     q = data;
-    *q++ = size >> 24;
-    *q++ = size >> 16;
-    *q++ = size >> 8;
-    *q++ = size;
-    cspace = size - 4;
 
     while (size != 0) {
 	if (htab[x] == *p) {
@@ -653,76 +663,296 @@ static Uint compress(char *data, char *text, Uint size)
 }
 
 /*
- * NAME:	decompress()
- * DESCRIPTION:	read and decompress data from the swap file
+ * NAME:	pred_decompress()
+ * DESCRIPTION:	decompress data compressed with a predictor
  */
-static char *decompress(sector *sectors, void (*readv) (char*, sector*, Uint, Uint), Uint size, Uint offset, Uint *dsize)
+static void pred_decompress(char *p, Uint n, char *q, Uint dsize)
 {
-    char buffer[8192], htab[16384];
+    char htab[16384], *qend;
     unsigned short buf, bufsize, x;
-    Uint n;
-    char *p, *q;
 
+    qend = q + dsize;
     buf = bufsize = 0;
     x = 0;
 
     /* clear the hash table */
     memset(htab, '\0', sizeof(htab));
 
-    n = sizeof(buffer);
-    if (n > size) {
-	n = size;
+    for (;;) {
+	if (bufsize == 0) {
+	    if (n == 0) {
+		break;
+	    }
+	    --n;
+	    buf = UCHAR(*p++);
+	    bufsize = 8;
+	}
+	if (buf & 1) {
+	    if (n == 0) {
+		break;
+	    }
+	    --n;
+	    buf += UCHAR(*p++) << bufsize;
+	    if (q == qend) {
+		fatal("bad compressed data");
+	    }
+
+	    *q = htab[x] = buf >> 1;
+	    buf >>= 9;
+	} else {
+	    if (q == qend) {
+		fatal("bad compressed data");
+	    }
+	    *q = htab[x];
+	    buf >>= 1;
+	}
+	--bufsize;
+
+	x = ((x << 3) & 0x3fff) ^ Hashtab::hashchar(UCHAR(*q++));
     }
-    (*readv)(p = buffer, sectors, n, offset);
-    size -= n;
-    offset += n;
-    *dsize = (UCHAR(p[0]) << 24) | (UCHAR(p[1]) << 16) | (UCHAR(p[2]) << 8) |
-	     UCHAR(p[3]);
-    q = ALLOC(char, *dsize);
-    p += 4;
-    n -= 4;
+}
 
-    for (;;) {
-	for (;;) {
-	    if (bufsize == 0) {
-		if (n == 0) {
-		    break;
-		}
-		--n;
-		buf = UCHAR(*p++);
-		bufsize = 8;
+# define LZ_HASHBITS	12		/* log2 of LZ hash table size */
+# define LZ_MINMATCH	4		/* minimum match length */
+# define LZ_MAXOFFSET	0xffff		/* maximum match offset */
+
+/*
+ * NAME:	lz_sequence()
+ * DESCRIPTION:	output literals followed by a match, or just literals if
+ *		len is 0
+ */
+static char *lz_sequence(char *q, char *qend, char *lit, Uint nlit,
+			 Uint offset, Uint len)
+{
+    Uint n;
+
+    n = 1 + nlit + nlit / 255 + 1;
+    if (len != 0) {
+	len -= LZ_MINMATCH;
+	n += 2 + len / 255 + 1;
+    }
+    if (n >= (Uint) (qend - q)) {
+	return (char *) NULL;	/* out of space */
+    }
+
+    /* token */
+    *q++ = (((nlit < 15) ? nlit : 15) << 4) | ((len < 15) ? len : 15);
+
+    /* literals */
+    if (nlit >= 15) {
+	for (n = nlit - 15; n >= 255; n -= 255) {
+	    *q++ = (char) 255;
+	}
+	*q++ = n;
+    }
+    memcpy(q, lit, nlit);
+    q += nlit;
+
+    if (offset != 0) {
+	/* match */
+	*q++ = offset;
+	*q++ = offset >> 8;
+	if (len >= 15) {
+	    for (len -= 15; len >= 255; len -= 255) {
+		*q++ = (char) 255;
 	    }
-	    if (buf & 1) {
-		if (n == 0) {
-		    break;
-		}
-		--n;
-		buf += UCHAR(*p++) << bufsize;
+	    *q++ = len;
+	}
+    }
 
-		*q = htab[x] = buf >> 1;
-		buf >>= 9;
-	    } else {
-		*q = htab[x];
-		buf >>= 1;
+    return q;
+}
+
+/*
+ * NAME:	lz_compress()
+ * DESCRIPTION:	compress data with LZ77, using a byte-oriented encoding
+ *		of literal runs and matches
+ */
+static Uint lz_compress(char *data, char *text, Uint size, Uint cspace)
+{
+    Uint htab[1 << LZ_HASHBITS];
+    char *p, *q, *m, *lit, *end, *limit, *qend;
+    Uint seq, h, len;
+
+    /* clear the hash table */
+    memset(htab, '\0', sizeof(htab));
+
+    p = lit = text;
+    end = text + size;
+    limit = end - LZ_MINMATCH;
+    q = data;
+    qend = data + cspace;
+
+    while (p <= limit) {
+	memcpy(&seq, p, sizeof(Uint));
+	h = (seq * 2654435761U) >> (32 - LZ_HASHBITS);
+	m = text + htab[h];
+	htab[h] = p - text;
+	if (m < p && p - m <= LZ_MAXOFFSET && memcmp(m, p, LZ_MINMATCH) == 0)
+	{
+	    /* extend match */
+	    for (len = LZ_MINMATCH; p + len < end && m[len] == p[len]; len++) ;
+	    q = lz_sequence(q, qend, lit, p - lit, p - m, len);
+	    if (q == (char *) NULL) {
+		return 0;	/* out of space */
 	    }
-	    --bufsize;
+	    p = lit = p + len;
+	} else {
+	    /* skip faster through data that doesn't compress */
+	    p += 1 + ((p - lit) >> 6);
+	}
+    }
+
+    /* final literals */
+    q = lz_sequence(q, qend, lit, end - lit, 0, 0);
+    if (q == (char *) NULL) {
+	return 0;		/* compression did not reduce size */
+    }
+
+    return (intptr_t) q - (intptr_t) data;
+}
 
-	    x = ((x << 3) & 0x3fff) ^ Hashtab::hashchar(UCHAR(*q++));
+/*
+ * NAME:	lz_length()
+ * DESCRIPTION:	decode the extension of a literal or match length
+ */
+static Uint lz_length(char **pp, char *end, Uint len, Uint max)
+{
+    char *p;
+    int c;
+
+    p = *pp;
+    do {
+	if (p == end || len > max) {
+	    fatal("bad compressed data");
 	}
+	len += c = UCHAR(*p++);
+    } while (c == 255);
+    *pp = p;
+
+    return len;
+}
 
-	if (size == 0) {
-	    return q - *dsize;
+/*
+ * NAME:	lz_decompress()
+ * DESCRIPTION:	decompress data compressed with LZ77
+ */
+static void lz_decompress(char *p, Uint n, char *q, Uint dsize)
+{
+    char *end, *start, *qend, *m;
+    Uint len, offset;
+    int token;
+
+    end = p + n;
+    start = q;
+    qend = q + dsize;
+    while (p < end) {
+	token = UCHAR(*p++);
+
+	/* literals */
+	len = token >> 4;
+	if (len == 15) {
+	    len = lz_length(&p, end, len, dsize);
+	}
+	if (len > (Uint) (end - p) || len > (Uint) (qend - q)) {
+	    fatal("bad compressed data");
 	}
-	n = sizeof(buffer);
-	if (n > size) {
-	    n = size;
+	memcpy(q, p, len);
+	p += len;
+	q += len;
+	if (p == end) {
+	    break;
+	}
+
+	/* match */
+	if (end - p < 2) {
+	    fatal("bad compressed data");
+	}
+	offset = UCHAR(p[0]) | (UCHAR(p[1]) << 8);
+	p += 2;
+	len = token & 15;
+	if (len == 15) {
+	    len = lz_length(&p, end, len, dsize);
+	}
+	len += LZ_MINMATCH;
+	if (offset == 0 || offset > (Uint) (q - start) ||
+	    len > (Uint) (qend - q)) {
+	    fatal("bad compressed data");
+	}
+	m = q - offset;
+	if (offset >= len) {
+	    memcpy(q, m, len);
+	    q += len;
+	} else {
+	    /* overlapping match */
+	    do {
+		*q++ = *m++;
+	    } while (--len != 0);
 	}
-	(*readv)(p = buffer, sectors, n, offset);
-	size -= n;
-	offset += n;
     }
 }
 
+struct codec {
+    Uint (*compress) (char*, char*, Uint, Uint);	/* compress */
+    void (*decompress) (char*, Uint, char*, Uint);	/* decompress */
+};
+
+static codec codecs[] = {
+    { (Uint (*) (char*, char*, Uint, Uint)) NULL,
+      (void (*) (char*, Uint, char*, Uint)) NULL },	/* CMP_NONE */
+    { pred_compress, pred_decompress },			/* CMP_PRED */
+    { lz_compress, lz_decompress }			/* CMP_LZ */
+};
+
+/*
+ * NAME:	compress()
+ * DESCRIPTION:	compress data, return the compressed size or 0 if it
+ *		could not be reduced
+ */
+static Uint compress(char *data, char *text, Uint size)
+{
+    Uint cspace;
+
+    if (cmptype == CMP_NONE || size <= 4 + 1) {
+	/* can't get smaller than this */
+	return 0;
+    }
+
+    data[0] = size >> 24;
+    data[1] = size >> 16;
+    data[2] = size >> 8;
+    data[3] = size;
+    cspace = (*codecs[cmptype].compress)(data + 4, text, size, size - 4);
+    return (cspace != 0) ? cspace + 4 : 0;
+}
+
+/*
+ * NAME:	decompress()
+ * DESCRIPTION:	read and decompress data from the swap file
+ */
+static char *decompress(int type, sector *sectors, void (*readv) (char*, sector*, Uint, Uint), Uint size, Uint offset, Uint *dsize)
+{
+    char buffer[8192], *p, *q;
+
+    if (type <= CMP_NONE || type > CMP_LZ) {
+	fatal("unknown compression type %d", type);
+    }
+    if (size < 4) {
+	fatal("bad compressed data");
+    }
+    p = (size <= sizeof(buffer)) ? buffer : ALLOC(char, size);
+    (*readv)(p, sectors, size, offset);
+    *dsize = (UCHAR(p[0]) << 24) | (UCHAR(p[1]) << 16) | (UCHAR(p[2]) << 8) |
+	     UCHAR(p[3]);
+    q = ALLOC(char, *dsize);
+    (*codecs[type].decompress)(p + 4, size - 4, q, *dsize);
+    if (p != buffer) {
+	FREE(p);
+    }
+
+    return q;
+}
+
 
 /*
  * NAME:	get_prog()
@@ -732,7 +962,8 @@ static void get_prog(Control *ctrl, void (*readv) (char*, sector*, Uint, Uint))
 {
     if (ctrl->progsize != 0) {
 	if (ctrl->flags & CTRL_PROGCMP) {
-	    ctrl->prog = decompress(ctrl->sectors, readv, ctrl->progsize,
+	    ctrl->prog = decompress(ctrl->flags & CTRL_PROGCMP,
+				    ctrl->sectors, readv, ctrl->progsize,
 				    ctrl->progoffset, &ctrl->progsize);
 	} else {
 	    ctrl->prog = ALLOC(char, ctrl->progsize);
@@ -762,8 +993,8 @@ static void get_stext(Control *ctrl, void (*readv) (char*, sector*, Uint, Uint))
 {
     /* load strings text */
     if (ctrl->flags & CTRL_STRCMP) {
-	ctrl->stext = decompress(ctrl->sectors, readv,
-				 ctrl->strsize,
+	ctrl->stext = decompress((ctrl->flags & CTRL_STRCMP) >> 2,
+				 ctrl->sectors, readv, ctrl->strsize,
 				 ctrl->stroffset +
 				 ctrl->nstrings * sizeof(ssizet),
 				 &ctrl->strsize);
@@ -958,6 +1189,156 @@ dsymbol *d_get_symbols(Control *ctrl)
     return ctrl->symbols;
 }
 
+/*
+ * NAME:	data->get_callcache()
+ * DESCRIPTION:	get call_other lookup cache
+ */
+dcallcache *d_get_callcache(Control *ctrl)
+{
+    dcallcache *cc;
+    int i;
+
+    if (ctrl->callcache == (dcallcache *) NULL) {
+	cc = ctrl->callcache = ALLOC(dcallcache, CALLCACHESZ);
+	for (i = CALLCACHESZ; i > 0; --i) {
+	    (cc++)->name = (String *) NULL;
+	}
+    }
+    return ctrl->callcache;
+}
+
+/*
+ * NAME:	data->del_callcache()
+ * DESCRIPTION:	invalidate call_other lookup cache
+ */
+void d_del_callcache(Control *ctrl)
+{
+    dcallcache *cc;
+    int i;
+
+    if (ctrl->callcache != (dcallcache *) NULL) {
+	for (cc = ctrl->callcache, i = CALLCACHESZ; i > 0; cc++, --i) {
+	    if (cc->name != (String *) NULL) {
+		cc->name->del();
+	    }
+	}
+	FREE(ctrl->callcache);
+	ctrl->callcache = (dcallcache *) NULL;
+    }
+}
+
+/*
+ * NAME:	data->get_account()
+ * DESCRIPTION:	get the function accounting table of a program, which is
+ *		kept in static memory so it survives swapping out the
+ *		control block
+ */
+dacct *d_get_account(Control *ctrl, bool create)
+{
+    dacct **acct;
+
+    if (acctab == (dacct **) NULL) {
+	if (!create) {
+	    return (dacct *) NULL;
+	}
+	m_static();
+	acctab = ALLOC(dacct*, nacct);
+	m_dynamic();
+	memset(acctab, '\0', nacct * sizeof(dacct*));
+    }
+    acct = &acctab[ctrl->oindex];
+    if (*acct == (dacct *) NULL && create) {
+	m_static();
+	*acct = ALLOC(dacct, ctrl->nfuncdefs);
+	m_dynamic();
+	memset(*acct, '\0', ctrl->nfuncdefs * sizeof(dacct));
+    }
+    return *acct;
+}
+
+/*
+ * NAME:	data->del_account()
+ * DESCRIPTION:	remove the function accounting table of a program
+ */
+void d_del_account(Control *ctrl)
+{
+    if (acctab != (dacct **) NULL && ctrl->oindex < nacct &&
+	acctab[ctrl->oindex] != (dacct *) NULL) {
+	FREE(acctab[ctrl->oindex]);
+	acctab[ctrl->oindex] = (dacct *) NULL;
+    }
+}
+
+/*
+ * NAME:	data->clear_account()
+ * DESCRIPTION:	remove all function accounting
+ */
+void d_clear_account()
+{
+    uindex i;
+
+    if (acctab != (dacct **) NULL) {
+	for (i = 0; i < nacct; i++) {
+	    if (acctab[i] != (dacct *) NULL) {
+		FREE(acctab[i]);
+	    }
+	}
+	FREE(acctab);
+	acctab = (dacct **) NULL;
+    }
+}
+
+/*
+ * NAME:	data->dump_account()
+ * DESCRIPTION:	write function accounting to the accounting file, and
+ *		remove it
+ */
+void d_dump_account()
+{
+    char *line;
+    int fd;
+    uindex i;
+    unsigned short n;
+    Object *obj;
+    Control *ctrl;
+    dfuncdef *func;
+    dacct *acct;
+    String *str;
+
+    if (acctab != (dacct **) NULL && acctfile != (char *) NULL) {
+	fd = P_open(acctfile, O_CREAT | O_TRUNC | O_WRONLY | O_BINARY,
+		    0644);
+	if (fd < 0) {
+	    message("Cannot create accounting file \"/%s\"\012", acctfile);
+	} else {
+	    for (i = 0; i < nacct; i++) {
+		if (acctab[i] == (dacct *) NULL) {
+		    continue;
+		}
+		obj = OBJR(i);
+		ctrl = obj->control();
+		func = d_get_funcdefs(ctrl);
+		for (acct = acctab[i], n = ctrl->nfuncdefs; n > 0;
+		     acct++, func++, --n) {
+		    if (acct->calls == 0) {
+			continue;
+		    }
+		    str = d_get_strconst(ctrl, func->inherit, func->index);
+		    line = ALLOCA(char, strlen(obj->name) + str->len + 70);
+		    sprintf(line, "/%s\t%s\t%llu\t%llu\t%llu\012", obj->name,
+			    str->text, (unsigned long long) acct->calls,
+			    (unsigned long long) acct->ticks,
+			    (unsigned long long) acct->time);
+		    (void) P_write(fd, line, strlen(line));
+		    AFREE(line);
+		}
+	    }
+	    P_close(fd);
+	}
+    }
+    d_clear_account();
+}
+
 /*
  * NAME:	get_vtypes()
  * DESCRIPTION:	get variable types
@@ -1026,7 +1407,8 @@ static void get_strings(Dataspace *data, void (*readv) (char*, sector*, Uint, Ui
 	if (data->strsize > 0) {
 	    /* load strings text */
 	    if (data->flags & DATA_STRCMP) {
-		data->stext = decompress(data->sectors, readv, data->strsize,
+		data->stext = decompress(data->flags & DATA_STRCMP,
+					 data->sectors, readv, data->strsize,
 					 data->stroffset +
 					       data->nstrings * sizeof(sstring),
 					 &data->strsize);
@@ -1407,7 +1789,7 @@ static void d_save_control(Control *ctrl)
      */
 
     /* create header */
-    header.flags = ctrl->flags & (CTRL_UNDEFINED | CTRL_VM_2_1);
+    header.flags = ctrl->flags & (CTRL_UNDEFINED | CTRL_VM_2_1 | CTRL_VM_2_2);
     header.ninherits = ctrl->ninherits;
     header.imapsz = ctrl->imapsz;
     header.compiled = ctrl->compiled;
@@ -1433,7 +1815,7 @@ static void d_save_control(Control *ctrl)
 	    prog = ALLOC(char, header.progsize);
 	    size = compress(prog, ctrl->prog, header.progsize);
 	    if (size != 0) {
-		header.flags |= CMP_PRED;
+		header.flags |= cmptype;
 		header.progsize = size;
 	    } else {
 		FREE(prog);
@@ -1470,7 +1852,7 @@ static void d_save_control(Control *ctrl)
 	    text = ALLOC(char, header.strsize);
 	    size = compress(text, stext, header.strsize);
 	    if (size != 0) {
-		header.flags |= CMP_PRED << 2;
+		header.flags |= cmptype << 2;
 		header.strsize = size;
 	    } else {
 		FREE(text);
@@ -2170,7 +2552,7 @@ static bool d_save_dataspace(Dataspace *data, bool swap)
 		text = ALLOC(char, header.strsize);
 		size = compress(text, save.stext, header.strsize);
 		if (size != 0) {
-		    header.flags |= CMP_PRED;
+		    header.flags |= cmptype;
 		    header.strsize = size;
 		} else {
 		    FREE(text);
@@ -2277,8 +2659,10 @@ sector d_swapout(unsigned int frag)
     sector n, count;
     Dataspace *data;
     Control *ctrl;
+    bool cut;
 
     count = 0;
+    cut = FALSE;
 
     if (frag != 0) {
 	/* swap out dataspace blocks */
@@ -2286,6 +2670,13 @@ sector d_swapout(unsigned int frag)
 	for (n = ndata / frag, n -= (n > 0 && frag != 1); n > 0; --n) {
 	    Dataspace *prev;
 
+	    if (deadline != 0 && P_ntime() >= deadline) {
+		/* out of time */
+		swapcut++;
+		cut = TRUE;
+		break;
+	    }
+
 	    prev = data->prev;
 	    if (d_save_dataspace(data, TRUE)) {
 		count++;
@@ -2304,6 +2695,16 @@ sector d_swapout(unsigned int frag)
 	    if (ctrl->ndata == 0) {
 		if (ctrl->sectors == (sector *) NULL ||
 		    (ctrl->flags & CTRL_VARMAP)) {
+		    if (!cut && deadline != 0 && P_ntime() >= deadline) {
+			/* out of time */
+			swapcut++;
+			cut = TRUE;
+		    }
+		    if (cut) {
+			/* only free control blocks that need not be saved */
+			ctrl = prev;
+			continue;
+		    }
 		    d_save_control(ctrl);
 		}
 		OBJ(ctrl->oindex)->ctrl = (Control *) NULL;
@@ -2324,6 +2725,57 @@ sector d_swapout(unsigned int frag)
     return count;
 }
 
+/*
+ * NAME:	data->swaptask()
+ * DESCRIPTION:	swap out dataspace and control blocks after a task, more of
+ *		them under memory pressure and none with memory to spare
+ */
+sector d_swaptask(unsigned int frag)
+{
+    allocinfo *info;
+    size_t used;
+    sector count;
+    unsigned int start;
+
+    if (swapmem == 0 && swapbudget == 0) {
+	swapfrag = frag;
+	return d_swapout(frag);
+    }
+
+    info = m_info();
+    used = info->smemused + info->dmemused;
+    if (!m_check() || (swapmem != 0 && used > swapmem)) {
+	/* under pressure: swap out twice as much as last time */
+	start = (frag != 0) ? frag : 32;
+	swapfrag = (swapfrag == 0 || swapfrag > start) ? start :
+		   (swapfrag > 1) ? swapfrag >> 1 : 1;
+    } else if (swapmem != 0 && used < swapmem - (swapmem >> 2)) {
+	/* plenty of memory */
+	swapfrag = 0;
+    } else {
+	swapfrag = frag;
+    }
+
+    if (swapbudget != 0) {
+	deadline = P_ntime() + swapbudget;
+    }
+    count = d_swapout(swapfrag);
+    deadline = 0;
+
+    return count;
+}
+
+/*
+ * NAME:	data->swapstats()
+ * DESCRIPTION:	return the current swap fragment, and the number of times
+ *		swapping out was cut short by the time budget
+ */
+void d_swapstats(unsigned int *frag, Uint *cut)
+{
+    *frag = swapfrag;
+    *cut = swapcut;
+}
+
 /*
  * NAME:	data->upgrade_mem()
  * DESCRIPTION:	upgrade all obj and all objects cloned from obj that have
@@ -2450,7 +2902,8 @@ static Control *d_conv_control(Object *obj, Uint instance,
 	if (header.progsize != 0) {
 	    /* program */
 	    if (header.flags & CMP_TYPE) {
-		ctrl->prog = decompress(ctrl->sectors, readv, header.progsize,
+		ctrl->prog = decompress(header.flags & CMP_TYPE,
+					ctrl->sectors, readv, header.progsize,
 					size, &ctrl->progsize);
 	    } else {
 		ctrl->prog = ALLOC(char, header.progsize);
@@ -2479,7 +2932,8 @@ static Control *d_conv_control(Object *obj, Uint instance,
 	    }
 	    if (header.strsize != 0) {
 		if (header.flags & (CMP_TYPE << 2)) {
-		    ctrl->stext = decompress(ctrl->sectors, readv,
+		    ctrl->stext = decompress((header.flags >> 2) & CMP_TYPE,
+					     ctrl->sectors, readv,
 					     header.strsize, size,
 					     &ctrl->strsize);
 		} else {
@@ -2692,7 +3146,8 @@ static Dataspace *d_conv_dataspace(Object *obj, Uint *counttab,
 	}
 	if (header.strsize != 0) {
 	    if (header.flags & CMP_TYPE) {
-		data->stext = decompress(data->sectors, readv, header.strsize,
+		data->stext = decompress(header.flags & CMP_TYPE,
+					 data->sectors, readv, header.strsize,
 					 size, &data->strsize);
 	    } else {
 		data->stext = ALLOC(char, header.strsize);
@@ -2789,15 +3244,19 @@ Dataspace *d_restore_data(Object *obj, Uint *counttab,
 
 /*
  * NAME:	data->restore_obj()
- * DESCRIPTION:	restore an object
+ * DESCRIPTION:	restore an object, from the secondary snapshot if secondary
+ *		is TRUE
  */
 void d_restore_obj(Object *obj, Uint instance, Uint *counttab, bool cactive,
-		   bool dactive)
+		   bool dactive, bool secondary)
 {
     Control *ctrl;
     Dataspace *data;
 
-    if (!converted) {
+    if (secondary) {
+	ctrl = d_restore_ctrl(obj, instance, sw_conv2);
+	data = d_restore_data(obj, counttab, sw_conv2);
+    } else if (!converted) {
 	ctrl = d_restore_ctrl(obj, instance, sw_conv);
 	data = d_restore_data(obj, counttab, sw_conv);
     } else {
@@ -2942,6 +3401,9 @@ void d_free_control(Control *ctrl)
 	FREE(ctrl->vtypes);
     }
 
+    /* delete call_other cache */
+    d_del_callcache(ctrl);
+
     if (ctrl != chead) {
 	ctrl->prev->next = ctrl->next;
     } else {
@@ -23,14 +23,11 @@
 # include "object.h"
 # include "data.h"
 
-# define STR_CHUNK	128
-
 struct StrHash : public Hashtab::Entry, public ChunkAllocated {
     String *str;		/* string entry */
     Uint index;			/* building index */
 };
 
-static Chunk<String, STR_CHUNK> schunk;
 static Chunk<StrHash, STR_CHUNK> hchunk;
 
 static Hashtab *sht;		/* string merge table */
@@ -58,7 +55,7 @@ String::~String()
  */
 String *String::alloc(const char *text, long len)
 {
-    return chunknew (schunk) String(text, len);
+    return new String(text, len);
 }
 
 /*
@@ -84,11 +81,11 @@ void String::del()
 }
 
 /*
- * remove string chunks from memory
+ * remove string slabs from memory
  */
 void String::clean()
 {
-    schunk.clean();
+    slab.clean();
 }
 
 /*
@@ -17,7 +17,9 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-class String : public ChunkAllocated {
+# define STR_CHUNK	128
+
+class String : public SlabAllocated<String, STR_CHUNK, SLAB_STRING> {
 public:
     void ref() { refCount++; }
     void del();
@@ -27,8 +27,12 @@ struct header {			/* swap slot header */
     sector sec;			/* the sector that uses this slot */
     sector swap;		/* the swap sector (if any) */
     bool dirty;			/* has the swap slot been written to? */
+    char queue;			/* queue the swap slot is in */
 };
 
+# define SQ_IN		0	/* first-in queue: referenced once */
+# define SQ_MAIN	1	/* main queue: referenced again later */
+
 static char *swapfile;			/* swap file name */
 static int swap;			/* swap file descriptor */
 static int dump, dump2;			/* snapshot descriptors */
@@ -37,7 +41,13 @@ static sector *map, *smap;		/* sector map, swap free map */
 static sector mfree, sfree;		/* free sector lists */
 static char *cbuf;			/* sector buffer */
 static sector cached;			/* sector currently cached in cbuf */
-static header *first, *last;		/* first and last swap slot */
+static header *first[2], *last[2];	/* first and last swap slot */
+static sector nslots[2];		/* # swap slots in each queue */
+static sector kin;			/* max. size of the first-in queue */
+static Uint *ghost;			/* recently replaced sectors */
+static sector *gring;			/* ghost sector ring buffer */
+static sector gsize, gnext;		/* size and index of ring buffer */
+static Uuint hits, misses, evictions;	/* swap cache statistics */
 static header *lfree;			/* free swap slot list */
 static off_t slotsize;			/* sizeof(header) + size of sector */
 static unsigned int sectorsize;		/* size of sector */
@@ -48,25 +58,45 @@ static sector nfree;			/* # free sectors */
 static sector ssectors;			/* sectors actually in swap file */
 static sector sbarrier;			/* swap sector barrier */
 static bool swapping;			/* currently using a swapfile? */
+static bool frozen;			/* swap file frozen for a snapshot? */
+static sector fbarrier;			/* swap sector barrier before freeze */
+static sector ffree;			/* free sector list before freeze */
+static char childfile[STRINGSZ + 5];	/* swap file of snapshot process */
+static bool mapped;			/* swap file mapped in memory? */
+static char *smem;			/* mapped swap file */
+static off_t smemsize;			/* size of mapping */
+static off_t sfilesize;			/* size of mapped swap file */
 
 /*
  * NAME:	swap->init()
  * DESCRIPTION:	initialize the swap device
  */
-void sw_init(char *file, unsigned int total, unsigned int cache, unsigned int secsize)
+void sw_init(char *file, unsigned int total, unsigned int cache, unsigned int secsize, bool mmap)
 {
     header *h;
     sector i;
 
+    if (mmap) {
+	/* sectors are accessed in the mapped swap file, not in slots */
+	cache = 0;
+    }
+    mapped = mmap;
+    smem = (char *) NULL;
+    smemsize = sfilesize = 0;
+
     /* allocate and initialize all tables */
     swapfile = file;
     swapsize = total;
     cachesize = cache;
     sectorsize = secsize;
     slotsize = sizeof(header) + secsize;
-    mem = ALLOC(char, slotsize * cache);
     map = ALLOC(sector, total);
     smap = ALLOC(sector, total);
+    ghost = ALLOC(Uint, (total + 31) >> 5);
+    memset(ghost, '\0', ((total + 31) >> 5) * sizeof(Uint));
+    kin = (cache + 3) >> 2;
+    gsize = (cache + 1) >> 1;
+    gnext = 0;
     cbuf = ALLOC(char, secsize);
     cached = SW_UNUSED;
 
@@ -79,23 +109,84 @@ void sw_init(char *file, unsigned int total, unsigned int cache, unsigned int se
     /* init free sector maps */
     mfree = SW_UNUSED;
     sfree = SW_UNUSED;
-    lfree = h = (header *) mem;
-    for (i = cache - 1; i > 0; --i) {
+    if (cache != 0) {
+	mem = ALLOC(char, slotsize * cache);
+	lfree = h = (header *) mem;
+	for (i = cache - 1; i > 0; --i) {
+	    h->sec = SW_UNUSED;
+	    h->next = (header *) ((char *) h + slotsize);
+	    h = h->next;
+	}
 	h->sec = SW_UNUSED;
-	h->next = (header *) ((char *) h + slotsize);
-	h = h->next;
+	h->next = (header *) NULL;
+
+	gring = ALLOC(sector, gsize);
+	for (i = 0; i < gsize; i++) {
+	    gring[i] = SW_UNUSED;
+	}
+    } else {
+	mem = (char *) NULL;
+	lfree = (header *) NULL;
+	gring = (sector *) NULL;
     }
-    h->sec = SW_UNUSED;
-    h->next = (header *) NULL;
 
     /* no swap slots in use yet */
-    first = (header *) NULL;
-    last = (header *) NULL;
+    first[SQ_IN] = last[SQ_IN] = (header *) NULL;
+    first[SQ_MAIN] = last[SQ_MAIN] = (header *) NULL;
+    nslots[SQ_IN] = nslots[SQ_MAIN] = 0;
 
-    swap = dump = -1;
+    swap = dump = dump2 = -1;
     swapping = TRUE;
 }
 
+/*
+ * NAME:	swap->unmap()
+ * DESCRIPTION:	remove the mapping of the swap file
+ */
+static void sw_unmap()
+{
+    if (smem != (char *) NULL) {
+	P_munmap(smem, smemsize);
+	smem = (char *) NULL;
+	smemsize = 0;
+    }
+}
+
+/*
+ * NAME:	swap->mapfile()
+ * DESCRIPTION:	map the swap file in memory, making sure that it is large
+ *		enough to hold swap sector loc
+ */
+static void sw_mapfile(sector loc)
+{
+    struct stat st;
+    off_t size;
+
+    if (P_fstat(swap, &st) < 0) {
+	fatal("cannot stat swap file");
+    }
+    sfilesize = st.st_size;
+    size = (off_t) (loc + 2L) * sectorsize;
+    if (size > sfilesize) {
+	/* extend the swap file, with room to spare */
+	size += sfilesize >> 3;
+	if (P_ftruncate(swap, size) < 0) {
+	    fatal("cannot extend swap file");
+	}
+	sfilesize = size;
+    }
+
+    if (sfilesize > smemsize) {
+	/* (re)map the swap file, with room to grow */
+	sw_unmap();
+	smemsize = sfilesize + (off_t) swapsize * sectorsize;
+	smem = P_mmap(swap, smemsize);
+	if (smem == (char *) NULL) {
+	    fatal("cannot map swap file");
+	}
+    }
+}
+
 /*
  * NAME:	swap->finish()
  * DESCRIPTION:	clean up swapfile
@@ -105,6 +196,7 @@ void sw_finish()
     if (swap >= 0) {
 	char buf[STRINGSZ];
 
+	sw_unmap();
 	P_close(swap);
 	P_unlink(path_native(buf, swapfile));
     }
@@ -144,6 +236,97 @@ static void sw_create()
     if (swap < 0 || !sw_write(swap, cbuf, sectorsize)) {
 	fatal("cannot create swap file \"%s\"", swapfile);
     }
+    if (mapped) {
+	sw_mapfile(0);
+    }
+}
+
+/*
+ * NAME:	swap->unlink()
+ * DESCRIPTION:	remove a swap slot from its queue
+ */
+static void sw_unlink(header *h)
+{
+    int q;
+
+    q = h->queue;
+    if (h != first[q]) {
+	h->prev->next = h->next;
+    } else {
+	first[q] = h->next;
+	if (first[q] != (header *) NULL) {
+	    first[q]->prev = (header *) NULL;
+	}
+    }
+    if (h != last[q]) {
+	h->next->prev = h->prev;
+    } else {
+	last[q] = h->prev;
+	if (last[q] != (header *) NULL) {
+	    last[q]->next = (header *) NULL;
+	}
+    }
+    --nslots[q];
+}
+
+/*
+ * NAME:	swap->push()
+ * DESCRIPTION:	put a swap slot at the head of a queue
+ */
+static void sw_push(header *h, int q)
+{
+    h->queue = q;
+    h->prev = (header *) NULL;
+    h->next = first[q];
+    if (first[q] != (header *) NULL) {
+	first[q]->prev = h;
+    } else {
+	last[q] = h;	/* last was NULL too */
+    }
+    first[q] = h;
+    nslots[q]++;
+}
+
+/*
+ * NAME:	swap->ghost()
+ * DESCRIPTION:	remember a sector replaced from the first-in queue, and
+ *		forget the oldest such sector
+ */
+static void sw_ghost(sector sec)
+{
+    sector old;
+
+    if (gsize != 0) {
+	old = gring[gnext];
+	if (old != SW_UNUSED) {
+	    ghost[old >> 5] &= ~(1 << (old & 31));
+	}
+	ghost[sec >> 5] |= 1 << (sec & 31);
+	gring[gnext] = sec;
+	if (++gnext == gsize) {
+	    gnext = 0;
+	}
+    }
+}
+
+/*
+ * NAME:	swap->unghost()
+ * DESCRIPTION:	forget a remembered sector, and remove it from the ring
+ *		buffer so that it cannot clear the bit of a later entry
+ */
+static void sw_unghost(sector sec)
+{
+    sector i;
+
+    if (ghost[sec >> 5] & (1 << (sec & 31))) {
+	ghost[sec >> 5] &= ~(1 << (sec & 31));
+	for (i = 0; i < gsize; i++) {
+	    if (gring[i] == sec) {
+		gring[i] = SW_UNUSED;
+		break;
+	    }
+	}
+    }
 }
 
 /*
@@ -222,24 +405,9 @@ void sw_delv(sector *vec, unsigned int size)
 	i = map[sec];
 	if (i < cachesize && (h=(header *) (mem + i * slotsize))->sec == sec) {
 	    /*
-	     * remove the swap slot from the first-last list
+	     * remove the swap slot from its queue
 	     */
-	    if (h != first) {
-		h->prev->next = h->next;
-	    } else {
-		first = h->next;
-		if (first != (header *) NULL) {
-		    first->prev = (header *) NULL;
-		}
-	    }
-	    if (h != last) {
-		h->next->prev = h->prev;
-	    } else {
-		last = h->prev;
-		if (last != (header *) NULL) {
-		    last->next = (header *) NULL;
-		}
-	    }
+	    sw_unlink(h);
 	    /*
 	     * put the cache slot in the free cache slot list
 	     */
@@ -251,6 +419,7 @@ void sw_delv(sector *vec, unsigned int size)
 	/*
 	 * put sec in free sector list
 	 */
+	sw_unghost(sec);
 	map[sec] = mfree;
 	mfree = sec;
 	nfree++;
@@ -259,15 +428,120 @@ void sw_delv(sector *vec, unsigned int size)
     }
 }
 
+/*
+ * NAME:	swap->alloc()
+ * DESCRIPTION:	allocate a new sector in the swap file
+ */
+static sector sw_alloc()
+{
+    sector sec;
+
+    if (sfree == SW_UNUSED) {
+	if (ssectors == SW_UNUSED) {
+	    fatal("out of sectors");
+	}
+	return ssectors++;
+    } else {
+	sec = sfree;
+	sfree = smap[sec];
+	return sec + sbarrier;
+    }
+}
+
+/*
+ * NAME:	swap->sort()
+ * DESCRIPTION:	sort swap slots by the swap file sector they use
+ */
+static void sw_sort(header **hv, unsigned int n)
+{
+    header *h;
+    unsigned int i, j;
+
+    for (i = 1; i < n; i++) {
+	h = hv[i];
+	for (j = i; j > 0 && hv[j - 1]->swap > h->swap; --j) {
+	    hv[j] = hv[j - 1];
+	}
+	hv[j] = h;
+    }
+}
+
+/*
+ * NAME:	swap->io()
+ * DESCRIPTION:	read or write sorted swap slots, one run of adjacent sectors
+ *		at a time
+ */
+static bool sw_io(int fd, header **hv, unsigned int n, bool write)
+{
+    struct iovec iov[SWAPRUN];
+    unsigned int i, j;
+    off_t offset;
+    long size;
+
+    for (i = 0; i < n; i = j) {
+	for (j = i; j < n && hv[j]->swap == hv[i]->swap + (j - i); j++) {
+	    iov[j - i].iov_base = hv[j] + 1;
+	    iov[j - i].iov_len = sectorsize;
+	}
+	offset = (off_t) (hv[i]->swap + 1L) * sectorsize;
+	size = (long) (j - i) * sectorsize;
+	if (((write) ? P_pwritev(fd, iov, j - i, offset) :
+		       P_preadv(fd, iov, j - i, offset)) != size) {
+	    return FALSE;
+	}
+    }
+    return TRUE;
+}
+
+/*
+ * NAME:	swap->clean()
+ * DESCRIPTION:	write back the dirty slots among the n swap slots starting
+ *		with h, in the direction of the most recently used one
+ */
+static void sw_clean(header *h, sector n)
+{
+    header *hv[SWAPRUN];
+    unsigned int count;
+
+    if (swap < 0) {
+	sw_create();
+    }
+
+    do {
+	for (count = 0; h != (header *) NULL && n != 0 && count < SWAPRUN;
+	     h = h->prev, --n) {
+	    if (h->dirty) {
+		if (h->swap == SW_UNUSED || h->swap < sbarrier) {
+		    /*
+		     * allocate new sector in swap file
+		     */
+		    h->swap = sw_alloc();
+		}
+		h->dirty = FALSE;
+		hv[count++] = h;
+	    }
+	}
+
+	sw_sort(hv, count);
+	if (!sw_io(swap, hv, count, TRUE)) {
+	    fatal("cannot write swap file");
+	}
+    } while (h != (header *) NULL && n != 0);
+}
+
 /*
  * NAME:	swap->load()
  * DESCRIPTION:	reserve a swap slot for sector sec. If fill == TRUE, load it
- *		from the swap file if appropriate.
+ *		from the swap file if appropriate.  Slots are managed 2Q
+ *		style: a newly loaded sector enters the first-in queue, from
+ *		which it is replaced first without affecting the main queue,
+ *		unless it was replaced from there only recently.
  */
 static header *sw_load(sector sec, bool restore, bool fill)
 {
     header *h;
-    sector load, save;
+    sector load;
+    int q;
 
     load = map[sec];
     if (load >= cachesize ||
@@ -275,6 +549,7 @@ static header *sw_load(sector sec, bool restore, bool fill)
 	/*
 	 * the sector is either unused or in the swap file
 	 */
+	misses++;
 	if (lfree != (header *) NULL) {
 	    /*
 	     * get swap slot from the free swap slot list
@@ -283,47 +558,26 @@ static header *sw_load(sector sec, bool restore, bool fill)
 	    lfree = h->next;
 	} else {
 	    /*
-	     * No free slot available, use the last one in the swap slot list
-	     * instead.
+	     * No free slot available, use the last one in the first-in
+	     * queue if that queue is too large, or else the last one in the
+	     * main queue instead.
 	     */
-	    h = last;
-	    last = h->prev;
-	    if (last != (header *) NULL) {
-		last->next = (header *) NULL;
-	    } else {
-		first = (header *) NULL;
-	    }
-	    save = h->swap;
+	    q = (nslots[SQ_IN] > kin || last[SQ_MAIN] == (header *) NULL) ?
+		 SQ_IN : SQ_MAIN;
+	    h = last[q];
 	    if (h->dirty) {
 		/*
-		 * Dump the sector to swap file
+		 * Dump the sector to swap file, along with other dirty
+		 * sectors that are about to be replaced
 		 */
-
-		if (save == SW_UNUSED || save < sbarrier) {
-		    /*
-		     * allocate new sector in swap file
-		     */
-		    if (sfree == SW_UNUSED) {
-			if (ssectors == SW_UNUSED) {
-			    fatal("out of sectors");
-			}
-			save = ssectors++;
-		    } else {
-			save = sfree;
-			sfree = smap[save];
-			save += sbarrier;
-		    }
-		}
-
-		if (swap < 0) {
-		    sw_create();
-		}
-		P_lseek(swap, (off_t) (save + 1L) * sectorsize, SEEK_SET);
-		if (!sw_write(swap, h + 1, sectorsize)) {
-		    fatal("cannot write swap file");
-		}
+		sw_clean(h, SWAPRUN);
+	    }
+	    sw_unlink(h);
+	    if (q == SQ_IN) {
+		sw_ghost(h->sec);
 	    }
-	    map[h->sec] = save;
+	    map[h->sec] = h->swap;
+	    evictions++;
 	}
 	h->sec = sec;
 	h->swap = load;
@@ -355,37 +609,153 @@ static header *sw_load(sector sec, bool restore, bool fill)
 	    /* zero-fill new sector */
 	    memset(h + 1, '\0', sectorsize);
 	}
-    } else {
+
 	/*
-	 * The sector already had a slot. Remove it from the first-last list.
+	 * a sector that was replaced from the first-in queue and is needed
+	 * again goes to the main queue
 	 */
-	if (h != first) {
-	    h->prev->next = h->next;
+	if (ghost[sec >> 5] & (1 << (sec & 31))) {
+	    sw_unghost(sec);
+	    q = SQ_MAIN;
 	} else {
-	    first = h->next;
+	    q = SQ_IN;
 	}
-	if (h != last) {
-	    h->next->prev = h->prev;
-	} else {
-	    last = h->prev;
-	    if (last != (header *) NULL) {
-		last->next = (header *) NULL;
+    } else {
+	hits++;
+	if (h->queue == SQ_IN) {
+	    /* the first-in queue is not reordered by later references */
+	    return h;
+	}
+	/*
+	 * The sector already had a slot. Remove it from the main queue.
+	 */
+	sw_unlink(h);
+	q = SQ_MAIN;
+    }
+    /*
+     * put the sector at the head of the queue
+     */
+    sw_push(h, q);
+
+    return h;
+}
+
+/*
+ * NAME:	swap->fetch()
+ * DESCRIPTION:	load those sectors in a vector which are not yet in memory,
+ *		with as few reads as possible
+ */
+static void sw_fetch(sector *vec, Uint n, bool restore)
+{
+    header *hv[SWAPRUN];
+    sector sec, load;
+    unsigned int count;
+
+    /* don't let the slots reserved here replace each other */
+    if (n > kin) {
+	n = kin;
+    }
+
+    do {
+	for (count = 0; n != 0 && count < SWAPRUN; --n) {
+	    sec = *vec++;
+	    load = map[sec];
+	    if (load != SW_UNUSED && (load >= cachesize ||
+			((header *) (mem + load * slotsize))->sec != sec)) {
+		/* reserve a slot, read it later */
+		hv[count++] = sw_load(sec, FALSE, FALSE);
+	    }
+	}
+
+	sw_sort(hv, count);
+	if (restore) {
+	    if (!sw_io(dump, hv, count, FALSE)) {
+		fatal("cannot read snapshot");
 	    }
+	} else if (!sw_io(swap, hv, count, FALSE)) {
+	    fatal("cannot read swap file");
 	}
+    } while (n != 0);
+}
+
+/*
+ * NAME:	swap->mapsec()
+ * DESCRIPTION:	return sector sec in the mapped swap file, for writing.  If
+ *		fill is TRUE, the existing contents must be preserved.
+ */
+static char *sw_mapsec(sector sec, bool fill)
+{
+    sector load, save;
+    char *p;
+
+    load = map[sec];
+    if (load != SW_UNUSED && load >= sbarrier) {
+	return smem + (load + 1L) * sectorsize;
     }
+
     /*
-     * put the sector at the head of the first-last list
+     * allocate new sector in swap file
      */
-    h->prev = (header *) NULL;
-    h->next = first;
-    if (first != (header *) NULL) {
-	first->prev = h;
-    } else {
-	last = h;	/* last was NULL too */
+    if (swap < 0) {
+	sw_create();
+    }
+    save = sw_alloc();
+    if ((off_t) (save + 2L) * sectorsize > sfilesize) {
+	sw_mapfile(save);
+    }
+    p = smem + (save + 1L) * sectorsize;
+    if (fill) {
+	if (load != SW_UNUSED) {
+	    memcpy(p, smem + (load + 1L) * sectorsize, sectorsize);
+	} else {
+	    memset(p, '\0', sectorsize);
+	}
     }
-    first = h;
+    map[sec] = save;
 
-    return h;
+    return p;
+}
+
+/*
+ * NAME:	swap->mreadv()
+ * DESCRIPTION:	read bytes from a vector of sectors in the mapped swap file
+ */
+static void sw_mreadv(char *m, sector *vec, Uint size, Uint idx)
+{
+    sector load;
+    unsigned int len;
+
+    vec += idx / sectorsize;
+    idx %= sectorsize;
+    do {
+	len = (size > sectorsize - idx) ? sectorsize - idx : size;
+	load = map[*vec++];
+	if (load != SW_UNUSED) {
+	    memcpy(m, smem + (load + 1L) * sectorsize + idx, len);
+	} else {
+	    memset(m, '\0', len);
+	}
+	idx = 0;
+	m += len;
+    } while ((size -= len) > 0);
+}
+
+/*
+ * NAME:	swap->mwritev()
+ * DESCRIPTION:	write bytes to a vector of sectors in the mapped swap file
+ */
+static void sw_mwritev(char *m, sector *vec, Uint size, Uint idx)
+{
+    unsigned int len;
+
+    vec += idx / sectorsize;
+    idx %= sectorsize;
+    do {
+	len = (size > sectorsize - idx) ? sectorsize - idx : size;
+	memcpy(sw_mapsec(*vec++, (len != sectorsize)) + idx, m, len);
+	idx = 0;
+	m += len;
+    } while ((size -= len) > 0);
 }
 
 /*
@@ -395,9 +765,20 @@ static header *sw_load(sector sec, bool restore, bool fill)
 void sw_readv(char *m, sector *vec, Uint size, Uint idx)
 {
     unsigned int len;
+    Uint n;
+
+    if (mapped) {
+	sw_mreadv(m, vec, size, idx);
+	return;
+    }
 
     vec += idx / sectorsize;
     idx %= sectorsize;
+    n = (idx + size + sectorsize - 1) / sectorsize;
+    if (m >= (char *) (vec + n) || m + size <= (char *) vec) {
+	/* prefetch, unless the vector itself is being read */
+	sw_fetch(vec, n, FALSE);
+    }
     do {
 	len = (size > sectorsize - idx) ? sectorsize - idx : size;
 	memcpy(m, (char *) (sw_load(*vec++, FALSE, TRUE) + 1) + idx, len);
@@ -415,6 +796,11 @@ void sw_writev(char *m, sector *vec, Uint size, Uint idx)
     header *h;
     unsigned int len;
 
+    if (mapped) {
+	sw_mwritev(m, vec, size, idx);
+	return;
+    }
+
     vec += idx / sectorsize;
     idx %= sectorsize;
     do {
@@ -435,9 +821,21 @@ void sw_dreadv(char *m, sector *vec, Uint size, Uint idx)
 {
     header *h;
     unsigned int len;
+    Uint n;
+
+    if (mapped) {
+	/* no swap slots: read the snapshot sector by sector */
+	sw_conv(m, vec, size, idx);
+	return;
+    }
 
     vec += idx / sectorsize;
     idx %= sectorsize;
+    n = (idx + size + sectorsize - 1) / sectorsize;
+    if (m >= (char *) (vec + n) || m + size <= (char *) vec) {
+	/* prefetch, unless the vector itself is being read */
+	sw_fetch(vec, n, TRUE);
+    }
     do {
 	len = (size > sectorsize - idx) ? sectorsize - idx : size;
 	h = sw_load(*vec++, TRUE, FALSE);
@@ -449,29 +847,61 @@ void sw_dreadv(char *m, sector *vec, Uint size, Uint idx)
 }
 
 /*
- * NAME:	swap->conv()
- * DESCRIPTION:	restore converted bytes from a vector of sectors in snapshot
+ * NAME:	swap->sconv()
+ * DESCRIPTION:	restore bytes from a vector of sectors in a snapshot, reading
+ *		whole sectors that are adjacent in the snapshot all at once
  */
-void sw_conv(char *m, sector *vec, Uint size, Uint idx)
+static bool sw_sconv(int fd, char *m, sector *vec, Uint size, Uint idx)
 {
-    unsigned int len;
+    sector load;
+    Uint len, n;
 
     vec += idx / restoresecsize;
     idx %= restoresecsize;
     do {
-	len = (size > restoresecsize - idx) ? restoresecsize - idx : size;
-	if (*vec != cached) {
-	    P_lseek(dump, (off_t) (map[*vec] + 1L) * restoresecsize, SEEK_SET);
-	    if (P_read(dump, cbuf, restoresecsize) <= 0) {
-		fatal("cannot read snapshot");
+	if (idx == 0 && size >= restoresecsize && *vec != cached) {
+	    load = map[*vec];
+	    for (n = 1;
+		 (n + 1) * restoresecsize <= size && vec[n] != cached &&
+		 map[vec[n]] == load + n;
+		 n++) ;
+	    len = n * restoresecsize;
+	    P_lseek(fd, (off_t) (load + 1L) * restoresecsize, SEEK_SET);
+	    if (P_read(fd, m, (int) len) != (int) len) {
+		return FALSE;
+	    }
+	    do {
+		map[*vec++] = SW_UNUSED;
+	    } while (--n != 0);
+	} else {
+	    len = (size > restoresecsize - idx) ? restoresecsize - idx : size;
+	    if (*vec != cached) {
+		P_lseek(fd, (off_t) (map[*vec] + 1L) * restoresecsize,
+			SEEK_SET);
+		if (P_read(fd, cbuf, restoresecsize) <= 0) {
+		    return FALSE;
+		}
+		map[cached = *vec] = SW_UNUSED;
 	    }
-	    map[cached = *vec] = SW_UNUSED;
+	    vec++;
+	    memcpy(m, cbuf + idx, len);
+	    idx = 0;
 	}
-	vec++;
-	memcpy(m, cbuf + idx, len);
-	idx = 0;
 	m += len;
     } while ((size -= len) > 0);
+
+    return TRUE;
+}
+
+/*
+ * NAME:	swap->conv()
+ * DESCRIPTION:	restore converted bytes from a vector of sectors in snapshot
+ */
+void sw_conv(char *m, sector *vec, Uint size, Uint idx)
+{
+    if (!sw_sconv(dump, m, vec, size, idx)) {
+	fatal("cannot read snapshot");
+    }
 }
 
 /*
@@ -480,25 +910,9 @@ void sw_conv(char *m, sector *vec, Uint size, Uint idx)
  */
 void sw_conv2(char *m, sector *vec, Uint size, Uint idx)
 {
-    unsigned int len;
-
-    vec += idx / restoresecsize;
-    idx %= restoresecsize;
-    do {
-	len = (size > restoresecsize - idx) ? restoresecsize - idx : size;
-	if (*vec != cached) {
-	    P_lseek(dump2, (off_t) (map[*vec] + 1L) * restoresecsize,
-		    SEEK_SET);
-	    if (P_read(dump2, cbuf, restoresecsize) <= 0) {
-		fatal("cannot read secondary snapshot");
-	    }
-	    map[cached = *vec] = SW_UNUSED;
-	}
-	vec++;
-	memcpy(m, cbuf + idx, len);
-	idx = 0;
-	m += len;
-    } while ((size -= len) > 0);
+    if (!sw_sconv(dump2, m, vec, size, idx)) {
+	fatal("cannot read secondary snapshot");
+    }
 }
 
 /*
@@ -529,6 +943,17 @@ sector sw_count()
     return nsectors - nfree;
 }
 
+/*
+ * NAME:	swap->stats()
+ * DESCRIPTION:	return swap cache hits, misses and evictions
+ */
+void sw_stats(Uuint *h, Uuint *m, Uuint *e)
+{
+    *h = hits;
+    *m = misses;
+    *e = evictions;
+}
+
 
 struct dump_header {
     Uint secsize;		/* size of swap sector */
@@ -547,7 +972,7 @@ static char dh_layout[] = "idddd";
 int sw_dump(char *snapshot, bool keep)
 {
     header *h;
-    sector sec;
+    int i;
     char buffer[STRINGSZ + 4], buf1[STRINGSZ], buf2[STRINGSZ], *p, *q;
     sector n;
 
@@ -556,34 +981,15 @@ int sw_dump(char *snapshot, bool keep)
     }
 
     /* flush the cache and adjust sector map */
-    for (h = last; h != (header *) NULL; h = h->prev) {
-	sec = h->swap;
-	if (h->dirty) {
-	    /*
-	     * Dump the sector to swap file
-	     */
-	    if (sec == SW_UNUSED || sec < sbarrier) {
-		/*
-		 * allocate new sector in swap file
-		 */
-		if (sfree == SW_UNUSED) {
-		    if (ssectors == SW_UNUSED) {
-			fatal("out of sectors");
-		    }
-		    sec = ssectors++;
-		} else {
-		    sec = sfree;
-		    sfree = smap[sec];
-		    sec += sbarrier;
-		}
-		h->swap = sec;
-	    }
-	    P_lseek(swap, (off_t) (sec + 1L) * sectorsize, SEEK_SET);
-	    if (!sw_write(swap, h + 1, sectorsize)) {
-		fatal("cannot write swap file");
-	    }
+    for (i = SQ_IN; i <= SQ_MAIN; i++) {
+	sw_clean(last[i], cachesize);
+	for (h = last[i]; h != (header *) NULL; h = h->prev) {
+	    map[h->sec] = h->swap;
 	}
-	map[h->sec] = sec;
+    }
+    if (mapped) {
+	/* start writing back the mapped swap file */
+	P_msync(smem, sfilesize);
     }
 
     if (dump >= 0 && !keep) {
@@ -598,6 +1004,7 @@ int sw_dump(char *snapshot, bool keep)
 	P_rename(p, q);
 
 	/* move to snapshot */
+	sw_unmap();
 	P_close(swap);
 	q = path_native(buf2, swapfile);
 	if (P_rename(q, p) < 0) {
@@ -641,6 +1048,14 @@ int sw_dump(char *snapshot, bool keep)
 	}
     }
 
+    if (mapped) {
+	/* cut off room to spare in the mapped swap file */
+	sfilesize = (off_t) (ssectors + 1L) * sectorsize;
+	if (P_ftruncate(swap, sfilesize) < 0) {
+	    fatal("cannot truncate swap file");
+	}
+    }
+
     /* write map */
     P_lseek(swap, (off_t) (ssectors + 1L) * sectorsize, SEEK_SET);
     if (!sw_write(swap, map, nsectors * sizeof(sector))) {
@@ -648,9 +1063,10 @@ int sw_dump(char *snapshot, bool keep)
     }
 
     /* fix the sector map */
-    for (h = last; h != (header *) NULL; h = h->prev) {
-	map[h->sec] = ((intptr_t) h - (intptr_t) mem) / slotsize;
-	h->dirty = FALSE;
+    for (i = SQ_IN; i <= SQ_MAIN; i++) {
+	for (h = last[i]; h != (header *) NULL; h = h->prev) {
+	    map[h->sec] = ((intptr_t) h - (intptr_t) mem) / slotsize;
+	}
     }
 
     return swap;
@@ -723,8 +1139,12 @@ void sw_dump2(char *header, int size, bool incr)
 	}
 	sbarrier = ssectors = sectors;
 	swapping = FALSE;
+	if (mapped) {
+	    sw_mapfile(ssectors);
+	}
     } else {
 	/* full snapshot */
+	sw_unmap();
 	dump = swap;
 	swap = -1;
 	sbarrier = ssectors = 0;
@@ -735,6 +1155,128 @@ void sw_dump2(char *header, int size, bool incr)
     cached = SW_UNUSED;
 }
 
+/*
+ * NAME:	swap->freeze()
+ * DESCRIPTION:	freeze the sectors in the swap file, so that a snapshot
+ *		process can copy them
+ */
+bool sw_freeze()
+{
+    if (!swapping || frozen) {
+	return FALSE;
+    }
+
+    /* only write beyond the current end of the swap file */
+    fbarrier = sbarrier;
+    ffree = sfree;
+    sbarrier = ssectors;
+    sfree = SW_UNUSED;
+    frozen = TRUE;
+    return TRUE;
+}
+
+/*
+ * NAME:	swap->thaw()
+ * DESCRIPTION:	unfreeze the swap file after the snapshot process is done,
+ *		and recover the sectors that were freed in the mean time
+ */
+void sw_thaw()
+{
+    char *del, *used;
+    header *h;
+    sector sec, i, n;
+
+    if (!frozen) {
+	return;
+    }
+    sbarrier = fbarrier;
+    frozen = FALSE;
+
+    n = ssectors - sbarrier;
+    del = ALLOC(char, nsectors + n);
+    memset(del, '\0', nsectors + n);
+    used = del + nsectors;
+
+    /* mark deleted sectors */
+    for (sec = mfree; sec != SW_UNUSED; sec = map[sec]) {
+	del[sec] = TRUE;
+    }
+
+    /* mark swap file sectors in use */
+    for (sec = 0; sec < nsectors; sec++) {
+	if (!del[sec]) {
+	    i = map[sec];
+	    if (i < cachesize &&
+		(h=(header *) (mem + i * slotsize))->sec == sec) {
+		i = h->swap;
+	    }
+	    if (i != SW_UNUSED && i >= sbarrier) {
+		used[i - sbarrier] = TRUE;
+	    }
+	}
+    }
+
+    /* rebuild the free swap file sector list */
+    sfree = SW_UNUSED;
+    for (i = (n < swapsize) ? n : swapsize; i > 0; ) {
+	if (!used[--i]) {
+	    smap[i] = sfree;
+	    sfree = i;
+	}
+    }
+
+    FREE(del);
+}
+
+/*
+ * NAME:	swap->child()
+ * DESCRIPTION:	prepare the swap file in a snapshot process: copy the frozen
+ *		sectors to a private swap file
+ */
+void sw_child()
+{
+    char *buffer;
+    int old;
+    off_t size;
+    unsigned int len;
+
+    sprintf(childfile, "%s.dump", swapfile);
+    if (swap >= 0) {
+	/* also used for the native file names */
+	buffer = ALLOC(char, sectorsize * 64);
+	old = P_open(path_native(buffer, swapfile), O_RDONLY | O_BINARY, 0);
+	sw_unmap();
+	P_close(swap);
+	swap = P_open(path_native(buffer, childfile),
+		      O_RDWR | O_CREAT | O_TRUNC | O_BINARY, 0600);
+	if (old < 0 || swap < 0) {
+	    fatal("cannot copy swap file");
+	}
+
+	/* copy initial sector and swap sectors */
+	for (size = (ssectors + 1L) * sectorsize; size > 0; size -= len) {
+	    len = (size > sectorsize * 64) ? sectorsize * 64 : size;
+	    if (P_read(old, buffer, len) != len) {
+		fatal("cannot read swap file");
+	    }
+	    if (!sw_write(swap, buffer, len)) {
+		fatal("cannot write swap file");
+	    }
+	}
+	FREE(buffer);
+	P_close(old);
+	if (mapped) {
+	    sw_mapfile(ssectors);
+	}
+    }
+    swapfile = childfile;
+
+    /* nothing else writes to this swap file */
+    sbarrier = fbarrier;
+    sfree = ffree;
+    frozen = FALSE;
+}
+
 /*
  * NAME:	swap->restore()
  * DESCRIPTION:	restore snapshot
@@ -777,3 +1319,15 @@ void sw_restore2(int fd)
 {
     dump2 = fd;
 }
+
+/*
+ * NAME:	swap->close2()
+ * DESCRIPTION:	close the secondary snapshot, once nothing is left in it
+ */
+void sw_close2()
+{
+    if (dump2 >= 0) {
+	P_close(dump2);
+	dump2 = -1;
+    }
+}
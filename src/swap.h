@@ -18,7 +18,7 @@
  */
 
 extern void	sw_init		(char*, unsigned int, unsigned int,
-				   unsigned int);
+				   unsigned int, bool);
 extern void	sw_finish	();
 extern bool	sw_write	(int, void*, size_t);
 extern void	sw_newv		(sector*, unsigned int);
@@ -31,8 +31,13 @@ extern void	sw_conv		(char*, sector*, Uint, Uint);
 extern void	sw_conv2	(char*, sector*, Uint, Uint);
 extern sector	sw_mapsize	(unsigned int);
 extern sector	sw_count	();
+extern void	sw_stats	(Uuint*, Uuint*, Uuint*);
 extern bool	sw_copy		(Uint);
 extern int	sw_dump		(char*, bool);
 extern void	sw_dump2	(char*, int, bool);
+extern bool	sw_freeze	();
+extern void	sw_thaw		();
+extern void	sw_child	();
 extern void	sw_restore	(int, unsigned int);
 extern void	sw_restore2	(int);
+extern void	sw_close2	();